@@ -23,6 +23,7 @@ imu_calibration_state = 0
 
 data = dlmread('sensor4_calibration_c.csv',',',1,0);
 
+% Deltas are differences of the board's sample times, a lost sample leaves a gap in time
 delta = data(:,1)/1000000;
 acc = data(:,2:4);          %acceleration data, [x y z]
 gyro = data(:,5:7);         %gyro [x y z]
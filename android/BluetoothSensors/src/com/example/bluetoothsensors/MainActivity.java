@@ -328,7 +328,13 @@ public class MainActivity extends Activity {
 	
 	// Sensor value class for easy access in data structures
 	static class SensorValues {
+		// Microseconds since the last sample, from the board clock so lost samples leave a gap
 		int delta;
+		// Sequence number and board time of the last sample, and samples found missing
+		int sequence;
+		int time;
+		boolean stamped;
+		long lost;
 		float[] acceleration = {0, 0, 0};
 		float[] rotational_rate = {0, 0, 0};
 		float altitude = 0;
@@ -409,11 +415,24 @@ public class MainActivity extends Activity {
 				}
 				break;
 			case STX:
-				state = processPacket(2,payload_buffer);
+				state = processPacket(6,payload_buffer);
 				if (state == DLE)
 					sensors.errors |= DELTA;
-				else
-					sensors.delta = (payload_buffer[0] << 8) | (payload_buffer[1] & 0xFF);
+				else {
+					int sequence = ((payload_buffer[0] & 0xFF) << 8) | (payload_buffer[1] & 0xFF);
+					int time = ((payload_buffer[2] & 0xFF) << 24) | ((payload_buffer[3] & 0xFF) << 16) |
+							((payload_buffer[4] & 0xFF) << 8) | (payload_buffer[5] & 0xFF);
+					if (sensors.stamped) {
+						// A step back in the sequence is the board starting over, not a loss
+						int gap = (sequence - sensors.sequence - 1) & 0xFFFF;
+						if (gap < 0x8000)
+							sensors.lost += gap;
+						sensors.delta = time - sensors.time;
+					}
+					sensors.sequence = sequence;
+					sensors.time = time;
+					sensors.stamped = true;
+				}
 				break;
 			case ACC:
 				state = processPacket(6,payload_buffer);
@@ -480,7 +499,8 @@ public class MainActivity extends Activity {
 					"W Angular Velocity:" + String.format("%6.1f ", sensors.rotational_rate[2]) + " deg/s\n" +
 					"Altitude:" + String.format(" %4.0f", sensors.altitude) + " m\n" +
 					"Temperature:" + String.format(" %4.1f", sensors.temperature) + " C\n" +
-					"Light:" + String.format(" %2.0f", sensors.light) + "%\n");
+					"Light:" + String.format(" %2.0f", sensors.light) + "%\n" +
+					"Lost samples: " + sensors.lost + "\n");
 		}
 	};
 	
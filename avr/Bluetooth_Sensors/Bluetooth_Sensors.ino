@@ -15,36 +15,155 @@
 
 #define DEBUG 0
 
+// Collect barometer samples in bulk from the sensor's FIFO instead of reading the output
+// registers, each drained sample is sent in its own frame. Can be set on the compiler command
+// line, as the host build does for tools/fifo_check.
+#ifndef BAROMETER_FIFO
+#define BAROMETER_FIFO 0
+#endif
+// Barometer FIFO sample period as a power of two seconds
+#define BAROMETER_TIME_STEP 0
+// Barometer oversampling ratio code, 2^code samples averaged into each conversion taking from
+// 6 ms (0) to 512 ms (7)
+#define BAROMETER_OVERSAMPLE 5
+// Start each barometer conversion on a barometer tick, so one is ready at the next and the
+// readings keep to the barometer's divisor while the conversion time fits between ticks. The
+// sensor otherwise converts once a second on its own. Not used with BAROMETER_FIFO.
+#define BAROMETER_ONE_SHOT 1
+// Send pressure instead of altitude in the barometer block, see Sensor_Protocol.h
+#define BAROMETER_PRESSURE 0
+
+// Let the gyroscope buffer its 800 Hz output in its FIFO and send every buffered sample. The
+// sample clock then ticks at the gyroscope's rate with one drained sample sent on each tick,
+// and samples carrying only the gyroscope are sent in between while the FIFO runs more than
+// GYRO_BACKLOG samples ahead. Can be set on the compiler command line, as the host build does
+// for tools/fifo_check.
+#ifndef GYRO_FIFO
+#define GYRO_FIFO 0
+#endif
+// Samples waiting in the gyroscope FIFO before it is drained
+#define GYRO_WATERMARK 4
+#define GYRO_BACKLOG (2 * GYRO_WATERMARK)
+
+// Accelerometer output data rate and oversampling mode, codes of the driver's data_rate and
+// oversampling enumerations. 800 Hz (0) in high resolution (2) has a fresh reading for every
+// tick of the sample clock with the least noise.
+#define ACCELEROMETER_RATE 0
+#define ACCELEROMETER_OVERSAMPLING 2
+
+// Source of the sample clock. Free running samples as fast as the serial link takes frames,
+// the timer ticks at SAMPLE_RATE, and the data ready modes tick on the gyroscope INT2/DRDY
+// output on D2 or the accelerometer INT1 output on D3 (these need the sensor interrupt pins
+// wired to the spare level shifter channels)
+#define SAMPLE_FREE_RUNNING 0
+#define SAMPLE_TIMER 1
+#define SAMPLE_GYRO_READY 2
+#define SAMPLE_ACCELEROMETER_READY 3
+#define SAMPLE_CLOCK SAMPLE_TIMER
+// Base sample rate in Hz for the timer clock, the gyroscope's output rate when it is read
+// through its FIFO
+#if GYRO_FIFO
+#define SAMPLE_RATE 800
+#else
+#define SAMPLE_RATE 400
+#endif
+// Ticks of the sample clock between reads of each sensor, 400 Hz for the accelerometer and
+// 4 Hz for the barometer and light sensor at either rate
+#define ACCELEROMETER_DIVISOR (SAMPLE_RATE / 400)
+#define GYRO_DIVISOR 1
+#define BAROMETER_DIVISOR (SAMPLE_RATE / 4)
+#define LIGHT_DIVISOR (SAMPLE_RATE / 4)
+// Milliseconds without a tick from a data ready sample clock before its sensor is set up again
+#define CLOCK_TIMEOUT 100
+
+// Ticks of the sample clock between samples while the board is still, 1 samples on every tick
+// always, and the motion threshold in steps of 0.063 g, both until changed with SET_MOTION.
+// Motion is the accelerometer's transient detection: an axis through its high pass filter
+// beyond the threshold for MOTION_COUNT samples at its data rate.
+#define MOTION_STRIDE 1
+#define MOTION_THRESHOLD 1
+#define MOTION_COUNT 8
+
+// Run the orientation filter on every gyroscope sample and send its quaternion with every
+// ORIENTATION_DIVISOR gyroscope samples. Can be set on the compiler command line, as the host
+// build does for tools/orientation_config_check.
+#ifndef ONBOARD_ORIENTATION
+#define ONBOARD_ORIENTATION 0
+#endif
+#define ORIENTATION_DIVISOR 4
+
+// Time each stage of the sampling loop with timer 1 and send the times for SEND_STATS, see
+// Stage_Profiler.h. Left out entirely when 0, it can also be set on the compiler command line.
+#ifndef STAGE_PROFILING
+#define STAGE_PROFILING 0
+#endif
+
+// Send frames from two buffers through the UART's interrupt instead of the core's Serial, so
+// the next sample is collected while the last frame goes out, see Frame_Port.h
+#define DOUBLE_BUFFERED_TX 1
+
+// Rate of the serial link at reset, the RN-42 Bluetooth module is set to it with SU,11
+#define BAUD_RATE 115200
+// Change the RN-42's UART to the same rate when a receiver asks for a new baud rate, through
+// its command mode. Turn this off when the board is wired straight to the receiver.
+#define BLUETOOTH_RATE_CHANGE 1
+// Largest difference in percent between a baud rate asked for and the rate the UART can run
+// at. Both ends of an 8N1 link together can be about 4.5 % apart.
+#define BAUD_RATE_TOLERANCE 4
+// Milliseconds of quiet on the link before the RN-42 command mode escape, and the time
+// allowed for the module to answer it
+#define MODULE_GUARD_TIME 20
+#define MODULE_TIMEOUT 500
+
 // Include sensor comunication and configuration libraries 
 #include "MMA8452Q_Accelerometer.h"
 #include "MPL3115A2_Barometer.h"
 #include "L3G4200D_Gyroscope.h"
 
-// Include I2C Library
-#include "Wire.h"
+// Include the interrupt driven I2C bus and the sample clock
+#include "TWI_Queue.h"
+#include "Sample_Scheduler.h"
 
 // Comunication codes
-enum network
-{
-    START_STREAM = 0xB0,
-    END_STREAM = 0xB1,
-    SEND_SINGLE = 0xB2,
-    DLE = 0x10,
-    STX = 0x20,
-    ETX = 0x30,
-    ACC = 0x01,
-    GYRO = 0x02,
-    BARO = 0x04,
-    PHT = 0x08
-};
-
-// Error handeling codes
-#define NO_ERROR 0
-#define BUFFER_SIZE_ERROR 1
-#define ADDRESS_NO_ACKNOWLEDGE 2
-#define DATA_NO_ACKNOWLEDGE 3
-#define TWI_ERROR 4
-#define IDENTIFICATION_FAILURE 5
+#include "Sensor_Protocol.h"
+#include "Frame_Codec.h"
+
+#include "Orientation_Filter.h"
+#include "Stage_Profiler.h"
+#include "Frame_Port.h"
+
+// Port the frames are sent through and the requests read from
+#if DOUBLE_BUFFERED_TX
+#if DEBUG
+#error "DEBUG prints through Serial, which needs the UART to itself, turn off DOUBLE_BUFFERED_TX"
+#endif
+#define SERIAL_LINK frame_port
+#else
+#define SERIAL_LINK Serial
+#endif
+
+// Rate the gyroscope samples arrive at, the FIFO and its data ready output run at the 800 Hz
+// output rate
+#if GYRO_FIFO || SAMPLE_CLOCK == SAMPLE_GYRO_READY
+#define GYRO_RATE 800
+#else
+#define GYRO_RATE (SAMPLE_RATE / GYRO_DIVISOR)
+#endif
+
+#if ONBOARD_ORIENTATION
+#if ORIENTATION_DIVISOR < QUAT_DIVISOR_MIN
+#error "ORIENTATION_DIVISOR is too small for the quaternions to fit in the batched frames"
+#endif
+#if GYRO_RATE < ORIENTATION_RATE_MIN
+#error "The gyroscope is sampled too slowly for the orientation filter"
+#endif
+#endif
+
+// The orientation filter is set up for the full gyroscope rate and the gyroscope FIFO has to be
+// drained at it
+#if (ONBOARD_ORIENTATION || GYRO_FIFO) && MOTION_STRIDE > 1
+#error "MOTION_STRIDE can not be used with ONBOARD_ORIENTATION or GYRO_FIFO"
+#endif
 
 // Initialize the sensor objects
 MMA8452Q_Accelerometer accelerometer;
@@ -52,22 +171,139 @@ L3G4200D_Gyroscope gyrometer;
 MPL3115A2_Barometer barometer;
 unsigned int ambient_light;
 #define PHOTO_SENSOR_PIN A3
+#if ONBOARD_ORIENTATION
+Orientation_Filter orientation;
+// Gyroscope samples the filter has taken since the last quaternion was sent
+byte orientation_count;
+#endif
+
+#if STAGE_PROFILING
+Stage_Profiler profiler;
+#define PROFILE_BEGIN() profiler.begin()
+#define PROFILE_MARK(stage) profiler.mark(stage)
+#else
+#define PROFILE_BEGIN()
+#define PROFILE_MARK(stage)
+#endif
 
 // Request code byte to be recieved by the 
 char request;
 // Error code resulting from I2C comunication
 byte error;
 
-// Timing variables
-unsigned int start,stop,diff;
-// Downsampling counter for the barometric sensor
-short int sample_count;
+// Time the reads for the sample being collected were started, and for the most recently
+// collected sample
+unsigned long sample_time, sampled_time;
+// Sequence number of the next sample sent, counting every sample sent since reset
+uint16_t sequence;
+// Samples written to the open batched frame
+byte batch_count;
+// Send accelerometer and gyroscope readings as differences in batched frames
+bool compressed;
+// Last accelerometer and gyroscope readings in the open compressed frame and the sensors that
+// have had their full keyframe reading sent in it
+int16_t last_acc[3], last_gyro[3];
+byte keyed;
+// Framing of the frames sent, DLE_FRAMING until the receiver asks for COBS_FRAMING
+byte framing = DLE_FRAMING;
+// COBS frame being built, frame[0] is kept for the code byte added when it is encoded
+#if DOUBLE_BUFFERED_TX
+Frame_Port frame_port;
+// Built in place in the port's transmit buffer
+byte * frame;
+#else
+byte frame[COBS_FRAME_MAX + 1];
+#endif
+byte frame_size;
+// Sample clock deciding which sensors are read on each tick
+Sample_Scheduler scheduler;
+// Sensors (ACC, GYRO, BARO and PHT bits) the receiver has asked to be read
+byte enabled_sensors = ACC | GYRO | BARO | PHT;
+// Rate the UART runs at
+uint32_t link_rate;
+// Sensors (ACC, GYRO, BARO and PHT bits) with reads started on the bus and not yet
+// collected, and sensors with fresh data in the most recently collected sample
+byte requested, sampled;
+#if BAROMETER_FIFO
+// Next drained barometer sample waiting to be sent
+byte barometer_next;
+#endif
+#if GYRO_FIFO
+// Next drained gyroscope sample waiting to be sent
+byte gyro_next;
+#endif
+// Failed reads of the accelerometer, gyroscope and barometer (indexed by their bits shifted
+// right once), the times each was set up again after one and the error code of its last
+// failure, for the health frame
+uint16_t read_failures[HEALTH_SENSORS], sensor_setups[HEALTH_SENSORS];
+byte last_errors[HEALTH_SENSORS];
+// Sensors (ACC, GYRO and BARO bits) with a failed read since they were last set up, and
+// sensors whose setup failed, which are left out of the samples until it passes
+byte failed, down;
+// Time a sensor last failed its setup
+unsigned long retry_time;
+// Range and high pass cutoff codes set by configuration requests for the accelerometer and
+// gyroscope, made again whenever either is set up again
+byte ranges[2], cutoffs[2] = { HIGH_PASS_OFF, HIGH_PASS_OFF };
+// Ticks of the sample clock between samples while the board is still and the motion threshold,
+// the ticks between samples now and the time the accelerometer last saw motion
+byte motion_stride = MOTION_STRIDE, motion_threshold = MOTION_THRESHOLD;
+byte stride = 1;
+unsigned long motion_time;
+
+// Prototypes the Arduino IDE generates for a sketch, written out so the sketch also compiles
+// as plain C++ for the host simulation
+byte initSensor(byte sensor);
+byte setupSensor(byte sensor);
+void restoreSensors();
+void setupSampleClock();
+void sampleTick();
+void startRate();
+void adaptRate();
+byte waitForSample();
+void checkError(const char * name, byte sensor, byte error);
+void requestData(byte due);
+void getData();
+void filterGyroSample();
+bool nextGyroSample();
+void catchUpGyro(bool batched);
+#if DEBUG
+void print_data();
+#endif
+void frameBegin(byte type);
+void frameByte(byte value);
+void frameBlock(const void * data, byte size);
+void frameWord(uint16_t value);
+void frameLong(uint32_t value);
+void frameTag(byte tag);
+void frameEnd();
+void frameDeltas(const int16_t * values, int16_t * last, byte sensor);
+void frameSensors(bool tagged);
+void bluetooth_send();
+void batch_send();
+void batchFlush();
+void send_sample();
+void sendStats();
+void sendHealth();
+void setReadModes(byte mode);
+void sendBenchmark();
+void drainLink();
+bool readArgument(byte & value);
+void sendAck(byte request, byte status, uint32_t value);
+byte setBaudRate(uint32_t baud, uint32_t & actual);
+bool setModuleRate(uint32_t baud);
+byte setSensorRange(byte sensor, byte code);
+byte setHighPass(byte sensor, byte code);
+byte enableMotion();
+byte setMotion(byte ticks, byte threshold);
+void configure(byte request);
 
 // Initialize the sensors and serial objects
 void setup()
 {
     // Setup a hardware serial connection
-    Serial.begin(115000);
+    SERIAL_LINK.begin(BAUD_RATE);
+    link_rate = F_CPU / 8 / ((F_CPU / 4 / BAUD_RATE - 1) / 2 + 1);
     // Serial.print("Started serial\n");
     // Wire.begin();
     // Serial.print("Started i2c\n");
@@ -78,102 +314,389 @@ void setup()
 #if DEBUG
     Serial.print("Starting setup\n");
 #endif
-    // Initialize the sensors on the I2C bus
-    error = accelerometer.setup();
-    if (error != NO_ERROR)
-    {
+    // Initialize the sensors on the I2C bus, one that fails is left out of the samples and
+    // tried again later rather than stopping the board
 #if DEBUG
-	Serial.print("Accelerometer setup error: ");
-	Serial.print(error);
-	Serial.println();
-#else
-    while(true) {}
+    static const char * const names[] = { "Accelerometer", "Gyrometer", "Barometer" };
 #endif
-    }
+    for (byte sensor = ACC; sensor <= BARO; sensor <<= 1) {
+	error = setupSensor(sensor);
 #if DEBUG
-    else
-	Serial.print("Setup Accelerometer\n");
+	if (error != NO_ERROR) {
+	    Serial.print(names[sensor >> 1]);
+	    Serial.print(" setup error: ");
+	    Serial.print(error);
+	    Serial.println();
+	}
+	else {
+	    Serial.print("Setup ");
+	    Serial.print(names[sensor >> 1]);
+	    Serial.print("\n");
+	}
+#endif
+    }
+
+#if ONBOARD_ORIENTATION
+    orientation.setup(GYRO_RATE);
 #endif
 
-    error = gyrometer.setup();
+    setupSampleClock();
+}
+
+// Set up one of the I2C sensors (ACC, GYRO or BARO) from reset as the sketch uses it, with the
+// settings configuration requests have made since
+byte initSensor(byte sensor)
+{
+    byte error;
+    if (sensor == BARO) {
+	error = barometer.setup();
+	if (error == NO_ERROR)
+	    error = barometer.setOversampling(
+		(MPL3115A2_Barometer::oversample)BAROMETER_OVERSAMPLE);
+#if BAROMETER_PRESSURE
+	if (error == NO_ERROR)
+	    error = barometer.setOutput(MPL3115A2_Barometer::BAROMETER_OUTPUT);
+#endif
+#if BAROMETER_FIFO
+	if (error == NO_ERROR)
+	    error = barometer.enableFIFO(BAROMETER_TIME_STEP);
+#elif BAROMETER_ONE_SHOT
+	if (error == NO_ERROR)
+	    error = barometer.enableOneShot();
+#endif
+	return error;
+    }
+
+    if (sensor == ACC) {
+	error = accelerometer.setup();
+	if (error == NO_ERROR)
+	    error = accelerometer.setDataRate(
+		(MMA8452Q_Accelerometer::data_rate)ACCELEROMETER_RATE);
+	if (error == NO_ERROR)
+	    error = accelerometer.setOversampling(
+		(MMA8452Q_Accelerometer::oversampling)ACCELEROMETER_OVERSAMPLING);
+#if SAMPLE_CLOCK == SAMPLE_ACCELEROMETER_READY
+	if (error == NO_ERROR)
+	    error = accelerometer.enableDataReadyInterrupt();
+#endif
+    }
+    else {
+	error = gyrometer.setup();
+#if GYRO_FIFO
+	if (error == NO_ERROR)
+	    error = gyrometer.enableFIFO(GYRO_WATERMARK);
+#endif
+#if SAMPLE_CLOCK == SAMPLE_GYRO_READY
+	if (error == NO_ERROR)
+	    error = gyrometer.enableDataReadyInterrupt();
+#endif
+    }
     if (error != NO_ERROR)
-    {
-#if DEBUG
-	Serial.print("Gyrometer setup error: ");
-	Serial.print(error);
-	Serial.println();
-#else
-	while(true) {}
+	return error;
+
+    byte status = ACK_OK;
+    if (ranges[sensor >> 1] != 0)
+	status = setSensorRange(sensor, ranges[sensor >> 1]);
+    if (status == ACK_OK && cutoffs[sensor >> 1] != HIGH_PASS_OFF)
+	status = setHighPass(sensor, cutoffs[sensor >> 1]);
+    if (status != ACK_OK)
+	return status & ~ACK_BUS_ERROR;
+    if (sensor == ACC && motion_stride > 1)
+	return enableMotion();
+    return NO_ERROR;
+}
+
+// Set up a sensor, marking it down when that fails so it is tried again SENSOR_RETRY
+// milliseconds later
+byte setupSensor(byte sensor)
+{
+    byte error = initSensor(sensor);
+    if (error == NO_ERROR)
+	down &= ~sensor;
+    else {
+	down |= sensor;
+	last_errors[sensor >> 1] = error;
+	retry_time = millis();
+    }
+    return error;
+}
+
+// Set up again the sensors with a failed read, and the sensors that are down once they are
+// due another try
+void restoreSensors()
+{
+    byte due = failed;
+    failed = 0;
+    if (down && millis() - retry_time >= SENSOR_RETRY)
+	due |= down;
+    for (byte sensor = ACC; sensor <= BARO; sensor <<= 1) {
+	if (due & sensor) {
+	    sensor_setups[sensor >> 1] += 1;
+	    setupSensor(sensor);
+	}
+    }
+}
+
+// Set each sensor's rate and start the interrupt that ticks the sample clock
+void setupSampleClock()
+{
+    scheduler.setDivisor(0, ACCELEROMETER_DIVISOR);
+    scheduler.setDivisor(1, GYRO_DIVISOR);
+    scheduler.setDivisor(2, BAROMETER_DIVISOR);
+    scheduler.setDivisor(3, LIGHT_DIVISOR);
+#if SAMPLE_CLOCK == SAMPLE_TIMER
+    // Timer 1 in clear timer on compare mode with a prescaler of 8
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS11);
+    OCR1A = F_CPU / 8 / SAMPLE_RATE - 1;
+    TIMSK1 = _BV(OCIE1A);
+#elif SAMPLE_CLOCK == SAMPLE_GYRO_READY
+    // The gyroscope's data ready output was turned on with the rest of its setup
+    attachInterrupt(0, sampleTick, RISING);
+#elif SAMPLE_CLOCK == SAMPLE_ACCELEROMETER_READY
+    // The accelerometer interrupt output is active low
+    attachInterrupt(1, sampleTick, FALLING);
 #endif
+#if STAGE_PROFILING
+    profiler.setup();
+#endif
+}
+
+// Advance the sample clock, called from the interrupt chosen by SAMPLE_CLOCK
+void sampleTick()
+{
+    scheduler.tick();
+}
+
+// Start a stream sampling on every tick, as if the board had just moved
+void startRate()
+{
+    stride = 1;
+    scheduler.setStride(stride);
+    motion_time = millis();
+}
+
+// Sample on every motion_stride ticks once the accelerometer has seen no motion for MOTION_HOLD
+// milliseconds and on every tick again from the first sample that sees some, called after each
+// sample is collected. An open batched frame is finished at the rate it was started at.
+void adaptRate()
+{
+    if (motion_stride <= 1 && stride == 1)
+	return;
+    // Without accelerometer readings there is no telling, the board is taken to be moving
+    if (motion_stride <= 1 || !(enabled_sensors & ACC) || (down & ACC) ||
+	((sampled & ACC) && accelerometer.moving()))
+	motion_time = millis();
+    byte next = millis() - motion_time < MOTION_HOLD ? 1 : motion_stride;
+    if (next != stride && batch_count == 0) {
+	stride = next;
+	scheduler.setStride(stride);
     }
-#if DEBUG
-    else
-	Serial.print("Setup Gyrometer\n");
+}
+
+#if SAMPLE_CLOCK == SAMPLE_TIMER
+ISR(TIMER1_COMPA_vect)
+{
+    sampleTick();
+}
 #endif
 
-    error = barometer.setup();
-    if (error != NO_ERROR)
-    {
-#if DEBUG
-	Serial.print("Barometer setup error: ");
-	Serial.print(error);
-	Serial.println();
-#else
-	while(true) {}
+#if DOUBLE_BUFFERED_TX
+ISR(USART_UDRE_vect)
+{
+    frame_port.dataEmpty();
+}
+
+ISR(USART_RX_vect)
+{
+    frame_port.receiveComplete();
+}
+#endif
+
+// Wait for the next tick of the sample clock and return the sensors due on it
+byte waitForSample()
+{
+    byte due;
+#if SAMPLE_CLOCK == SAMPLE_FREE_RUNNING
+    // Every pass through the loop is a tick
+    sampleTick();
 #endif
+#if SAMPLE_CLOCK == SAMPLE_GYRO_READY || SAMPLE_CLOCK == SAMPLE_ACCELEROMETER_READY
+    // A sensor that stops ticking has lost its setup (or is down), give up on the tick so it
+    // is set up again once the empty sample is collected
+    unsigned long begun = millis();
+    while (!scheduler.poll(due)) {
+	if (millis() - begun > CLOCK_TIMEOUT) {
+	    failed |= SAMPLE_CLOCK == SAMPLE_GYRO_READY ? GYRO : ACC;
+	    return 0;
+	}
     }
+#else
+    while (!scheduler.poll(due));
+#endif
+    return due;
+}
+
+// Count a failed read of 'sensor' and leave its block out of the sample, the sensor is set up
+// again once the sample is collected. Reported over the serial link when debugging.
+void checkError(const char * name, byte sensor, byte error)
+{
+    if (error == NO_ERROR)
+	return;
+    read_failures[sensor >> 1] += 1;
+    last_errors[sensor >> 1] = error;
+    failed |= sensor;
+    sampled &= ~sensor;
 #if DEBUG
-    else
-	Serial.print("Setup Barometer\n");
+    Serial.print(name);
+    Serial.print(" communication error: ");
+    Serial.print(error);
+    Serial.println();
+#else
+    // The name is only printed when debugging
+    (void)name;
 #endif
-    start = millis();
 }
 
+// Start the I2C reads for the sensors in 'due', the bus works through them in the background
+void requestData(byte due)
+{
+    sample_time = micros();
+    due &= enabled_sensors & ~down;
+    requested = due;
+    if (due & ACC)
+	accelerometer.requestData();
+#if GYRO_FIFO
+    // Drain the gyroscope FIFO once every sample it held has been sent
+    if (gyro_next < gyrometer.fifo_count)
+	requested &= ~GYRO;
+    else if (due & GYRO)
+	gyrometer.requestFIFO();
+#else
+    if (due & GYRO)
+	gyrometer.requestData();
+#endif
+#if BAROMETER_FIFO
+    // Drain the barometer FIFO once every sample it held has been sent
+    if (barometer_next < barometer.fifo_count)
+	requested &= ~BARO;
+    else if (due & BARO)
+	barometer.requestFIFO();
+#else
+    if (due & BARO)
+	barometer.requestData();
+#endif
+}
+
+// Wait for the reads started by requestData() and note which sensors have fresh data, then set
+// up again any sensor whose read failed
 void getData()
 {
-#if DEBUG
-    error = accelerometer.readData();
-    if (error != NO_ERROR)
-    {
-	Serial.print("Accelerometer communication error: ");
-	Serial.print(error);
-	Serial.println();
+    sampled_time = sample_time;
+    sampled = requested;
+    requested = 0;
+    if (sampled & ACC) {
+	checkError("Accelerometer", ACC, accelerometer.collectData());
+	PROFILE_MARK(STAGE_ACC);
     }
-    error = gyrometer.readData();
-    if (error != NO_ERROR)
-    {
-	Serial.print("Gyro communication error: ");
-	Serial.print(error);
-	Serial.println();
-    }
-    if (sample_count == 0) {
-	error = barometer.readData();
-	if (error != NO_ERROR)
-	{
-	    Serial.print("Altimeter communication error: ");
-	    Serial.print(error);
-	    Serial.println();
-	}
-	ambient_light = analogRead(PHOTO_SENSOR_PIN);
+#if GYRO_FIFO
+    // Hand out the drained samples one per tick until the next drain
+    if (sampled & GYRO) {
+	checkError("Gyro", GYRO, gyrometer.collectFIFO());
+	gyro_next = 0;
+	PROFILE_MARK(STAGE_GYRO);
     }
+    sampled &= ~GYRO;
+    nextGyroSample();
 #else
-    accelerometer.readData();
-    gyrometer.readData();
-    if (sample_count == 0) {
-	barometer.readData();
+    if (sampled & GYRO) {
+	checkError("Gyro", GYRO, gyrometer.collectData());
+	PROFILE_MARK(STAGE_GYRO);
+    }
+#endif
+#if BAROMETER_FIFO
+    // Hand out the drained samples one per frame until the next drain
+    if (sampled & BARO) {
+	checkError("Altimeter FIFO", BARO, barometer.collectFIFO());
+	barometer_next = 0;
+	PROFILE_MARK(STAGE_BARO);
+    }
+    sampled &= ~BARO;
+    if (barometer_next < barometer.fifo_count) {
+	barometer.loadFIFOSample(barometer_next++);
+	sampled |= BARO;
+    }
+#else
+    if (sampled & BARO) {
+	checkError("Altimeter", BARO, barometer.collectData());
+	// A conversion still under way is not waited for, the barometer is left out until the
+	// read that finds it finished
+	if (!barometer.newData())
+	    sampled &= ~BARO;
+	PROFILE_MARK(STAGE_BARO);
+    }
+#endif
+    if (sampled & PHT) {
 	ambient_light = analogRead(PHOTO_SENSOR_PIN);
+	PROFILE_MARK(STAGE_LIGHT);
     }
+#if ONBOARD_ORIENTATION
+    if (sampled & GYRO)
+	filterGyroSample();
 #endif
+    if (failed || down)
+	restoreSensors();
+}
+
+#if ONBOARD_ORIENTATION
+// Run the filter on the gyroscope sample with the latest accelerometer reading, adding the
+// quaternion to the sample every ORIENTATION_DIVISOR gyroscope samples
+void filterGyroSample()
+{
+    orientation.update(accelerometer.acc, gyrometer.gyro);
+    orientation_count += 1;
+    if (orientation_count == ORIENTATION_DIVISOR) {
+	orientation_count = 0;
+	sampled |= QUAT;
+    }
+    PROFILE_MARK(STAGE_FILTER);
 }
+#endif
 
+#if GYRO_FIFO
+// Add the next drained gyroscope sample to the collected sample, false if all were handed out
+bool nextGyroSample()
+{
+    if (gyro_next == gyrometer.fifo_count)
+	return false;
+    gyrometer.loadFIFOSample(gyro_next++);
+    sampled |= GYRO;
+    return true;
+}
 
+// Send samples of the gyroscope alone, with the sampled time of the last, while the FIFO is
+// more than GYRO_BACKLOG samples ahead of the stream, as it gets after missed ticks
+void catchUpGyro(bool batched)
+{
+    while (gyrometer.fifo_count - gyro_next + gyrometer.fifoWaiting() > GYRO_BACKLOG) {
+	sampled = 0;
+	if (!nextGyroSample())
+	    break;
+#if ONBOARD_ORIENTATION
+	filterGyroSample();
+#endif
+	if (batched)
+	    batch_send();
+	else
+	    send_sample();
+    }
+}
+#endif
 
+#if DEBUG
+// Print the collected sample as a line of comma separated values, for debugging over the
+// serial monitor
 void print_data() {
-    getData();
-    ambient_light = analogRead(PHOTO_SENSOR_PIN);
-    stop = micros();
-    diff = stop-start;
-    start = stop;
     Serial.print(accelerometer.acc[0]);
     Serial.print(',');
     Serial.print(accelerometer.acc[1]);
@@ -185,86 +708,629 @@ void print_data() {
     Serial.print(gyrometer.gyro[1]);
     Serial.print(',');
     Serial.print(gyrometer.gyro[2]);
-    if (sample_count == 0) {
+    if (sampled & BARO) {
 	Serial.print(',');
 	Serial.print((float)barometer.pressure+(float)barometer.pressure_frac/16);
 	Serial.print(',');
 	Serial.print((float)barometer.temperature+(float)barometer.temperature_frac/16);
+    }
+    if (sampled & PHT) {
 	Serial.print(',');
 	Serial.print(ambient_light);
     }
     Serial.print(',');
-    Serial.print(diff);
+    Serial.print(sampled_time);
     Serial.print('\n');
 }
+#endif
+
+// Start a frame of the given type (STX or BTX) in the framing chosen by the receiver
+void frameBegin(byte type) {
+    if (framing == COBS_FRAMING) {
+#if DOUBLE_BUFFERED_TX
+	// Build straight into the buffer the frame is sent from
+	frame = frame_port.buffer();
+#endif
+	frame_size = 0;
+	frameByte(type);
+    }
+    else {
+	SERIAL_LINK.write(DLE);
+	SERIAL_LINK.write(type);
+    }
+}
+
+// Add a byte to the open frame. DLE framing writes it straight out, doubling it if it could
+// be mistaken for a control code. COBS framing holds the frame until it is complete, the first
+// byte of the buffer is left for the COBS code byte.
+void frameByte(byte value) {
+    if (framing == COBS_FRAMING) {
+	frame_size += 1;
+	frame[frame_size] = value;
+    }
+    else {
+	if (value == DLE)
+	    SERIAL_LINK.write(DLE);
+	SERIAL_LINK.write(value);
+    }
+}
+
+void frameBlock(const void * data, byte size) {
+    const byte * bytes = (const byte *)data;
+    for (byte i = 0; i < size; ++i)
+	frameByte(bytes[i]);
+}
+
+// Add a 16 bit value to the open frame, high byte first
+void frameWord(uint16_t value) {
+    frameByte(highByte(value));
+    frameByte(lowByte(value));
+}
+
+// Add a 32 bit value to the open frame, high byte first
+void frameLong(uint32_t value) {
+    frameWord(value >> 16);
+    frameWord(value);
+}
+
+// Mark the start of a sensor block in a single sample frame
+void frameTag(byte tag) {
+    if (framing == COBS_FRAMING)
+	frameByte(tag);
+    else {
+	SERIAL_LINK.write(DLE);
+	SERIAL_LINK.write(tag);
+    }
+}
+
+// Close the open frame, COBS frames get their CRC and are encoded and sent here
+void frameEnd() {
+    if (framing == COBS_FRAMING) {
+	uint16_t crc = crc16(frame + 1, frame_size);
+	frameByte(lowByte(crc));
+	frameByte(highByte(crc));
+	cobsEncodeInPlace(frame, frame_size);
+#if DOUBLE_BUFFERED_TX
+	frame[frame_size + 1] = 0;
+	frame_port.commit(frame_size + 2);
+#else
+	Serial.write(frame, frame_size + 1);
+	Serial.write((byte)0);
+#endif
+    }
+    else {
+	SERIAL_LINK.write(DLE);
+	SERIAL_LINK.write(ETX);
+#if DOUBLE_BUFFERED_TX
+	// Start sending the frame, DLE frames are written into the port as they are built
+	frame_port.flush();
+#endif
+    }
+}
+
+// Write three axes as zig-zag varint differences from the last reading in the frame, or in
+// full if this is the first reading of the sensor in the frame
+void frameDeltas(const int16_t * values, int16_t * last, byte sensor) {
+    if (keyed & sensor) {
+	for (byte i = 0; i < 3; ++i) {
+	    byte varint[VARINT16_MAX];
+	    frameBlock(varint, varintEncode(zigZag16(values[i] - last[i]), varint));
+	}
+    }
+    else {
+	frameBlock(values, 3 * sizeof(int16_t));
+	keyed |= sensor;
+    }
+    for (byte i = 0; i < 3; ++i)
+	last[i] = values[i];
+}
+
+// Write the payloads of the sensors in the collected sample
+void frameSensors(bool tagged) {
+    if (sampled & ACC) {
+	if (tagged)
+	    frameTag(ACC);
+	if (compressed && !tagged)
+	    frameDeltas(accelerometer.acc, last_acc, ACC);
+	else
+	    frameBlock(accelerometer.data, ACC_PAYLOAD);
+    }
+    if (sampled & GYRO) {
+	if (tagged)
+	    frameTag(GYRO);
+	if (compressed && !tagged)
+	    frameDeltas(gyrometer.gyro, last_gyro, GYRO);
+	else
+	    frameBlock(gyrometer.data, GYRO_PAYLOAD);
+    }
+    if (sampled & BARO) {
+	if (tagged)
+	    frameTag(BARO);
+	frameBlock(barometer.data, BARO_PAYLOAD);
+    }
+    if (sampled & PHT) {
+	if (tagged)
+	    frameTag(PHT);
+	frameByte(lowByte(ambient_light));
+	frameByte(highByte(ambient_light));
+    }
+#if ONBOARD_ORIENTATION
+    if (sampled & QUAT) {
+	byte quaternion[QUAT_PAYLOAD];
+	if (tagged)
+	    frameTag(QUAT);
+	orientation.compact(quaternion);
+	frameBlock(quaternion, QUAT_PAYLOAD);
+    }
+#endif
+}
 
 // Send sensor packets via bluetooth
 void bluetooth_send() {
-    getData();
-    stop = micros();
-    diff = stop-start;
-    start = stop;
-    Serial.write(DLE);
-    Serial.write(STX);
-    if (highByte(diff) == DLE)
-	Serial.write(DLE);
-    Serial.write(highByte(diff));
-    if (lowByte(diff) == DLE)
-	Serial.write(DLE);
-    Serial.write(lowByte(diff));
-
-    Serial.write(DLE);
-    Serial.write(ACC);
-    accelerometer.sendData(Serial,DLE);
-
-    Serial.write(DLE);
-    Serial.write(GYRO);
-    gyrometer.sendData(Serial,DLE);
-
-    if (sample_count == 0) {
-	Serial.write(DLE);
-	Serial.write(BARO);
-	barometer.sendData(Serial,DLE);
-
-	Serial.write(DLE);
-	Serial.write(PHT);
-	if (lowByte(ambient_light) == DLE)
-	    Serial.write(DLE);
-	Serial.write(lowByte(ambient_light));
-	if (highByte(ambient_light) == DLE)
-	    Serial.write(DLE);
-	Serial.write(highByte(ambient_light));
-    }
-    Serial.write(DLE);
-    Serial.write(ETX);
+    frameBegin(STX);
+    frameWord(sequence++);
+    frameLong(sampled_time);
+    frameSensors(true);
+    frameEnd();
+}
+
+// Add the collected sample to the open batched frame, starting a new frame with its header
+// when none is open and closing it once it holds BATCH_SIZE samples
+void batch_send() {
+    if (batch_count == 0) {
+	frameBegin(compressed ? CTX : BTX);
+	keyed = 0;
+	frameByte(BATCH_SIZE);
+	frameWord(sequence);
+	frameLong(sampled_time);
+#if SAMPLE_CLOCK == SAMPLE_TIMER
+	// The ticks between the samples the sensors read come out on, 0 when uneven or too long
+	// for the header
+	uint32_t period = 1000000L / SAMPLE_RATE *
+	    scheduler.samplePeriod(enabled_sensors & ~down);
+	frameWord(period <= 0xFFFF ? period : 0);
+#else
+	// Data ready and free running clocks have no fixed period to report
+	frameWord(0);
+#endif
+    }
+
+    frameByte(sampled);
+    frameSensors(false);
+    sequence += 1;
+
+    batch_count += 1;
+    if (batch_count == BATCH_SIZE) {
+	frameEnd();
+	batch_count = 0;
+    }
+}
+
+// Close the open batched frame with empty samples, so the stream ends at once instead of
+// waiting on sensors that may not be due again. They are padding rather than samples, so the
+// next stream numbers on from the last sample read.
+void batchFlush() {
+    uint16_t next = sequence;
+    sampled = 0;
+    while (batch_count != 0)
+	batch_send();
+    sequence = next;
+}
+
+// Send the time taken by each stage of the sampling loop and start timing afresh, a board
+// built without STAGE_PROFILING sends a frame with no stages
+void sendStats() {
+    frameBegin(PTX);
+#if STAGE_PROFILING
+    frameByte(STAGE_COUNT);
+    frameWord(PROFILE_TICK_NS);
+    for (byte i = 0; i < STAGE_COUNT; ++i) {
+	const Stage_Stats & stats = profiler.stages[i];
+	frameWord(stats.count);
+	frameWord(stats.shortest);
+	frameWord(stats.longest);
+	frameLong(stats.total);
+	for (byte j = 0; j < PROFILE_BINS; ++j)
+	    frameWord(stats.bins[j]);
+    }
+    profiler.reset();
+#else
+    frameByte(0);
+    frameWord(0);
+#endif
+    frameEnd();
+}
+
+// Send the bus recoveries and each sensor's failures since reset
+void sendHealth() {
+    frameBegin(HTX);
+    frameWord(twi_queue.recoveries);
+    for (byte i = 0; i < HEALTH_SENSORS; ++i) {
+	frameWord(read_failures[i]);
+	frameWord(sensor_setups[i]);
+	frameByte(last_errors[i]);
+    }
+    frameByte(down);
+    frameEnd();
+}
+
+// Read the sensors' output registers with one burst each or one transaction per register
+void setReadModes(byte mode) {
+    accelerometer.setReadMode((MMA8452Q_Accelerometer::mode)mode);
+    gyrometer.setReadMode((L3G4200D_Gyroscope::mode)mode);
+    barometer.setReadMode((MPL3115A2_Barometer::mode)mode);
+}
+
+// Time full samples at each bus frequency and read mode and send the results, see
+// Sensor_Protocol.h
+void sendBenchmark() {
+    static const unsigned long frequencies[] = { TWI_STANDARD_MODE, TWI_FAST_MODE };
+    uint32_t totals[BENCHMARK_RECORDS];
+    uint16_t longest[BENCHMARK_RECORDS];
+    byte failures[BENCHMARK_RECORDS];
+
+    // Every run is timed before the frame is started so sending it takes no bus time
+    for (byte run = 0; run < BENCHMARK_RECORDS; ++run) {
+	twi_queue.setFrequency(frequencies[run >> 1]);
+	setReadModes(run & 1);
+	totals[run] = 0;
+	longest[run] = 0;
+	failures[run] = 0;
+	for (byte i = 0; i < BENCHMARK_READS; ++i) {
+	    unsigned long begun = micros();
+	    // Queue all three reads at once as the sampling loop does
+	    accelerometer.requestData();
+	    gyrometer.requestData();
+	    barometer.requestData();
+	    failures[run] += accelerometer.collectData() != NO_ERROR;
+	    failures[run] += gyrometer.collectData() != NO_ERROR;
+	    failures[run] += barometer.collectData() != NO_ERROR;
+	    unsigned long taken = micros() - begun;
+	    totals[run] += taken;
+	    if (taken > longest[run])
+		longest[run] = taken > 0xFFFF ? 0xFFFF : taken;
+	}
+    }
+    twi_queue.setFrequency(TWI_FREQUENCY);
+    setReadModes(BENCHMARK_BURST);
+
+    frameBegin(RTX);
+    frameByte(BENCHMARK_RECORDS);
+    for (byte run = 0; run < BENCHMARK_RECORDS; ++run) {
+	frameWord(frequencies[run >> 1] / 1000);
+	frameByte(run & 1);
+	frameByte(failures[run]);
+	frameWord(totals[run] / BENCHMARK_READS);
+	frameWord(longest[run]);
+    }
+    frameEnd();
+}
+
+// Wait until everything written to the serial link has been sent
+void drainLink() {
+#if DOUBLE_BUFFERED_TX
+    frame_port.drain();
+#else
+    Serial.flush();
+#endif
+}
+
+// Wait for the next argument byte of a configuration request, false if it does not come in
+// time
+bool readArgument(byte & value) {
+    unsigned long begun = millis();
+    int data;
+    while ((data = SERIAL_LINK.read()) < 0)
+	if (millis() - begun > CONFIG_TIMEOUT)
+	    return false;
+    value = data;
+    return true;
+}
+
+// Answer a configuration request with its status and the setting now in effect
+void sendAck(byte request, byte status, uint32_t value) {
+    frameBegin(ATX);
+    frameByte(request);
+    frameByte(status);
+    frameLong(value);
+    frameEnd();
+}
+
+// Move the serial link to 'baud', the Bluetooth module first. 'actual' is set to the rate the
+// UART then runs at.
+byte setBaudRate(uint32_t baud, uint32_t & actual) {
+    actual = link_rate;
+    if (baud < 1200 || baud > F_CPU / 8)
+	return ACK_INVALID;
+    // The double speed divisor the core would pick
+    uint32_t divisor = (F_CPU / 4 / baud - 1) / 2;
+    uint32_t rate = F_CPU / 8 / (divisor + 1);
+    uint32_t difference = rate > baud ? rate - baud : baud - rate;
+    if (difference * 100 > baud * BAUD_RATE_TOLERANCE)
+	return ACK_INVALID;
+#if BLUETOOTH_RATE_CHANGE
+    if (!setModuleRate(baud))
+	return ACK_MODULE_ERROR;
+#else
+    drainLink();
+#endif
+    SERIAL_LINK.begin(baud);
+    link_rate = rate;
+    actual = rate;
+    // Let a receiver wired to the board change its own rate before the acknowledgement
+    delay(CONFIG_BAUD_SETTLE);
+    return ACK_OK;
+}
+
+// Change the RN-42's UART rate until it is next powered up. In command mode, entered with
+// $$$ and a quiet link on either side, U,<rate>,N changes the rate and leaves command mode.
+// Returns false if the module does not answer or does not have the rate, leaving it in data
+// mode at the old rate.
+bool setModuleRate(uint32_t baud) {
+    static const uint32_t rates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800 };
+    static const char * const codes[] = { "9600", "19.2", "38.4", "57.6", "115K", "230K", "460K" };
+    byte index = 0;
+    while (index < sizeof(rates) / sizeof(rates[0]) && rates[index] != baud)
+	index += 1;
+    if (index == sizeof(rates) / sizeof(rates[0]))
+	return false;
+
+    drainLink();
+    delay(MODULE_GUARD_TIME);
+    SERIAL_LINK.write((const uint8_t *)"$$$", 3);
+    drainLink();
+
+    // Wait for the CMD reply, skipping anything else
+    static const char reply[] = "CMD\r\n";
+    byte matched = 0;
+    unsigned long begun = millis();
+    while (reply[matched]) {
+	if (millis() - begun > MODULE_TIMEOUT)
+	    return false;
+	int data = SERIAL_LINK.read();
+	if (data < 0)
+	    continue;
+	if (data == reply[matched])
+	    matched += 1;
+	else
+	    matched = data == reply[0] ? 1 : 0;
+    }
+
+    SERIAL_LINK.write((const uint8_t *)"U,", 2);
+    SERIAL_LINK.write((const uint8_t *)codes[index], strlen(codes[index]));
+    SERIAL_LINK.write((const uint8_t *)",N\r", 3);
+    drainLink();
+    return true;
+}
+
+// Set the range of the accelerometer or gyroscope from the driver's range code
+byte setSensorRange(byte sensor, byte code) {
+    byte error;
+    if (sensor == ACC && code <= MMA8452Q_Accelerometer::MAX_8G) {
+#if ONBOARD_ORIENTATION
+	// The filter takes the accelerometer counts to be in the 2 g range
+	if (code != MMA8452Q_Accelerometer::MAX_2G)
+	    return ACK_INVALID;
+#endif
+	error = accelerometer.setRange((MMA8452Q_Accelerometer::range)code);
+    }
+    else if (sensor == GYRO && code <= L3G4200D_Gyroscope::MAX_2000_DPS) {
+	error = gyrometer.setRange((L3G4200D_Gyroscope::range)code);
+#if ONBOARD_ORIENTATION
+	// A full scale the filter can not follow at the gyroscope rate is refused, with the
+	// gyroscope put back to the range the filter is set up for
+	static const uint16_t full_scales[] = { 250, 500, 2000 };
+	if (error == NO_ERROR && !orientation.setup(GYRO_RATE, full_scales[code])) {
+	    gyrometer.setRange((L3G4200D_Gyroscope::range)ranges[GYRO >> 1]);
+	    return ACK_INVALID;
+	}
+#endif
+    }
+    else
+	return ACK_INVALID;
+    if (error != NO_ERROR)
+	return ACK_BUS_ERROR | error;
+    // Kept to be made again if the sensor is set up again
+    ranges[sensor >> 1] = code;
+    return ACK_OK;
+}
+
+// Set the high pass filter cutoff of the accelerometer or gyroscope from the driver's filter
+// code, or turn the filter off
+byte setHighPass(byte sensor, byte code) {
+    byte error;
+    if (sensor == ACC && code == HIGH_PASS_OFF)
+	error = accelerometer.disableHighPassFilter();
+    else if (sensor == ACC && code <= MMA8452Q_Accelerometer::CUTOFF_2_HZ) {
+	error = accelerometer.setHighPassCutoff((MMA8452Q_Accelerometer::filter)code);
+	if (error == NO_ERROR)
+	    error = accelerometer.enableHighPassFilter();
+    }
+    else if (sensor == GYRO && code == HIGH_PASS_OFF)
+	error = gyrometer.disableHighPassFilter();
+    else if (sensor == GYRO && code <= L3G4200D_Gyroscope::CUTOFF_TENTH_HZ) {
+	error = gyrometer.setHighPassCutoff((L3G4200D_Gyroscope::filter)code);
+	if (error == NO_ERROR)
+	    error = gyrometer.enableHighPassFilter();
+    }
+    else
+	return ACK_INVALID;
+    if (error != NO_ERROR)
+	return ACK_BUS_ERROR | error;
+    cutoffs[sensor >> 1] = code;
+    return ACK_OK;
+}
+
+// Turn on the accelerometer's motion detection with the threshold set
+byte enableMotion() {
+    byte error = NO_ERROR;
+    // The detection goes through the output's high pass filter, which is left at its lowest
+    // cutoff to catch slow movements unless a configuration request chose one
+    if (cutoffs[0] == HIGH_PASS_OFF)
+	error = accelerometer.setHighPassCutoff(MMA8452Q_Accelerometer::CUTOFF_2_HZ);
+    if (error == NO_ERROR)
+	error = accelerometer.enableMotionDetection(motion_threshold, MOTION_COUNT);
+    return error;
+}
+
+// Sample on every 'ticks' ticks of the sample clock while the board is still, watching for
+// motion beyond 'threshold' steps of 0.063 g, or on every tick always for 0 or 1
+byte setMotion(byte ticks, byte threshold) {
+    byte error;
+    if (ticks <= 1)
+	error = accelerometer.disableMotionDetection();
+    else {
+#if ONBOARD_ORIENTATION || GYRO_FIFO
+	// The filter needs the full gyroscope rate and the FIFO has to be drained at it
+	return ACK_INVALID;
+#endif
+	if (threshold == 0 || threshold > MOTION_THRESHOLD_MAX)
+	    return ACK_INVALID;
+	motion_threshold = threshold;
+	error = enableMotion();
+    }
+    if (error != NO_ERROR)
+	return ACK_BUS_ERROR | error;
+    // Kept to be made again if the accelerometer is set up again
+    motion_stride = ticks;
+    return ACK_OK;
+}
+
+// Read the arguments of a configuration request, apply it and acknowledge it
+void configure(byte request) {
+    byte arguments[4] = { 0, 0, 0, 0 };
+    byte count = request == SET_BAUD_RATE ? 4 : request == SET_SENSORS ? 1 :
+	request == SET_DIVISOR ? 3 : 2;
+    for (byte i = 0; i < count; ++i) {
+	if (!readArgument(arguments[i])) {
+	    sendAck(request, ACK_TIMEOUT, 0);
+	    return;
+	}
+    }
+
+    byte status = ACK_OK;
+    uint32_t value = 0;
+    if (request == SET_BAUD_RATE) {
+	uint32_t baud = ((uint32_t)arguments[0] << 24) | ((uint32_t)arguments[1] << 16) |
+	    ((uint32_t)arguments[2] << 8) | arguments[3];
+	status = setBaudRate(baud, value);
+    }
+    else if (request == SET_SENSORS) {
+	if (arguments[0] & ~(ACC | GYRO | BARO | PHT))
+	    status = ACK_INVALID;
+	else
+	    enabled_sensors = arguments[0];
+	value = arguments[0];
+    }
+    else if (request == SET_DIVISOR) {
+	byte sensor = arguments[0];
+	uint16_t ticks = (arguments[1] << 8) | arguments[2];
+	byte index = 0;
+	while (index < SCHEDULER_SENSORS && sensor != (1 << index))
+	    index += 1;
+	if (index == SCHEDULER_SENSORS)
+	    status = ACK_INVALID;
+#if ONBOARD_ORIENTATION || GYRO_FIFO
+	// The filter is set up for the gyroscope rate the board was built with and the FIFO has
+	// to be drained at it
+	else if (sensor == GYRO && ticks != GYRO_DIVISOR)
+	    status = ACK_INVALID;
+#endif
+	else
+	    scheduler.setDivisor(index, ticks);
+	value = ticks;
+    }
+    else if (request == SET_RANGE) {
+	status = setSensorRange(arguments[0], arguments[1]);
+	value = arguments[1];
+    }
+    else if (request == SET_MOTION) {
+	status = setMotion(arguments[0], arguments[1]);
+	value = arguments[0];
+    }
+    else {
+	status = setHighPass(arguments[0], arguments[1]);
+	value = arguments[1];
+    }
+    sendAck(request, status, value);
+}
+
+// Send the most recently collected sample in the format chosen at compile time
+void send_sample() {
+#if DEBUG
+    print_data();
+#else
+    bluetooth_send();
+#endif
 }
 
 void loop() {
-    sample_count = 0;
-    start = micros();
     for (;;) {
 	// While data request continue to come in serve them as fast as possible
 	// by getting data ready while the other end is working
-	char request = Serial.read();
+	byte request = SERIAL_LINK.read();
 	if (request == START_STREAM) {
-	    while (Serial.read() != END_STREAM) {
-		if (sample_count == 100)
-		    sample_count = 0;
-#if DEBUG
-		print_data();
-#else
-		bluetooth_send();
+	    scheduler.reset();
+	    startRate();
+	    sampled = 0;
+	    PROFILE_BEGIN();
+	    while (SERIAL_LINK.read() != END_STREAM) {
+		// Read the sensors due on this tick and send the last sample while the bus
+		// is busy with them
+		byte due = waitForSample();
+		PROFILE_MARK(STAGE_WAIT);
+		requestData(due);
+		PROFILE_MARK(STAGE_REQUEST);
+		if (sampled) {
+		    send_sample();
+#if GYRO_FIFO
+		    catchUpGyro(false);
 #endif
-		sample_count += 1;
+		    PROFILE_MARK(STAGE_SEND);
+		}
+		getData();
+		adaptRate();
 	    }
+	    if (sampled)
+		send_sample();
 	}
-	else if (request == SEND_SINGLE) {
-#if DEBUG
-	    print_data();
-#else
-	    bluetooth_send();
+	else if (request == START_BATCH_STREAM || request == START_COMPRESSED_STREAM) {
+	    compressed = request == START_COMPRESSED_STREAM;
+	    scheduler.reset();
+	    startRate();
+	    batch_count = 0;
+	    PROFILE_BEGIN();
+	    while (SERIAL_LINK.read() != END_STREAM) {
+		byte due = waitForSample();
+		PROFILE_MARK(STAGE_WAIT);
+		requestData(due);
+		PROFILE_MARK(STAGE_REQUEST);
+		getData();
+		if (sampled) {
+		    batch_send();
+#if GYRO_FIFO
+		    catchUpGyro(true);
 #endif
+		    PROFILE_MARK(STAGE_SEND);
+		}
+		adaptRate();
+	    }
+	    batchFlush();
+	}
+	else if (request == COBS_FRAMING || request == DLE_FRAMING)
+	    framing = request;
+	else if (request == SEND_STATS)
+	    sendStats();
+	else if (request == SEND_HEALTH)
+	    sendHealth();
+	else if (request == RUN_BENCHMARK)
+	    sendBenchmark();
+	else if ((request >= SET_BAUD_RATE && request <= SET_HIGH_PASS) || request == SET_MOTION)
+	    configure(request);
+	else if (request == SEND_SINGLE) {
+	    requestData(ACC | GYRO | BARO | PHT);
+	    getData();
+	    send_sample();
 	}
     }
 }	    
-
@@ -0,0 +1,86 @@
+// Consistent overhead byte stuffing (COBS) and CRC-16 for the COBS framed protocol variant
+
+#include "Frame_Codec.h"
+
+// CRC-16 of a block of bytes
+uint16_t crc16(const uint8_t * data, size_t size)
+{
+    uint16_t crc = CRC16_INIT;
+    for (size_t i = 0; i < size; ++i)
+	crc = crc16Update(crc, data[i]);
+    return crc;
+}
+
+// Encode 'size' bytes from 'in' into 'out', which must hold COBS_MAX_ENCODED(size) bytes, and
+// return the encoded size. The zero delimiter is not written.
+size_t cobsEncode(const uint8_t * in, size_t size, uint8_t * out)
+{
+    // Each block starts with a code byte giving the distance to the next zero
+    size_t code_index = 0;
+    size_t out_index = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < size; ++i)
+    {
+	if (in[i] == 0)
+	{
+	    out[code_index] = code;
+	    code_index = out_index++;
+	    code = 1;
+	    continue;
+	}
+	out[out_index++] = in[i];
+	code += 1;
+	// A full block with no zero, the next block starts without one being implied
+	if (code == 0xFF && i + 1 < size)
+	{
+	    out[code_index] = code;
+	    code_index = out_index++;
+	    code = 1;
+	}
+    }
+    out[code_index] = code;
+    return out_index;
+}
+
+// Encode a frame of at most COBS_BLOCK bytes in place. The frame is held in frame[1] to
+// frame[size] and frame[0] is overwritten, giving size + 1 encoded bytes without a second
+// buffer.
+void cobsEncodeInPlace(uint8_t * frame, uint8_t size)
+{
+    // Walk back from the implied zero after the frame, replacing each zero (and the code slot
+    // at the start) with the distance to the zero after it
+    uint8_t next = size + 1;
+    for (uint8_t i = size; i > 0; --i)
+    {
+	if (frame[i] == 0)
+	{
+	    frame[i] = next - i;
+	    next = i;
+	}
+    }
+    frame[0] = next;
+}
+
+// Decode 'size' encoded bytes from 'in' into 'out', which may be the same buffer, and return
+// the decoded size or -1 if the bytes are not a valid encoding
+long cobsDecode(const uint8_t * in, size_t size, uint8_t * out)
+{
+    size_t in_index = 0;
+    size_t out_index = 0;
+    while (in_index < size)
+    {
+	uint8_t code = in[in_index++];
+	if (code == 0 || in_index + code - 1 > size)
+	    return -1;
+	for (uint8_t i = 1; i < code; ++i)
+	{
+	    if (in[in_index] == 0)
+		return -1;
+	    out[out_index++] = in[in_index++];
+	}
+	// The zero the code stands for, except after a full block or at the end of the frame
+	if (code != 0xFF && in_index < size)
+	    out[out_index++] = 0;
+    }
+    return out_index;
+}
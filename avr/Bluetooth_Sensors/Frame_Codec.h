@@ -0,0 +1,93 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Consistent overhead byte stuffing (COBS) and CRC-16 for the COBS framed protocol variant.
+// COBS removes every zero from a frame at a cost of one byte per 254, so a single zero byte can
+// mark the end of each frame no matter what the sensors read. Also the zig-zag varints used by
+// the compressed frames. Shared by the firmware and the host tools.
+
+// Compiler directive to make sure the functions have not already been defined
+#ifndef FRAME_CODEC
+#define FRAME_CODEC
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Initial value of the frame check sequence
+#define CRC16_INIT 0xFFFF
+
+// Longest run COBS can encode with one code byte, frames up to this size grow by exactly one
+#define COBS_BLOCK 254
+
+// Largest encoded size of 'size' bytes, not counting the zero delimiter
+#define COBS_MAX_ENCODED(size) ((size) + (size) / COBS_BLOCK + 1)
+
+// Add a byte to a CRC-16 (polynomial 0x1021 reflected, as _crc_ccitt_update in avr-libc)
+inline uint16_t crc16Update(uint16_t crc, uint8_t data)
+{
+    data ^= crc & 0xFF;
+    data ^= data << 4;
+    return (((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3);
+}
+
+// CRC-16 of a block of bytes
+uint16_t crc16(const uint8_t * data, size_t size);
+
+// Encode 'size' bytes from 'in' into 'out', which must hold COBS_MAX_ENCODED(size) bytes, and
+// return the encoded size. The zero delimiter is not written.
+size_t cobsEncode(const uint8_t * in, size_t size, uint8_t * out);
+
+// Encode a frame of at most COBS_BLOCK bytes in place. The frame is held in frame[1] to
+// frame[size] and frame[0] is overwritten, giving size + 1 encoded bytes without a second
+// buffer.
+void cobsEncodeInPlace(uint8_t * frame, uint8_t size);
+
+// Decode 'size' encoded bytes from 'in' into 'out', which may be the same buffer, and return
+// the decoded size or -1 if the bytes are not a valid encoding
+long cobsDecode(const uint8_t * in, size_t size, uint8_t * out);
+
+// Map a signed difference to an unsigned one with small magnitudes near zero (0, -1, 1, -2 ...
+// become 0, 1, 2, 3 ...) so small negative differences also take few varint bytes
+inline uint16_t zigZag16(int16_t value) { return ((uint16_t)value << 1) ^ (uint16_t)(value >> 15); }
+inline int16_t unZigZag16(uint16_t value) { return (value >> 1) ^ -(int16_t)(value & 1); }
+
+// Longest varint of a 16 bit value
+#define VARINT16_MAX 3
+
+// Write 'value' seven bits at a time, low bits first, with the high bit of each byte set when
+// more follow. Returns the number of bytes written to 'out'.
+inline uint8_t varintEncode(uint16_t value, uint8_t * out)
+{
+    uint8_t size = 0;
+    while (value >= 0x80)
+    {
+	out[size++] = (value & 0x7F) | 0x80;
+	value >>= 7;
+    }
+    out[size++] = value;
+    return size;
+}
+
+// Read a varint from at most 'size' bytes of 'in'. Returns the number of bytes used or 0 if the
+// varint is cut short or too long for 16 bits.
+inline uint8_t varintDecode(const uint8_t * in, size_t size, uint16_t & value)
+{
+    value = 0;
+    for (uint8_t i = 0; i < VARINT16_MAX && i < size; ++i)
+    {
+	value |= (uint16_t)(in[i] & 0x7F) << (7 * i);
+	if (!(in[i] & 0x80))
+	    return i + 1;
+    }
+    return 0;
+}
+
+#endif
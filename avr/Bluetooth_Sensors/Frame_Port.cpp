@@ -0,0 +1,114 @@
+// Interrupt driven serial port with double buffered frame transmission
+
+#include "Arduino.h"
+#include "Frame_Port.h"
+#include "UART_Hardware.h"
+
+Frame_Port::Frame_Port()
+{
+    building = 0;
+    fill = 0;
+    sending = false;
+    next = 0;
+    remaining = 0;
+    head = 0;
+    tail = 0;
+    settle = 0;
+    waits = 0;
+    overruns = 0;
+}
+
+// Start the UART at the rate the core's Serial.begin() would give, it uses the double speed
+// divisor rounded the same way
+void Frame_Port::begin(long baud)
+{
+    uartEnable((F_CPU / 4 / baud - 1) / 2);
+    settle = 20000000L / baud + 1;
+}
+
+// Add a byte to the buffer being built
+void Frame_Port::write(uint8_t data)
+{
+    if (fill == PORT_BUFFER_SIZE)
+	flush();
+    buffers[building][fill++] = data;
+}
+
+void Frame_Port::write(const uint8_t * data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+	write(data[i]);
+}
+
+// Hand the buffer being built to the interrupt and start building in the other one
+void Frame_Port::flush()
+{
+    if (fill == 0)
+	return;
+    if (sending) {
+	waits += 1;
+	while (sending)
+	    uartYield();
+    }
+    // The interrupt is off until it is enabled below, so the pointers are safe to set
+    next = buffers[building];
+    remaining = fill;
+    sending = true;
+    uartTransmitInterrupt(true);
+    building ^= 1;
+    fill = 0;
+}
+
+// Send everything written and wait until the last byte has left the UART
+void Frame_Port::drain()
+{
+    flush();
+    while (sending)
+	uartYield();
+    // The interrupt is done once it loads the last byte, which then still has the data and
+    // shift registers to go through
+    delayMicroseconds(settle);
+}
+
+// Send the first 'size' bytes of the buffer returned by buffer()
+void Frame_Port::commit(uint16_t size)
+{
+    fill = size;
+    flush();
+}
+
+// Next request byte, or -1 when nothing is waiting
+int Frame_Port::read()
+{
+    if (tail == head) {
+	uartPoll();
+	return -1;
+    }
+    uint8_t data = received[tail];
+    tail = (tail + 1) & (PORT_RECEIVE_SIZE - 1);
+    return data;
+}
+
+// Load the next byte of the buffer being sent, turning the interrupt off after the last
+void Frame_Port::dataEmpty()
+{
+    uartWriteData(*next++);
+    remaining -= 1;
+    if (remaining == 0) {
+	uartTransmitInterrupt(false);
+	sending = false;
+    }
+}
+
+// Keep a received request byte for read()
+void Frame_Port::receiveComplete()
+{
+    uint8_t data = uartReadData();
+    uint8_t following = (head + 1) & (PORT_RECEIVE_SIZE - 1);
+    if (following == tail) {
+	overruns += 1;
+	return;
+    }
+    received[head] = data;
+    head = following;
+}
@@ -0,0 +1,92 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Interrupt driven serial port for the frames sent to the receiver, used in place of the
+// core's Serial. Frames are built straight into one of two buffers while the other is sent by
+// the data register empty interrupt, so collecting the next sample overlaps sending the last
+// one and the loop only waits when a whole buffer is still going out as the next is finished.
+// A COBS frame is built and encoded in place in the buffer it is sent from. Request bytes from
+// the receiver are kept in a small ring by the receive interrupt.
+//
+// The sketch owns the instance and its interrupt handlers, so none of this is linked in when
+// it sends through Serial:
+//   ISR(USART_UDRE_vect) { frame_port.dataEmpty(); }
+//   ISR(USART_RX_vect) { frame_port.receiveComplete(); }
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef FRAME_PORT
+#define FRAME_PORT
+
+#include "stddef.h"
+#include "stdint.h"
+#include "Sensor_Protocol.h"
+
+// Bytes in each transmit buffer, a COBS frame encoded in place with its zero delimiter
+#define PORT_BUFFER_SIZE (COBS_FRAME_MAX + 2)
+
+// Request bytes that can wait to be read, a power of two
+#define PORT_RECEIVE_SIZE 16
+
+class Frame_Port {
+// Internal members not used outside the class
+private:
+    uint8_t buffers[2][PORT_BUFFER_SIZE];
+    // Buffer being built and the bytes in it
+    uint8_t building;
+    uint16_t fill;
+    // Set while the interrupt sends the other buffer, and its place in it
+    volatile bool sending;
+    const uint8_t * next;
+    uint16_t remaining;
+    // Received request bytes
+    uint8_t received[PORT_RECEIVE_SIZE];
+    volatile uint8_t head;
+    uint8_t tail;
+    // Microseconds two bytes take on the wire, the data and shift registers emptying
+    uint16_t settle;
+
+// Member functions accesible outside the class
+public:
+    // Buffers that had to wait for the one before to be sent, the times the loop was held up
+    uint16_t waits;
+    // Request bytes lost to a full ring
+    uint16_t overruns;
+
+    Frame_Port();
+
+    // Start the UART at the rate the core's Serial.begin() would give, or change to it once
+    // drain() has returned
+    void begin(long baud);
+
+    // Add a byte to the buffer being built, handing it to the interrupt when it is full
+    void write(uint8_t data);
+    void write(const uint8_t * data, size_t size);
+
+    // Hand the buffer being built to the interrupt, first waiting for the other one to be sent
+    void flush();
+
+    // Send everything written and wait until the last byte has left the UART
+    void drain();
+
+    // The empty buffer being built, for a frame written in place, and send its first 'size'
+    // bytes
+    uint8_t * buffer() { return buffers[building]; }
+    void commit(uint16_t size);
+
+    // Next request byte, or -1 when nothing is waiting
+    int read();
+
+    // Interrupt handlers, the transmit data register is empty and a byte has been received
+    void dataEmpty();
+    void receiveComplete();
+};
+
+#endif
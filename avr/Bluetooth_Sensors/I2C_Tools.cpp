@@ -11,19 +11,7 @@
 // the result in 'dest'
 byte readRegister(byte deviceAddress, byte readAddress, byte & dest)
 {
-    byte error;
-    // Open the slave device for writing
-    Wire.beginTransmission(deviceAddress);
-    // Set the requested register address in the send queue
-    Wire.write(readAddress);
-    // Send the request register but keep the connection active
-    error = Wire.endTransmission(false);
-    // Request the byte from the slave device
-    Wire.requestFrom(deviceAddress, 1);
-    // 
-    while(!Wire.available());
-    dest = Wire.read();
-    return error;
+    return readRegisters(deviceAddress, readAddress, 1, &dest);
 }
 
 // Read a multiple bytes from a slave device by specifying its address 'deviceAddress', the 
@@ -31,35 +19,17 @@ byte readRegister(byte deviceAddress, byte readAddress, byte & dest)
 // 'size' and a pointer to the byte array in which the result will be placed 'dest'
 byte readRegisters(byte deviceAddress, byte readAddress, byte size, byte * dest)
 {
-    byte error;
-    // Open the slave device for writing
-    Wire.beginTransmission(deviceAddress);
-    // Set the starting address of the registers requested in the send queue
-    Wire.write(readAddress);
-    // Send the request register but keep the connection alive
-    error = Wire.endTransmission(false);
-    // Request bytes from the slave starting at the read address until read address + size
-    Wire.requestFrom(deviceAddress, size);
-    // Get each byte from the recieve queue
-    for(int i = 0; i < size; ++i)
-    {
-	while(!Wire.available()); 
-	dest[i] = Wire.read();
-    }
-    return error;
+    TWI_Transaction transaction;
+    // Queue the register address write, repeated start and read then wait for the interrupt
+    // driven bus to finish with it
+    transaction.setRead(deviceAddress, readAddress, size, dest);
+    return twi_queue.execute(transaction);
 }
 
 // Write a single byte to a slave device by specifying its address 'deviceAdress', the register address to write to 'writeAddress', and a reference to the byte to write 'src'
 byte writeRegister(byte deviceAddress, byte writeAddress, const byte & src)
 {
-    // Open the slave device for writing
-    Wire.beginTransmission(deviceAddress);
-    // Write the register address to be writen too
-    Wire.write(writeAddress);
-    // Write to the register
-    Wire.write(src);
-    // Clear the send queue and close the connection
-    return Wire.endTransmission(); 
+    return writeRegisters(deviceAddress, writeAddress, 1, &src);
 }
 
 // Write a multiple bytes to a slave device by specifying its address 'deviceAdress',
@@ -67,14 +37,30 @@ byte writeRegister(byte deviceAddress, byte writeAddress, const byte & src)
 // and a pointer to the byte array to write to 'src'
 byte writeRegisters(byte deviceAddress, byte writeAddress, byte size, const byte * src)
 {
-    // Open the slave device for writing
-    Wire.beginTransmission(deviceAddress);
-    // Write the register address to write to
-    Wire.write(writeAddress);
-    // Write each byte
-    for (int i = 0; i < size; ++i) {
-	Wire.write(src[i]);
-    }
-    return Wire.endTransmission();
+    TWI_Transaction transaction;
+    // The bus only reads from the source buffer during a write
+    transaction.setWrite(deviceAddress, writeAddress, size, const_cast<byte *>(src));
+    return twi_queue.execute(transaction);
+}
+
+// Change the 'mask' bits of a register to 'bits' with one read and one write, keeping the rest
+byte updateRegister(byte deviceAddress, byte address, byte mask, byte bits)
+{
+    // Register and error code state
+    byte reg_value, error;
+
+    error = readRegister(deviceAddress, address, reg_value);
+    if (error != NO_ERROR)
+	return error;
+    reg_value = (reg_value & ~mask) | (bits & mask);
+    return writeRegister(deviceAddress, address, reg_value);
+}
+
+// Start a read of 'size' bytes without waiting for it, the bus fills 'dest' in the
+// background and 'transaction' reports when it is done
+byte requestRegisters(TWI_Transaction & transaction, byte deviceAddress, byte readAddress,
+		      byte size, byte * dest)
+{
+    transaction.setRead(deviceAddress, readAddress, size, dest);
+    return twi_queue.submit(transaction);
 }
-    
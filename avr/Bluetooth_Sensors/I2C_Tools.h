@@ -21,7 +21,7 @@
 
 // Libraries containing more basic tools for I2C comunications
 #include <Arduino.h>
-#include <Wire.h>
+#include "TWI_Queue.h"
 #include "stdint.h"
 
 // Read a single byte from a slave device by specifying its address 'deviceAddress', the 
@@ -40,6 +40,14 @@ byte writeRegister(byte deviceAddress, byte writeAddress, const byte & writeData
 // Write a multiple bytes to a slave device by specifying its address 'deviceAdress',
 //the register address to write to 'writeAddress', the number of bytes to be written 'size',
 // and a pointer to the byte array to write to 'src'
-byte writeRegister(byte deviceAddress, byte writeAddress, byte size, const byte * src);  
+byte writeRegisters(byte deviceAddress, byte writeAddress, byte size, const byte * src);  
+
+// Change the 'mask' bits of a register to 'bits' with one read and one write, keeping the rest
+byte updateRegister(byte deviceAddress, byte address, byte mask, byte bits);
+
+// Start a read of 'size' bytes without waiting for it, the bus fills 'dest' in the
+// background and 'transaction' reports when it is done
+byte requestRegisters(TWI_Transaction & transaction, byte deviceAddress, byte readAddress,
+		      byte size, byte * dest);
 
 #endif
@@ -7,40 +7,54 @@
 // inertial sensors.
 
 #include "L3G4200D_Gyroscope.h"
+#include "Register_Map.h"
 
 // I2C address defined by the datasheet and jumper configuration
 #define DEVICE_ADDRESS 0x69
 
-// Register addresses from ST Datasheets
-#define WHO_AM_I   0x0F
-#define CTRL_REG1 0x20
-#define CTRL_REG2 0x21
-#define CTRL_REG3 0x22
-#define CTRL_REG4 0x23
-#define CTRL_REG5 0x24
-#define REFERENCE 0x25
-#define OUT_TEMP 0x26
-#define STATUS_REG 0x27
-#define OUT_X_L 0x28
-#define OUT_X_H 0x29
-#define OUT_Y_L 0x2A
-#define OUT_Y_H 0x2B
-#define OUT_Z_L 0x2C
-#define OUT_Z_H 0x2D
-#define FIFO_CTRL_REG 0x2E
-#define FIFO_SRC_REG 0x2F
-
-//Register values from ST datasheets
+// Registers from ST Datasheets, the configuration registers are cached so changing them is a
+// single write. The reboot bit of CTRL_REG5 clears itself.
+typedef Device_Register<DEVICE_ADDRESS, 0x0F> Who_Am_I;
+typedef Cached_Register<DEVICE_ADDRESS, 0x20> Ctrl_Reg1;
+typedef Cached_Register<DEVICE_ADDRESS, 0x21> Ctrl_Reg2;
+typedef Cached_Register<DEVICE_ADDRESS, 0x22> Ctrl_Reg3;
+typedef Cached_Register<DEVICE_ADDRESS, 0x23> Ctrl_Reg4;
+typedef Cached_Register<DEVICE_ADDRESS, 0x24, 0x80> Ctrl_Reg5;
+typedef Device_Register<DEVICE_ADDRESS, 0x25> Reference;
+typedef Device_Register<DEVICE_ADDRESS, 0x26> Out_Temp;
+typedef Device_Register<DEVICE_ADDRESS, 0x27> Status_Reg;
+typedef Device_Register<DEVICE_ADDRESS, 0x28> Out_X_L;
+typedef Cached_Register<DEVICE_ADDRESS, 0x2E> Fifo_Ctrl_Reg;
+typedef Device_Register<DEVICE_ADDRESS, 0x2F> Fifo_Src_Reg;
+
+// Register fields from ST Datasheets
+typedef Register_Field<Ctrl_Reg1, 0, 3> Axes_Enable;
+typedef Register_Field<Ctrl_Reg1, 3> Active;
+typedef Register_Field<Ctrl_Reg1, 4, 2> Bandwidth;
+typedef Register_Field<Ctrl_Reg1, 6, 2> Data_Rate;
+typedef Register_Field<Ctrl_Reg2, 0, 4> High_Pass_Cutoff;
+typedef Register_Field<Ctrl_Reg3, 3> Data_Ready_Interrupt;
+typedef Register_Field<Ctrl_Reg4, 4, 2> Full_Scale;
+typedef Register_Field<Ctrl_Reg5, 0> High_Pass_Output;
+typedef Register_Field<Ctrl_Reg5, 1> Low_Pass_Output;
+typedef Register_Field<Ctrl_Reg5, 4> High_Pass_Enable;
+typedef Register_Field<Ctrl_Reg5, 6> Fifo_Enable;
+typedef Register_Field<Ctrl_Reg5, 7> Reboot;
+typedef Register_Field<Fifo_Ctrl_Reg, 0, 5> Fifo_Watermark;
+typedef Register_Field<Fifo_Ctrl_Reg, 5, 3> Fifo_Mode;
+typedef Register_Field<Fifo_Src_Reg, 0, 5> Fifo_Count;
+typedef Register_Field<Fifo_Src_Reg, 6> Fifo_Overrun;
+typedef Register_Field<Status_Reg, 3> New_Data;
+typedef Register_Field<Status_Reg, 7> Data_Overrun;
+
+// Register field values from ST datasheets
 #define WHO_AM_I_VALUE 0xD3
-#define ACTIVE 0x08
-#define DISABLE_SLEEP 0x07
-#define OUTPUT_800HZ 0xC0
-#define OUTPUT_MASK 0x3F
-#define BANDWIDTH_110HZ 0x30
-#define BANDWIDTH_50HZ 0x20
-#define BANDWIDTH_35HZ 0x10
+#define ALL_AXES 0x07
+#define OUTPUT_800HZ 0x03
+#define BANDWIDTH_110HZ 0x03
+#define BANDWIDTH_50HZ 0x02
+#define BANDWIDTH_35HZ 0x01
 #define BANDWIDTH_30HZ 0x00
-#define BANDWIDTH_MASK 0xCF
 #define FILTER_56HZ 0x00
 #define FILTER_30HZ 0x01
 #define FILTER_15HZ 0x02
@@ -51,36 +65,48 @@
 #define FILTER_HALFHZ 0x07
 #define FILTER_FIFTHHZ 0x08
 #define FILTER_TENTHHZ 0x09
-#define FILTER_MASK 0xF0
-#define REBOOT 0x80
-#define ENABLE_HP_FILTER 0x11
-#define ENABLE_LP_FILTER 0x02
 #define RANGE_200DPS 0x00
-#define RANGE_500DPS 0x10
-#define RANGE_2000DPS 0x20
-#define RANGE_MASK 0x60
-
-
-// Error handeling codes
-#define NO_ERROR 0
-#define BUFFER_SIZE_ERROR 1
-#define ADDRESS_NO_ACKNOWLEDGE 2
-#define DATA_NO_ACKNOWLEDGE 3
-#define TWI_ERROR 4
-#define IDENTIFICATION_FAILURE 5
+#define RANGE_500DPS 0x01
+#define RANGE_2000DPS 0x02
+#define AUTO_INCREMENT 0x80
+#define FIFO_BYPASS_MODE 0x00
+#define FIFO_STREAM_MODE 0x02
+
+// Carry out 'action' on the copy of every cached register, reading them in two bursts
+static byte cacheRegisters(cache_action action)
+{
+    // Contents of CTRL_REG1 to CTRL_REG5 and of FIFO_CTRL_REG
+    byte control[5] = {0, 0, 0, 0, 0}, fifo = 0;
+    byte error = NO_ERROR;
+
+    if (action != CACHE_FORGET) {
+	error = readRegisters(DEVICE_ADDRESS, Ctrl_Reg1::address | AUTO_INCREMENT, 5, control);
+	if (error == NO_ERROR)
+	    error = readRegister(DEVICE_ADDRESS, Fifo_Ctrl_Reg::address, fifo);
+	if (error != NO_ERROR)
+	    action = CACHE_FORGET;
+    }
+    error = cacheRegister<Ctrl_Reg1>(action, control[0], error);
+    error = cacheRegister<Ctrl_Reg2>(action, control[1], error);
+    error = cacheRegister<Ctrl_Reg3>(action, control[2], error);
+    error = cacheRegister<Ctrl_Reg4>(action, control[3], error);
+    error = cacheRegister<Ctrl_Reg5>(action, control[4], error);
+    error = cacheRegister<Fifo_Ctrl_Reg>(action, fifo, error);
+    return error;
+}
 
 
 // Initialization of the communication and sensor hardware
 byte L3G4200D_Gyroscope::setup()
 {
     // Setup the I2C library
-    Wire.begin();
+    twi_queue.begin();
 
     // Register and error code state
     byte reg_value, error;
 
     // Check the identity register
-    error = readRegister(DEVICE_ADDRESS, WHO_AM_I, reg_value);
+    error = Who_Am_I::read(reg_value);
     if (error != NO_ERROR)
 	return error;
 
@@ -101,65 +127,50 @@ byte L3G4200D_Gyroscope::setup()
     if (error != NO_ERROR)
     	return error;
 
-    // Get the main control state
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    // Initialize with maximum sample rate and every axis on and activate sampling, the rest
+    // of the register is at its default after the reset so it is written without reading it
+    error = Ctrl_Reg1::update(Ctrl_Reg1::all(0) | Data_Rate::set(OUTPUT_800HZ) |
+			      Active::set(1) | Axes_Enable::set(ALL_AXES));
     if (error != NO_ERROR)
     	return error;
 
-    // Initialize with maximum sample rate
-    reg_value = reg_value & OUTPUT_MASK;
-    reg_value = reg_value | OUTPUT_800HZ;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-    	return error;
-
-    // Activate sampling
-    error = activate();
+    // Copy the registers so every later change is a single write
+    error = cacheRegisters(CACHE_LOAD);
     return error;
 }
 
+// Compare the driver's copies of its control registers with the device, REGISTER_MISMATCH
+// if any differed (the copies then hold what the device has)
+byte L3G4200D_Gyroscope::verifyRegisters()
+{
+    return cacheRegisters(CACHE_VERIFY);
+}
+
 // Activate sampling hardware amplifiers
 byte L3G4200D_Gyroscope::activate()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Get control register state so settings are saved
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
     // Flip the active state bit
-    reg_value = reg_value | ACTIVE;
-    error =  writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    return error;
+    return Active::write(1);
 }
 
 // Turn off the sampling hardware
 byte L3G4200D_Gyroscope::standby()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Get control register state to save setttings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
     // Send the active bit low
-    reg_value = reg_value & ~ACTIVE;
-    return writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value); 
+    return Active::write(0);
 }
 
 // Reset all settings and data values
 byte L3G4200D_Gyroscope::reset()
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Error code state
+    byte error;
 
     // Set the reboot flag high, it will automatically clear
-    reg_value = REBOOT;
-    error =  writeRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
+    error = Ctrl_Reg5::update(Ctrl_Reg5::all(0) | Reboot::set(1));
+
+    // Every register is back at its power on value
+    cacheRegisters(CACHE_FORGET);
     return error;
 }
 
@@ -167,181 +178,268 @@ byte L3G4200D_Gyroscope::reset()
 // code enumeration
 byte L3G4200D_Gyroscope::setRange(range max_range)
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Get the current settings state
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG4, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
-    // Set the range bits based in the masked range
-    reg_value = reg_value & RANGE_MASK;
-    reg_value = reg_value | max_range;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG4, reg_value);
-    return error;
+    // Set the full scale bits for the range code
+    static const byte range_bits[] = { RANGE_200DPS, RANGE_500DPS, RANGE_2000DPS };
+    return Full_Scale::write(range_bits[max_range]);
 }
 
 // Enable mode to turn off the sampling hardware power if no requests are
 // recived within a short timeout period
 byte L3G4200D_Gyroscope::enableSleep()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Get the current state of the control register to save the settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
-    // Set the sleep bit low
-    reg_value = reg_value & ~DISABLE_SLEEP; 
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value); 
-    return error; 
+    // Set the axis enable bits low
+    return Axes_Enable::write(0);
 }
 
 // Disable sleep mode for responsive sampling at the expense of incresed power consumption
 byte L3G4200D_Gyroscope::disableSleep()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Get the current settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
-    // Set the sleep bit high
-    reg_value = reg_value | DISABLE_SLEEP;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    return error;
+    // Set the axis enable bits high
+    return Axes_Enable::write(ALL_AXES);
 }
 
 // Enable high pass filtering on the output
 byte L3G4200D_Gyroscope::enableHighPassFilter()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Save the current register values
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
-    // Set the high pass flag high
-    reg_value = reg_value | ENABLE_HP_FILTER;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
-    return error; 
+    // Set the high pass flag and its output selection high in one write
+    return Ctrl_Reg5::update(High_Pass_Enable::set(1) | High_Pass_Output::set(1));
 }
 
 // Disable high pass filtering of the output
 byte L3G4200D_Gyroscope::disableHighPassFilter()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Save the previous register states
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
-    // Set the high pass flag low
-    reg_value = reg_value & ~ENABLE_HP_FILTER;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
-    return error; 
+    // Set the high pass flag and its output selection low in one write
+    return Ctrl_Reg5::update(High_Pass_Enable::set(0) | High_Pass_Output::set(0));
 }
 
 // Set the high pass filter cutoff frequency with a filter enumerated code
 byte L3G4200D_Gyroscope::setHighPassCutoff(filter frequency)
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Update the frequency code bits
+    return High_Pass_Cutoff::write(frequency);
+}
+
+// Enable a low pass filter on the output
+byte L3G4200D_Gyroscope::enableLowPassFilter()
+{
+    // Set the lowpass filter bit high
+    return Low_Pass_Output::write(1);
+}
+
+// Disable a low pass filter on the output
+byte L3G4200D_Gyroscope::disableLowPassFilter()
+{
+    // Set the low pass filter low
+    return Low_Pass_Output::write(0);
+}
+
+// Set a lowpass filter cutoff relative to the high pass filter cutoff with an enumerated
+// bandwidth code, the bandwidth is the difference in these cutoffs
+byte L3G4200D_Gyroscope::setLowPassBandwidth(bandwidth band)
+{
+    // Set the bandwidth bits for the bandwidth code
+    static const byte bandwidth_bits[] = {
+	BANDWIDTH_110HZ, BANDWIDTH_50HZ, BANDWIDTH_35HZ, BANDWIDTH_30HZ
+    };
+    return Bandwidth::write(bandwidth_bits[band]);
+}
+
+// Read the rotational rate off all three axes and store in memory
+byte L3G4200D_Gyroscope::readData()
+{
+    // Error code state
+    byte error;
 
-    // Save the previous register states
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
+    error = requestData();
     if (error != NO_ERROR)
 	return error;
+    return collectData();
+}
+
+// Choose between reading all axes with a single auto-increment burst (the default) or a
+// separate transaction for every register
+void L3G4200D_Gyroscope::setReadMode(mode read)
+{
+    read_mode = read;
+}
+
+// True if the last burst read returned a sample the sensor had not already reported
+bool L3G4200D_Gyroscope::newData()
+{
+    return New_Data::get(status);
+}
+
+// True if the sensor overwrote a sample before the last burst read could collect it
+bool L3G4200D_Gyroscope::overrun()
+{
+    return Data_Overrun::get(status);
+}
+
+// Start reading the rotational rate of all three axes without waiting for the bus
+byte L3G4200D_Gyroscope::requestData()
+{
+    // Error code state
+    byte error;
 
-    // Wipe the frequency code bits
-    reg_value = reg_value & FILTER_MASK;
-    // Update the new code in the register
-    reg_value = reg_value | frequency;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
+    // Setting the high bit of the register address makes the sensor step through the
+    // status register and all six output registers in one transaction
+    if (read_mode == BURST_READ)
+	return requestRegisters(transactions[0], DEVICE_ADDRESS,
+				Status_Reg::address | AUTO_INCREMENT, 7, raw_data);
+
+    // Otherwise queue each axis using sequential byte offsets from the first axis high byte
+    for(int i = 0; i < 6 ; i++)
+    {
+	error = requestRegisters(transactions[i], DEVICE_ADDRESS, Out_X_L::address + i, 1,
+				 &raw_data[i + 1]);
+	if (error != NO_ERROR)
+	    return error;
+    }
     return error;
 }
 
-// Enable a low pass filter on the output
-byte L3G4200D_Gyroscope::enableLowPassFilter()
+// Wait for the reading started by requestData() and store it in memory
+byte L3G4200D_Gyroscope::collectData()
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Error code state
+    byte error = NO_ERROR;
 
-    // Save the other settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
-    if (error != NO_ERROR)
-	return error;
+    if (read_mode == BURST_READ)
+    {
+	error = twi_queue.wait(transactions[0]);
+	status = raw_data[0];
+    }
+    else
+    {
+	for(int i = 0; i < 6 ; i++)
+	{
+	    // Keep the first failure but let the rest of the queued reads drain
+	    if (twi_queue.wait(transactions[i]) != NO_ERROR && error == NO_ERROR)
+		error = transactions[i].status;
+	}
+    }
 
-    // Set the lowpass filter bit high
-    reg_value = reg_value | ENABLE_LP_FILTER;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
-    return error; 
+    // The output registers arrive low byte first which matches the AVR's int layout
+    for(int i = 0; i < 6 ; i++)
+    	data[i] = raw_data[i + 1];
+    return error;
 }
 
-// Disable a low pass filter on the output
-byte L3G4200D_Gyroscope::disableLowPassFilter()
+// Drive the INT2/DRDY pin each time a new sample is ready
+byte L3G4200D_Gyroscope::enableDataReadyInterrupt()
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Set the data ready on INT2 bit high
+    return Data_Ready_Interrupt::write(1);
+}
+
+// Let the sensor buffer up to 32 samples in stream mode, the firmware drains them once
+// 'watermark' samples are waiting with requestFIFO() and collectFIFO()
+byte L3G4200D_Gyroscope::enableFIFO(byte watermark)
+{
+    // Error code state
+    byte error;
 
-    // Save the other settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
+    // Stream mode keeps accepting samples when full, discarding the oldest. The mode and
+    // watermark fill the whole register so it is written without reading it.
+    error = Fifo_Ctrl_Reg::update(Fifo_Mode::set(FIFO_STREAM_MODE) |
+				  Fifo_Watermark::set(watermark));
     if (error != NO_ERROR)
 	return error;
 
-    // Set the low pass filter low
-    reg_value = reg_value & ~ENABLE_LP_FILTER;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG5, reg_value);
-    return error; 
+    // Set the FIFO enable bit high
+    error = Fifo_Enable::write(1);
+    if (error != NO_ERROR)
+	return error;
+
+    fifo_watermark = watermark & Fifo_Watermark::mask;
+    fifo_waiting = 0;
+    fifo_count = 0;
+    return error;
 }
 
-// Set a lowpass filter cutoff relative to the high pass filter cutoff with an enumerated
-// bandwidth code, the bandwidth is the difference in these cutoffs
-byte L3G4200D_Gyroscope::setLowPassBandwidth(bandwidth band)
+// Return to reading the output registers directly
+byte L3G4200D_Gyroscope::disableFIFO()
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Error code state
+    byte error;
 
-    // Save the other settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    // Set the FIFO enable bit low
+    error = Fifo_Enable::write(0);
     if (error != NO_ERROR)
 	return error;
 
-    // Clear the bandwidth bits
-    reg_value = reg_value & BANDWIDTH_MASK;
-    // Set the bandwidth code
-    reg_value = reg_value | band;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    error = Fifo_Ctrl_Reg::update(Fifo_Mode::set(FIFO_BYPASS_MODE) | Fifo_Watermark::set(0));
+
+    fifo_waiting = 0;
+    fifo_count = 0;
     return error;
 }
 
-// Read the rotational rate off all three axes and store in memory
-byte L3G4200D_Gyroscope::readData()
+// Start reading the samples waiting at the last drain, along with the FIFO state
+byte L3G4200D_Gyroscope::requestFIFO()
 {
-    // Register and error code state
-    byte error, reg_value;
-    // Loop through each axis using sequential byte offsets from the first axis high byte
-    // The I2C implimentation is not compatible with Wirings buffered readRegister() function
-    for(int i = 0; i < 6 ; i++)
+    // Error code state
+    byte error;
+
+    // Samples are only read once the last source register read showed the watermark was
+    // reached, so both reads can be queued at once without waiting on the source first
+    fifo_count = 0;
+    if (fifo_waiting != 0 && fifo_waiting >= fifo_watermark)
     {
-	error = readRegister(DEVICE_ADDRESS, OUT_X_L + i , reg_value);
-	if (error != 0)
+	fifo_count = fifo_waiting;
+	if (fifo_count > L3G4200D_FIFO_DEPTH)
+	    fifo_count = L3G4200D_FIFO_DEPTH;
+	// With the FIFO on the auto-increment address wraps from OUT_Z_H back to OUT_X_L
+	// and moves on to the next sample, so one burst drains them all
+	error = requestRegisters(fifo_transaction, DEVICE_ADDRESS,
+				 Out_X_L::address | AUTO_INCREMENT, fifo_count * 6, fifo_data);
+	if (error != NO_ERROR)
 	    return error;
+    }
+    return Fifo_Src_Reg::request(fifo_source_transaction, 1, &fifo_source);
+}
 
-    	data[i] = reg_value;
+// Wait for the drain started by requestFIFO(), fifo_count samples are then available
+byte L3G4200D_Gyroscope::collectFIFO()
+{
+    // Error code state
+    byte error = NO_ERROR;
+
+    if (fifo_count != 0)
+    {
+	error = twi_queue.wait(fifo_transaction);
+	if (error != NO_ERROR)
+	    fifo_count = 0;
     }
+
+    if (twi_queue.wait(fifo_source_transaction) != NO_ERROR)
+    {
+	fifo_waiting = 0;
+	return error != NO_ERROR ? error : fifo_source_transaction.status;
+    }
+
+    // Remember what is left for the next drain and count any lost samples
+    fifo_waiting = Fifo_Count::get(fifo_source);
+    if (Fifo_Overrun::get(fifo_source))
+	fifo_overruns += 1;
     return error;
 }
 
+// Place a drained FIFO sample in the rate data members
+void L3G4200D_Gyroscope::loadFIFOSample(byte index)
+{
+    if (index >= fifo_count)
+	return;
+    for(int i = 0; i < 6 ; i++)
+    	data[i] = fifo_data[index * 6 + i];
+}
+
+// Samples the FIFO still held once the last drain was read, due at the next drain
+byte L3G4200D_Gyroscope::fifoWaiting()
+{
+    return fifo_waiting;
+}
+
 // Send the data via a specified serial device in byte sized chuncks with the high byte 
 // followed by the low byte of each axis, 6 bytes in total
 void L3G4200D_Gyroscope::sendData(HardwareSerial & serial_device, byte delimiter)
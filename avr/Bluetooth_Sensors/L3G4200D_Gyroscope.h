@@ -23,11 +23,13 @@
 
 // Headers for other tools used within the class
 #include "Arduino.h"
-#include "Wire.h"
 #include "I2C_Tools.h"
 #include "HardwareSerial.h"
 #include "stdint.h"
 
+// Most samples taken from the on-chip FIFO in one transaction, each sample costs 6 bytes
+#define L3G4200D_FIFO_DEPTH 8
+
 class L3G4200D_Gyroscope {
 // Internal members not used outside the class
 private:
@@ -35,11 +37,25 @@ private:
     byte activate();
     byte reset();
 
+    // Background reads of the output registers and their raw contents, a burst read uses the
+    // first transaction and places the status register ahead of the axes
+    TWI_Transaction transactions[6];
+    byte raw_data[7];
+    byte read_mode;
+
+    // Background reads of the FIFO samples and its source register, and their raw contents
+    TWI_Transaction fifo_transaction, fifo_source_transaction;
+    byte fifo_data[L3G4200D_FIFO_DEPTH * 6];
+    byte fifo_source;
+    // Samples known to be waiting in the FIFO from the last source register read
+    byte fifo_waiting;
+    byte fifo_watermark;
+
 // Member functions and enumerations accesible outside the class
 public:
     union
     {
-	int gyro[3];
+	int16_t gyro[3];
 	char data[6];
     };
 
@@ -60,6 +76,16 @@ public:
       BAND_30_HZ
     };
 
+    // Register access used to read the axes
+    enum mode
+    {
+      BURST_READ,
+      PER_REGISTER_READ
+    };
+
+    // Contents of STATUS_REG read along with the last burst read
+    byte status;
+
     // Frequency code for the highpass filter cuttoff frequencies
     enum filter
     {
@@ -108,9 +134,56 @@ public:
     // bandwidth code, the bandwidth is the difference in these cutoffs
     byte setLowPassBandwidth(bandwidth band);
 
+    // Choose between reading all axes with a single auto-increment burst (the default) or a
+    // separate transaction for every register
+    void setReadMode(mode read);
+
+    // True if the last burst read returned a sample the sensor had not already reported
+    bool newData();
+
+    // True if the sensor overwrote a sample before the last burst read could collect it
+    bool overrun();
+
+    // Compare the driver's copies of its control registers with the device, REGISTER_MISMATCH
+    // if any differed (the copies then hold what the device has)
+    byte verifyRegisters();
+
+    // Drive the INT2/DRDY pin each time a new sample is ready
+    byte enableDataReadyInterrupt();
+
+    // Number of samples held from the last FIFO drain, and the number of times the FIFO
+    // filled and lost samples before it was drained
+    byte fifo_count;
+    unsigned int fifo_overruns;
+
+    // Let the sensor buffer up to 32 samples in stream mode, the firmware drains them once
+    // 'watermark' samples are waiting with requestFIFO() and collectFIFO()
+    byte enableFIFO(byte watermark);
+
+    // Return to reading the output registers directly
+    byte disableFIFO();
+
+    // Start reading the samples waiting at the last drain, along with the FIFO state
+    byte requestFIFO();
+
+    // Wait for the drain started by requestFIFO(), fifo_count samples are then available
+    byte collectFIFO();
+
+    // Place a drained FIFO sample in the rate data members
+    void loadFIFOSample(byte index);
+
+    // Samples the FIFO still held once the last drain was read, due at the next drain
+    byte fifoWaiting();
+
     // Read the rotational rate of all three axes and store in memory
     byte readData();
 
+    // Start reading the rotational rate of all three axes without waiting for the bus
+    byte requestData();
+
+    // Wait for the reading started by requestData() and store it in memory
+    byte collectData();
+
     // Send the data via a specified serial device in byte sized chuncks with the high byte 
     // followed by the low byte of each axis, 6 bytes in total
     void sendData(HardwareSerial & serial_device, byte delimiter);
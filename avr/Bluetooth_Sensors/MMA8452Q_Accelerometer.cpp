@@ -7,56 +7,87 @@
 // Default I2C Address of the Sparkfun MMA8542 Breakout, jumper toggle on chip bottom
 #define DEVICE_ADDRESS 0x1D
 
-// Register addresses from Freescales Datasheets
-#define STATUS 0x00
-#define OUT_X_MSB 0x01
-#define OUT_X_LSB 0x02
-#define OUT_Y_MSB 0x03
-#define OUT_Y_LSB 0x04
-#define OUT_Z_MSB 0x05
-#define OUT_Z_LSB 0x06
-#define WHO_AM_I   0x0D
-#define XYZ_DATA_CFG  0x0E
-#define HP_FILTER_CUTOFF 0x0F
-#define CTRL_REG1 0x2A
-#define CTRL_REG2 0x2B
-#define CTRL_REG3 0x2C
-#define CTRL_REG4 0x2D
-#define CTRL_REG5 0x2F
-#define INTERUPT 0x2E
-#define OFFSET_X 0x30
-#define OFFSET_Y 0x31
-#define OFFSET_Z 0x31
+// Registers from Freescales Datasheets, the configuration registers are cached so changing
+// them is a single write. The reset bit of CTRL_REG2 clears itself.
+typedef Device_Register<DEVICE_ADDRESS, 0x00> Status;
+typedef Device_Register<DEVICE_ADDRESS, 0x01> Out_X_Msb;
+typedef Device_Register<DEVICE_ADDRESS, 0x0D> Who_Am_I;
+typedef Cached_Register<DEVICE_ADDRESS, 0x0E> Xyz_Data_Cfg;
+typedef Cached_Register<DEVICE_ADDRESS, 0x0F> Hp_Filter_Cutoff;
+typedef Cached_Register<DEVICE_ADDRESS, 0x1D> Transient_Cfg;
+typedef Device_Register<DEVICE_ADDRESS, 0x1E> Transient_Src;
+typedef Cached_Register<DEVICE_ADDRESS, 0x1F> Transient_Ths;
+typedef Cached_Register<DEVICE_ADDRESS, 0x20> Transient_Count;
+typedef Cached_Register<DEVICE_ADDRESS, 0x2A> Ctrl_Reg1;
+typedef Cached_Register<DEVICE_ADDRESS, 0x2B, 0x40> Ctrl_Reg2;
+typedef Cached_Register<DEVICE_ADDRESS, 0x2C> Ctrl_Reg3;
+typedef Cached_Register<DEVICE_ADDRESS, 0x2D> Ctrl_Reg4;
+typedef Cached_Register<DEVICE_ADDRESS, 0x2E> Ctrl_Reg5;
+
+// Register fields from Freescales Datasheets
+typedef Register_Field<Xyz_Data_Cfg, 0, 2> Full_Scale;
+typedef Register_Field<Xyz_Data_Cfg, 4> High_Pass_Output;
+typedef Register_Field<Hp_Filter_Cutoff, 0, 2> High_Pass_Cutoff;
+typedef Register_Field<Transient_Cfg, 1, 3> Transient_Axes;
+typedef Register_Field<Transient_Cfg, 4> Transient_Latch;
+typedef Register_Field<Transient_Src, 6> Transient_Active;
+typedef Register_Field<Transient_Ths, 0, 7> Transient_Threshold;
+typedef Register_Field<Ctrl_Reg1, 0> Active;
+typedef Register_Field<Ctrl_Reg1, 2> Low_Noise;
+typedef Register_Field<Ctrl_Reg1, 3, 3> Data_Rate;
+typedef Register_Field<Ctrl_Reg2, 0, 2> Active_Mode;
+typedef Register_Field<Ctrl_Reg2, 2> Auto_Sleep;
+typedef Register_Field<Ctrl_Reg2, 3, 2> Sleep_Mode;
+typedef Register_Field<Ctrl_Reg2, 6> Reset;
+typedef Register_Field<Ctrl_Reg4, 0> Data_Ready_Enable;
+typedef Register_Field<Ctrl_Reg5, 0> Data_Ready_Route;
 
 // Register constant values from Freescales Datasheets
 #define WHO_AM_I_VALUE 0x2A
+#define ROUTE_INT1 1
+#define ALL_AXES 0x07
 
-// Error handeling codes
-#define NO_ERROR 0
-#define BUFFER_SIZE_ERROR 1
-#define ADDRESS_NO_ACKNOWLEDGE 2
-#define DATA_NO_ACKNOWLEDGE 3
-#define TWI_ERROR 4
-#define IDENTIFICATION_FAILURE 5
-
-// Bitmasks required to set register values from Freescale Datasheets
-#define ENABLE_FILTER 0x10
 #define RANGE_2G 0x00
 #define RANGE_4G 0x01
 #define RANGE_8G 0x02
-#define RANGE_MASK 0xFC
+
 #define FILTER_16HZ 0x00
 #define FILTER_8HZ 0x01
 #define FILTER_4HZ 0x02
 #define FILTER_2HZ 0x03
-#define FILTER_MASK 0xFC
-#define OUTPUT_800HZ 0x00
-#define ACTIVE 0x01
-#define LOW_NOISE 0x04
-#define HIGH_RESOLUTION_MODE 0x02
-#define LOW_POWER_SLEEP_MODE 0x18
-#define AUTO_SLEEP 0x04
-#define RESET 0x40
+
+// Carry out 'action' on the copy of every cached register, reading them in four reads. The
+// transient registers are read around TRANSIENT_SRC, reading it would clear a latched event.
+static byte cacheRegisters(cache_action action)
+{
+    // Contents of XYZ_DATA_CFG and HP_FILTER_CUTOFF, of TRANSIENT_CFG, of TRANSIENT_THS and
+    // TRANSIENT_COUNT, and of CTRL_REG1 to CTRL_REG5
+    byte filter[2] = {0, 0}, transient[3] = {0, 0, 0}, control[5] = {0, 0, 0, 0, 0};
+    byte error = NO_ERROR;
+
+    if (action != CACHE_FORGET) {
+	error = Xyz_Data_Cfg::readBlock(2, filter);
+	if (error == NO_ERROR)
+	    error = Transient_Cfg::readBlock(1, transient);
+	if (error == NO_ERROR)
+	    error = Transient_Ths::readBlock(2, transient + 1);
+	if (error == NO_ERROR)
+	    error = Ctrl_Reg1::readBlock(5, control);
+	if (error != NO_ERROR)
+	    action = CACHE_FORGET;
+    }
+    error = cacheRegister<Xyz_Data_Cfg>(action, filter[0], error);
+    error = cacheRegister<Hp_Filter_Cutoff>(action, filter[1], error);
+    error = cacheRegister<Transient_Cfg>(action, transient[0], error);
+    error = cacheRegister<Transient_Ths>(action, transient[1], error);
+    error = cacheRegister<Transient_Count>(action, transient[2], error);
+    error = cacheRegister<Ctrl_Reg1>(action, control[0], error);
+    error = cacheRegister<Ctrl_Reg2>(action, control[1], error);
+    error = cacheRegister<Ctrl_Reg3>(action, control[2], error);
+    error = cacheRegister<Ctrl_Reg4>(action, control[3], error);
+    error = cacheRegister<Ctrl_Reg5>(action, control[4], error);
+    return error;
+}
 
     // Initialization of the communication and sensor hardware
 byte MMA8452Q_Accelerometer::setup()
@@ -66,10 +97,13 @@ byte MMA8452Q_Accelerometer::setup()
     byte reg_value, error;
 
     // Initialize I2C communication
-    Wire.begin();
+    twi_queue.begin();
+
+    // The reset below turns the transient detection off
+    detecting = false;
 
     // Get the identity of the device with the accelerometers address
-    error = readRegister(DEVICE_ADDRESS, WHO_AM_I, reg_value);
+    error = Who_Am_I::read(reg_value);
     if (error != NO_ERROR)
 	return error;
 
@@ -85,8 +119,9 @@ byte MMA8452Q_Accelerometer::setup()
     if (error != NO_ERROR)
     	return error;
 
-    // Put the device into standby, turning off the hardware power (this is required)
-    error = standby();
+    // Put the device into standby, turning off the hardware power (this is required). After
+    // the reset every other control bit is known to be clear so the whole register is written.
+    error = Ctrl_Reg1::update(Ctrl_Reg1::all(0) | Data_Rate::set(RATE_800_HZ));
     if (error != NO_ERROR)
     	return error;
 
@@ -95,210 +130,316 @@ byte MMA8452Q_Accelerometer::setup()
 	return error;
 
     // Set the active mode to have high resolution and the sleep mode to optimize power
-    reg_value = HIGH_RESOLUTION_MODE | LOW_POWER_SLEEP_MODE;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
+    error = Ctrl_Reg2::update(Ctrl_Reg2::all(0) | Active_Mode::set(HIGH_RESOLUTION) |
+			      Sleep_Mode::set(LOW_POWER));
+    if (error != NO_ERROR)
+    	return error;
+
+    // Copy the registers so every later change is a single write
+    error = cacheRegisters(CACHE_LOAD);
     if (error != NO_ERROR)
     	return error;
 
-    // Resume sampling
-    error = resume();
+    // Start sampling
+    error = Active::write(1);
     return error;
 }
 
-// Resume sampling
-byte MMA8452Q_Accelerometer::resume()
+// Compare the driver's copies of its control registers with the device, REGISTER_MISMATCH
+// if any differed (the copies then hold what the device has)
+byte MMA8452Q_Accelerometer::verifyRegisters()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
-    // Set the active flag high
-    reg_value = reg_value | ACTIVE;
-    error =  writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    return error;
+    return cacheRegisters(CACHE_VERIFY);
 }
 
-//  Reset the register settings to default
-byte MMA8452Q_Accelerometer::reset()
+// Put the device into standby if it is sampling, keeping the control register it had in
+// 'control' for resume()
+byte MMA8452Q_Accelerometer::standby(byte & control)
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Error code state
+    byte error;
 
     // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
-    if (error != NO_ERROR)
+    error = Ctrl_Reg1::read(control);
+    if (error != NO_ERROR || !Active::get(control))
 	return error;
 
-    // Set the reset flag high, this will automatically clear
-    reg_value = reg_value | RESET;
-    error =  writeRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
-    if (error != NO_ERROR)
-	return error;
-    delay(5);
-    return error;
+    // Set the active bit low
+    return Ctrl_Reg1::write(control & ~Active::mask);
 }
 
+// Resume sampling if the device was sampling when standby() saved 'control'
+byte MMA8452Q_Accelerometer::resume(byte control)
+{
+    if (!Active::get(control))
+	return NO_ERROR;
+    return Ctrl_Reg1::write(control);
+}
 
-// Turn off the sampling hardware
-byte MMA8452Q_Accelerometer::standby()
+//  Reset the register settings to default
+byte MMA8452Q_Accelerometer::reset()
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Error code state
+    byte error;
 
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    // Set the reset flag high, this will automatically clear
+    error = Reset::write(1);
     if (error != NO_ERROR)
 	return error;
+    delay(5);
 
-    // Set the active bit low
-    reg_value = reg_value & ~ACTIVE;
-    return writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value); 
+    // Every register is back at its power on value
+    cacheRegisters(CACHE_FORGET);
+    return error;
 }
 
 // Enable mode to turn off the sampling hardware power if no requests are
 // recived within a short timeout period
 byte MMA8452Q_Accelerometer::enableSleepOnInactivity()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
     // Set the sleep bit high
-    reg_value = reg_value | AUTO_SLEEP;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value); 
-    return error; 
+    return Auto_Sleep::write(1);
 }
 
 // Disable sleep mode for responsive sampling at the expense of incresed power consumption
 byte MMA8452Q_Accelerometer::disableSleepOnInactivity()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
     // Set the sleep bit low
-    reg_value = reg_value & ~AUTO_SLEEP;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG2, reg_value);
-    return error;
+    return Auto_Sleep::write(0);
 }
 
 // Enable high pass filtering on the output
 byte MMA8452Q_Accelerometer::enableHighPassFilter()
 {
-    // Register and error code state
-    byte reg_value, error;
-
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, XYZ_DATA_CFG, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
     // Set the filter bit high
-    reg_value = reg_value | ENABLE_FILTER;
-    error = writeRegister(DEVICE_ADDRESS, XYZ_DATA_CFG, reg_value);
-    return error; 
+    return writeInStandby(High_Pass_Output::set(1));
 }
 
 // Disable high pass filtering of the output
 byte MMA8452Q_Accelerometer::disableHighPassFilter()
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Set the filter bit low
+    return writeInStandby(High_Pass_Output::set(0));
+}
 
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, XYZ_DATA_CFG, reg_value);
+// Drive the INT1 pin each time a new sample is ready
+byte MMA8452Q_Accelerometer::enableDataReadyInterrupt()
+{
+    // Control register and error code state
+    byte control, error;
+
+    // The interrupt registers can only be changed in standby
+    error = standby(control);
     if (error != NO_ERROR)
 	return error;
 
-    // Set the filter bit low
-    reg_value = reg_value & ~ENABLE_FILTER;
-    error = writeRegister(DEVICE_ADDRESS, XYZ_DATA_CFG, reg_value);
-    return error; 
+    // Set the data ready interrupt enable bit high
+    error = Data_Ready_Enable::write(1);
+    if (error != NO_ERROR)
+	return error;
+
+    // Route data ready to INT1
+    error = Data_Ready_Route::write(ROUTE_INT1);
+    if (error != NO_ERROR)
+	return error;
+
+    return resume(control);
 }
 
-// Set the high pass filter cutoff frequency with an enumerated filter code
+// Set the upper and lower range to be measured in gravities with a range code enumeration
 byte MMA8452Q_Accelerometer::setRange(range max_range)
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Control register and error code state
+    byte control, error;
 
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    // The range and noise mode can only be changed in standby
+    error = standby(control);
     if (error != NO_ERROR)
 	return error;
 
-    // Set low noise mode
-    if (reg_value == MMA8452Q_Accelerometer::MAX_8G)
-	reg_value = reg_value & ~LOW_NOISE;
-    else
-	reg_value = reg_value | LOW_NOISE;
-    error =  writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    // Set the range bits
+    error = Full_Scale::write(max_range);
     if (error != NO_ERROR)
 	return error;
 
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, XYZ_DATA_CFG, reg_value);
+    // Low noise mode only measures up to 4 g, the saved control register is written back
+    // with it so the device is left active if it was
+    Register_Change<Ctrl_Reg1> noise = Low_Noise::set(max_range != MAX_8G);
+    return Ctrl_Reg1::write((control & ~noise.mask) | noise.bits);
+}
+
+// Set the high pass filter cutoff frequency with an enumerated filter code
+byte MMA8452Q_Accelerometer::setHighPassCutoff(filter frequency)
+{
+    // Set the filter bits
+    return writeInStandby(High_Pass_Cutoff::set(frequency));
+}
+
+// Set the output data rate with an enumerated data rate code
+byte MMA8452Q_Accelerometer::setDataRate(data_rate rate)
+{
+    // Control register and error code state
+    byte control, error;
+
+    // The rate is in the same register as the active bit, so it is written back with it
+    error = standby(control);
     if (error != NO_ERROR)
 	return error;
+    Register_Change<Ctrl_Reg1> change = Data_Rate::set(rate);
+    return Ctrl_Reg1::write((control & ~change.mask) | change.bits);
+}
 
-    // Clear the range bits
-    reg_value = reg_value & RANGE_MASK;
-    // Set the range bits
-    reg_value = reg_value | max_range;
-    error = writeRegister(DEVICE_ADDRESS, XYZ_DATA_CFG, reg_value);
-    return error;
+// Set the oversampling mode used while awake with an enumerated oversampling code
+byte MMA8452Q_Accelerometer::setOversampling(oversampling mode)
+{
+    return writeInStandby(Active_Mode::set(mode));
 }
 
-// Set the high pass filter cutoff frequency with an enumerated filter code
-byte MMA8452Q_Accelerometer::setHighPassCutoff(filter frequency)
+// Watch all three axes for motion with the embedded transient detection
+byte MMA8452Q_Accelerometer::enableMotionDetection(byte threshold, byte count)
 {
-    // Register and error code state
-    byte reg_value, error;
+    // Control register and error code state
+    byte control, error;
 
-    // Save the current settings
-    error = readRegister(DEVICE_ADDRESS, HP_FILTER_CUTOFF, reg_value);
+    // The transient registers can only be changed in standby
+    error = standby(control);
+    if (error != NO_ERROR)
+	return error;
+    error = Transient_Ths::update(Transient_Ths::all(0) | Transient_Threshold::set(threshold));
+    if (error != NO_ERROR)
+	return error;
+    error = Transient_Count::write(count);
     if (error != NO_ERROR)
 	return error;
 
-    // Clear the filter bits
-    reg_value = reg_value & FILTER_MASK;
-    // Set the filter bits
-    reg_value = reg_value | frequency;
-    error = writeRegister(DEVICE_ADDRESS, HP_FILTER_CUTOFF, reg_value);
+    // An event stays in TRANSIENT_SRC until it is read, so none is missed between reads
+    error = Transient_Cfg::update(Transient_Cfg::all(0) | Transient_Axes::set(ALL_AXES) |
+				  Transient_Latch::set(1));
+    if (error != NO_ERROR)
+	return error;
+    detecting = true;
+    transient_source = 0;
+    return resume(control);
+}
+
+// Stop watching for motion
+byte MMA8452Q_Accelerometer::disableMotionDetection()
+{
+    // Error code state
+    byte error;
+
+    error = writeInStandby(Transient_Cfg::all(0));
+    if (error == NO_ERROR)
+	detecting = false;
     return error;
 }
 
+// True if the last read of the output registers found motion since the read before it
+bool MMA8452Q_Accelerometer::moving()
+{
+    return detecting && Transient_Active::get(transient_source);
+}
+
+// Make 'change' to a register that can only be written in standby, putting the device back
+// into active mode afterwards if it was sampling
+template <class Register>
+byte MMA8452Q_Accelerometer::writeInStandby(Register_Change<Register> change)
+{
+    // Control register and error code state
+    byte control, error;
+
+    error = standby(control);
+    if (error != NO_ERROR)
+	return error;
+    error = Register::update(change);
+    if (error != NO_ERROR)
+	return error;
+    return resume(control);
+}
+
 // Read the acceleration of all three axes and store in memory
 byte MMA8452Q_Accelerometer::readData()
 {
     // Error code state
     byte error;
-    // Buffer for the sensor data
-    byte rawData[6];
 
-    // Get acceleration of all 3 axes
-    error = readRegisters(DEVICE_ADDRESS, OUT_X_MSB, 6, rawData);
+    error = requestData();
+    if (error != NO_ERROR)
+	return error;
+    return collectData();
+}
+
+// Choose between reading all axes with a single auto-increment burst (the default) or a
+// separate transaction for every register
+void MMA8452Q_Accelerometer::setReadMode(mode read)
+{
+    read_mode = read;
+}
+
+// Start reading the acceleration of all three axes without waiting for the bus
+byte MMA8452Q_Accelerometer::requestData()
+{
+    // Error code state
+    byte error = NO_ERROR;
+
+    // Whether there was motion is read first, an event latched after it is left for the next
+    // read
+    if (detecting)
+    {
+	error = Transient_Src::request(transient_transaction, 1, &transient_source);
+	if (error != NO_ERROR)
+	    return error;
+    }
+
+    // Get acceleration of all 3 axes in the background
+    if (read_mode == BURST_READ)
+	return Out_X_Msb::request(transactions[0], 6, raw_data);
+
+    // Otherwise queue each output register on its own
+    for(int i = 0; i < 6 ; i++)
+    {
+	error = requestRegisters(transactions[i], DEVICE_ADDRESS, Out_X_Msb::address + i, 1,
+				 &raw_data[i]);
+	if (error != NO_ERROR)
+	    return error;
+    }
+    return error;
+}
+
+// Wait for the reading started by requestData() and store it in memory
+byte MMA8452Q_Accelerometer::collectData()
+{
+    // Error code state
+    byte error = NO_ERROR;
+
+    if (read_mode == BURST_READ)
+	error = twi_queue.wait(transactions[0]);
+    else
+    {
+	for(int i = 0; i < 6 ; i++)
+	{
+	    // Keep the first failure but let the rest of the queued reads drain
+	    if (twi_queue.wait(transactions[i]) != NO_ERROR && error == NO_ERROR)
+		error = transactions[i].status;
+	}
+    }
+    // A failed read of the transient source counts as no motion
+    if (detecting && twi_queue.wait(transient_transaction) != NO_ERROR)
+    {
+	transient_source = 0;
+	if (error == NO_ERROR)
+	    error = transient_transaction.status;
+    }
     // Loop through each axis
     for(int i = 0; i < 6 ; i+=2)
     {
     	// Because the data registers hold only 12 bits and they are set so that the first
     	// register can be used on low resource systems the data is offset by 4 bits, shifting
     	// it to the right makes it aligned at the least significant bit
-    	data[i+1] = (int8_t)rawData[i] >> 4 ;
+    	data[i+1] = (int8_t)raw_data[i] >> 4 ;
     	// Get the low byte
-	data[i] = rawData[i] << 4;
-    	data[i] |= rawData[i+1] >> 4;
+	data[i] = raw_data[i] << 4;
+    	data[i] |= raw_data[i+1] >> 4;
     }
 
     return error;
@@ -19,32 +19,39 @@
 
 // Headers for other tools used within the class
 #include "Arduino.h"
-#include "Wire.h"
 #include "I2C_Tools.h"
+#include "Register_Map.h"
 #include "HardwareSerial.h"
 #include "stdint.h"
 
-#define RANGE_2G 0x00
-#define RANGE_4G 0x01
-#define RANGE_8G 0x02
-
-#define FILTER_16HZ 0x00
-#define FILTER_8HZ 0x01
-#define FILTER_4HZ 0x02
-#define FILTER_2HZ 0x03
-
 class MMA8452Q_Accelerometer {
 // Internal members not used outside the class
 private:
-    byte standby();
-    byte resume();
+    // Standby keeps the control register in 'control' so resume() can put it back
+    byte standby(byte & control);
+    byte resume(byte control);
     byte reset();
+    // Make 'change' to a register that can only be written in standby
+    template <class Register>
+    byte writeInStandby(Register_Change<Register> change);
+
+    // Background reads of the output registers and their raw contents, a burst read uses the
+    // first transaction only
+    TWI_Transaction transactions[6];
+    byte raw_data[6];
+    byte read_mode;
+
+    // Transient detection is on, so each read of the output registers also takes the latched
+    // TRANSIENT_SRC, and its background read and contents
+    bool detecting;
+    TWI_Transaction transient_transaction;
+    byte transient_source;
 	
 // Member functions and enumerations accesible outside the class
 public:
     union
     {
-	int acc[3];
+	int16_t acc[3];
 	byte data[6];
     };
 
@@ -65,6 +72,36 @@ public:
       CUTOFF_2_HZ
     };
 
+    // Register access used to read the axes
+    enum mode
+    {
+      BURST_READ,
+      PER_REGISTER_READ
+    };
+
+    // Output data rate codes, halving from 800 Hz down to 50 Hz and then 12.5, 6.25 and 1.56 Hz
+    enum data_rate
+    {
+      RATE_800_HZ,
+      RATE_400_HZ,
+      RATE_200_HZ,
+      RATE_100_HZ,
+      RATE_50_HZ,
+      RATE_12_5_HZ,
+      RATE_6_25_HZ,
+      RATE_1_56_HZ
+    };
+
+    // Oversampling mode codes, trading noise against supply current. High resolution averages
+    // the most samples at every data rate and low power the fewest.
+    enum oversampling
+    {
+      NORMAL_OVERSAMPLING,
+      LOW_NOISE_LOW_POWER,
+      HIGH_RESOLUTION,
+      LOW_POWER
+    };
+
     // Initialization of the communication and sensor hardware
     byte setup();
 
@@ -88,9 +125,46 @@ public:
     // Set the high pass filter cutoff frequency with an enumerated filter code
     byte setHighPassCutoff(filter frequency); 
 
+    // Set the output data rate with an enumerated data rate code
+    byte setDataRate(data_rate rate);
+
+    // Set the oversampling mode used while awake with an enumerated oversampling code
+    byte setOversampling(oversampling mode);
+
+    // Watch all three axes for motion with the embedded transient detection: a high pass
+    // filtered axis beyond 'threshold' steps of 0.063 g (1 to 127) for 'count' samples at the
+    // data rate. The filter is the one set by setHighPassCutoff() whether or not the output is
+    // filtered. An event is latched until the next read of the output registers, which then
+    // also reads whether there was one.
+    byte enableMotionDetection(byte threshold, byte count);
+
+    // Stop watching for motion
+    byte disableMotionDetection();
+
+    // True if motion detection is on and the last read of the output registers found motion
+    // since the read before it
+    bool moving();
+
+    // Compare the driver's copies of its control registers with the device, REGISTER_MISMATCH
+    // if any differed (the copies then hold what the device has)
+    byte verifyRegisters();
+
+    // Drive the INT1 pin each time a new sample is ready
+    byte enableDataReadyInterrupt();
+
+    // Choose between reading all axes with a single auto-increment burst (the default) or a
+    // separate transaction for every register
+    void setReadMode(mode read);
+
     // Read the acceleration of all three axes and store in memory
     byte readData();
 
+    // Start reading the acceleration of all three axes without waiting for the bus
+    byte requestData();
+
+    // Wait for the reading started by requestData() and store it in memory
+    byte collectData();
+
     // Send the data via a specified serial device in byte sized chuncks with the high byte 
     // followed by the low byte of each axis, 6 bytes in total
     void sendData(HardwareSerial & serial_device, byte delimiter);
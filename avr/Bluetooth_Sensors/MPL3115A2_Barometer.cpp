@@ -1,4 +1,5 @@
 #include "MPL3115A2_Barometer.h"
+#include "Register_Map.h"
 
 // Class to provide and interface for the MPL3115A2 barometric pressure and altitude sensor. 
 // The sensor provides conversion from altitude to pressure.
@@ -6,39 +7,62 @@
 // The slave device address
 #define DEVICE_ADDRESS 0x60
 
-// Register addresses from Freescales Datasheets
-#define STATUS 0x00
-#define OUT_P_MSB 0x01
-#define OUT_P_CSB 0x02
-#define OUT_P_LSB 0x03
-#define OUT_T_MSB 0x04
-#define OUT_T_LSB 0x05
-
-#define WHO_AM_I   0x0C
-
-#define CTRL_REG1 0x26
-#define CTRL_REG2 0x27
-#define CTRL_REG3 0x28
-#define CTRL_REG4 0x29
-#define CTRL_REG5 0x2B
+// Registers from Freescales Datasheets, the configuration registers are cached so changing
+// them is a single write. The reset and one shot bits of CTRL_REG1 clear themselves.
+typedef Device_Register<DEVICE_ADDRESS, 0x00> Status;
+typedef Device_Register<DEVICE_ADDRESS, 0x01> Out_P_Msb;
+typedef Device_Register<DEVICE_ADDRESS, 0x0C> Who_Am_I;
+typedef Cached_Register<DEVICE_ADDRESS, 0x26, 0x06> Ctrl_Reg1;
+typedef Cached_Register<DEVICE_ADDRESS, 0x27> Ctrl_Reg2;
+typedef Cached_Register<DEVICE_ADDRESS, 0x28> Ctrl_Reg3;
+typedef Cached_Register<DEVICE_ADDRESS, 0x29> Ctrl_Reg4;
+typedef Cached_Register<DEVICE_ADDRESS, 0x2A> Ctrl_Reg5;
+typedef Device_Register<DEVICE_ADDRESS, 0x01> F_Data;
+typedef Device_Register<DEVICE_ADDRESS, 0x0D> F_Status;
+typedef Cached_Register<DEVICE_ADDRESS, 0x0F> F_Setup;
+
+// Register fields from Freescales Datasheets
+typedef Register_Field<Ctrl_Reg1, 0> Active;
+typedef Register_Field<Ctrl_Reg1, 1> One_Shot;
+typedef Register_Field<Ctrl_Reg1, 2> Reset;
+typedef Register_Field<Ctrl_Reg1, 3, 3> Oversample;
+typedef Register_Field<Ctrl_Reg1, 7> Altimeter_Mode;
+typedef Register_Field<Ctrl_Reg2, 0, 4> Time_Step;
+// TDR, PDR and PTDR, set by a finished conversion and cleared by reading its output
+typedef Register_Field<Status, 1, 3> Data_Ready;
+typedef Register_Field<F_Status, 0, 6> Fifo_Count;
+typedef Register_Field<F_Status, 7> Fifo_Overflow;
+typedef Register_Field<F_Setup, 0, 6> Fifo_Watermark;
+typedef Register_Field<F_Setup, 6, 2> Fifo_Mode;
 
 // Register constant values from Freescales Datasheets
 //#define WHO_AM_I_VALUE 0x0D
 #define WHO_AM_I_VALUE 0xC4
+#define FIFO_CIRCULAR 0x01
+#define FIFO_DISABLED 0x00
 
-// Bitmasks required to set register values from Freescale Datasheets
-#define ENABLE_FILTER 0x10
-#define ACTIVE 0x01
-#define RESET 0x04
-#define ALTIMETER_MODE 0x80
-
-// Error handeling codes
-#define NO_ERROR 0
-#define BUFFER_SIZE_ERROR 1
-#define ADDRESS_NO_ACKNOWLEDGE 2
-#define DATA_NO_ACKNOWLEDGE 3
-#define TWI_ERROR 4
-#define IDENTIFICATION_FAILURE 5
+// Carry out 'action' on the copy of every cached register, reading them in two bursts
+static uint8_t cacheRegisters(cache_action action)
+{
+    // Contents of CTRL_REG1 to CTRL_REG5 and of F_SETUP
+    uint8_t control[5] = {0, 0, 0, 0, 0}, fifo = 0;
+    uint8_t error = NO_ERROR;
+
+    if (action != CACHE_FORGET) {
+	error = Ctrl_Reg1::readBlock(5, control);
+	if (error == NO_ERROR)
+	    error = F_Setup::readBlock(1, &fifo);
+	if (error != NO_ERROR)
+	    action = CACHE_FORGET;
+    }
+    error = cacheRegister<Ctrl_Reg1>(action, control[0], error);
+    error = cacheRegister<Ctrl_Reg2>(action, control[1], error);
+    error = cacheRegister<Ctrl_Reg3>(action, control[2], error);
+    error = cacheRegister<Ctrl_Reg4>(action, control[3], error);
+    error = cacheRegister<Ctrl_Reg5>(action, control[4], error);
+    error = cacheRegister<F_Setup>(action, fifo, error);
+    return error;
+}
 
 // Initialization of the communication and sensor hardware
 uint8_t MPL3115A2_Barometer::setup()
@@ -48,10 +72,16 @@ uint8_t MPL3115A2_Barometer::setup()
     uint8_t reg_value, error;
     
     // Start the I2C connection
-    Wire.begin();
+    twi_queue.begin();
+
+    // A one shot write still on the bus finishes before the device is reset, the sensor is
+    // left converting continuously
+    twi_queue.wait(conversion_transaction);
+    one_shot = false;
+    converting = false;
 
     // Get the devices identity
-    error = readRegister(DEVICE_ADDRESS, WHO_AM_I, reg_value);
+    error = Who_Am_I::read(reg_value);
     if (error != NO_ERROR)
 	return error;
 
@@ -62,114 +92,350 @@ uint8_t MPL3115A2_Barometer::setup()
 	return error;
     }
 
-    // Reset the registers to default
+    // Reset the registers to default, which leaves the sampling hardware powered down
     error = reset();
     if (error != NO_ERROR)
     	return error;
 
-    // Power down the sampling hardware
-    error = standby();
+    // Set the output to altitude instead of pressure and resume the sampling, the rest of the
+    // register is at its default after the reset so it is written without reading it
+    error = Ctrl_Reg1::update(Ctrl_Reg1::all(0) | Altimeter_Mode::set(1) | Active::set(1));
     if (error != NO_ERROR)
     	return error;
 
-    // Set the output to altitude instead of pressure
-    reg_value = ALTIMETER_MODE | ACTIVE;
-    error = writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-    	return error;
-
-    // Resume the sampling
-    error = resume();
+    // Copy the registers so every later change is a single write
+    error = cacheRegisters(CACHE_LOAD);
     return error;
 }
 
-// Turn on the sampling hardware
-uint8_t MPL3115A2_Barometer::resume()
+// Compare the driver's copies of its control registers with the device, REGISTER_MISMATCH
+// if any differed (the copies then hold what the device has)
+uint8_t MPL3115A2_Barometer::verifyRegisters()
 {
-    // Register and error code state
-    uint8_t reg_value, error;
+    return cacheRegisters(CACHE_VERIFY);
+}
+
+// Put the sampling hardware in standby if it is sampling, keeping the control register it had
+// in 'control' for resume()
+uint8_t MPL3115A2_Barometer::standby(uint8_t & control)
+{
+    // Error code state
+    uint8_t error;
 
     // Save the other settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
+    error = Ctrl_Reg1::read(control);
+    if (error != NO_ERROR || !Active::get(control))
 	return error;
 
-    // Set the active bit high
-    reg_value = reg_value | ACTIVE;
-    error =  writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    return error;
+    // Set the active bit low
+    return Ctrl_Reg1::write(control & ~Active::mask);
+}
+
+// Turn the sampling hardware back on if it was on when standby() saved 'control'
+uint8_t MPL3115A2_Barometer::resume(uint8_t control)
+{
+    if (!Active::get(control))
+	return NO_ERROR;
+    return Ctrl_Reg1::write(control);
 }
 
 
 // Reset the registers to default state
 uint8_t MPL3115A2_Barometer::reset()
 {
-    // Register and error code state
-    uint8_t reg_value, error;
+    // Error code state
+    uint8_t error;
 
-    // Save the other settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
-    if (error != NO_ERROR)
-	return error;
-
-    // Set the reset bit high, this will automatically clear
-    reg_value = reg_value | RESET;
-    error =  writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    // Set the reset bit high, this will automatically clear. Every other setting is lost so
+    // the register is written without reading it.
+    error = Ctrl_Reg1::update(Ctrl_Reg1::all(0) | Reset::set(1));
 
     // The sensor resets before the connection is closed so handle the error here
-    if (error == 3)
-	error = 0;
+    if (error == DATA_NO_ACKNOWLEDGE)
+	error = NO_ERROR;
     else
 	return error;
 
+    // Every register is back at its power on value
+    cacheRegisters(CACHE_FORGET);
+
     // This sensor needs time to reset
     delay(5);
     return error;
 }
 
-// Power down the sampling hardware
-uint8_t MPL3115A2_Barometer::standby()
+// Change the 'mask' bits of CTRL_REG1 to 'bits' with the sampling hardware off
+uint8_t MPL3115A2_Barometer::changeControl(uint8_t mask, uint8_t bits)
 {
-    // Register and error code state
-    uint8_t reg_value, error;
+    // Control register and error code state
+    uint8_t control, error;
 
-    // Save the other settings
-    error = readRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value);
+    // The settings are changed and the hardware turned back on with the same write
+    error = standby(control);
     if (error != NO_ERROR)
 	return error;
+    return Ctrl_Reg1::write((control & ~mask) | (bits & mask));
+}
 
-    // Set the active bit low
-    reg_value = reg_value & ~ACTIVE;
-    return writeRegister(DEVICE_ADDRESS, CTRL_REG1, reg_value); 
+// Set the oversampling ratio with an enumerated oversample code
+uint8_t MPL3115A2_Barometer::setOversampling(oversample ratio)
+{
+    return changeControl(Oversample::mask, Oversample::set(ratio).bits);
+}
+
+// Output altitude or pressure
+uint8_t MPL3115A2_Barometer::setOutput(output measurement)
+{
+    return changeControl(Altimeter_Mode::mask,
+			 Altimeter_Mode::set(measurement == ALTIMETER_OUTPUT).bits);
+}
+
+// Leave the sampling hardware off between conversions and convert once for each
+// startConversion()
+uint8_t MPL3115A2_Barometer::enableOneShot()
+{
+    // Control register and error code state
+    uint8_t control, error;
+
+    error = standby(control);
+    if (error != NO_ERROR)
+	return error;
+    one_shot = true;
+    converting = false;
+    return startConversion();
+}
+
+// Convert continuously on the sensor's own time step
+uint8_t MPL3115A2_Barometer::disableOneShot()
+{
+    // Let the last one shot write finish before the register is written again
+    twi_queue.wait(conversion_transaction);
+    one_shot = false;
+    converting = false;
+    return changeControl(Active::mask, Active::set(1).bits);
+}
+
+// Start a one shot conversion in the background
+uint8_t MPL3115A2_Barometer::startConversion()
+{
+    // Control register and error code state
+    uint8_t control, error;
+
+    // The write starting the last conversion has to be off the queue before it is reused, and
+    // a write that failed started nothing
+    if (!conversion_transaction.complete())
+	return NO_ERROR;
+    if (converting && conversion_transaction.status == NO_ERROR)
+	return NO_ERROR;
+
+    // The one shot bit clears itself when the conversion is done so it is not kept in the copy
+    // of the register
+    error = Ctrl_Reg1::read(control);
+    if (error != NO_ERROR)
+	return error;
+    conversion_control = control | One_Shot::set(1).bits;
+    conversion_transaction.setWrite(DEVICE_ADDRESS, Ctrl_Reg1::address, 1,
+				    &conversion_control);
+    converting = true;
+    return twi_queue.submit(conversion_transaction);
 }
 
 // Read and store the altitude and temperature data
 uint8_t MPL3115A2_Barometer::readData()
 {
-    // Register and error code state
-    uint8_t error, reg_value;
+    // Error code state
+    uint8_t error;
+
+    error = requestData();
+    if (error != NO_ERROR)
+	return error;
+    return collectData();
+}
+
+// Choose between reading the pressure and temperature with a single burst (the default) or a
+// separate transaction for every register
+void MPL3115A2_Barometer::setReadMode(mode read)
+{
+    read_mode = read;
+}
 
-    // Loop through each axis using sequential byte offsets from the first axis high byte
-    // The I2C implimentation is not compatible with Wirings buffered readRegister() function
-    for(int i = 0; i < 5 ; i++)
+// Start reading the altitude and temperature data without waiting for the bus
+uint8_t MPL3115A2_Barometer::requestData()
+{
+    // Error code state
+    uint8_t error = NO_ERROR;
+
+    // The sensor steps through the status, pressure and temperature registers on its own so
+    // all six bytes come back in one transaction
+    if (read_mode == BURST_READ)
+	return Status::request(transactions[0], 6, raw_data);
+
+    // Otherwise queue each register on its own
+    for (uint8_t i = 0; i < 6; i++)
     {
-	error = readRegister(DEVICE_ADDRESS, OUT_P_MSB + i , reg_value);
-	if (error != 0)
+	error = requestRegisters(transactions[i], DEVICE_ADDRESS, Status::address + i, 1,
+				 &raw_data[i]);
+	if (error != NO_ERROR)
 	    return error;
-    	data[i] = reg_value;
     }
+    return error;
+}
+
+// Wait for the reading started by requestData() and store it in memory
+uint8_t MPL3115A2_Barometer::collectData()
+{
+    // Error code state
+    uint8_t error = NO_ERROR;
+
+    if (read_mode == BURST_READ)
+	error = twi_queue.wait(transactions[0]);
+    else
+    {
+	for (uint8_t i = 0; i < 6; i++)
+	{
+	    // Keep the first failure but let the rest of the queued reads drain
+	    if (twi_queue.wait(transactions[i]) != NO_ERROR && error == NO_ERROR)
+		error = transactions[i].status;
+	}
+    }
+    if (error != NO_ERROR)
+    {
+	status = 0;
+	return error;
+    }
+
+    // A conversion still under way leaves the last one in the data members
+    status = raw_data[0];
+    if (newData())
+    {
+	storeSample(raw_data + 1);
+	converting = false;
+    }
+    if (one_shot)
+	error = startConversion();
+    return error;
+}
+
+// True if the last read of the output registers found a conversion not read before
+bool MPL3115A2_Barometer::newData()
+{
+    return Data_Ready::get(status) != 0;
+}
+
+// Order and align a raw 5 byte sample into the data members
+void MPL3115A2_Barometer::storeSample(const uint8_t * raw)
+{
     // AVR architecture is little endian, but the sensor values are big endian
     // this operation switches them for the multibyte altitude
-    uint8_t temp;
-    temp = data[0];
-    data[0] = data[1];
-    data[1] = temp;
+    data[0] = raw[1];
+    data[1] = raw[0];
+    data[2] = raw[2];
+    data[3] = raw[3];
+    data[4] = raw[4];
     // Shift the fractional bits over so they are aligned with the start of the byte
     pressure_frac >>= 4;
     temperature_frac >>= 4;
+}
+
+// Buffer samples on the sensor, taken every 2^time_step seconds, to be collected in bulk
+// with requestFIFO() and collectFIFO()
+uint8_t MPL3115A2_Barometer::enableFIFO(uint8_t time_step)
+{
+    // Control register and error code state
+    uint8_t control, error;
+
+    // The FIFO can only be configured while the sampling hardware is off
+    error = standby(control);
+    if (error != NO_ERROR)
+	return error;
+
+    // Set the automatic acquisition time step that fills the FIFO
+    error = Time_Step::write(time_step);
+    if (error != NO_ERROR)
+	return error;
+
+    // Keep the newest samples if the FIFO fills before it is drained
+    error = F_Setup::update(Fifo_Mode::set(FIFO_CIRCULAR) | Fifo_Watermark::set(0));
+    if (error != NO_ERROR)
+	return error;
+
+    fifo_waiting = 0;
+    fifo_count = 0;
+    return resume(control);
+}
+
+// Return to reading the output registers directly
+uint8_t MPL3115A2_Barometer::disableFIFO()
+{
+    // Control register and error code state
+    uint8_t control, error;
+
+    error = standby(control);
+    if (error != NO_ERROR)
+	return error;
+
+    error = F_Setup::update(Fifo_Mode::set(FIFO_DISABLED) | Fifo_Watermark::set(0));
+    if (error != NO_ERROR)
+	return error;
+
+    fifo_waiting = 0;
+    fifo_count = 0;
+    return resume(control);
+}
+
+// Start reading the samples the FIFO held at the last drain, along with its status
+uint8_t MPL3115A2_Barometer::requestFIFO()
+{
+    // Error code state
+    uint8_t error;
+
+    // Samples are only read if the last status said they were there, so both reads can be
+    // queued at once without waiting on the status first
+    fifo_count = fifo_waiting;
+    if (fifo_count > MPL3115A2_FIFO_DEPTH)
+	fifo_count = MPL3115A2_FIFO_DEPTH;
+    if (fifo_count != 0)
+    {
+	error = F_Data::request(fifo_transaction, fifo_count * 5, fifo_data);
+	if (error != NO_ERROR)
+	    return error;
+    }
+    return F_Status::request(fifo_status_transaction, 1, &fifo_status);
+}
+
+// Wait for the drain started by requestFIFO(), fifo_count samples are then available
+uint8_t MPL3115A2_Barometer::collectFIFO()
+{
+    // Error code state
+    uint8_t error = NO_ERROR;
+
+    if (fifo_count != 0)
+    {
+	error = twi_queue.wait(fifo_transaction);
+	if (error != NO_ERROR)
+	    fifo_count = 0;
+    }
+
+    if (twi_queue.wait(fifo_status_transaction) != NO_ERROR)
+    {
+	fifo_waiting = 0;
+	return error != NO_ERROR ? error : fifo_status_transaction.status;
+    }
+
+    // Remember what is left for the next drain and count any lost samples
+    fifo_waiting = Fifo_Count::get(fifo_status);
+    if (Fifo_Overflow::get(fifo_status))
+	fifo_overflows += 1;
     return error;
 }
 
+// Place a drained FIFO sample in the altitude and temperature data members
+void MPL3115A2_Barometer::loadFIFOSample(uint8_t index)
+{
+    if (index < fifo_count)
+	storeSample(&fifo_data[index * 5]);
+}
+
 // Send the altitude and temperature data with the specified serial device in byte sized
 // chuncks with a format of altitude integer high and low bytes, altitude fractional byte
 // termperature integer byte and temperature fractional byte (the fractional bytes are in
@@ -13,6 +13,13 @@
 
 // Class to provide and interface for the MPL3115A2 barometric pressure and altitude sensor. 
 // The sensor provides conversion from altitude to pressure.
+//
+// The sensor converts continuously on its own time step, or once for each startConversion()
+// in one shot mode, averaging 2^n samples into each conversion for the oversampling code n.
+// Reads of the output registers take the data ready status with them, so a conversion still
+// under way is never waited for: the output is only stored, and newData() only true, once a
+// new conversion has finished. In one shot mode collectData() starts the next conversion in
+// the background as soon as one has been collected.
 
 // Compiler directive to make sure the class has not already been defined
 #ifndef MPL3115A2_BAROMETER
@@ -20,17 +27,47 @@
 
 // Headers for other tools used within the class
 #include "Arduino.h"
-#include "Wire.h"
 #include "I2C_Tools.h"
 #include "stdint.h"
 
+// Most samples taken from the on-chip FIFO in one transaction, each sample costs 5 bytes
+#define MPL3115A2_FIFO_DEPTH 8
+
 
 class MPL3115A2_Barometer{
 // Internal members not used outside the class
 private:
-    uint8_t standby();
-    uint8_t resume();
+    // Standby keeps the control register in 'control' so resume() can put it back
+    uint8_t standby(uint8_t & control);
+    uint8_t resume(uint8_t control);
     uint8_t reset();
+    // Change the 'mask' bits of CTRL_REG1 to 'bits' with the sampling hardware off, turning it
+    // back on after if it was on
+    uint8_t changeControl(uint8_t mask, uint8_t bits);
+
+    // Background reads of the status and output registers and their raw contents, a burst read
+    // uses the first transaction only
+    TWI_Transaction transactions[6];
+    uint8_t raw_data[6];
+    uint8_t read_mode;
+
+    // Background write of CTRL_REG1 starting a one shot conversion, and the value written
+    TWI_Transaction conversion_transaction;
+    uint8_t conversion_control;
+    // Converting once per startConversion(), and whether a conversion has been started and
+    // not collected yet
+    bool one_shot;
+    bool converting;
+
+    // Background reads of the FIFO samples and its status, and their raw contents
+    TWI_Transaction fifo_transaction, fifo_status_transaction;
+    uint8_t fifo_data[MPL3115A2_FIFO_DEPTH * 5];
+    uint8_t fifo_status;
+    // Samples known to be waiting in the FIFO from the last status read
+    uint8_t fifo_waiting;
+
+    // Order and align a raw 5 byte sample into the data members
+    void storeSample(const uint8_t * raw);
 
 // Member functions and enumerations accesible outside the class
 public:
@@ -46,12 +83,100 @@ public:
 	char data[6];
     };
     
+    // Register access used to read the pressure and temperature
+    enum mode
+    {
+      BURST_READ,
+      PER_REGISTER_READ
+    };
+
+    // Oversampling ratio codes, the samples averaged into each conversion. The conversion
+    // takes from about 6 ms at OVERSAMPLE_1 to 512 ms at OVERSAMPLE_128.
+    enum oversample
+    {
+      OVERSAMPLE_1,
+      OVERSAMPLE_2,
+      OVERSAMPLE_4,
+      OVERSAMPLE_8,
+      OVERSAMPLE_16,
+      OVERSAMPLE_32,
+      OVERSAMPLE_64,
+      OVERSAMPLE_128
+    };
+
+    // What the pressure data members hold: altitude in meters as a signed 16.4 fixed point
+    // number, or pressure in Pascals as an unsigned 18.2 fixed point number with the top 16
+    // bits in 'pressure' and the low 4 bits of 'pressure_frac' holding the rest
+    enum output
+    {
+      ALTIMETER_OUTPUT,
+      BAROMETER_OUTPUT
+    };
+
+    // Contents of DR_STATUS read along with the last output registers
+    uint8_t status;
+
     // Initialization of the communication and sensor hardware
     uint8_t setup();
 
+    // Set the oversampling ratio with an enumerated oversample code
+    uint8_t setOversampling(oversample ratio);
+
+    // Output altitude or pressure
+    uint8_t setOutput(output measurement);
+
+    // Leave the sampling hardware off between conversions and convert once for each
+    // startConversion(), the first is started here
+    uint8_t enableOneShot();
+
+    // Convert continuously on the sensor's own time step
+    uint8_t disableOneShot();
+
+    // Start a one shot conversion in the background, nothing is done while one is under way
+    uint8_t startConversion();
+
+    // True if the last read of the output registers found a conversion not read before
+    bool newData();
+
     // Read and store the altitude and temperature data
     uint8_t readData();
 
+    // Start reading the altitude and temperature data without waiting for the bus
+    uint8_t requestData();
+
+    // Wait for the reading started by requestData() and store it in memory if it is new, in
+    // one shot mode the next conversion is then started
+    uint8_t collectData();
+
+    // Choose between reading the pressure and temperature with a single burst (the default)
+    // or a separate transaction for every register
+    void setReadMode(mode read);
+
+    // Compare the driver's copies of its control registers with the device, REGISTER_MISMATCH
+    // if any differed (the copies then hold what the device has)
+    uint8_t verifyRegisters();
+
+    // Number of samples held from the last FIFO drain, and the number of times the FIFO
+    // filled and lost samples before it was drained
+    uint8_t fifo_count;
+    uint16_t fifo_overflows;
+
+    // Buffer samples on the sensor, taken every 2^time_step seconds, to be collected in bulk
+    // with requestFIFO() and collectFIFO()
+    uint8_t enableFIFO(uint8_t time_step);
+
+    // Return to reading the output registers directly
+    uint8_t disableFIFO();
+
+    // Start reading the samples the FIFO held at the last drain, along with its status
+    uint8_t requestFIFO();
+
+    // Wait for the drain started by requestFIFO(), fifo_count samples are then available
+    uint8_t collectFIFO();
+
+    // Place a drained FIFO sample in the altitude and temperature data members
+    void loadFIFOSample(uint8_t index);
+
     // Send the altitude and temperature data with the specified serial device in byte sized
     // chuncks with a format of altitude integer high and low bytes, altitude fractional byte
     // termperature integer byte and temperature fractional byte (the fractional bytes are in
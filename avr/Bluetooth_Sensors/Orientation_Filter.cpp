@@ -0,0 +1,215 @@
+// Fixed point Mahony orientation filter, shared by the firmware and the host tools
+
+#include <stdlib.h>
+#include "Orientation_Filter.h"
+
+#define PI_F 3.14159265f
+
+// Accelerometer magnitude squared window in counts^2 that the estimate is steered in, 0.8 g
+// to 1.2 g
+#define GRAVITY_LOW ((16L << (2 * ORIENTATION_ONE_G_SHIFT)) / 25)
+#define GRAVITY_HIGH ((36L << (2 * ORIENTATION_ONE_G_SHIFT)) / 25)
+
+// Largest integral, a bias of 11 dps at 400 Hz
+#define INTEGRAL_MAX (1L << 30)
+
+#define HALF_ANGLE_MAX 32767
+
+// Round a positive gain to 16 bits, returns false if it does not fit
+static bool toGain(float value, uint16_t & gain)
+{
+    if (value < 0 || value > 65535)
+	return false;
+    gain = (uint16_t)(value + 0.5f);
+    return true;
+}
+
+static int16_t saturate(int32_t value)
+{
+    if (value > HALF_ANGLE_MAX)
+	return HALF_ANGLE_MAX;
+    if (value < -HALF_ANGLE_MAX)
+	return -HALF_ANGLE_MAX;
+    return value;
+}
+
+Orientation_Filter::Orientation_Filter()
+{
+    rate_gain = 0;
+    kp = 0;
+    ki = 0;
+    reset();
+}
+
+// Set the update rate, gyroscope full scale and gains
+bool Orientation_Filter::setup(uint16_t rate, uint16_t full_scale, float kp, float ki)
+{
+    // Radians per count over half an update
+    float half_step = full_scale * PI_F / 180 / 32768 / 2 / rate;
+    uint16_t gains[3];
+    if (!toGain(half_step * 65536.0f * 4194304.0f, gains[0]) ||
+	!toGain(kp / 2 / rate * 16777216.0f, gains[1]) ||
+	!toGain(ki / 2 / rate / rate * 268435456.0f, gains[2]))
+	return false;
+    rate_gain = gains[0];
+    this->kp = gains[1];
+    this->ki = gains[2];
+    return true;
+}
+
+// Go back to level with no bias estimate
+void Orientation_Filter::reset()
+{
+    q[0] = 1L << 30;
+    for (uint8_t i = 0; i < 3; ++i) {
+	q[i + 1] = 0;
+	integral[i] = 0;
+	residual[i] = 0;
+    }
+    corrected = 0;
+    updates = 0;
+}
+
+// Take one reading of each sensor
+void Orientation_Filter::update(const int16_t * acc, const int16_t * gyro)
+{
+    // The quaternion in Q14 for the multiplies
+    int16_t s[4];
+    for (uint8_t i = 0; i < 4; ++i)
+	s[i] = (q[i] + 0x8000) >> 16;
+
+    // Half angle turned about each axis, the fraction of a step rounded off is carried to the
+    // next update so a steady rate does not drift
+    int32_t h[3];
+    for (uint8_t i = 0; i < 3; ++i) {
+	int32_t step = (int32_t)gyro[i] * rate_gain + residual[i];
+	h[i] = step >> 16;
+	residual[i] = step;
+    }
+
+    int32_t norm = (int32_t)acc[0] * acc[0] + (int32_t)acc[1] * acc[1] +
+	(int32_t)acc[2] * acc[2];
+    if (norm > GRAVITY_LOW && norm < GRAVITY_HIGH) {
+	// One Newton step for 1 / |a| from 1 g, (3 - |a|^2) / 2 is within 6 % over the window
+	// and that only scales the gains
+	uint16_t inverse = ((3L << (2 * ORIENTATION_ONE_G_SHIFT)) - norm) >>
+	    (2 * ORIENTATION_ONE_G_SHIFT - 14);
+	int16_t a[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	    a[i] = ((int32_t)acc[i] * inverse) >> (ORIENTATION_ONE_G_SHIFT + 1);
+
+	// Gravity direction in the board frame from the estimate
+	int16_t v[3];
+	v[0] = ((int32_t)s[1] * s[3] - (int32_t)s[0] * s[2]) >> 13;
+	v[1] = ((int32_t)s[0] * s[1] + (int32_t)s[2] * s[3]) >> 13;
+	v[2] = ((int32_t)s[0] * s[0] - (int32_t)s[1] * s[1] - (int32_t)s[2] * s[2] +
+		(int32_t)s[3] * s[3]) >> 14;
+
+	// Turn the estimate towards the measured direction
+	int16_t e[3];
+	e[0] = ((int32_t)a[1] * v[2] - (int32_t)a[2] * v[1]) >> 14;
+	e[1] = ((int32_t)a[2] * v[0] - (int32_t)a[0] * v[2]) >> 14;
+	e[2] = ((int32_t)a[0] * v[1] - (int32_t)a[1] * v[0]) >> 14;
+	for (uint8_t i = 0; i < 3; ++i) {
+	    integral[i] += (int32_t)e[i] * ki;
+	    if (integral[i] > INTEGRAL_MAX)
+		integral[i] = INTEGRAL_MAX;
+	    else if (integral[i] < -INTEGRAL_MAX)
+		integral[i] = -INTEGRAL_MAX;
+	    h[i] += ((int32_t)e[i] * kp) >> 16;
+	}
+	corrected += 1;
+    }
+
+    int16_t r[3];
+    for (uint8_t i = 0; i < 3; ++i)
+	r[i] = saturate(h[i] + (integral[i] >> 20));
+
+    // q += q * (0, r), Q14 by Q22 products rounded to Q30
+    int32_t d[4];
+    d[0] = -(int32_t)s[1] * r[0] - (int32_t)s[2] * r[1] - (int32_t)s[3] * r[2];
+    d[1] = (int32_t)s[0] * r[0] + (int32_t)s[2] * r[2] - (int32_t)s[3] * r[1];
+    d[2] = (int32_t)s[0] * r[1] - (int32_t)s[1] * r[2] + (int32_t)s[3] * r[0];
+    d[3] = (int32_t)s[0] * r[2] + (int32_t)s[1] * r[1] - (int32_t)s[2] * r[0];
+    for (uint8_t i = 0; i < 4; ++i)
+	q[i] += (d[i] + 32) >> 6;
+
+    // Normalize with the first order step q += q (1 - |q|^2) / 2
+    int32_t error = 1L << 28;
+    for (uint8_t i = 0; i < 4; ++i) {
+	s[i] = (q[i] + 0x8000) >> 16;
+	error -= (int32_t)s[i] * s[i];
+    }
+    int16_t scale = error >> 13;
+    for (uint8_t i = 0; i < 4; ++i)
+	q[i] += (int32_t)s[i] * scale;
+    updates += 1;
+}
+
+// The orientation as w, x, y and z, Q14
+void Orientation_Filter::quaternion(int16_t * out) const
+{
+    for (uint8_t i = 0; i < 4; ++i)
+	out[i] = (q[i] + 0x8000) >> 16;
+}
+
+// Write the compact quaternion. The largest component is left out and the other three, each
+// within 1 / sqrt(2), are written doubled with the place of the one left out in the low bits
+// of the first two.
+void Orientation_Filter::compact(uint8_t * out) const
+{
+    int16_t s[4];
+    quaternion(s);
+    uint8_t largest = 0;
+    for (uint8_t i = 1; i < 4; ++i)
+	if (abs(s[i]) > abs(s[largest]))
+	    largest = i;
+    uint8_t index = 0;
+    for (uint8_t i = 0; i < 4; ++i) {
+	if (i == largest)
+	    continue;
+	// q and -q are the same rotation, send the one with the left out component positive
+	int16_t value = s[largest] < 0 ? -s[i] : s[i];
+	uint16_t bits = ((uint16_t)value << 1) | ((largest >> index) & 1);
+	out[2 * index] = bits;
+	out[2 * index + 1] = bits >> 8;
+	index += 1;
+    }
+}
+
+// Integer square root of a 32 bit value
+static uint16_t squareRoot(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value)
+	bit >>= 2;
+    while (bit) {
+	if (value >= root + bit) {
+	    value -= root + bit;
+	    root = (root >> 1) + bit;
+	}
+	else
+	    root >>= 1;
+	bit >>= 2;
+    }
+    return root;
+}
+
+// Rebuild w, x, y and z from a compact quaternion
+void expandQuaternion(const uint8_t * compact, int16_t * out)
+{
+    int16_t values[3];
+    for (uint8_t i = 0; i < 3; ++i)
+	values[i] = (int16_t)(compact[2 * i] | (compact[2 * i + 1] << 8));
+    uint8_t largest = (values[0] & 1) | ((values[1] & 1) << 1);
+    int32_t rest = 1L << 28;
+    uint8_t index = 0;
+    for (uint8_t i = 0; i < 4; ++i) {
+	if (i == largest)
+	    continue;
+	out[i] = values[index++] >> 1;
+	rest -= (int32_t)out[i] * out[i];
+    }
+    out[largest] = rest > 0 ? squareRoot(rest) : 0;
+}
@@ -0,0 +1,90 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Mahony complementary filter estimating the board orientation from the accelerometer and
+// gyroscope counts, in fixed point so it keeps up with the gyroscope on the ATmega328. The
+// gyroscope rates are integrated into a quaternion and the cross product of the measured and
+// estimated gravity directions steers it back, in proportion and through an integral that
+// learns the gyroscope bias. Yaw has nothing to steer it and drifts with the remaining bias.
+// Shared by the firmware and the host tools, which run the same code for accuracy tests.
+//
+// Fixed point formats, Qn holding n fraction bits:
+//   quaternion          int32_t Q30, read out as int16_t Q14
+//   rotation per update int16_t Q22 half angle in radians
+//   gravity directions  int16_t Q14
+// Every multiply in an update is 16 by 16 bits into 32, which the AVR does in hardware.
+// The gyroscope and accelerometer axes are taken to be aligned.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef ORIENTATION_FILTER
+#define ORIENTATION_FILTER
+
+#include <stdint.h>
+
+// Accelerometer counts in 1 g as a power of two, 1024 for the MMA8452Q in 2 g mode
+#define ORIENTATION_ONE_G_SHIFT 10
+
+// Lowest gyroscope rate in Hz the half angle per update can be held at for 250 dps full scale
+#define ORIENTATION_RATE_MIN 280
+
+// Default proportional and integral gains, in 1/s and 1/s^2
+#define ORIENTATION_KP 1.0f
+#define ORIENTATION_KI 0.05f
+
+// Bytes of the compact quaternion, the three smallest components as little endian Q14 values
+// shifted up a bit, with the place of the largest in the low bits of the first two. The largest
+// is rebuilt from the unit length and the sign that makes it positive.
+#define ORIENTATION_COMPACT_SIZE 6
+
+class Orientation_Filter {
+// Internal members not used outside the class
+private:
+    int32_t q[4];
+    // Gyroscope counts to half angle per update, Q16
+    uint16_t rate_gain;
+    // Error to half angle per update, Q24, and to integral per update, Q28
+    uint16_t kp, ki;
+    // Integral of the error, the gyroscope bias correction as a Q42 half angle per update
+    int32_t integral[3];
+    // Fractions of a Q22 step left over from the last update, Q38
+    uint16_t residual[3];
+
+// Member functions accesible outside the class
+public:
+    // Updates that had the accelerometer in the 0.8 g to 1.2 g window and steered the estimate
+    uint32_t corrected;
+    uint32_t updates;
+
+    Orientation_Filter();
+
+    // Set the update rate in Hz, the gyroscope full scale in degrees per second and the gains,
+    // returns false and keeps the gains it had if the rate is too slow to hold a full scale
+    // rotation per update or a gain is too large for its fixed point format
+    bool setup(uint16_t rate, uint16_t full_scale = 250, float kp = ORIENTATION_KP,
+	       float ki = ORIENTATION_KI);
+
+    // Go back to level with no bias estimate
+    void reset();
+
+    // Take one reading of each sensor, counts as the drivers hold them
+    void update(const int16_t * acc, const int16_t * gyro);
+
+    // The orientation as w, x, y and z, Q14
+    void quaternion(int16_t * out) const;
+
+    // Write the compact quaternion, ORIENTATION_COMPACT_SIZE bytes
+    void compact(uint8_t * out) const;
+};
+
+// Rebuild w, x, y and z (Q14) from a compact quaternion
+void expandQuaternion(const uint8_t * compact, int16_t * out);
+
+#endif
@@ -0,0 +1,72 @@
+// Shadow copies of cached device registers, shared by every Cached_Register
+
+#include "Register_Map.h"
+
+// Take 'value' read from the device as the copy, REGISTER_MISMATCH if there was a copy and it
+// differed
+uint8_t takeCached(Register_Cache & cache, uint8_t volatile_bits, uint8_t value)
+{
+    value &= ~volatile_bits;
+    uint8_t error = cache.loaded && value != cache.shadow ? REGISTER_MISMATCH : NO_ERROR;
+    cache.shadow = value;
+    cache.loaded = true;
+    return error;
+}
+
+// Take the copy from the device, a failed read leaves no copy
+uint8_t loadCached(Register_Cache & cache, uint8_t device, uint8_t address, uint8_t volatile_bits)
+{
+    uint8_t value, error;
+    error = readRegister(device, address, value);
+    if (error != NO_ERROR) {
+	cache.loaded = false;
+	return error;
+    }
+    return takeCached(cache, volatile_bits, value);
+}
+
+// Read the register from the copy, loading it first if there is none yet
+uint8_t readCached(Register_Cache & cache, uint8_t device, uint8_t address, uint8_t volatile_bits,
+		   uint8_t & value)
+{
+    uint8_t error = NO_ERROR;
+    if (!cache.loaded || REGISTER_VERIFY)
+	error = loadCached(cache, device, address, volatile_bits);
+    value = cache.shadow;
+    return error;
+}
+
+// Write the whole register and keep what was written as the copy when the write succeeded
+uint8_t writeCached(Register_Cache & cache, uint8_t device, uint8_t address,
+		    uint8_t volatile_bits, uint8_t value)
+{
+    uint8_t error = writeRegister(device, address, value);
+    cache.shadow = value & ~volatile_bits;
+    cache.loaded = error == NO_ERROR;
+    return error;
+}
+
+// Give the 'mask' bits the values in 'bits' with one write, from the copy of the rest
+uint8_t updateCached(Register_Cache & cache, uint8_t device, uint8_t address,
+		     uint8_t volatile_bits, uint8_t mask, uint8_t bits)
+{
+    uint8_t error;
+    if (mask != 0xFF && (!cache.loaded || REGISTER_VERIFY)) {
+	error = loadCached(cache, device, address, volatile_bits);
+	if (error != NO_ERROR)
+	    return error;
+    }
+    return writeCached(cache, device, address, volatile_bits,
+		       (cache.shadow & ~mask) | (bits & mask));
+}
+
+uint8_t cacheRegister(cache_action action, Register_Cache & cache, uint8_t volatile_bits,
+		      uint8_t value, uint8_t error)
+{
+    uint8_t result = NO_ERROR;
+    if (action != CACHE_VERIFY)
+	cache.loaded = false;
+    if (action != CACHE_FORGET)
+	result = takeCached(cache, volatile_bits, value);
+    return error != NO_ERROR ? error : result;
+}
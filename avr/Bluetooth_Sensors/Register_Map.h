@@ -0,0 +1,218 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Compile time map of the registers of an I2C device. A register is a type carrying the device
+// and register addresses and a field is a type carrying its register, position and width, so
+// every access inlines to a call of the I2C_Tools functions with constant arguments and the
+// masks and shifts are folded away by the compiler. Changes to fields of the same register are
+// combined with | and made with one read-modify-write, and a register is not read at all when
+// every one of its bits is being written. Combining fields of different registers does not
+// compile. A control register can instead be a Cached_Register, which keeps a shadow copy of
+// its contents on the AVR so reading it costs no bus time and changing some of its bits is a
+// single write.
+//
+//     typedef Cached_Register<0x1D, 0x2A> Ctrl_Reg1;
+//     typedef Register_Field<Ctrl_Reg1, 0> Active;
+//     typedef Register_Field<Ctrl_Reg1, 3, 3> Data_Rate;
+//
+//     error = Ctrl_Reg1::update(Active::set(0) | Data_Rate::set(1));
+
+// Compiler directive to make sure the templates have not already been defined
+#ifndef REGISTER_MAP
+#define REGISTER_MAP
+
+#include "I2C_Tools.h"
+#include "stdint.h"
+
+// Set to 1 to check the shadow copy of a cached register against the device every time it is
+// read or changed, a difference is reported as REGISTER_MISMATCH. Every access then costs the
+// bus read the copy saves, so this is for testing drivers only.
+#ifndef REGISTER_VERIFY
+#define REGISTER_VERIFY 0
+#endif
+
+// Bits of 'Register' to change and the values to give them
+template <class Register>
+struct Register_Change
+{
+    uint8_t mask;
+    uint8_t bits;
+
+    Register_Change(uint8_t change_mask, uint8_t change_bits)
+	: mask(change_mask), bits(change_bits) {}
+
+    // Both changes at once, the right hand one wins where they overlap
+    Register_Change operator|(const Register_Change & other) const
+    {
+	return Register_Change(mask | other.mask, (bits & ~other.mask) | other.bits);
+    }
+};
+
+// Register 'Address' of the I2C device at 'Device'
+template <uint8_t Device, uint8_t Address>
+struct Device_Register
+{
+    enum { device = Device, address = Address };
+
+    // Read or write the whole register
+    static uint8_t read(uint8_t & value) { return readRegister(Device, Address, value); }
+    static uint8_t write(uint8_t value) { return writeRegister(Device, Address, value); }
+
+    // Read or write 'size' registers starting with this one
+    static uint8_t readBlock(uint8_t size, uint8_t * dest)
+    {
+	return readRegisters(Device, Address, size, dest);
+    }
+    static uint8_t writeBlock(uint8_t size, const uint8_t * src)
+    {
+	return writeRegisters(Device, Address, size, src);
+    }
+
+    // Start a read of 'size' registers starting with this one in the background
+    static uint8_t request(TWI_Transaction & transaction, uint8_t size, uint8_t * dest)
+    {
+	return requestRegisters(transaction, Device, Address, size, dest);
+    }
+
+    // Make 'change' with one read-modify-write, or only the write when it covers every bit.
+    // The mask is a constant at every call so only one of the two calls is compiled in.
+    static uint8_t update(Register_Change<Device_Register> change)
+    {
+	if (change.mask == 0xFF)
+	    return write(change.bits);
+	return updateRegister(Device, Address, change.mask, change.bits);
+    }
+
+    // The change that writes 'value' to every bit
+    static Register_Change<Device_Register> all(uint8_t value)
+    {
+	return Register_Change<Device_Register>(0xFF, value);
+    }
+};
+
+// Shadow copy of a cached register and whether it holds the device's contents
+struct Register_Cache
+{
+    uint8_t shadow;
+    bool loaded;
+};
+
+// The work of Cached_Register below, kept out of line in Register_Map.cpp so every cached
+// access is one call with constant arguments whatever register it is for. 'volatile_bits' are
+// left out of the copy.
+uint8_t takeCached(Register_Cache & cache, uint8_t volatile_bits, uint8_t value);
+uint8_t loadCached(Register_Cache & cache, uint8_t device, uint8_t address, uint8_t volatile_bits);
+uint8_t readCached(Register_Cache & cache, uint8_t device, uint8_t address, uint8_t volatile_bits,
+		   uint8_t & value);
+uint8_t writeCached(Register_Cache & cache, uint8_t device, uint8_t address,
+		    uint8_t volatile_bits, uint8_t value);
+uint8_t updateCached(Register_Cache & cache, uint8_t device, uint8_t address,
+		     uint8_t volatile_bits, uint8_t mask, uint8_t bits);
+
+// Register 'Address' of the I2C device at 'Device' with a shadow copy of its contents. The copy
+// is taken by the first read or change that needs it, or by load(), and kept up to date by
+// every write, so only registers the device itself never changes should be cached. 'Volatile'
+// bits clear themselves on the device (resets and one shot triggers) and are left out of the
+// copy. After a device reset the copy is stale and forget() must be called.
+template <uint8_t Device, uint8_t Address, uint8_t Volatile = 0>
+struct Cached_Register
+{
+    enum { device = Device, address = Address, volatile_bits = Volatile };
+
+    static Register_Cache cache;
+
+    // Take 'value' read from the device as the copy, REGISTER_MISMATCH if there was a copy
+    // and it differed
+    static uint8_t take(uint8_t value) { return takeCached(cache, Volatile, value); }
+
+    // Take the copy from the device, REGISTER_MISMATCH if there was one and it differed
+    static uint8_t load() { return loadCached(cache, Device, Address, Volatile); }
+
+    // Drop the copy, the next access reads the device again
+    static void forget() { cache.loaded = false; }
+
+    // Read the whole register, from the copy once there is one
+    static uint8_t read(uint8_t & value)
+    {
+	return readCached(cache, Device, Address, Volatile, value);
+    }
+
+    // Read 'size' registers from the device starting with this one, without using or changing
+    // the copy
+    static uint8_t readBlock(uint8_t size, uint8_t * dest)
+    {
+	return readRegisters(Device, Address, size, dest);
+    }
+
+    // Write the whole register, a failed write leaves the device contents unknown
+    static uint8_t write(uint8_t value)
+    {
+	return writeCached(cache, Device, Address, Volatile, value);
+    }
+
+    // Make 'change' with a single write, the register is only read when there is no copy yet
+    // and the change does not cover every bit
+    static uint8_t update(Register_Change<Cached_Register> change)
+    {
+	return updateCached(cache, Device, Address, Volatile, change.mask, change.bits);
+    }
+
+    // The change that writes 'value' to every bit
+    static Register_Change<Cached_Register> all(uint8_t value)
+    {
+	return Register_Change<Cached_Register>(0xFF, value);
+    }
+};
+
+template <uint8_t Device, uint8_t Address, uint8_t Volatile>
+Register_Cache Cached_Register<Device, Address, Volatile>::cache;
+
+// What cacheRegister() does with the shadow copy of a register
+enum cache_action
+{
+    CACHE_FORGET,
+    CACHE_LOAD,
+    CACHE_VERIFY
+};
+
+// Forget the copy of a cached register, or replace it with 'value' read from the device or
+// check it against 'value', returning 'error' if it is set and the result for this register
+// otherwise. Drivers read their cached registers in as few bursts as their addresses allow and
+// chain this over them, so one list serves all three actions.
+uint8_t cacheRegister(cache_action action, Register_Cache & cache, uint8_t volatile_bits,
+		      uint8_t value, uint8_t error);
+
+template <class Register>
+inline uint8_t cacheRegister(cache_action action, uint8_t value, uint8_t error)
+{
+    return cacheRegister(action, Register::cache, Register::volatile_bits, value, error);
+}
+
+// 'Width' bits of 'Register' starting at bit 'Shift'
+template <class Register, uint8_t Shift, uint8_t Width = 1>
+struct Register_Field
+{
+    enum { mask = (uint8_t)(((1 << Width) - 1) << Shift) };
+
+    // The change that gives the field 'value', counted from the field's lowest bit
+    static Register_Change<Register> set(uint8_t value)
+    {
+	return Register_Change<Register>(mask, (value << Shift) & mask);
+    }
+
+    // The field's value in the register contents 'reg_value'
+    static uint8_t get(uint8_t reg_value) { return (reg_value & mask) >> Shift; }
+
+    // Change only this field on the device
+    static uint8_t write(uint8_t value) { return Register::update(set(value)); }
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Fixed rate sample scheduler. An interrupt (a hardware timer or a sensor's data ready
+// output) calls tick() at the base sample rate and the main loop polls for the ticks it has
+// not handled yet.
+
+#include "Arduino.h"
+#include "Sample_Scheduler.h"
+
+Sample_Scheduler::Sample_Scheduler()
+{
+    for (uint8_t i = 0; i < SCHEDULER_SENSORS; ++i)
+	divisor[i] = 1;
+    stride = 1;
+    reset();
+}
+
+// Read 'sensor' on every 'ticks' ticks, zero stops the sensor from being scheduled
+void Sample_Scheduler::setDivisor(uint8_t sensor, uint16_t ticks)
+{
+    if (sensor < SCHEDULER_SENSORS)
+	divisor[sensor] = ticks;
+}
+
+// Hand out every 'ticks' ticks instead of every tick
+void Sample_Scheduler::setStride(uint8_t ticks)
+{
+    stride = ticks ? ticks : 1;
+}
+
+// Forget waiting ticks and restart every sensor so they are all due on the next tick
+void Sample_Scheduler::reset()
+{
+    noInterrupts();
+    pending = 0;
+    interrupts();
+    ticks = 0;
+    missed = 0;
+    for (uint8_t i = 0; i < SCHEDULER_SENSORS; ++i)
+	phase[i] = 0;
+}
+
+// Record a tick, called from the interrupt that sets the sample rate
+void Sample_Scheduler::tick()
+{
+    if (pending != 0xFFFF)
+	pending += 1;
+}
+
+// True if a tick is waiting, 'due' is set to the bits of the sensors to sample on it
+bool Sample_Scheduler::poll(uint8_t & due)
+{
+    noInterrupts();
+    uint16_t waiting = pending;
+    // Ticks short of a whole stride are left to add up
+    if (waiting >= stride)
+	pending = 0;
+    interrupts();
+
+    due = 0;
+    if (waiting < stride)
+	return false;
+
+    // Only the newest tick can still be sampled, older ones beyond the stride are counted as
+    // missed but still advance every sensor so the decimation stays locked to time
+    missed += waiting - stride;
+    ticks += waiting;
+    for (uint8_t i = 0; i < SCHEDULER_SENSORS; ++i)
+    {
+	if (divisor[i] == 0)
+	    continue;
+	// A sensor is due if its count passed a multiple of its divisor during these ticks
+	bool wrapped = (phase[i] == 0) || (phase[i] + waiting > divisor[i]);
+	phase[i] = (phase[i] + waiting) % divisor[i];
+	if (wrapped)
+	    due |= 1 << i;
+    }
+    return true;
+}
+
+// Ticks between the ticks handed out with any of 'sensors' (bits as in 'due') due, 0 if none
+// is scheduled or they do not come out at a fixed period
+uint16_t Sample_Scheduler::samplePeriod(uint8_t sensors) const
+{
+    // Each sensor comes out on every handed out tick if its divisor is no longer than the
+    // stride, on every divisor ticks if that is a whole number of strides, and unevenly
+    // otherwise. Together they come out on the shortest period if it divides the others, or
+    // on every handed out tick if one does whatever the others do.
+    uint16_t periods[SCHEDULER_SENSORS];
+    uint16_t shortest = 0;
+    bool uneven = false;
+    for (uint8_t i = 0; i < SCHEDULER_SENSORS; ++i)
+    {
+	periods[i] = 0;
+	if (!(sensors & (1 << i)) || divisor[i] == 0)
+	    continue;
+	if (divisor[i] <= stride)
+	    periods[i] = stride;
+	else if (divisor[i] % stride == 0)
+	    periods[i] = divisor[i];
+	else
+	{
+	    uneven = true;
+	    continue;
+	}
+	if (shortest == 0 || periods[i] < shortest)
+	    shortest = periods[i];
+    }
+    if (shortest == stride)
+	return stride;
+    if (shortest == 0 || uneven)
+	return 0;
+    for (uint8_t i = 0; i < SCHEDULER_SENSORS; ++i)
+	if (periods[i] % shortest != 0)
+	    return 0;
+    return shortest;
+}
@@ -0,0 +1,68 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Fixed rate sample scheduler. An interrupt (a hardware timer or a sensor's data ready
+// output) calls tick() at the base sample rate and the main loop polls for the ticks it has
+// not handled yet. Each sensor is read on every n-th tick set by its divisor, counted in
+// ticks rather than loop passes so a slow pass never shifts the sensors out of phase. A stride
+// hands out only every n-th tick, with the sensors due on the ticks in between, which slows the
+// sample rate without changing the clock. The class does not touch any hardware so it can be
+// driven by simulated interrupts.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef SAMPLE_SCHEDULER
+#define SAMPLE_SCHEDULER
+
+#include "stdint.h"
+
+// Number of independently divided sensors, sensor n is reported as bit (1 << n) which
+// matches the ACC, GYRO, BARO and PHT packet codes
+#define SCHEDULER_SENSORS 4
+
+class Sample_Scheduler {
+// Internal members not used outside the class
+private:
+    volatile uint16_t pending;
+    uint8_t stride;
+    uint16_t divisor[SCHEDULER_SENSORS];
+    uint16_t phase[SCHEDULER_SENSORS];
+
+// Member functions accesible outside the class
+public:
+    // Ticks handled, and ticks that arrived while an earlier one was still waiting and so
+    // could not be sampled on time, not counting those a stride skips
+    uint32_t ticks;
+    uint16_t missed;
+
+    Sample_Scheduler();
+
+    // Read 'sensor' on every 'ticks' ticks, zero stops the sensor from being scheduled
+    void setDivisor(uint8_t sensor, uint16_t ticks);
+
+    // Hand out every 'ticks' ticks instead of every tick, best changed right after a poll so no
+    // ticks are waiting
+    void setStride(uint8_t ticks);
+
+    // Forget waiting ticks and restart every sensor so they are all due on the next tick
+    void reset();
+
+    // Record a tick, called from the interrupt that sets the sample rate
+    void tick();
+
+    // True if a tick is waiting, 'due' is set to the bits of the sensors to sample on it
+    bool poll(uint8_t & due);
+
+    // Ticks between the ticks handed out with any of 'sensors' (bits as in 'due') due, 0 if
+    // none is scheduled or they do not come out at a fixed period
+    uint16_t samplePeriod(uint8_t sensors) const;
+};
+
+#endif
@@ -0,0 +1,253 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Codes and layout of the serial protocol between the sensor board and its receivers. Shared
+// by the firmware and the host tools so both sides agree on every byte.
+//
+// Request codes are single bytes sent to the board. Everything the board sends is framed with
+// DLE (0x10) prefixed control codes and any DLE inside a frame is sent twice.
+//
+// Every sample sent is numbered, the sequence number counting up by one for each sample since
+// the board was reset and wrapping at 16 bits, and stamped with the board clock in
+// microseconds when its reads were started, which wraps at 32 bits (about 71 minutes). A gap
+// in the sequence numbers is a lost sample and the times give the spacing of those received.
+//
+// Single sample frame, one per sample:
+//   DLE STX | sequence number (2, high byte first) | time (4, high byte first) |
+//   DLE ACC | 6 bytes | DLE GYRO | 6 bytes | DLE BARO | 5 bytes | DLE PHT | 2 bytes |
+//   DLE QUAT | 6 bytes | DLE ETX
+// where each sensor block is only present when that sensor was read for the sample, and the
+// barometer block only when the read found a conversion that had not been sent. QUAT is
+// the orientation from the board's own filter as a unit quaternion with its largest component
+// left out, see ORIENTATION_COMPACT_SIZE in Orientation_Filter.h.
+//
+// The barometer block is the altitude in meters (2, signed, low byte first) and sixteenths of
+// a meter (1), then the temperature in degrees Celsius (1, signed) and sixteenths of a degree
+// (1). A board built with BAROMETER_PRESSURE sends pressure in its place, the first two bytes
+// (low byte first) holding the Pascals divided by four and the low four bits of the third the
+// two remaining bits of Pascals followed by two bits of quarter Pascals.
+//
+// Batched frame, BATCH_SIZE samples with one header:
+//   DLE BTX | sample count (1) | sequence number of the first sample (2, high byte first) |
+//   time of the first sample (4, high byte first) |
+//   sample period in microseconds (2, high byte first) | count samples | DLE ETX
+// where each sample is a byte with the ACC, GYRO, BARO, PHT and QUAT bits of the blocks it holds
+// followed by their payloads in that order, the same bytes as the single sample blocks. The
+// samples are numbered on from the first and are the period apart, a period of 0 is sent by
+// the data ready and free running sample clocks which have no fixed period. A sample with none
+// of the bits is padding: when the stream is ended the open frame is filled out with them
+// after the last sample read, without using up sequence numbers, and receivers drop them
+// without counting them as samples or losses.
+//
+// Compressed frames, sent for START_COMPRESSED_STREAM, are batched frames starting DLE CTX in
+// which the accelerometer and gyroscope readings after the first of each in the frame are sent
+// as the difference from the reading before. Each axis difference (16 bits, wrapping) is zig-zag
+// mapped and sent as a varint of one to three bytes, see Frame_Codec.h. The first reading of
+// each in a frame is sent in full as a keyframe so a lost frame does not spoil the next one.
+// Quaternions are sent in full.
+//
+// Stats frame, sent for SEND_STATS while the board is not streaming:
+//   DLE PTX | stage count (1) | tick length in nanoseconds (2) | count stage records | DLE ETX
+// where each stage record is the number of times the stage ran (2), its shortest, longest and
+// total time in ticks (2, 2 and 4) and PROFILE_BINS counts of times falling in each bin (2
+// each), all high byte first. Bin 0 counts times under PROFILE_BIN_FIRST ticks and each bin
+// after it times up to twice as long, the last bin every longer time. The stages are the
+// STAGE_* codes in order. A board built without STAGE_PROFILING sends no stages. Sending the
+// stats clears them.
+//
+// Health frame, sent for SEND_HEALTH while the board is not streaming:
+//   DLE HTX | bus recoveries (2) | ACC, GYRO and BARO records | sensors down (1) | DLE ETX
+// where the recoveries count the times a stalled I2C bus was freed and each record is the
+// number of failed reads of the sensor (2), the times it was set up again after one (2) and the
+// error code of the last failure (1), all high byte first. A sensor whose read fails is set up
+// again at once and left out of the samples while that fails, with another try every
+// SENSOR_RETRY milliseconds, and the ACC, GYRO and BARO bits of those sensors are the last
+// byte. The counts are kept from reset and wrap at 16 bits.
+//
+// Benchmark frame, sent for RUN_BENCHMARK while the board is not streaming:
+//   DLE RTX | record count (1) | count records | DLE ETX
+// where each record is an SCL frequency in kHz (2), a read mode (1, BENCHMARK_BURST or
+// BENCHMARK_PER_REGISTER), the number of failed reads (1) and the average and longest time in
+// microseconds (2 each) of BENCHMARK_READS full samples of the accelerometer, gyroscope and
+// barometer read back to back at that frequency and in that mode, all high byte first. There
+// is a record for each mode at standard and at fast mode. The bus is then returned to its own
+// frequency and the drivers to burst reads. The output registers are read whatever the build
+// samples from, so the benchmark takes samples from a sensor FIFO in use.
+//
+// Configuration requests, handled while the board is not streaming, are followed by argument
+// bytes (high byte first) and answered with an acknowledgement frame:
+//   SET_BAUD_RATE | baud rate (4)
+//   SET_SENSORS | ACC, GYRO, BARO and PHT bits of the sensors to read (1)
+//   SET_DIVISOR | sensor bit (1) | ticks of the sample clock between reads, 0 for never (2)
+//   SET_RANGE | ACC or GYRO (1) | range code of the driver's range enumeration (1)
+//   SET_HIGH_PASS | ACC or GYRO (1) | cutoff code of the driver's filter enumeration, or
+//       HIGH_PASS_OFF (1)
+//   SET_MOTION | ticks of the sample clock between samples while the board is still, 0 or 1
+//       for every tick always (1) | motion threshold in steps of 0.063 g, 1 to
+//       MOTION_THRESHOLD_MAX (1)
+// Arguments not received within CONFIG_TIMEOUT milliseconds of the request are given up on.
+// A new baud rate is acknowledged at that rate, CONFIG_BAUD_SETTLE milliseconds after the
+// request so a receiver wired to the board can change its own rate first. The rate applies
+// until the board is reset. With SET_MOTION the accelerometer watches for motion and the board
+// streams at the full rate only while it sees some: once it has seen none for MOTION_HOLD
+// milliseconds samples are taken on every given number of ticks instead, and on every tick
+// again from the first sample after it sees some. A batched frame keeps the rate it was
+// started at, its sample period is the period between its samples.
+//
+// Acknowledgement frame:
+//   DLE ATX | request (1) | ACK_* status (1) | value (4, high byte first) | DLE ETX
+// where the value is the setting asked for (the sensor bits, divisor, code or ticks), except for
+// SET_BAUD_RATE where it is the rate the UART runs at after the request: within a few percent
+// of the rate asked for, or the old rate if the request failed.
+//
+// A receiver can send COBS_FRAMING to have the same frames sent without DLE stuffing. Each
+// frame is then its type (STX or BTX), the frame contents as above with no DLE bytes at all
+// (single sample frames keep the ACC, GYRO, BARO, PHT and QUAT tags as plain bytes) and a CRC-16 of
+// all of that, low byte first. The whole is COBS encoded and followed by a zero byte, see
+// Frame_Codec.h. DLE_FRAMING switches back, boards start in DLE framing so older receivers
+// keep working.
+
+// Compiler directive to make sure the codes have not already been defined
+#ifndef SENSOR_PROTOCOL
+#define SENSOR_PROTOCOL
+
+// Comunication codes
+enum network
+{
+    START_STREAM = 0xB0,
+    END_STREAM = 0xB1,
+    SEND_SINGLE = 0xB2,
+    START_BATCH_STREAM = 0xB3,
+    COBS_FRAMING = 0xB4,
+    DLE_FRAMING = 0xB5,
+    START_COMPRESSED_STREAM = 0xB6,
+    SEND_STATS = 0xB7,
+    SET_BAUD_RATE = 0xB8,
+    SET_SENSORS = 0xB9,
+    SET_DIVISOR = 0xBA,
+    SET_RANGE = 0xBB,
+    SET_HIGH_PASS = 0xBC,
+    SEND_HEALTH = 0xBD,
+    RUN_BENCHMARK = 0xBE,
+    SET_MOTION = 0xBF,
+    DLE = 0x10,
+    STX = 0x20,
+    BTX = 0x21,
+    CTX = 0x22,
+    PTX = 0x23,
+    ATX = 0x24,
+    HTX = 0x25,
+    RTX = 0x26,
+    ETX = 0x30,
+    ACC = 0x01,
+    GYRO = 0x02,
+    BARO = 0x04,
+    PHT = 0x08,
+    QUAT = 0x40
+};
+
+// Status of a configuration request in its acknowledgement: done, an argument out of range or
+// not supported by this build, the arguments did not arrive in time, the Bluetooth module did
+// not take the new baud rate. A failed I2C transfer gives ACK_BUS_ERROR with the driver's error
+// code in the low bits.
+#define ACK_OK 0
+#define ACK_INVALID 1
+#define ACK_TIMEOUT 2
+#define ACK_MODULE_ERROR 3
+#define ACK_BUS_ERROR 0x80
+
+// Cutoff code that turns a high pass filter off
+#define HIGH_PASS_OFF 0xFF
+
+// Milliseconds allowed for the argument bytes of a configuration request
+#define CONFIG_TIMEOUT 100
+// Milliseconds between a baud rate request and its acknowledgement at the new rate
+#define CONFIG_BAUD_SETTLE 20
+
+// Bytes of the acknowledgement frame after its type
+#define ACK_PAYLOAD 6
+
+// Sensors in the health frame, the bytes of each record and of the frame after its type
+#define HEALTH_SENSORS 3
+#define HEALTH_RECORD_SIZE 5
+#define HEALTH_PAYLOAD (2 + HEALTH_SENSORS * HEALTH_RECORD_SIZE + 1)
+
+// Milliseconds between tries to set up a sensor that is down
+#define SENSOR_RETRY 1000
+
+// Highest motion threshold of SET_MOTION, and milliseconds without motion before the board
+// streams at the reduced rate
+#define MOTION_THRESHOLD_MAX 127
+#define MOTION_HOLD 2000
+
+// Full samples timed for each benchmark record, the read modes of the records, the records
+// sent and the bytes of each
+#define BENCHMARK_READS 64
+#define BENCHMARK_BURST 0
+#define BENCHMARK_PER_REGISTER 1
+#define BENCHMARK_RECORDS 4
+#define BENCHMARK_RECORD_SIZE 8
+
+// Payload bytes of each sensor block
+#define ACC_PAYLOAD 6
+#define GYRO_PAYLOAD 6
+#define BARO_PAYLOAD 5
+#define PHT_PAYLOAD 2
+#define QUAT_PAYLOAD 6
+
+// Stages of the sampling loop timed for the stats frame: waiting for the sample clock, starting
+// the I2C reads, waiting for each sensor's read, the analog read of the light sensor, the
+// orientation filter and sending the frame
+#define STAGE_WAIT 0
+#define STAGE_REQUEST 1
+#define STAGE_ACC 2
+#define STAGE_GYRO 3
+#define STAGE_BARO 4
+#define STAGE_LIGHT 5
+#define STAGE_FILTER 6
+#define STAGE_SEND 7
+#define STAGE_COUNT 8
+
+// Histogram bins of each stage and the upper bound of the first in ticks
+#define PROFILE_BINS 8
+#define PROFILE_BIN_FIRST 16
+
+// Bytes of a stage record in the stats frame
+#define STAGE_RECORD_SIZE (2 + 2 + 2 + 4 + 2 * PROFILE_BINS)
+
+// Fewest samples between quaternions, which keeps the largest batched frames within a COBS block
+#define QUAT_DIVISOR_MIN 2
+
+// Samples carried by one batched frame
+#define BATCH_SIZE 8
+
+// Largest sample in a batched frame, the sensor bits and every payload
+#define SAMPLE_RECORD_MAX (1 + ACC_PAYLOAD + GYRO_PAYLOAD + BARO_PAYLOAD + PHT_PAYLOAD + QUAT_PAYLOAD)
+
+// Largest sample in a compressed frame, every axis difference can take three bytes
+#define COMPRESSED_RECORD_MAX (1 + 3 * 3 + 3 * 3 + BARO_PAYLOAD + PHT_PAYLOAD + QUAT_PAYLOAD)
+
+// Bytes of the single sample and batched frame headers after the type
+#define SINGLE_HEADER_SIZE 6
+#define BATCH_HEADER_SIZE 9
+
+// Largest COBS frame before encoding, type, contents and CRC. Frames are kept within one COBS
+// block so the firmware can encode them in place.
+#define COBS_FRAME_MAX 254
+#if 1 + BATCH_HEADER_SIZE + BATCH_SIZE * (COMPRESSED_RECORD_MAX - QUAT_PAYLOAD) + \
+    (BATCH_SIZE / QUAT_DIVISOR_MIN) * QUAT_PAYLOAD + 2 > COBS_FRAME_MAX
+#error "Batched frames do not fit in one COBS block, reduce BATCH_SIZE"
+#endif
+#if 1 + 3 + STAGE_COUNT * STAGE_RECORD_SIZE + 2 > COBS_FRAME_MAX
+#error "The stats frame does not fit in one COBS block, reduce PROFILE_BINS"
+#endif
+
+#endif
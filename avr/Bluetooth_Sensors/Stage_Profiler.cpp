@@ -0,0 +1,71 @@
+// Timing of each stage of the sampling loop, read from timer 1
+
+#include "Arduino.h"
+#include "Stage_Profiler.h"
+
+Stage_Profiler::Stage_Profiler()
+{
+    last = 0;
+    wrap = 0;
+    reset();
+}
+
+// Start timer 1 counting, or take the wrap from its compare register if it already runs the
+// sample clock
+void Stage_Profiler::setup()
+{
+    if (TCCR1B & _BV(WGM12))
+	wrap = OCR1A + 1;
+    else {
+	// Normal mode with a prescaler of 8, wrapping every 32 ms
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11);
+	wrap = 0;
+    }
+}
+
+// Forget the recorded times
+void Stage_Profiler::reset()
+{
+    for (uint8_t i = 0; i < STAGE_COUNT; ++i) {
+	Stage_Stats & stats = stages[i];
+	stats.count = 0;
+	stats.shortest = 0xFFFF;
+	stats.longest = 0;
+	stats.total = 0;
+	for (uint8_t j = 0; j < PROFILE_BINS; ++j)
+	    stats.bins[j] = 0;
+    }
+}
+
+// Start timing from now
+void Stage_Profiler::begin()
+{
+    last = TCNT1;
+}
+
+// Add the time since the last mark to 'stage'
+void Stage_Profiler::mark(uint8_t stage)
+{
+    uint16_t now = TCNT1;
+    uint16_t elapsed = now - last;
+    // The count went back to zero on a compare match since the last mark
+    if (now < last)
+	elapsed += wrap;
+    last = now;
+
+    Stage_Stats & stats = stages[stage];
+    if (stats.count == 0xFFFF)
+	return;
+    stats.count += 1;
+    if (elapsed < stats.shortest)
+	stats.shortest = elapsed;
+    if (elapsed > stats.longest)
+	stats.longest = elapsed;
+    stats.total += elapsed;
+    uint8_t bin = 0;
+    for (uint16_t bound = PROFILE_BIN_FIRST; bin < PROFILE_BINS - 1 && elapsed >= bound;
+	 bound <<= 1)
+	bin += 1;
+    stats.bins[bin] += 1;
+}
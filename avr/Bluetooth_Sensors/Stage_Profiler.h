@@ -0,0 +1,67 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Timing of each stage of the sampling loop for the stats frame. The loop calls begin() where
+// it starts and mark() as it finishes each stage, and the time since the previous call, read
+// from timer 1, is added to that stage's shortest, longest and total times and its histogram.
+// Timer 1 counts with a prescaler of 8, half a microsecond at 16 MHz. When it runs the sample
+// clock it is cleared on every compare match, which the profiler allows for, so a stage longer
+// than one sample period is recorded short by whole periods.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef STAGE_PROFILER
+#define STAGE_PROFILER
+
+#include "stdint.h"
+#include "Sensor_Protocol.h"
+
+// Nanoseconds of a timer tick
+#define PROFILE_TICK_NS (8 * 1000000000LL / F_CPU)
+
+// Times recorded for one stage, in timer ticks
+struct Stage_Stats
+{
+    // Times the stage ran, recording stops once it reaches 0xFFFF so the mean stays right
+    uint16_t count;
+    uint16_t shortest;
+    uint16_t longest;
+    uint32_t total;
+    uint16_t bins[PROFILE_BINS];
+};
+
+class Stage_Profiler {
+// Internal members not used outside the class
+private:
+    // Timer count at the last mark and the count it wraps at, zero for 0x10000
+    uint16_t last;
+    uint16_t wrap;
+
+// Member functions accesible outside the class
+public:
+    Stage_Stats stages[STAGE_COUNT];
+
+    Stage_Profiler();
+
+    // Start timer 1 counting, or take the wrap from its compare register if it already runs
+    // the sample clock
+    void setup();
+
+    // Forget the recorded times
+    void reset();
+
+    // Start timing from now
+    void begin();
+
+    // Add the time since the last mark or begin() to 'stage'
+    void mark(uint8_t stage);
+};
+
+#endif
@@ -0,0 +1,150 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Register level access to the two wire interface (TWI) peripheral. On the AVR these are the
+// TWI registers themselves, in a host build they are provided by a simulated peripheral so the
+// transaction queue built on top of them can be run and checked on a desktop machine.
+
+// Compiler directive to make sure these functions have not already been defined
+#ifndef TWI_HARDWARE
+#define TWI_HARDWARE
+
+#include "stdint.h"
+
+#ifdef __AVR__
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// Status code of the last bus event with the prescaler bits removed
+inline uint8_t twiStatus() { return TWSR & 0xF8; }
+
+// Data register holding the last byte received or the next byte to be sent
+inline uint8_t twiReadData() { return TWDR; }
+inline void twiWriteData(uint8_t data) { TWDR = data; }
+
+// Control register, writing TWINT high releases the bus to perform the next action
+inline void twiControl(uint8_t control) { TWCR = control; }
+
+// True while a STOP condition is still being sent
+inline bool twiStopping() { return TWCR & _BV(TWSTO); }
+
+// Turn on the peripheral with the internal pull ups on the bus pins, the SCL frequency is
+// F_CPU / (16 + 2 * bit_rate) with the prescaler at one
+inline void twiEnable(uint8_t bit_rate)
+{
+    digitalWrite(SDA, HIGH);
+    digitalWrite(SCL, HIGH);
+    TWSR = 0;
+    TWBR = bit_rate;
+    TWCR = _BV(TWEN) | _BV(TWIE);
+}
+
+// Change the SCL frequency while the bus is idle
+inline void twiBitRate(uint8_t bit_rate) { TWBR = bit_rate; }
+
+// Drive a bus pin from the port as the bus drives it, low or let go to the pull up
+inline void twiPin(uint8_t pin, bool high)
+{
+    if (high)
+    {
+	pinMode(pin, INPUT);
+	digitalWrite(pin, HIGH);
+    }
+    else
+    {
+	digitalWrite(pin, LOW);
+	pinMode(pin, OUTPUT);
+    }
+    // Half an SCL period in standard mode
+    delayMicroseconds(5);
+}
+
+// Free the bus from a device left in the middle of a transfer. The peripheral is turned off
+// and SCL clocked from the port, up to the nine clocks of a byte and its acknowledge, until
+// the device lets go of SDA. A STOP then returns every device to idle and the peripheral is
+// turned back on at the same bit rate.
+inline void twiRecover()
+{
+    TWCR = 0;
+    twiPin(SDA, HIGH);
+    for (uint8_t clocks = 0; clocks < 9 && !digitalRead(SDA); ++clocks)
+    {
+	twiPin(SCL, LOW);
+	twiPin(SCL, HIGH);
+    }
+    twiPin(SCL, LOW);
+    twiPin(SDA, LOW);
+    twiPin(SCL, HIGH);
+    twiPin(SDA, HIGH);
+    TWCR = _BV(TWEN) | _BV(TWIE);
+}
+
+// Block the TWI interrupt while the queue is modified, returning the previous state
+inline uint8_t twiLock() { uint8_t state = SREG; cli(); return state; }
+inline void twiUnlock(uint8_t state) { SREG = state; }
+
+// Nothing to do while waiting on the bus, the interrupt does the work
+inline void twiYield() {}
+
+#else
+
+// Control register bit positions from the ATmega328 datasheet
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+
+// Provided by the simulated peripheral in the host build
+uint8_t twiStatus();
+uint8_t twiReadData();
+void twiWriteData(uint8_t data);
+void twiControl(uint8_t control);
+bool twiStopping();
+void twiEnable(uint8_t bit_rate);
+void twiBitRate(uint8_t bit_rate);
+void twiRecover();
+
+// Bus events are only delivered from twiYield() so there is nothing to block
+inline uint8_t twiLock() { return 0; }
+inline void twiUnlock(uint8_t) {}
+
+// Let the simulated peripheral advance the bus while the caller is waiting on it
+void twiYield();
+
+// Bus event handler, called by the simulated peripheral where the AVR would interrupt
+void twiInterrupt();
+
+#endif
+
+// Status codes from the ATmega328 datasheet for master transmitter and receiver modes
+#define TW_BUS_ERROR 0x00
+#define TW_START 0x08
+#define TW_REP_START 0x10
+#define TW_MT_SLA_ACK 0x18
+#define TW_MT_SLA_NACK 0x20
+#define TW_MT_DATA_ACK 0x28
+#define TW_MT_DATA_NACK 0x30
+#define TW_MT_ARB_LOST 0x38
+#define TW_MR_SLA_ACK 0x40
+#define TW_MR_SLA_NACK 0x48
+#define TW_MR_DATA_ACK 0x50
+#define TW_MR_DATA_NACK 0x58
+
+// Read and write flags appended to the device address
+#define TW_READ 1
+#define TW_WRITE 0
+
+#endif
@@ -0,0 +1,314 @@
+// Interrupt driven I2C master. Register reads and writes are submitted as transactions to a
+// queue and carried out by the TWI interrupt one bus event at a time, so the processor is free
+// to do other work (such as sending the previous sample) while the bus is busy. A stalled bus
+// is recovered by watch() while it is waited on. The bit rate is set for each transaction's
+// device as it is started.
+
+#include "Arduino.h"
+#include "TWI_Queue.h"
+#include "TWI_Hardware.h"
+
+// Control register values for each bus action, all keep the peripheral and its interrupt on
+#define TWI_START_CONDITION ((1 << TWINT) | (1 << TWEN) | (1 << TWIE) | (1 << TWSTA))
+#define TWI_STOP_CONDITION ((1 << TWINT) | (1 << TWEN) | (1 << TWIE) | (1 << TWSTO))
+#define TWI_SEND ((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+#define TWI_ACK ((1 << TWINT) | (1 << TWEN) | (1 << TWIE) | (1 << TWEA))
+#define TWI_NACK ((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+
+// The single bus master shared by all of the sensor drivers
+TWI_Queue twi_queue;
+
+// Set up a read of 'size' bytes starting at 'readAddress' into 'dest'
+void TWI_Transaction::setRead(uint8_t deviceAddress, uint8_t readAddress, uint8_t size,
+			      uint8_t * dest)
+{
+    device_address = deviceAddress;
+    register_address = readAddress;
+    this->size = size;
+    write = 0;
+    buffer = dest;
+    callback = 0;
+    status = NO_ERROR;
+}
+
+// Set up a write of 'size' bytes from 'src' starting at 'writeAddress'
+void TWI_Transaction::setWrite(uint8_t deviceAddress, uint8_t writeAddress, uint8_t size,
+			       uint8_t * src)
+{
+    device_address = deviceAddress;
+    register_address = writeAddress;
+    this->size = size;
+    write = 1;
+    buffer = src;
+    callback = 0;
+    status = NO_ERROR;
+}
+
+// Bit rate register value for an SCL frequency of 'frequency' Hz with the prescaler at one,
+// the nearest faster frequency the register can give
+static uint8_t bitRate(unsigned long frequency)
+{
+    unsigned long cycles = F_CPU / frequency;
+    if (cycles <= 16)
+	return 0;
+    if (cycles >= 16 + 2 * 255)
+	return 255;
+    return (cycles - 16) / 2;
+}
+
+TWI_Queue::TWI_Queue()
+{
+    bit_rate = bitRate(TWI_FREQUENCY);
+    active_rate = bit_rate;
+}
+
+// Enable the TWI hardware and its interrupt, safe to call more than once
+void TWI_Queue::begin()
+{
+    // Leave the hardware alone if another driver already has transactions on the bus
+    if (busy())
+	return;
+    head = 0;
+    active_rate = bit_rate;
+    twiEnable(bit_rate);
+}
+
+// Set the SCL frequency of every device without its own
+void TWI_Queue::setFrequency(unsigned long frequency)
+{
+    bit_rate = bitRate(frequency);
+}
+
+// Give 'device' its own SCL frequency, or return it to the default
+uint8_t TWI_Queue::setClock(uint8_t device, unsigned long frequency)
+{
+    uint8_t state = twiLock();
+    uint8_t i = 0;
+    while (i < profiles && profile_devices[i] != device)
+	++i;
+    if (frequency == 0)
+    {
+	// Move the last profile into the place of the one dropped
+	if (i < profiles)
+	{
+	    profiles -= 1;
+	    profile_devices[i] = profile_devices[profiles];
+	    profile_rates[i] = profile_rates[profiles];
+	}
+    }
+    else if (i < TWI_CLOCK_PROFILES)
+    {
+	profile_devices[i] = device;
+	profile_rates[i] = bitRate(frequency);
+	if (i == profiles)
+	    profiles += 1;
+    }
+    else
+    {
+	twiUnlock(state);
+	return BUFFER_SIZE_ERROR;
+    }
+    twiUnlock(state);
+    return NO_ERROR;
+}
+
+// Bit rate register value the transactions of 'device' are run at
+uint8_t TWI_Queue::rateOf(uint8_t device) const
+{
+    for (uint8_t i = 0; i < profiles; ++i)
+	if (profile_devices[i] == device)
+	    return profile_rates[i];
+    return bit_rate;
+}
+
+// Add a transaction to the end of the queue, the bus is started if it was idle
+uint8_t TWI_Queue::submit(TWI_Transaction & transaction)
+{
+    uint8_t state = twiLock();
+    if (count == TWI_QUEUE_SIZE)
+    {
+	twiUnlock(state);
+	transaction.status = BUFFER_SIZE_ERROR;
+	return BUFFER_SIZE_ERROR;
+    }
+
+    transaction.status = TWI_PENDING;
+    queue[(head + count) % TWI_QUEUE_SIZE] = &transaction;
+    count += 1;
+
+    // The interrupt will start the transaction when the one ahead of it finishes
+    if (count == 1)
+	start();
+    twiUnlock(state);
+    return NO_ERROR;
+}
+
+// Submit a transaction and wait for it to finish, returning its error code
+uint8_t TWI_Queue::execute(TWI_Transaction & transaction)
+{
+    uint8_t error = submit(transaction);
+    if (error != NO_ERROR)
+	return error;
+    return wait(transaction);
+}
+
+// Wait for a submitted transaction to finish and return its error code
+uint8_t TWI_Queue::wait(TWI_Transaction & transaction)
+{
+    while (!transaction.complete())
+    {
+	twiYield();
+	watch();
+    }
+    return transaction.status;
+}
+
+// Recover the bus if it has stalled
+void TWI_Queue::watch()
+{
+    uint8_t state = twiLock();
+    unsigned long now = micros();
+    // The stall is timed from the last bus event seen here
+    if (count == 0 || events != watched_events)
+    {
+	watched_events = events;
+	watched_time = now;
+    }
+    else if (now - watched_time >= TWI_STALL_MICROS)
+	recover();
+    twiUnlock(state);
+}
+
+// Free the bus from a device holding it and fail the active transaction
+void TWI_Queue::recover()
+{
+    recoveries += 1;
+    twiRecover();
+    finish(TWI_TIMEOUT);
+}
+
+// Begin the transaction at the head of the queue with a START condition
+void TWI_Queue::start()
+{
+    index = 0;
+    addressed = 0;
+    events += 1;
+    // A new START can not be requested until the last STOP is on the bus. A device holding
+    // SCL low keeps the STOP off the bus, so the START is requested anyway after a while and
+    // left for watch() to recover.
+    unsigned long begun = micros();
+    while (twiStopping() && micros() - begun < TWI_STALL_MICROS);
+
+    // The bus is idle between the STOP and the START so its SCL frequency can change
+    uint8_t rate = rateOf(queue[head]->device_address);
+    if (rate != active_rate)
+    {
+	active_rate = rate;
+	twiBitRate(rate);
+    }
+    twiControl(TWI_START_CONDITION);
+}
+
+// Release the bus and retire the active transaction with an error code
+void TWI_Queue::finish(uint8_t error)
+{
+    TWI_Transaction & transaction = *queue[head];
+    head = (head + 1) % TWI_QUEUE_SIZE;
+    count -= 1;
+
+    twiControl(TWI_STOP_CONDITION);
+    if (count != 0)
+	start();
+
+    // Mark completion last so a waiting caller never sees the bus in use by this transaction,
+    // the callback may submit new transactions
+    transaction.status = error;
+    if (transaction.callback)
+	transaction.callback(transaction);
+}
+
+// Advance the active transaction by one bus event, called from the TWI interrupt
+void TWI_Queue::service()
+{
+    events += 1;
+    if (count == 0)
+    {
+	twiControl(TWI_STOP_CONDITION);
+	return;
+    }
+    TWI_Transaction & transaction = *queue[head];
+
+    switch (twiStatus())
+    {
+    // Address the device for writing the register address, after the repeated START
+    // address it for reading
+    case TW_START:
+    case TW_REP_START:
+	if (addressed)
+	    twiWriteData((transaction.device_address << 1) | TW_READ);
+	else
+	    twiWriteData((transaction.device_address << 1) | TW_WRITE);
+	twiControl(TWI_SEND);
+	break;
+
+    // The device is listening, send the register address
+    case TW_MT_SLA_ACK:
+	twiWriteData(transaction.register_address);
+	addressed = 1;
+	twiControl(TWI_SEND);
+	break;
+
+    // Either write the next data byte or turn the bus around for reading
+    case TW_MT_DATA_ACK:
+	if (!transaction.write)
+	    twiControl(TWI_START_CONDITION);
+	else if (index < transaction.size)
+	{
+	    twiWriteData(transaction.buffer[index++]);
+	    twiControl(TWI_SEND);
+	}
+	else
+	    finish(NO_ERROR);
+	break;
+
+    // Acknowledge every byte but the last so the device knows when to stop sending
+    case TW_MR_SLA_ACK:
+	twiControl(transaction.size > 1 ? TWI_ACK : TWI_NACK);
+	break;
+
+    case TW_MR_DATA_ACK:
+	transaction.buffer[index++] = twiReadData();
+	twiControl(index + 1 < transaction.size ? TWI_ACK : TWI_NACK);
+	break;
+
+    // The last byte has arrived
+    case TW_MR_DATA_NACK:
+	transaction.buffer[index++] = twiReadData();
+	finish(NO_ERROR);
+	break;
+
+    case TW_MT_SLA_NACK:
+    case TW_MR_SLA_NACK:
+	finish(ADDRESS_NO_ACKNOWLEDGE);
+	break;
+
+    case TW_MT_DATA_NACK:
+	finish(DATA_NO_ACKNOWLEDGE);
+	break;
+
+    // Lost arbitration, bus errors and anything unexpected
+    default:
+	finish(TWI_ERROR);
+	break;
+    }
+}
+
+// Bus event interrupt, the TWI hardware raises this after every START, address and data byte
+#ifdef __AVR__
+ISR(TWI_vect)
+#else
+void twiInterrupt()
+#endif
+{
+    twi_queue.service();
+}
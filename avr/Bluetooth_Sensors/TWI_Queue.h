@@ -0,0 +1,162 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Interrupt driven I2C master. Register reads and writes are submitted as transactions to a
+// queue and carried out by the TWI interrupt one bus event at a time, so the processor is free
+// to do other work (such as sending the previous sample) while the bus is busy. Each
+// transaction carries a status flag that stays TWI_PENDING until the bus is done with it and
+// an optional callback run from the interrupt on completion.
+//
+// A device that stops answering in the middle of a transaction (holding SDA low after a glitch
+// on the bus, say) would leave the interrupt waiting forever. So the queue is watched while it
+// is waited on: once the bus has made no progress for TWI_STALL_MICROS the bus is recovered by
+// clocking SCL until SDA is released and sending a STOP, the active transaction fails with
+// TWI_TIMEOUT and the queue carries on with the next.
+//
+// The bus runs at TWI_FREQUENCY, fast mode unless the build sets it lower. A device that can not
+// keep up can be given its own slower SCL frequency with setClock(), the bit rate is then
+// changed between the STOP ending one transaction and the START of the next.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef TWI_QUEUE
+#define TWI_QUEUE
+
+#include "stdint.h"
+
+// Number of transactions that can be waiting for the bus at once, enough for the 18 status and
+// output registers of the sensors read one per transaction. A power of two keeps the wrap a
+// mask.
+#define TWI_QUEUE_SIZE 32
+
+// SCL frequencies of standard and fast mode I2C, all of the sensors on the board can run at
+// fast mode
+#define TWI_STANDARD_MODE 100000L
+#define TWI_FAST_MODE 400000L
+
+// Default SCL frequency of the bus, standard mode may be needed where the pull ups are weak
+#ifndef TWI_FREQUENCY
+#define TWI_FREQUENCY TWI_FAST_MODE
+#endif
+
+// Most devices that can be given their own SCL frequency
+#define TWI_CLOCK_PROFILES 4
+
+// Microseconds the bus may go without an event before it is recovered, several times the
+// longest byte at the slowest SCL frequency
+#define TWI_STALL_MICROS 2000
+
+// Error handeling codes of the bus, shared by the sensor drivers and the sketch
+#define NO_ERROR 0
+#define BUFFER_SIZE_ERROR 1
+#define ADDRESS_NO_ACKNOWLEDGE 2
+#define DATA_NO_ACKNOWLEDGE 3
+#define TWI_ERROR 4
+#define IDENTIFICATION_FAILURE 5
+// A register did not hold what the driver last wrote to it
+#define REGISTER_MISMATCH 6
+// The bus stalled during the transaction and was recovered
+#define TWI_TIMEOUT 7
+
+// Status of a transaction that has not finished on the bus
+#define TWI_PENDING 0xFF
+
+// A single register read or write, owned by the caller and referenced by the queue until it
+// completes so no data is copied
+struct TWI_Transaction
+{
+    uint8_t device_address;
+    uint8_t register_address;
+    uint8_t size;
+    uint8_t write;
+    uint8_t * buffer;
+    // Called from the interrupt when the transaction finishes, may be null
+    void (*callback)(TWI_Transaction & transaction);
+    // Error code of the transaction once finished, TWI_PENDING until then
+    volatile uint8_t status;
+
+    // Set up a read of 'size' bytes starting at 'readAddress' into 'dest'
+    void setRead(uint8_t deviceAddress, uint8_t readAddress, uint8_t size, uint8_t * dest);
+
+    // Set up a write of 'size' bytes from 'src' starting at 'writeAddress'
+    void setWrite(uint8_t deviceAddress, uint8_t writeAddress, uint8_t size, uint8_t * src);
+
+    // True once the bus is finished with the transaction
+    bool complete() const { return status != TWI_PENDING; }
+};
+
+class TWI_Queue {
+// Internal members not used outside the class
+private:
+    TWI_Transaction * queue[TWI_QUEUE_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t count;
+    // Bytes of the active transaction moved so far
+    uint8_t index;
+    // True once the register address of the active transaction has been sent
+    uint8_t addressed;
+    // Bus events so far, and the count and time when watch() last saw it change
+    volatile uint8_t events;
+    uint8_t watched_events;
+    unsigned long watched_time;
+    // Bit rate register values of the default SCL frequency, of the devices given their own
+    // and of the transaction last started
+    uint8_t bit_rate;
+    uint8_t profile_devices[TWI_CLOCK_PROFILES];
+    uint8_t profile_rates[TWI_CLOCK_PROFILES];
+    uint8_t profiles;
+    uint8_t active_rate;
+
+    uint8_t rateOf(uint8_t device) const;
+    void start();
+    void finish(uint8_t error);
+    void recover();
+
+// Member functions accesible outside the class
+public:
+    TWI_Queue();
+
+    // Enable the TWI hardware and its interrupt, safe to call more than once
+    void begin();
+
+    // Add a transaction to the end of the queue, the bus is started if it was idle
+    uint8_t submit(TWI_Transaction & transaction);
+
+    // Submit a transaction and wait for it to finish, returning its error code
+    uint8_t execute(TWI_Transaction & transaction);
+
+    // Wait for a submitted transaction to finish and return its error code
+    uint8_t wait(TWI_Transaction & transaction);
+
+    // Set the SCL frequency in Hz of every device without a frequency of its own, from the
+    // next transaction on
+    void setFrequency(unsigned long frequency);
+
+    // Run the transactions of 'device' at 'frequency' Hz instead of the default, 0 to return it
+    // to the default. BUFFER_SIZE_ERROR if TWI_CLOCK_PROFILES devices already have their own.
+    uint8_t setClock(uint8_t device, unsigned long frequency);
+
+    // True while any transaction is queued or on the bus
+    bool busy() const { return count != 0; }
+
+    // Recover the bus if it has stalled, called while waiting on it so a transaction nobody
+    // waits on can only hold the bus until the next wait
+    void watch();
+
+    // Times the bus was recovered since reset
+    uint16_t recoveries;
+
+    // Advance the active transaction by one bus event, called from the TWI interrupt
+    void service();
+};
+
+extern TWI_Queue twi_queue;
+
+#endif
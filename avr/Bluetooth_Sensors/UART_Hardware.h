@@ -0,0 +1,70 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Register level access to the USART for Frame_Port. On the AVR these are the USART 0
+// registers themselves, in a host build they are provided by a simulated UART that times each
+// byte on the wire. The interrupt handlers are the sketch's USART_UDRE_vect and USART_RX_vect.
+
+// Compiler directive to make sure these functions have not already been defined
+#ifndef UART_HARDWARE
+#define UART_HARDWARE
+
+#include "stdint.h"
+
+#ifdef __AVR__
+
+#include <Arduino.h>
+#include <avr/io.h>
+
+// Turn on the transmitter, and the receiver with its interrupt, for 8N1 frames at double speed
+// where the baud rate is F_CPU / 8 / (divisor + 1)
+inline void uartEnable(uint16_t divisor)
+{
+    UCSR0A = _BV(U2X0);
+    UBRR0 = divisor;
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+// Data register, the next byte to send or the last byte received
+inline void uartWriteData(uint8_t data) { UDR0 = data; }
+inline uint8_t uartReadData() { return UDR0; }
+
+// Interrupt raised while the transmit data register is empty
+inline void uartTransmitInterrupt(bool enable)
+{
+    if (enable)
+	UCSR0B |= _BV(UDRIE0);
+    else
+	UCSR0B &= ~_BV(UDRIE0);
+}
+
+// Nothing to do while waiting on the transmitter or polling for a received byte, the
+// interrupts do the work
+inline void uartYield() {}
+inline void uartPoll() {}
+
+#else
+
+// Provided by the simulated UART in the host build
+void uartEnable(uint16_t divisor);
+void uartWriteData(uint8_t data);
+uint8_t uartReadData();
+void uartTransmitInterrupt(bool enable);
+
+// Let the simulated UART move on while the caller waits for the transmitter, or charge the
+// time of a poll that found no received byte
+void uartYield();
+void uartPoll();
+
+#endif
+
+#endif
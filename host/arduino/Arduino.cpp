@@ -0,0 +1,217 @@
+// Minimal stand in for the Arduino core so the firmware sources can be compiled and run on a
+// desktop machine. Time is virtual and only moves when the simulation charges it.
+
+#include "Arduino.h"
+#include "Virtual_Clock.h"
+#include <stdio.h>
+
+// Cycles charged each time interrupts are enabled, about one pass of a polling loop
+#define POLL_CYCLES 32
+// An analog conversion is 13 ADC clocks at F_CPU / 128 and the call around it
+#define ANALOG_READ_CYCLES (13 * 128 + 100)
+// Entering and leaving an interrupt handler and the handler itself
+#define TIMER_INTERRUPT_CYCLES 60
+#define EXTERNAL_INTERRUPT_CYCLES 60
+// Serial calls, a write includes the interrupt that later moves the byte to the UART
+#define SERIAL_READ_CYCLES 40
+#define SERIAL_WRITE_CYCLES (80 + 60)
+
+// Values returned by analogRead() for each pin
+static int analog_values[32];
+// Handlers attached to the external interrupts
+static void (*external_handlers[2])();
+
+HardwareSerial Serial;
+
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t OCR1A;
+volatile uint8_t TIMSK1;
+
+// Left undefined unless the sketch is linked in
+extern "C" void TIMER1_COMPA_vect() __attribute__((weak));
+
+unsigned long millis() { return (unsigned long)(clockNanos() / 1000000); }
+unsigned long micros() { return (unsigned long)(clockNanos() / 1000); }
+void delay(unsigned long ms) { advanceNanos((uint64_t)ms * 1000000); }
+void delayMicroseconds(unsigned int us) { advanceNanos((uint64_t)us * 1000); }
+void advanceMicros(unsigned long us) { advanceNanos((uint64_t)us * 1000); }
+
+void interrupts() { chargeCycles(POLL_CYCLES); }
+
+int analogRead(uint8_t pin)
+{
+    chargeCycles(ANALOG_READ_CYCLES);
+    return analog_values[pin % 32];
+}
+
+void setAnalogValue(uint8_t pin, int value) { analog_values[pin % 32] = value; }
+void digitalWrite(uint8_t, uint8_t) {}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int)
+{
+    if (interrupt < 2)
+	external_handlers[interrupt] = handler;
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+    if (interrupt < 2)
+	external_handlers[interrupt] = 0;
+}
+
+// Call the handler attached to an external interrupt, if any
+void raiseInterrupt(uint8_t interrupt)
+{
+    if (interrupt < 2 && external_handlers[interrupt]) {
+	external_handlers[interrupt]();
+	chargeCycles(EXTERNAL_INTERRUPT_CYCLES);
+    }
+}
+
+// Timer 1 counting up to OCR1A with the compare A interrupt, as the sketch sets it up
+class Timer1_Model : public Clock_Source {
+private:
+    uint64_t next;
+
+    uint16_t prescaler()
+    {
+	static const uint16_t prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	return prescalers[TCCR1B & 7];
+    }
+
+    // Nanoseconds between compare matches, zero while stopped or not interrupting
+    uint64_t period()
+    {
+	if (!prescaler() || !(TCCR1B & _BV(WGM12)) || !(TIMSK1 & _BV(OCIE1A)) || !TIMER1_COMPA_vect)
+	    return 0;
+	return cycleNanos((uint64_t)prescaler() * (OCR1A + 1));
+    }
+
+public:
+    Timer1_Model() : next(0) { addClockSource(*this); }
+
+    // Timer ticks since the last compare match while interrupting, otherwise counted from the
+    // start of the simulation up to OCR1A in clear timer on compare mode or 0xFFFF in normal mode
+    uint16_t count()
+    {
+	if (!prescaler())
+	    return 0;
+	double tick = 1e9 * prescaler() / F_CPU;
+	uint64_t length = period();
+	if (length && next)
+	    return (clockNanos() - (next - length)) / tick;
+	uint64_t ticks = clockNanos() / tick;
+	return TCCR1B & _BV(WGM12) ? ticks % (OCR1A + 1) : ticks;
+    }
+
+    virtual uint64_t nextEvent()
+    {
+	uint64_t length = period();
+	if (length == 0) {
+	    next = 0;
+	    return CLOCK_IDLE;
+	}
+	// The count starts when the timer is set up
+	if (next == 0)
+	    next = clockNanos() + length;
+	return next;
+    }
+
+    virtual void fire()
+    {
+	next += period();
+	TIMER1_COMPA_vect();
+	chargeCycles(TIMER_INTERRUPT_CYCLES);
+    }
+};
+
+static Timer1_Model timer1;
+
+uint16_t timer1Count()
+{
+    return timer1.count();
+}
+
+// The core picks the double speed divisor, the UART then runs at F_CPU / 8 / (divisor + 1)
+void HardwareSerial::begin(long rate)
+{
+    baud = rate;
+    uint64_t divisor = (F_CPU / 4 / rate - 1) / 2;
+    byte_time = 10 * 1000000000ULL * 8 * (divisor + 1) / F_CPU;
+}
+
+// Next received byte, or -1 when nothing is waiting
+int HardwareSerial::read()
+{
+    chargeCycles(SERIAL_READ_CYCLES);
+    if (received.empty())
+	return -1;
+    uint8_t data = received.front();
+    received.pop_front();
+    return data;
+}
+
+size_t HardwareSerial::write(uint8_t data)
+{
+    chargeCycles(SERIAL_WRITE_CYCLES);
+    uint64_t now = clockNanos();
+    // With the buffer full, wait until the byte ahead of the buffer has left the shift register
+    if (byte_time && sent_time > now + SERIAL_TX_BUFFER_SIZE * byte_time) {
+	uint64_t room = sent_time - SERIAL_TX_BUFFER_SIZE * byte_time;
+	stalled += room - now;
+	advanceClockTo(room);
+	now = clockNanos();
+    }
+    sent_time = (sent_time > now ? sent_time : now) + byte_time;
+    transmitted.push_back(data);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t * data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+	write(data[i]);
+    return size;
+}
+
+// Wait for every byte written to be sent
+void HardwareSerial::flush()
+{
+    if (sent_time > clockNanos())
+	advanceClockTo(sent_time);
+}
+
+size_t HardwareSerial::print(const char * text)
+{
+    size_t n = 0;
+    while (text[n])
+	write((uint8_t)text[n++]);
+    return n;
+}
+
+size_t HardwareSerial::print(char value)
+{
+    return write((uint8_t)value);
+}
+
+size_t HardwareSerial::print(long value, int base)
+{
+    char text[40];
+    snprintf(text, sizeof(text), base == 16 ? "%lX" : "%ld", value);
+    return print(text);
+}
+
+size_t HardwareSerial::print(unsigned long value, int base)
+{
+    char text[40];
+    snprintf(text, sizeof(text), base == 16 ? "%lX" : "%lu", value);
+    return print(text);
+}
+
+size_t HardwareSerial::print(double value, int digits)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return print(text);
+}
@@ -0,0 +1,102 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Minimal stand in for the Arduino core so the firmware sources, and the sketch itself, can be
+// compiled and run on a desktop machine. Time is virtual and only moves when the simulation
+// charges it, see Virtual_Clock.h. Calls that take real time on the board (an analog
+// conversion, the polling loops that wait for interrupts) charge it here, and timer 1 is
+// modelled far enough to run the sketch's sample clock.
+
+// Compiler directive to make sure the core has not already been defined
+#ifndef HOST_ARDUINO
+#define HOST_ARDUINO
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Clock of the ATmega328 on the Uno
+#ifndef F_CPU
+#define F_CPU 16000000L
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define HEX 16
+#define DEC 10
+
+// Analog pins of the Uno
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define _BV(bit) (1 << (bit))
+
+// Interrupts are carried out between calls as the clock moves so there is nothing to mask.
+// Enabling them charges the few cycles of the polling loops they are used in, so code that
+// waits on a flag set by an interrupt lets time pass.
+void interrupts();
+#define noInterrupts()
+
+// Timer 1 registers and the bits the sketch uses, from the ATmega328 datasheet. Only normal
+// mode and clear timer on compare mode with the compare A interrupt are modelled, and the
+// count can only be read.
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t TIMSK1;
+uint16_t timer1Count();
+#define TCNT1 timer1Count()
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCIE1A 1
+
+// Interrupt handlers are plain functions the simulation calls by name
+#define ISR(vector) extern "C" void vector()
+extern "C" void TIMER1_COMPA_vect();
+extern "C" void USART_UDRE_vect();
+extern "C" void USART_RX_vect();
+
+// External interrupts 0 (pin 2) and 1 (pin 3), raised by the simulated sensors
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+void raiseInterrupt(uint8_t interrupt);
+
+// Virtual time since the simulation started
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Move the virtual clock forward, used by the simulated peripherals to charge bus time
+void advanceMicros(unsigned long us);
+
+// Analog and digital pins, analog values are set by the simulation
+int analogRead(uint8_t pin);
+void setAnalogValue(uint8_t pin, int value);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+#include "HardwareSerial.h"
+
+#endif
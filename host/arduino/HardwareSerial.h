@@ -0,0 +1,74 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Host stand in for the Arduino hardware serial port. Bytes written by the firmware are
+// collected for the simulation to inspect and bytes queued by the simulation are handed to
+// the firmware by read(). Sending is timed as the UART does it: the baud rate is rounded to
+// what the core's divisor gives, each byte takes ten bit times on the wire and a write to a
+// full transmit buffer waits for a byte to go out, charging the wait to the virtual clock.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef HOST_HARDWARE_SERIAL
+#define HOST_HARDWARE_SERIAL
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+// Bytes the core's transmit ring buffer holds
+#define SERIAL_TX_BUFFER_SIZE 64
+
+class HardwareSerial {
+public:
+    // Baud rate requested by the firmware
+    long baud;
+    // Nanoseconds each byte takes on the wire at the baud rate the UART really runs at
+    uint64_t byte_time;
+    // Virtual time the last byte written finishes sending
+    uint64_t sent_time;
+    // Nanoseconds writes spent waiting for room in the transmit buffer
+    uint64_t stalled;
+    // Bytes sent by the firmware
+    std::vector<uint8_t> transmitted;
+    // Bytes waiting to be read by the firmware
+    std::deque<uint8_t> received;
+
+    HardwareSerial() : baud(0), byte_time(0), sent_time(0), stalled(0) {}
+
+    void begin(long rate);
+    void end() {}
+    int available() { return received.size(); }
+    // Wait for every byte written to be sent
+    void flush();
+
+    // Next received byte, or -1 when nothing is waiting
+    int read();
+
+    size_t write(uint8_t data);
+    size_t write(const uint8_t * data, size_t size);
+
+    size_t print(const char * text);
+    size_t print(char value);
+    size_t print(long value, int base = 10);
+    size_t print(unsigned long value, int base = 10);
+    size_t print(int value, int base = 10) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = 10) { return print((unsigned long)value, base); }
+    size_t print(short value, int base = 10) { return print((long)value, base); }
+    size_t print(unsigned char value, int base = 10) { return print((unsigned long)value, base); }
+    size_t print(double value, int digits = 2);
+    size_t println() { return print("\r\n"); }
+    template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+};
+
+extern HardwareSerial Serial;
+
+#endif
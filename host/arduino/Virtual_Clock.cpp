@@ -0,0 +1,88 @@
+// Virtual time for the host build of the firmware
+
+#include "Virtual_Clock.h"
+#include "Arduino.h"
+#include <algorithm>
+#include <vector>
+
+static uint64_t clock_ns;
+static uint64_t clock_limit = CLOCK_IDLE;
+
+// Built on first use so sources constructed before main() can register
+static std::vector<Clock_Source *> & sources()
+{
+    static std::vector<Clock_Source *> list;
+    return list;
+}
+
+void addClockSource(Clock_Source & source)
+{
+    std::vector<Clock_Source *> & list = sources();
+    if (std::find(list.begin(), list.end(), &source) == list.end())
+	list.push_back(&source);
+}
+
+void removeClockSource(Clock_Source & source)
+{
+    std::vector<Clock_Source *> & list = sources();
+    list.erase(std::remove(list.begin(), list.end(), &source), list.end());
+}
+
+uint64_t clockNanos()
+{
+    return clock_ns;
+}
+
+static void setClock(uint64_t time)
+{
+    if (time >= clock_limit) {
+	clock_ns = clock_limit;
+	throw Clock_Limit();
+    }
+    clock_ns = time;
+}
+
+// Carry out every event due up to 'time' in order, then move the clock to it. Events are
+// carried out at their own time, or now if they were due before the clock got here.
+void advanceClockTo(uint64_t time)
+{
+    for (;;) {
+	Clock_Source * next = 0;
+	uint64_t when = CLOCK_IDLE;
+	std::vector<Clock_Source *> & list = sources();
+	for (size_t i = 0; i < list.size(); ++i) {
+	    uint64_t event = list[i]->nextEvent();
+	    if (event < when) {
+		when = event;
+		next = list[i];
+	    }
+	}
+	if (!next || when > time)
+	    break;
+	if (when > clock_ns)
+	    setClock(when);
+	next->fire();
+    }
+    if (time > clock_ns)
+	setClock(time);
+}
+
+void advanceNanos(uint64_t ns)
+{
+    advanceClockTo(clock_ns + ns);
+}
+
+uint64_t cycleNanos(uint64_t cycles)
+{
+    return cycles * 1000000000ULL / F_CPU;
+}
+
+void chargeCycles(unsigned long cycles)
+{
+    advanceNanos(cycleNanos(cycles));
+}
+
+void setClockLimit(uint64_t time)
+{
+    clock_limit = time;
+}
@@ -0,0 +1,64 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Virtual time for the host build of the firmware. The clock only moves when something charges
+// it: the simulated peripherals for the time their transfers take, the stand in core for the
+// cycles its calls cost and the firmware's busy waits for the time until the next event. Each
+// peripheral that acts at a point in time (a timer compare, the TWI finishing a byte, a sensor
+// latching a sample) is a clock source, and moving the clock past its next event carries the
+// event out at that time, much as the hardware would interrupt the code that is running.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef VIRTUAL_CLOCK
+#define VIRTUAL_CLOCK
+
+#include <stdint.h>
+
+// Next event time of a source with nothing to do
+#define CLOCK_IDLE UINT64_MAX
+
+// Something in the simulation that acts at points in virtual time
+class Clock_Source {
+public:
+    virtual ~Clock_Source() {}
+
+    // Nanoseconds of virtual time of the next action, CLOCK_IDLE if there is none
+    virtual uint64_t nextEvent() = 0;
+
+    // Carry out the action due at nextEvent(), which must then move on
+    virtual void fire() = 0;
+};
+
+// Thrown by whatever moves the clock past the limit set with setClockLimit(), so a simulation
+// of firmware that never returns from loop() can be stopped
+struct Clock_Limit {};
+
+// Register a source, and remove one that is about to go away
+void addClockSource(Clock_Source & source);
+void removeClockSource(Clock_Source & source);
+
+// Virtual time in nanoseconds since the simulation started
+uint64_t clockNanos();
+
+// Move the clock forward, carrying out every event that falls due on the way in time order
+void advanceNanos(uint64_t ns);
+void advanceClockTo(uint64_t time);
+
+// Charge the time 'cycles' CPU cycles take at F_CPU
+void chargeCycles(unsigned long cycles);
+
+// Throw Clock_Limit once the clock reaches 'time', CLOCK_IDLE for no limit
+void setClockLimit(uint64_t time);
+
+// Nanoseconds of 'cycles' CPU cycles
+uint64_t cycleNanos(uint64_t cycles);
+
+#endif
@@ -0,0 +1,538 @@
+// Accelerometer and gyroscope calibration from a capture of the board being turned between
+// static positions, see Imu_Calibration.h for the steps.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "Imu_Calibration.h"
+#include "Sample_Log.h"
+
+// Windows between exact recomputations of the running sums, bounding their rounding error
+#define VARIANCE_BLOCK 4096
+
+#define DEG_TO_RAD (M_PI / 180)
+
+// Call 'function' with every index below 'count', shared out over 'threads' threads
+template <typename Function>
+static void parallelFor(size_t count, unsigned threads, Function function)
+{
+    if (threads > count)
+	threads = count;
+    if (threads <= 1) {
+	for (size_t i = 0; i < count; ++i)
+	    function(i);
+	return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+	for (size_t i = next++; i < count; i = next++)
+	    function(i);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i)
+	pool.push_back(std::thread(work));
+    work();
+    for (size_t i = 0; i < pool.size(); ++i)
+	pool[i].join();
+}
+
+// Solve 'a' x = 'b' in place for a symmetric positive definite 'a' by Cholesky factoring,
+// false if 'a' is not positive definite
+static bool solveSymmetric(double a[CALIBRATION_PARAMETERS][CALIBRATION_PARAMETERS], double * b)
+{
+    const int n = CALIBRATION_PARAMETERS;
+    for (int j = 0; j < n; ++j) {
+	double diagonal = a[j][j];
+	for (int k = 0; k < j; ++k)
+	    diagonal -= a[j][k] * a[j][k];
+	if (!(diagonal > 0))
+	    return false;
+	a[j][j] = sqrt(diagonal);
+	for (int i = j + 1; i < n; ++i) {
+	    double value = a[i][j];
+	    for (int k = 0; k < j; ++k)
+		value -= a[i][k] * a[j][k];
+	    a[i][j] = value / a[j][j];
+	}
+    }
+    for (int i = 0; i < n; ++i) {
+	for (int k = 0; k < i; ++k)
+	    b[i] -= a[i][k] * b[k];
+	b[i] /= a[i][i];
+    }
+    for (int i = n - 1; i >= 0; --i) {
+	for (int k = i + 1; k < n; ++k)
+	    b[i] -= a[k][i] * b[k];
+	b[i] /= a[i][i];
+    }
+    return true;
+}
+
+// Sum of the squared residuals at 'p'
+static double sumOfSquares(Calibration_Residual residual, const void * context, size_t residuals,
+			   const double * p, unsigned threads, std::vector<double> & values)
+{
+    parallelFor(residuals, threads, [&](size_t i) { values[i] = residual(p, i, context); });
+    double sum = 0;
+    for (size_t i = 0; i < residuals; ++i)
+	sum += values[i] * values[i];
+    return sum;
+}
+
+void fitLeastSquares(Calibration_Residual residual, const void * context, size_t residuals,
+		     const double * init, unsigned threads, Calibration_Fit & fit,
+		     double tolerance, unsigned max_iterations)
+{
+    const int n = CALIBRATION_PARAMETERS;
+    std::vector<double> values(residuals), trial_values(residuals), jacobian(residuals * n);
+    memcpy(fit.p, init, sizeof(fit.p));
+    fit.iterations = 0;
+    fit.converged = false;
+    double lambda = 1e-3;
+    double sum = sumOfSquares(residual, context, residuals, fit.p, threads, values);
+
+    while (fit.iterations < max_iterations && !fit.converged) {
+	fit.iterations += 1;
+
+	// Forward differences, a step of a thousandth of each parameter or of one when it is zero
+	double step[n];
+	for (int j = 0; j < n; ++j)
+	    step[j] = fit.p[j] != 0 ? 1e-3 * fit.p[j] : 1e-3;
+	parallelFor(residuals, threads, [&](size_t i) {
+	    double p[n];
+	    memcpy(p, fit.p, sizeof(p));
+	    for (int j = 0; j < n; ++j) {
+		p[j] = fit.p[j] + step[j];
+		jacobian[i * n + j] = (residual(p, i, context) - values[i]) / step[j];
+		p[j] = fit.p[j];
+	    }
+	});
+
+	// Normal equations
+	double normal[n][n], gradient[n];
+	memset(normal, 0, sizeof(normal));
+	memset(gradient, 0, sizeof(gradient));
+	for (size_t i = 0; i < residuals; ++i) {
+	    const double * row = &jacobian[i * n];
+	    for (int j = 0; j < n; ++j) {
+		gradient[j] -= row[j] * values[i];
+		for (int k = 0; k <= j; ++k)
+		    normal[j][k] += row[j] * row[k];
+	    }
+	}
+	for (int j = 0; j < n; ++j)
+	    for (int k = 0; k < j; ++k)
+		normal[k][j] = normal[j][k];
+
+	// Raise the damping until a step lowers the sum of squares
+	bool improved = false;
+	while (!improved && lambda < 1e10) {
+	    double damped[n][n], delta[n], p[n];
+	    memcpy(damped, normal, sizeof(damped));
+	    memcpy(delta, gradient, sizeof(delta));
+	    for (int j = 0; j < n; ++j)
+		damped[j][j] += lambda * (normal[j][j] > 0 ? normal[j][j] : 1);
+	    if (!solveSymmetric(damped, delta)) {
+		lambda *= 10;
+		continue;
+	    }
+	    for (int j = 0; j < n; ++j)
+		p[j] = fit.p[j] + delta[j];
+	    double trial = sumOfSquares(residual, context, residuals, p, threads, trial_values);
+	    if (trial < sum) {
+		fit.converged = sum - trial < tolerance * sum;
+		memcpy(fit.p, p, sizeof(p));
+		values.swap(trial_values);
+		sum = trial;
+		lambda = std::max(lambda / 10, 1e-12);
+		improved = true;
+	    }
+	    else
+		lambda *= 10;
+	}
+	// Nowhere lower to go
+	if (!improved)
+	    fit.converged = true;
+    }
+    fit.rms = residuals ? sqrt(sum / residuals) : 0;
+}
+
+// Acceleration variance over the window of 'width' + 1 samples starting at each sample, as
+// calibration.m takes var() of acc(i:i+width) and acc(i-width:i)
+static void windowVariance(const std::vector<Imu_Sample> & samples, unsigned width,
+			   std::vector<double> & window, unsigned threads)
+{
+    const size_t windows = samples.size() - width;
+    const double n = width + 1;
+    window.resize(windows);
+
+    // Every block starts from exact sums about its first sample, then slides the window
+    parallelFor((windows + VARIANCE_BLOCK - 1) / VARIANCE_BLOCK, threads, [&](size_t block) {
+	size_t first = block * VARIANCE_BLOCK;
+	size_t last = std::min(first + VARIANCE_BLOCK, windows);
+	double shift[3], sum[3] = { 0, 0, 0 }, squares[3] = { 0, 0, 0 };
+	for (int axis = 0; axis < 3; ++axis)
+	    shift[axis] = samples[first].acc[axis];
+	for (size_t i = first; i <= first + width; ++i)
+	    for (int axis = 0; axis < 3; ++axis) {
+		double value = samples[i].acc[axis] - shift[axis];
+		sum[axis] += value;
+		squares[axis] += value * value;
+	    }
+
+	for (size_t i = first;; ++i) {
+	    double variance = 0;
+	    for (int axis = 0; axis < 3; ++axis)
+		variance += std::max((squares[axis] - sum[axis] * sum[axis] / n) / (n - 1), 0.0);
+	    window[i] = variance;
+	    if (i + 1 == last)
+		break;
+	    for (int axis = 0; axis < 3; ++axis) {
+		double leaving = samples[i].acc[axis] - shift[axis];
+		double entering = samples[i + width + 1].acc[axis] - shift[axis];
+		sum[axis] += entering - leaving;
+		squares[axis] += entering * entering - leaving * leaving;
+	    }
+	}
+    });
+}
+
+void staticVariance(const std::vector<Imu_Sample> & samples, unsigned width,
+		    std::vector<double> & variance, unsigned threads)
+{
+    variance.assign(samples.size(), 0);
+    if (width == 0 || samples.size() <= 2 * (size_t)width)
+	return;
+
+    std::vector<double> window;
+    windowVariance(samples, width, window, threads);
+    for (size_t i = width; i < samples.size() - width; ++i)
+	variance[i] = window[i] + window[i - width];
+}
+
+void staticVarianceDirect(const std::vector<Imu_Sample> & samples, unsigned width,
+			  std::vector<double> & variance)
+{
+    variance.assign(samples.size(), 0);
+    if (width == 0 || samples.size() <= 2 * (size_t)width)
+	return;
+
+    const double n = width + 1;
+    for (size_t i = width; i < samples.size() - width; ++i) {
+	double total = 0;
+	for (int side = 0; side < 2; ++side) {
+	    size_t first = side ? i : i - width;
+	    for (int axis = 0; axis < 3; ++axis) {
+		double mean = 0, squares = 0;
+		for (size_t k = first; k <= first + width; ++k)
+		    mean += samples[k].acc[axis];
+		mean /= n;
+		for (size_t k = first; k <= first + width; ++k) {
+		    double value = samples[k].acc[axis] - mean;
+		    squares += value * value;
+		}
+		total += squares / (n - 1);
+	    }
+	}
+	variance[i] = total;
+    }
+}
+
+void staticIntervals(const std::vector<double> & variance, unsigned width,
+		     std::vector<Static_Interval> & intervals, double quantile)
+{
+    intervals.clear();
+    const size_t count = variance.size();
+    if (count <= 2 * (size_t)width)
+	return;
+
+    // Cut off at the quantile of every variance, the zeros at the ends included
+    std::vector<double> sorted(variance);
+    size_t rank = (size_t)(count * quantile);
+    rank = std::min(std::max(rank, (size_t)1), count) - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    const double cutoff = sorted[rank];
+
+    std::vector<bool> still(count, false);
+    for (size_t i = width; i < count - width; ++i)
+	still[i] = variance[i] < cutoff;
+
+    // Each run ends on the first sample that moved, which calibration.m averages in as well
+    std::vector<Static_Interval> runs;
+    for (size_t i = 0; i + 1 < count; ++i) {
+	if (!still[i])
+	    continue;
+	size_t j = i + 1;
+	while (j + 1 < count && still[j])
+	    j += 1;
+	Static_Interval run = { i, j };
+	runs.push_back(run);
+	i = j;
+    }
+    if (runs.empty())
+	return;
+
+    // A third of the average length, leaving out the runs cut short by the ends of the capture
+    size_t first = runs.size() > 2 ? 1 : 0;
+    size_t last = runs.size() > 2 ? runs.size() - 1 : runs.size();
+    double average = 0;
+    for (size_t i = first; i < last; ++i)
+	average += runs[i].last - runs[i].first;
+    double shortest = average / (last - first) / 3;
+
+    for (size_t i = 0; i < runs.size(); ++i)
+	if (runs[i].last - runs[i].first > shortest)
+	    intervals.push_back(runs[i]);
+}
+
+double localGravity(double latitude, double altitude)
+{
+    double sin_latitude = sin(latitude), sin_twice = sin(2 * latitude);
+    return 9.780327 * (1 + 0.0053024 * sin_latitude * sin_latitude -
+		       0.0000058 * sin_twice * sin_twice) - 3.155e-7 * altitude;
+}
+
+void accelerometerCorrection(const double * p, double correction[3][3], double bias[3])
+{
+    double matrix[3][3] = { { p[0], p[3], p[4] }, { 0, p[1], p[5] }, { 0, 0, p[2] } };
+    memcpy(correction, matrix, sizeof(matrix));
+    for (int i = 0; i < 3; ++i)
+	bias[i] = p[6 + i];
+}
+
+void gyroscopeCorrection(const double * p, double correction[3][3])
+{
+    double matrix[3][3] = { { p[0], p[3], p[4] }, { p[6], p[1], p[5] }, { p[7], p[8], p[2] } };
+    memcpy(correction, matrix, sizeof(matrix));
+}
+
+// What the fits are given besides the parameters
+struct Calibration_Problem
+{
+    const Imu_Sample * samples;
+    const Static_Interval * intervals;
+    const double * means;
+    double gravity;
+};
+
+// Corrected magnitude of the average acceleration of static period 'index' less gravity
+static double accelerometerResidual(const double * p, size_t index, const void * context)
+{
+    const Calibration_Problem & problem = *(const Calibration_Problem *)context;
+    const double * mean = problem.means + 3 * index;
+    double correction[3][3], bias[3], magnitude = 0;
+    accelerometerCorrection(p, correction, bias);
+    for (int i = 0; i < 3; ++i) {
+	double value = bias[i];
+	for (int j = 0; j < 3; ++j)
+	    value += correction[i][j] * mean[j];
+	magnitude += value * value;
+    }
+    return sqrt(magnitude) - problem.gravity;
+}
+
+// Distance between the corrected gyroscope rates integrated from the end of static period
+// 'index' to the start of the next and the rotation between their gravity vectors. The rates
+// are converted to rad/s before integrating, calibration.m integrated deg/s as rad/s which left
+// the fit to find the conversion from a start a factor of 57 away.
+static double gyroscopeResidual(const double * p, size_t index, const void * context)
+{
+    const Calibration_Problem & problem = *(const Calibration_Problem *)context;
+    double correction[3][3];
+    gyroscopeCorrection(p, correction);
+
+    // q = q + q * (0, w) dt / 2, normalized after every step
+    double q[4] = { 1, 0, 0, 0 };
+    for (size_t k = problem.intervals[index].last; k < problem.intervals[index + 1].first; ++k) {
+	const Imu_Sample & sample = problem.samples[k];
+	double w[3];
+	for (int i = 0; i < 3; ++i)
+	    w[i] = (correction[i][0] * sample.gyro[0] + correction[i][1] * sample.gyro[1] +
+		    correction[i][2] * sample.gyro[2]) * DEG_TO_RAD;
+	double half = 0.5 * sample.delta;
+	double step[4] = { -q[1] * w[0] - q[2] * w[1] - q[3] * w[2],
+			   q[0] * w[0] + q[2] * w[2] - q[3] * w[1],
+			   q[0] * w[1] - q[1] * w[2] + q[3] * w[0],
+			   q[0] * w[2] + q[1] * w[1] - q[2] * w[0] };
+	double norm = 0;
+	for (int i = 0; i < 4; ++i) {
+	    q[i] += half * step[i];
+	    norm += q[i] * q[i];
+	}
+	norm = sqrt(norm);
+	for (int i = 0; i < 4; ++i)
+	    q[i] /= norm;
+    }
+
+    // Shortest rotation between the gravity vectors, half a turn about any perpendicular axis
+    // when they are opposite
+    const double * v1 = problem.means + 3 * index;
+    const double * v2 = v1 + 3;
+    double n1 = sqrt(v1[0] * v1[0] + v1[1] * v1[1] + v1[2] * v1[2]);
+    double n2 = sqrt(v2[0] * v2[0] + v2[1] * v2[1] + v2[2] * v2[2]);
+    double dot = v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2];
+    double rotation[4];
+    if (dot < -0.999999 * n1 * n2) {
+	double axis[3] = { 0, -v1[2], v1[1] };
+	if (sqrt(axis[1] * axis[1] + axis[2] * axis[2]) < 1e-6 * n1) {
+	    axis[0] = v1[2];
+	    axis[1] = 0;
+	    axis[2] = -v1[0];
+	}
+	double norm = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	rotation[0] = 0;
+	for (int i = 0; i < 3; ++i)
+	    rotation[i + 1] = axis[i] / norm;
+    }
+    else {
+	rotation[0] = n1 * n2 + dot;
+	rotation[1] = v1[1] * v2[2] - v1[2] * v2[1];
+	rotation[2] = v1[2] * v2[0] - v1[0] * v2[2];
+	rotation[3] = v1[0] * v2[1] - v1[1] * v2[0];
+	double norm = sqrt(rotation[0] * rotation[0] + rotation[1] * rotation[1] +
+			   rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+	for (int i = 0; i < 4; ++i)
+	    rotation[i] /= norm;
+    }
+
+    double distance = 0;
+    for (int i = 0; i < 4; ++i)
+	distance += (rotation[i] - q[i]) * (rotation[i] - q[i]);
+    return sqrt(distance);
+}
+
+Imu_Calibration::Imu_Calibration()
+    : width(CALIBRATION_WIDTH), quantile(2.0 / 3.0),
+      gravity(localGravity(40.0176, 1655)), threads(1)
+{
+}
+
+bool Imu_Calibration::calibrate(const std::vector<Imu_Sample> & samples)
+{
+    staticVariance(samples, width, variance, threads);
+    staticIntervals(variance, width, intervals, quantile);
+    // The gyroscope is fitted to the movements between periods, one fewer than the periods
+    if (intervals.size() <= CALIBRATION_PARAMETERS)
+	return false;
+
+    means.assign(3 * intervals.size(), 0);
+    for (size_t i = 0; i < intervals.size(); ++i) {
+	for (size_t k = intervals[i].first; k <= intervals[i].last; ++k)
+	    for (int axis = 0; axis < 3; ++axis)
+		means[3 * i + axis] += samples[k].acc[axis];
+	for (int axis = 0; axis < 3; ++axis)
+	    means[3 * i + axis] /= intervals[i].last - intervals[i].first + 1;
+    }
+
+    const double init[CALIBRATION_PARAMETERS] = { 1, 1, 1, 0, 0, 0, 0, 0, 0 };
+    Calibration_Problem problem = { &samples[0], &intervals[0], &means[0], gravity };
+    fitLeastSquares(accelerometerResidual, &problem, intervals.size(), init, threads,
+		    accelerometer);
+
+    // The gyroscope is fitted to the rotations between the corrected gravity vectors
+    double correction[3][3], bias[3];
+    accelerometerCorrection(accelerometer.p, correction, bias);
+    std::vector<double> corrected(means.size());
+    for (size_t i = 0; i < intervals.size(); ++i)
+	for (int axis = 0; axis < 3; ++axis)
+	    corrected[3 * i + axis] = bias[axis] + correction[axis][0] * means[3 * i] +
+		correction[axis][1] * means[3 * i + 1] + correction[axis][2] * means[3 * i + 2];
+    problem.means = &corrected[0];
+    fitLeastSquares(gyroscopeResidual, &problem, intervals.size() - 1, init, threads,
+		    gyroscope);
+    return true;
+}
+
+// Android application CSV log, the first line is skipped as dlmread is told to
+static bool loadCsv(const std::string & path, std::vector<Imu_Sample> & samples)
+{
+    FILE * file = fopen(path.c_str(), "r");
+    if (!file)
+	return false;
+
+    char line[512];
+    bool first = true;
+    while (fgets(line, sizeof(line), file)) {
+	if (first) {
+	    first = false;
+	    continue;
+	}
+	double values[7];
+	char * next = line;
+	int count = 0;
+	for (; count < 7; ++count) {
+	    char * end;
+	    values[count] = strtod(next, &end);
+	    if (end == next)
+		break;
+	    next = end;
+	    while (*next == ',' || *next == ' ')
+		next += 1;
+	}
+	if (count == 0)
+	    continue;
+	if (count < 7) {
+	    fclose(file);
+	    return false;
+	}
+	Imu_Sample sample;
+	sample.delta = values[0] * 1e-6;
+	memcpy(sample.acc, values + 1, sizeof(sample.acc));
+	memcpy(sample.gyro, values + 4, sizeof(sample.gyro));
+	samples.push_back(sample);
+    }
+    fclose(file);
+    return true;
+}
+
+// Binary sample log, readings a sample does not have repeat the last values as in the CSV log
+static bool loadLog(const std::string & path, std::vector<Imu_Sample> & samples)
+{
+    Sample_Log_Reader log;
+    if (!log.open(path))
+	return false;
+
+    const double acc_scale = log.column(LOG_ACC_X).scale;
+    const double gyro_scale = log.column(LOG_GYRO_X).scale;
+    Imu_Sample sample;
+    memset(&sample, 0, sizeof(sample));
+    uint64_t last_time = 0;
+    samples.reserve(samples.size() + log.rows());
+    for (uint32_t chunk = 0; chunk < log.chunks(); ++chunk) {
+	uint32_t rows = log.chunk(chunk).rows;
+	const uint64_t * times = log.values<uint64_t>(chunk, LOG_TIME);
+	const uint16_t * deltas = log.values<uint16_t>(chunk, LOG_DELTA);
+	const uint8_t * sensors = log.values<uint8_t>(chunk, LOG_SENSORS);
+	const int16_t * acc[3], * gyro[3];
+	for (int i = 0; i < 3; ++i) {
+	    acc[i] = log.values<int16_t>(chunk, LOG_ACC_X + i);
+	    gyro[i] = log.values<int16_t>(chunk, LOG_GYRO_X + i);
+	}
+	for (uint32_t row = 0; row < rows; ++row) {
+	    // Spacing from the board times, the first row keeps the delta it was logged with
+	    sample.delta = (samples.empty() ? deltas[row] : times[row] - last_time) * 1e-6;
+	    last_time = times[row];
+	    for (int i = 0; i < 3; ++i) {
+		if (sensors[row] & ACC)
+		    sample.acc[i] = acc[i][row] * acc_scale;
+		if (sensors[row] & GYRO)
+		    sample.gyro[i] = gyro[i][row] * gyro_scale;
+	    }
+	    samples.push_back(sample);
+	}
+    }
+    return true;
+}
+
+bool loadImuSamples(const std::string & path, std::vector<Imu_Sample> & samples)
+{
+    const std::string extension = ".bslog";
+    if (path.size() > extension.size() &&
+	path.compare(path.size() - extension.size(), extension.size(), extension) == 0)
+	return loadLog(path, samples);
+    return loadCsv(path, samples);
+}
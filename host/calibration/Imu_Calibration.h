@@ -0,0 +1,125 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Accelerometer and gyroscope calibration, the same steps as analysis/calibration.m:
+//   1. the variance of the acceleration over a window before and after every sample marks the
+//      board as static where it is below the two thirds quantile,
+//   2. runs of static samples shorter than a third of the average run are dropped and the
+//      acceleration is averaged over the rest,
+//   3. an upper triangular scale and alignment matrix and a bias are fitted to the
+//      accelerometer so every average has the magnitude of local gravity,
+//   4. a full scale and alignment matrix is fitted to the gyroscope so its rates, integrated
+//      over the movement between two static periods, give the rotation between their gravity
+//      vectors.
+// The window variances are kept as running sums so finding the static periods is linear in
+// the length of the capture, and both fits are solved with Levenberg-Marquardt with the
+// residuals of the static periods or the movements between them shared out over threads.
+
+// Compiler directive to make sure the classes have not already been defined
+#ifndef IMU_CALIBRATION
+#define IMU_CALIBRATION
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define CALIBRATION_PARAMETERS 9
+#define CALIBRATION_WIDTH 100
+
+// A sample as logged by the Android application
+struct Imu_Sample
+{
+    // Seconds since the last sample
+    double delta;
+    // Acceleration in m/s^2 and rotation rate in deg/s for each axis
+    double acc[3];
+    double gyro[3];
+};
+
+// Samples 'first' through 'last' of a static period
+struct Static_Interval
+{
+    size_t first;
+    size_t last;
+};
+
+// Residual 'index' of a least squares problem for the parameters 'p', called from several
+// threads at once
+typedef double (*Calibration_Residual)(const double * p, size_t index, const void * context);
+
+struct Calibration_Fit
+{
+    double p[CALIBRATION_PARAMETERS];
+    unsigned iterations;
+    bool converged;
+    // Root mean square of the residuals at 'p'
+    double rms;
+};
+
+// Least squares fit of CALIBRATION_PARAMETERS parameters starting from 'init', with forward
+// difference derivatives stepped by a thousandth of each parameter as leasqr does. Stops once
+// the sum of squares improves by less than 'tolerance' of itself or after 'max_iterations'.
+void fitLeastSquares(Calibration_Residual residual, const void * context, size_t residuals,
+		     const double * init, unsigned threads, Calibration_Fit & fit,
+		     double tolerance = 1e-4, unsigned max_iterations = 20);
+
+// Sum over the axes of the acceleration variance over the 'width' samples before and the
+// 'width' samples after each sample, zero within 'width' of either end
+void staticVariance(const std::vector<Imu_Sample> & samples, unsigned width,
+		    std::vector<double> & variance, unsigned threads = 1);
+
+// The same computed window by window as calibration.m does, for comparison
+void staticVarianceDirect(const std::vector<Imu_Sample> & samples, unsigned width,
+			  std::vector<double> & variance);
+
+// Static periods of at least a third of the average length where 'variance', computed with
+// 'width', is below its 'quantile'
+void staticIntervals(const std::vector<double> & variance, unsigned width,
+		     std::vector<Static_Interval> & intervals, double quantile = 2.0 / 3.0);
+
+// Gravity in m/s^2 from the formula used by calibration.m, which passes the latitude in
+// degrees to sin()
+double localGravity(double latitude, double altitude);
+
+// Correction matrices from fitted parameters, in the parameter layout of calibration.m:
+//   accelerometer [p1 p4 p5; 0 p2 p6; 0 0 p3] with bias [p7 p8 p9]
+//   gyroscope [p1 p4 p5; p7 p2 p6; p8 p9 p3]
+void accelerometerCorrection(const double * p, double correction[3][3], double bias[3]);
+void gyroscopeCorrection(const double * p, double correction[3][3]);
+
+class Imu_Calibration {
+// Member functions accesible outside the class
+public:
+    unsigned width;
+    double quantile;
+    double gravity;
+    unsigned threads;
+
+    std::vector<double> variance;
+    std::vector<Static_Interval> intervals;
+    // Average acceleration over each interval, three values per interval
+    std::vector<double> means;
+    Calibration_Fit accelerometer;
+    Calibration_Fit gyroscope;
+
+    // Gravity at the latitude and altitude of the calibration.m captures
+    Imu_Calibration();
+
+    // Find the static periods and fit both sensors, false if there are too few periods
+    bool calibrate(const std::vector<Imu_Sample> & samples);
+};
+
+// Read samples from an Android application CSV log, skipping the first line as calibration.m
+// does, or from a binary sample log (Sample_Log.h) when the file name ends in .bslog
+bool loadImuSamples(const std::string & path, std::vector<Imu_Sample> & samples);
+
+#endif
@@ -0,0 +1,422 @@
+// Ingest service for many sensor boards at once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Ingest_Service.h"
+
+// Events handled by one call to epoll_wait
+#define INGEST_EVENTS 64
+
+// How often paused devices are looked at while any are waiting
+#define INGEST_PAUSE_POLL_MS 10
+
+// Log buffer for each device
+#define INGEST_LOG_BUFFER 65536
+
+static uint64_t milliseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Terminal speed code for a baud rate, 115200 if the rate is not a standard one
+static speed_t speedCode(int baud)
+{
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B115200;
+    }
+}
+
+Ingest_Device::Ingest_Device(const std::string & path, int fd, FILE * log,
+			     Sensor_Stream::Handler handler)
+    : path(path), fd(fd), log(log), stream(handler, this)
+{
+    scheduled = false;
+    paused = false;
+    dropping = false;
+    paused_since = 0;
+    resync = false;
+    open = true;
+    bytes = 0;
+    dropped_chunks = 0;
+    dropped_bytes = 0;
+    pauses = 0;
+    request_failures = 0;
+}
+
+Ingest_Device::~Ingest_Device()
+{
+    if (fd >= 0)
+	close(fd);
+    if (log)
+	fclose(log);
+}
+
+Ingest_Service::Ingest_Service(unsigned worker_count, const std::string & log_dir,
+			       size_t queue_chunks, unsigned stall_ms, bool binary_logs)
+    : binary_logs(binary_logs), log_dir(log_dir), stopping(false)
+{
+    this->queue_chunks = queue_chunks ? queue_chunks : 1;
+    this->stall_ms = stall_ms;
+    this->worker_count = worker_count ? worker_count : 1;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = 0;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+}
+
+Ingest_Service::~Ingest_Service()
+{
+    for (size_t i = 0; i < devices.size(); ++i)
+	delete devices[i];
+    for (size_t i = 0; i < chunks.size(); ++i)
+	delete chunks[i];
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+// Open a serial port, or take an already open descriptor, and start logging it
+bool Ingest_Service::addDevice(const std::string & path, const std::string & name, int baud,
+			       int fd)
+{
+    if (fd < 0)
+	fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    else
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (fd < 0)
+	return false;
+
+    if (isatty(fd)) {
+	struct termios settings;
+	if (tcgetattr(fd, &settings) == 0) {
+	    cfmakeraw(&settings);
+	    cfsetspeed(&settings, speedCode(baud));
+	    settings.c_cflag |= CLOCAL | CREAD;
+	    tcsetattr(fd, TCSANOW, &settings);
+	}
+    }
+
+    FILE * log = 0;
+    if (!binary_logs) {
+	log = fopen((log_dir + "/" + name + ".csv").c_str(), "w");
+	if (!log) {
+	    close(fd);
+	    return false;
+	}
+	setvbuf(log, 0, _IOFBF, INGEST_LOG_BUFFER);
+	fprintf(log, "time,delta,lost,sensors,acc_x,acc_y,acc_z,gyro_x,gyro_y,gyro_z,"
+		"altitude,temperature,light\n");
+    }
+
+    Ingest_Device * device = new Ingest_Device(path, fd, log, logReading);
+    if (binary_logs && !device->binary_log.open(log_dir + "/" + name + ".bslog")) {
+	delete device;
+	return false;
+    }
+    devices.push_back(device);
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = device;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+    // Every device can fill its queue with one more chunk being read
+    for (size_t i = 0; i < queue_chunks + 1; ++i) {
+	chunks.push_back(new Ingest_Chunk);
+	pool.push_back(chunks.back());
+    }
+    return true;
+}
+
+// Send a request code to every device
+void Ingest_Service::request(uint8_t code)
+{
+    for (size_t i = 0; i < devices.size(); ++i)
+	if (devices[i]->open && write(devices[i]->fd, &code, 1) != 1)
+	    devices[i]->request_failures += 1;
+}
+
+Ingest_Chunk * Ingest_Service::takeChunk()
+{
+    std::lock_guard<std::mutex> guard(pool_lock);
+    if (pool.empty())
+	return 0;
+    Ingest_Chunk * chunk = pool.back();
+    pool.pop_back();
+    return chunk;
+}
+
+void Ingest_Service::returnChunk(Ingest_Chunk * chunk)
+{
+    std::lock_guard<std::mutex> guard(pool_lock);
+    pool.push_back(chunk);
+}
+
+// Wake the reader out of epoll_wait
+void Ingest_Service::wake()
+{
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0)
+	return;
+}
+
+// Make run() return, safe to call from a signal handler or another thread
+void Ingest_Service::stop()
+{
+    stopping = true;
+    wake();
+}
+
+// Write one line of the device's log, called by the worker decoding the device
+void Ingest_Service::logReading(const Sensor_Reading & reading, void * context)
+{
+    Ingest_Device & device = *(Ingest_Device *)context;
+    if (!device.log) {
+	device.binary_log.append(reading);
+	return;
+    }
+    fprintf(device.log, "%u,%u,%u,%u,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%u\n", reading.time,
+	    reading.delta, reading.lost, reading.sensors, reading.acc[0], reading.acc[1], reading.acc[2],
+	    reading.gyro[0], reading.gyro[1], reading.gyro[2],
+	    reading.altitude + reading.altitude_frac / 16.0,
+	    reading.temperature + reading.temperature_frac / 16.0, reading.light);
+}
+
+// Stop watching a port that has hung up or failed, chunks already read are still decoded
+void Ingest_Service::closeDevice(Ingest_Device & device)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, device.fd, 0);
+    device.open = false;
+}
+
+// Read what has arrived on a port into a chunk and queue it for the workers. Returns false
+// when nothing was read.
+bool Ingest_Service::readDevice(Ingest_Device & device)
+{
+    Ingest_Chunk * chunk = takeChunk();
+    if (!chunk)
+	return false;
+    ssize_t size = read(device.fd, chunk->data, INGEST_CHUNK);
+    if (size <= 0) {
+	returnChunk(chunk);
+	// Terminals report a hang up as an error or end of file
+	if (size == 0 || (errno != EAGAIN && errno != EINTR))
+	    closeDevice(device);
+	return false;
+    }
+    chunk->size = size;
+    device.bytes += size;
+
+    bool schedule = false;
+    {
+	std::lock_guard<std::mutex> guard(device.lock);
+	if (device.queue.size() >= queue_chunks) {
+	    // Only reached once the device has been paused for too long
+	    device.dropped_chunks += 1;
+	    device.dropped_bytes += size;
+	    device.resync = true;
+	    returnChunk(chunk);
+	    return true;
+	}
+	device.queue.push_back(chunk);
+	if (!device.scheduled) {
+	    device.scheduled = true;
+	    schedule = true;
+	}
+	// Stop taking data from a device the workers have fallen behind on
+	if (device.queue.size() >= queue_chunks && !device.paused) {
+	    device.paused = true;
+	    device.paused_since = milliseconds();
+	    device.pauses += 1;
+	    struct epoll_event event;
+	    event.events = 0;
+	    event.data.ptr = &device;
+	    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, device.fd, &event);
+	}
+    }
+
+    if (schedule) {
+	std::lock_guard<std::mutex> guard(ready_lock);
+	ready.push_back(&device);
+	ready_signal.notify_one();
+    }
+    return true;
+}
+
+// Start taking data again from paused devices the workers have caught up on, and from those
+// paused too long, which then drop what does not fit. Returns true if any are still paused.
+bool Ingest_Service::resumeDevices()
+{
+    bool waiting = false;
+    uint64_t now = milliseconds();
+    for (size_t i = 0; i < devices.size(); ++i) {
+	Ingest_Device & device = *devices[i];
+	std::lock_guard<std::mutex> guard(device.lock);
+	if (!device.paused || !device.open)
+	    continue;
+	bool caught_up = device.queue.size() <= queue_chunks / 2;
+	bool stalled = !device.dropping && now - device.paused_since >= stall_ms;
+	if (caught_up || stalled) {
+	    struct epoll_event event;
+	    event.events = EPOLLIN;
+	    event.data.ptr = &device;
+	    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, device.fd, &event);
+	}
+	if (caught_up) {
+	    device.paused = false;
+	    device.dropping = false;
+	}
+	else {
+	    device.dropping = device.dropping || stalled;
+	    waiting = waiting || !device.dropping;
+	}
+    }
+    return waiting;
+}
+
+// Decode queued chunks of ready devices until the service stops and nothing is left
+void Ingest_Service::work()
+{
+    for (;;) {
+	Ingest_Device * device;
+	{
+	    std::unique_lock<std::mutex> guard(ready_lock);
+	    ready_signal.wait(guard, [this] { return !ready.empty() || finishing; });
+	    if (ready.empty())
+		return;
+	    device = ready.front();
+	    ready.pop_front();
+	}
+
+	for (;;) {
+	    Ingest_Chunk * chunk;
+	    bool resync, paused;
+	    {
+		std::lock_guard<std::mutex> guard(device->lock);
+		if (device->queue.empty()) {
+		    device->scheduled = false;
+		    break;
+		}
+		chunk = device->queue.front();
+		device->queue.pop_front();
+		resync = device->resync;
+		device->resync = false;
+		paused = device->paused;
+	    }
+	    {
+		std::lock_guard<std::mutex> guard(device->decode_lock);
+		if (resync)
+		    device->stream.reset();
+		device->stream.feed(chunk->data, chunk->size);
+	    }
+	    returnChunk(chunk);
+	    if (paused)
+		wake();
+	}
+    }
+}
+
+// Read and decode until stop() is called or every port has closed
+void Ingest_Service::run()
+{
+    finishing = false;
+    for (unsigned i = 0; i < worker_count; ++i)
+	workers.push_back(std::thread(&Ingest_Service::work, this));
+
+    struct epoll_event events[INGEST_EVENTS];
+    bool waiting = false;
+    while (!stopping) {
+	int count = epoll_wait(epoll_fd, events, INGEST_EVENTS,
+			       waiting ? INGEST_PAUSE_POLL_MS : -1);
+	if (count < 0 && errno != EINTR)
+	    break;
+	for (int i = 0; i < count; ++i) {
+	    Ingest_Device * device = (Ingest_Device *)events[i].data.ptr;
+	    if (!device) {
+		uint64_t value;
+		if (read(wake_fd, &value, sizeof(value)) < 0)
+		    continue;
+		continue;
+	    }
+	    if (!device->open)
+		continue;
+	    if (events[i].events & EPOLLIN)
+		readDevice(*device);
+	    // Take whatever is still buffered before letting go of a port that hung up
+	    else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+		while (device->open && readDevice(*device));
+		if (device->open)
+		    closeDevice(*device);
+	    }
+	}
+	waiting = resumeDevices();
+
+	bool any_open = false;
+	for (size_t i = 0; i < devices.size(); ++i)
+	    any_open = any_open || devices[i]->open;
+	if (!any_open)
+	    break;
+    }
+
+    // Let the workers empty the queues then stop them
+    {
+	std::lock_guard<std::mutex> guard(ready_lock);
+	finishing = true;
+    }
+    ready_signal.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i)
+	workers[i].join();
+    workers.clear();
+    for (size_t i = 0; i < devices.size(); ++i) {
+	if (devices[i]->log)
+	    fflush(devices[i]->log);
+	else
+	    devices[i]->binary_log.close();
+    }
+}
+
+// Bytes waiting in the ports that have not been read yet
+size_t Ingest_Service::unreadBytes()
+{
+    size_t total = 0;
+    for (size_t i = 0; i < devices.size(); ++i) {
+	int waiting;
+	if (devices[i]->open && ioctl(devices[i]->fd, FIONREAD, &waiting) == 0)
+	    total += waiting;
+    }
+    return total;
+}
+
+// Per device byte, sample, drop and error counts
+void Ingest_Service::printStats(FILE * out)
+{
+    fprintf(out, "%-24s %12s %10s %8s %8s %8s %8s %8s %12s %8s\n", "device", "bytes", "samples",
+	    "lost", "frames", "errors", "pauses", "dropped", "dropped B", "requests");
+    for (size_t i = 0; i < devices.size(); ++i) {
+	Ingest_Device & device = *devices[i];
+	std::lock_guard<std::mutex> guard(device.decode_lock);
+	fprintf(out, "%-24s %12lu %10lu %8lu %8lu %8lu %8lu %8lu %12lu %8lu\n",
+		device.path.c_str(), device.bytes.load(), device.stream.readings,
+		device.stream.lost, device.stream.frames,
+		device.stream.malformed + device.stream.framingErrors(), device.pauses.load(),
+		device.dropped_chunks.load(), device.dropped_bytes.load(),
+		device.request_failures.load());
+    }
+}
@@ -0,0 +1,156 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Ingest service for many sensor boards at once. One thread waits on every serial or RFCOMM
+// port with epoll and reads whatever has arrived into chunks from a fixed pool. The chunks are
+// queued on their device and a pool of worker threads decodes them with Sensor_Stream and
+// writes each sample to the device's log, a binary sample log (Sample_Log.h) or a CSV file.
+// A device is only ever worked on by one worker at a
+// time so its samples stay in order.
+//
+// Each device can have at most 'queue_chunks' chunks waiting. When a device's queue is full the
+// reader stops taking its data so the port buffers fill and the board is slowed down, and if
+// the device is still full after 'stall_ms' milliseconds new data is read and thrown away,
+// counted as dropped, so one stuck log can not hold up a board forever.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef INGEST_SERVICE
+#define INGEST_SERVICE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Sensor_Stream.h"
+#include "Sample_Log.h"
+
+// Bytes read from a port at a time
+#define INGEST_CHUNK 4096
+
+struct Ingest_Chunk
+{
+    size_t size;
+    uint8_t data[INGEST_CHUNK];
+};
+
+// A board and everything the service keeps for it
+class Ingest_Device {
+public:
+    std::string path;
+    int fd;
+    // CSV log, or null when samples go to the binary log
+    FILE * log;
+    Sample_Log_Writer binary_log;
+    Sensor_Stream stream;
+
+    // Chunks waiting to be decoded, guarded by 'lock'
+    std::mutex lock;
+    std::deque<Ingest_Chunk *> queue;
+    // True while the device is on the ready list or being decoded by a worker
+    bool scheduled;
+    // True while the reader has stopped taking data because the queue is full, and when that
+    // started in milliseconds. Once paused for too long the reader takes the data again and
+    // drops it while the queue stays full.
+    bool paused;
+    bool dropping;
+    uint64_t paused_since;
+    // Set when data was dropped so the decoder starts clean on the next chunk
+    bool resync;
+    // False once the port has hung up or failed, only used by the reader
+    bool open;
+    // Held by the worker while it decodes, so counters can be read from other threads
+    std::mutex decode_lock;
+
+    // Counters, written by the reader and read by anyone
+    std::atomic<unsigned long> bytes;
+    std::atomic<unsigned long> dropped_chunks;
+    std::atomic<unsigned long> dropped_bytes;
+    std::atomic<unsigned long> pauses;
+    std::atomic<unsigned long> request_failures;
+
+    // Decoded samples are passed to 'handler' with the device as context
+    Ingest_Device(const std::string & path, int fd, FILE * log, Sensor_Stream::Handler handler);
+    ~Ingest_Device();
+};
+
+class Ingest_Service {
+// Internal members not used outside the class
+private:
+    int epoll_fd;
+    // Written to wake the reader for a stop or a device to resume
+    int wake_fd;
+    size_t queue_chunks;
+    unsigned stall_ms;
+    unsigned worker_count;
+    bool binary_logs;
+    std::string log_dir;
+    std::vector<Ingest_Device *> devices;
+
+    // Chunks not in use
+    std::mutex pool_lock;
+    std::vector<Ingest_Chunk *> pool;
+    std::vector<Ingest_Chunk *> chunks;
+
+    // Devices with chunks waiting for a worker
+    std::mutex ready_lock;
+    std::condition_variable ready_signal;
+    std::deque<Ingest_Device *> ready;
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping;
+    // Set under 'ready_lock' once nothing more will be read, workers exit when the list is empty
+    bool finishing;
+
+    Ingest_Chunk * takeChunk();
+    void returnChunk(Ingest_Chunk * chunk);
+    bool readDevice(Ingest_Device & device);
+    bool resumeDevices();
+    void closeDevice(Ingest_Device & device);
+    void wake();
+    void work();
+    static void logReading(const Sensor_Reading & reading, void * context);
+
+// Member functions accesible outside the class
+public:
+    Ingest_Service(unsigned worker_count, const std::string & log_dir, size_t queue_chunks,
+		   unsigned stall_ms, bool binary_logs = true);
+    ~Ingest_Service();
+
+    // Open a serial port, or take an already open descriptor when 'fd' is not -1, and start
+    // logging it to <log_dir>/<name>.bslog, or <log_dir>/<name>.csv without binary logs. Ports are set to raw mode at 'baud' when they are
+    // terminals. Returns false if the port or log could not be opened. Must be called before
+    // run().
+    bool addDevice(const std::string & path, const std::string & name, int baud, int fd = -1);
+
+    // Send a request code to every device, such as START_STREAM
+    void request(uint8_t code);
+
+    // Read and decode until stop() is called or every port has closed, then finish decoding
+    // everything already read
+    void run();
+
+    // Make run() return, safe to call from a signal handler or another thread
+    void stop();
+
+    // Bytes waiting in the ports that have not been read yet
+    size_t unreadBytes();
+
+    // Per device byte, sample, drop and error counts
+    void printStats(FILE * out);
+
+    const std::vector<Ingest_Device *> & deviceList() const { return devices; }
+};
+
+#endif
@@ -0,0 +1,201 @@
+// A made up sensor board on the master side of a pseudo terminal
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Pty_Board.h"
+#include "Sensor_Frames.h"
+
+// Longest the board sleeps between looking for requests and sending samples
+#define BOARD_TICK_US 1000
+
+// Barometer and light sensor divisor, as in the firmware
+#define BOARD_SLOW_DIVISOR 100
+
+static uint64_t microseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+Pty_Board::Pty_Board(unsigned rate, unsigned seed)
+    : master(-1), rate(rate ? rate : 1), seed(seed), running(false), generating(true),
+      silent(false)
+{
+    samples = 0;
+    bytes = 0;
+}
+
+Pty_Board::~Pty_Board()
+{
+    stop();
+}
+
+// Create the pseudo terminal and start the board
+bool Pty_Board::start()
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0)
+	return false;
+    if (grantpt(master) != 0 || unlockpt(master) != 0) {
+	close(master);
+	master = -1;
+	return false;
+    }
+    slave_path = ptsname(master);
+
+    // Bytes must pass through untouched in both directions
+    struct termios settings;
+    if (tcgetattr(master, &settings) == 0) {
+	cfmakeraw(&settings);
+	tcsetattr(master, TCSANOW, &settings);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    running = true;
+    thread = std::thread(&Pty_Board::loop, this);
+    return true;
+}
+
+// Stop sending samples but keep the port open
+void Pty_Board::quiet()
+{
+    generating = false;
+    while (running && !silent)
+	usleep(BOARD_TICK_US);
+}
+
+// Stop the board and close the port
+void Pty_Board::stop()
+{
+    if (thread.joinable()) {
+	running = false;
+	thread.join();
+    }
+    if (master >= 0) {
+	close(master);
+	master = -1;
+    }
+}
+
+// Act on any request codes sent to the board
+void Pty_Board::handleRequests(uint8_t & mode, uint8_t & framing)
+{
+    uint8_t requests[64];
+    ssize_t size;
+    while ((size = read(master, requests, sizeof(requests))) > 0) {
+	for (ssize_t i = 0; i < size; ++i) {
+	    uint8_t request = requests[i];
+	    if (request == START_STREAM || request == START_BATCH_STREAM ||
+		request == START_COMPRESSED_STREAM)
+		mode = request;
+	    else if (request == END_STREAM)
+		mode = 0;
+	    else if (request == COBS_FRAMING || request == DLE_FRAMING)
+		framing = request;
+	}
+    }
+}
+
+// Write everything, waiting while the port's buffer is full as the board's serial port would.
+// Returns false if the board was stopped first.
+bool Pty_Board::send(const uint8_t * data, size_t size)
+{
+    while (size != 0) {
+	ssize_t written = write(master, data, size);
+	if (written > 0) {
+	    data += written;
+	    size -= written;
+	    bytes += written;
+	    continue;
+	}
+	if (written < 0 && errno != EAGAIN && errno != EINTR)
+	    return false;
+	if (!running)
+	    return false;
+	struct pollfd wait = { master, POLLOUT, 0 };
+	poll(&wait, 1, 10);
+    }
+    return true;
+}
+
+void Pty_Board::loop()
+{
+    srand(seed);
+    uint8_t mode = 0;
+    uint8_t framing = DLE_FRAMING;
+    uint64_t period = 1000000 / rate;
+    uint64_t next = microseconds();
+    unsigned long count = 0;
+    Sensor_Sample batch[BATCH_SIZE];
+    unsigned batched = 0;
+    uint8_t frame[COBS_COMPRESSED_FRAME_MAX(BATCH_SIZE) + COMPRESSED_FRAME_MAX(BATCH_SIZE)];
+
+    while (running) {
+	handleRequests(mode, framing);
+	uint64_t now = microseconds();
+	if (!mode || !generating) {
+	    silent = !generating;
+	    next = now;
+	    // The samples of an unfinished batch were never sent, number the next in their place
+	    count -= batched;
+	    batched = 0;
+	    usleep(BOARD_TICK_US);
+	    continue;
+	}
+
+	// Send every sample that has come due, a held up board catches up afterwards
+	while (running && generating && next <= now) {
+	    Sensor_Sample sample;
+	    memset(&sample, 0, sizeof(sample));
+	    sample.sensors = ACC | GYRO;
+	    if (count % BOARD_SLOW_DIVISOR == 0)
+		sample.sensors |= BARO | PHT;
+	    for (int i = 0; i < ACC_PAYLOAD; ++i)
+		sample.acc[i] = rand();
+	    for (int i = 0; i < GYRO_PAYLOAD; ++i)
+		sample.gyro[i] = rand();
+	    for (int i = 0; i < BARO_PAYLOAD; ++i)
+		sample.baro[i] = rand();
+	    for (int i = 0; i < PHT_PAYLOAD; ++i)
+		sample.light[i] = rand();
+	    sample.sequence = count;
+	    sample.time = (uint32_t)next;
+	    count += 1;
+	    next += period;
+
+	    size_t size = 0;
+	    if (mode == START_STREAM) {
+		size = framing == COBS_FRAMING ? encodeCobsSingleFrame(sample, frame) :
+		    encodeSingleFrame(sample, frame);
+		if (!send(frame, size))
+		    return;
+		samples += 1;
+		continue;
+	    }
+
+	    batch[batched++] = sample;
+	    if (batched < BATCH_SIZE)
+		continue;
+	    if (mode == START_BATCH_STREAM)
+		size = framing == COBS_FRAMING ?
+		    encodeCobsBatchFrame(batch, BATCH_SIZE, period, frame) :
+		    encodeBatchFrame(batch, BATCH_SIZE, period, frame);
+	    else
+		size = framing == COBS_FRAMING ?
+		    encodeCobsCompressedFrame(batch, BATCH_SIZE, period, frame) :
+		    encodeCompressedFrame(batch, BATCH_SIZE, period, frame);
+	    batched = 0;
+	    if (!send(frame, size))
+		return;
+	    samples += BATCH_SIZE;
+	}
+	usleep(BOARD_TICK_US);
+    }
+}
@@ -0,0 +1,68 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A made up sensor board on the master side of a pseudo terminal. The slave side behaves like
+// the board's serial or RFCOMM port, so anything that reads a board can be run against it with
+// no hardware. The board answers the same request codes as the firmware (stream, batched and
+// compressed streams, end of stream and framing changes) and sends random samples at a fixed
+// rate from its own thread. Like the real board it is held up while the port's buffer is full.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef PTY_BOARD
+#define PTY_BOARD
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+class Pty_Board {
+// Internal members not used outside the class
+private:
+    int master;
+    std::string slave_path;
+    unsigned rate;
+    unsigned seed;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<bool> generating;
+    // Set by the board once it has stopped sending after quiet()
+    std::atomic<bool> silent;
+
+    void handleRequests(uint8_t & mode, uint8_t & framing);
+    bool send(const uint8_t * data, size_t size);
+    void loop();
+
+// Member functions accesible outside the class
+public:
+    // Samples and bytes sent so far
+    std::atomic<unsigned long> samples;
+    std::atomic<unsigned long> bytes;
+
+    // A board sending 'rate' samples per second once asked to stream
+    Pty_Board(unsigned rate, unsigned seed);
+    ~Pty_Board();
+
+    // Create the pseudo terminal and start the board, returns false if that fails
+    bool start();
+
+    // Stop sending samples but keep the port open so what was sent can still be read, returns
+    // once the board has sent its last sample
+    void quiet();
+
+    // Stop the board and close the port, the reader sees a hang up
+    void stop();
+
+    // Path of the slave side to open as the board's port
+    const std::string & path() const { return slave_path; }
+};
+
+#endif
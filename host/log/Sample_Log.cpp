@@ -0,0 +1,418 @@
+// Binary sample log writer and memory mapped reader
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Sample_Log.h"
+
+#define LOG_MAGIC "BSNSLOG1"
+#define CHUNK_MAGIC "CHNK"
+#define HEADER_SIZE 64
+#define CHUNK_HEADER_SIZE 32
+
+// Scales from the Android application, 2 g and 250 deg/s ranges and a 10 bit light reading
+#define ACC_SCALE (2 * 2 * 9.8067f / (1 << 12))
+#define GYRO_SCALE (2 * 250.0f / (1 << 16))
+#define LIGHT_SCALE (100.0f / (1 << 10))
+
+const Log_Column sample_log_columns[LOG_COLUMNS] = {
+    { LOG_TIME, 8, 0, 0, 1e-6f, "time" },
+    { LOG_DELTA, 2, 0, 0, 1e-6f, "delta" },
+    { LOG_SENSORS, 1, 0, 0, 1, "sensors" },
+    { LOG_ACC_X, 2, 1, 0, ACC_SCALE, "acc_x" },
+    { LOG_ACC_Y, 2, 1, 0, ACC_SCALE, "acc_y" },
+    { LOG_ACC_Z, 2, 1, 0, ACC_SCALE, "acc_z" },
+    { LOG_GYRO_X, 2, 1, 0, GYRO_SCALE, "gyro_x" },
+    { LOG_GYRO_Y, 2, 1, 0, GYRO_SCALE, "gyro_y" },
+    { LOG_GYRO_Z, 2, 1, 0, GYRO_SCALE, "gyro_z" },
+    { LOG_ALTITUDE, 4, 1, 0, 1 / 16.0f, "altitude" },
+    { LOG_TEMPERATURE, 2, 1, 0, 1 / 16.0f, "temperature" },
+    { LOG_LIGHT, 2, 0, 0, LIGHT_SCALE, "light" }
+};
+
+// Round a size up to the 8 byte boundary
+static size_t padded(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+// Little endian header fields, the host is assumed little endian like the board
+struct Log_Header
+{
+    char magic[8];
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t column_count;
+    uint16_t reserved;
+    uint32_t chunk_rows;
+    uint32_t chunk_count;
+    uint64_t row_count;
+    uint64_t index_offset;
+    uint64_t first_time;
+    uint64_t last_time;
+    uint64_t reserved2;
+};
+
+struct Log_Chunk_Header
+{
+    char magic[4];
+    uint32_t rows;
+    uint64_t first_time;
+    uint64_t last_time;
+    uint64_t reserved;
+};
+
+Sample_Log_Writer::Sample_Log_Writer()
+{
+    file = 0;
+}
+
+Sample_Log_Writer::~Sample_Log_Writer()
+{
+    close();
+}
+
+// Create a log
+bool Sample_Log_Writer::open(const std::string & path, uint32_t chunk_rows)
+{
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+	return false;
+    this->chunk_rows = chunk_rows ? chunk_rows : SAMPLE_LOG_CHUNK_ROWS;
+    rows = 0;
+    row_count = 0;
+    first_time = 0;
+    last_time = 0;
+    last_board_time = 0;
+    time_base = 0;
+    index.clear();
+    for (int i = 0; i < LOG_COLUMNS; ++i)
+	columns[i].resize(padded((size_t)this->chunk_rows * sample_log_columns[i].size));
+
+    // The header is written again on close once the counts are known
+    Log_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_MAGIC, 8);
+    header.version = SAMPLE_LOG_VERSION;
+    header.header_size = HEADER_SIZE;
+    header.column_count = LOG_COLUMNS;
+    header.chunk_rows = this->chunk_rows;
+    return fwrite(&header, sizeof(header), 1, file) == 1 &&
+	fwrite(sample_log_columns, sizeof(sample_log_columns), 1, file) == 1;
+}
+
+// Add a sample
+bool Sample_Log_Writer::append(const Sensor_Reading & reading)
+{
+    if (!file)
+	return false;
+
+    // Board times are 32 bits and wrap about every 71 minutes
+    if (row_count != 0 && reading.time < last_board_time)
+	time_base += (uint64_t)1 << 32;
+    last_board_time = reading.time;
+    uint64_t time = time_base + reading.time;
+    if (row_count == 0)
+	first_time = time;
+    if (rows == 0)
+	index.push_back(Log_Chunk());
+    last_time = time;
+
+    int32_t altitude = reading.altitude * 16 + reading.altitude_frac;
+    int16_t temperature = reading.temperature * 16 + reading.temperature_frac;
+    ((uint64_t *)&columns[LOG_TIME][0])[rows] = time;
+    ((uint16_t *)&columns[LOG_DELTA][0])[rows] = reading.delta;
+    columns[LOG_SENSORS][rows] = reading.sensors;
+    for (int i = 0; i < 3; ++i) {
+	((int16_t *)&columns[LOG_ACC_X + i][0])[rows] = reading.acc[i];
+	((int16_t *)&columns[LOG_GYRO_X + i][0])[rows] = reading.gyro[i];
+    }
+    ((int32_t *)&columns[LOG_ALTITUDE][0])[rows] = altitude;
+    ((int16_t *)&columns[LOG_TEMPERATURE][0])[rows] = temperature;
+    ((uint16_t *)&columns[LOG_LIGHT][0])[rows] = reading.light;
+
+    rows += 1;
+    row_count += 1;
+    if (rows == chunk_rows)
+	return flushChunk();
+    return true;
+}
+
+// Write 'size' bytes and pad them out to the 8 byte boundary
+bool Sample_Log_Writer::writePadded(const void * data, size_t size)
+{
+    static const uint8_t zeros[8] = { 0 };
+    if (fwrite(data, 1, size, file) != size)
+	return false;
+    size_t padding = padded(size) - size;
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+// Write the rows held so far as a chunk
+bool Sample_Log_Writer::flushChunk()
+{
+    if (rows == 0)
+	return true;
+    Log_Chunk & entry = index.back();
+    entry.offset = ftell(file);
+    entry.rows = rows;
+    entry.reserved = 0;
+    entry.first_time = ((uint64_t *)&columns[LOG_TIME][0])[0];
+    entry.last_time = ((uint64_t *)&columns[LOG_TIME][0])[rows - 1];
+
+    Log_Chunk_Header header;
+    memcpy(header.magic, CHUNK_MAGIC, 4);
+    header.rows = rows;
+    header.first_time = entry.first_time;
+    header.last_time = entry.last_time;
+    header.reserved = 0;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; i < LOG_COLUMNS; ++i)
+	written = written && writePadded(&columns[i][0], (size_t)rows * sample_log_columns[i].size);
+    rows = 0;
+    return written;
+}
+
+// Write the last chunk, the index and the header and close the file
+bool Sample_Log_Writer::close()
+{
+    if (!file)
+	return true;
+    bool written = flushChunk();
+
+    Log_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_MAGIC, 8);
+    header.version = SAMPLE_LOG_VERSION;
+    header.header_size = HEADER_SIZE;
+    header.column_count = LOG_COLUMNS;
+    header.chunk_rows = chunk_rows;
+    header.chunk_count = index.size();
+    header.row_count = row_count;
+    header.index_offset = ftell(file);
+    header.first_time = first_time;
+    header.last_time = last_time;
+    if (!index.empty())
+	written = written && fwrite(&index[0], sizeof(Log_Chunk), index.size(), file) ==
+	    index.size();
+    written = written && fseek(file, 0, SEEK_SET) == 0 &&
+	fwrite(&header, sizeof(header), 1, file) == 1;
+    written = fclose(file) == 0 && written;
+    file = 0;
+    return written;
+}
+
+Sample_Log_Reader::Sample_Log_Reader()
+{
+    fd = -1;
+    map = 0;
+    map_size = 0;
+    chunk_index = 0;
+    chunk_count = 0;
+    row_count = 0;
+    column_count = 0;
+    column_table = 0;
+}
+
+Sample_Log_Reader::~Sample_Log_Reader()
+{
+    close();
+}
+
+void Sample_Log_Reader::close()
+{
+    if (map)
+	munmap((void *)map, map_size);
+    if (fd >= 0)
+	::close(fd);
+    fd = -1;
+    map = 0;
+    chunk_count = 0;
+    row_count = 0;
+}
+
+// Map a log and check its header and index
+bool Sample_Log_Reader::open(const std::string & path)
+{
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+	return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < HEADER_SIZE) {
+	close();
+	return false;
+    }
+    map_size = status.st_size;
+    void * mapped = mmap(0, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+	map = 0;
+	close();
+	return false;
+    }
+    map = (const uint8_t *)mapped;
+
+    const Log_Header & header = *(const Log_Header *)map;
+    if (memcmp(header.magic, LOG_MAGIC, 8) != 0 || header.version != SAMPLE_LOG_VERSION ||
+	header.column_count != LOG_COLUMNS ||
+	HEADER_SIZE + (size_t)header.column_count * sizeof(Log_Column) > map_size ||
+	header.index_offset + (uint64_t)header.chunk_count * sizeof(Log_Chunk) > map_size) {
+	close();
+	return false;
+    }
+    column_count = header.column_count;
+    column_table = (const Log_Column *)(map + header.header_size);
+    for (int i = 0; i < LOG_COLUMNS; ++i)
+	if (column_table[i].id != i || column_table[i].size != sample_log_columns[i].size) {
+	    close();
+	    return false;
+	}
+
+    // Every chunk the index points at must lie inside the file
+    chunk_index = (const Log_Chunk *)(map + header.index_offset);
+    uint64_t rows = 0;
+    for (uint32_t i = 0; i < header.chunk_count; ++i) {
+	const Log_Chunk & chunk = chunk_index[i];
+	uint64_t size = CHUNK_HEADER_SIZE;
+	for (int j = 0; j < LOG_COLUMNS; ++j)
+	    size += padded((size_t)chunk.rows * column_table[j].size);
+	if (chunk.offset % 8 != 0 || chunk.offset + size > header.index_offset ||
+	    memcmp(map + chunk.offset, CHUNK_MAGIC, 4) != 0) {
+	    close();
+	    return false;
+	}
+	rows += chunk.rows;
+    }
+    if (rows != header.row_count) {
+	close();
+	return false;
+    }
+    chunk_count = header.chunk_count;
+    row_count = header.row_count;
+    return true;
+}
+
+// Values of a column in a chunk, pointing into the mapped file
+const void * Sample_Log_Reader::columnData(uint32_t chunk, uint8_t id) const
+{
+    const Log_Chunk & entry = chunk_index[chunk];
+    uint64_t offset = entry.offset + CHUNK_HEADER_SIZE;
+    for (uint8_t i = 0; i < id; ++i)
+	offset += padded((size_t)entry.rows * column_table[i].size);
+    return map + offset;
+}
+
+// First chunk that may hold samples at or after 'time'
+uint32_t Sample_Log_Reader::findChunk(uint64_t time) const
+{
+    uint32_t low = 0, high = chunk_count;
+    while (low < high) {
+	uint32_t middle = (low + high) / 2;
+	if (chunk_index[middle].last_time < time)
+	    low = middle + 1;
+	else
+	    high = middle;
+    }
+    return low;
+}
+
+// Write a log in the layout of the Android application's CSV log
+bool exportCsv(const Sample_Log_Reader & log, FILE * csv)
+{
+    const float acc_scale = log.column(LOG_ACC_X).scale;
+    const float gyro_scale = log.column(LOG_GYRO_X).scale;
+    const float light_scale = log.column(LOG_LIGHT).scale;
+    float acc[3] = { 0, 0, 0 }, gyro[3] = { 0, 0, 0 };
+    float altitude = 0, temperature = 0, light = 0;
+
+    for (uint32_t chunk = 0; chunk < log.chunks(); ++chunk) {
+	uint32_t rows = log.chunk(chunk).rows;
+	const uint16_t * delta = log.values<uint16_t>(chunk, LOG_DELTA);
+	const uint8_t * sensors = log.values<uint8_t>(chunk, LOG_SENSORS);
+	const int16_t * acc_axes[3], * gyro_axes[3];
+	for (int i = 0; i < 3; ++i) {
+	    acc_axes[i] = log.values<int16_t>(chunk, LOG_ACC_X + i);
+	    gyro_axes[i] = log.values<int16_t>(chunk, LOG_GYRO_X + i);
+	}
+	const int32_t * altitudes = log.values<int32_t>(chunk, LOG_ALTITUDE);
+	const int16_t * temperatures = log.values<int16_t>(chunk, LOG_TEMPERATURE);
+	const uint16_t * lights = log.values<uint16_t>(chunk, LOG_LIGHT);
+
+	for (uint32_t row = 0; row < rows; ++row) {
+	    for (int i = 0; i < 3; ++i) {
+		if (sensors[row] & ACC)
+		    acc[i] = acc_axes[i][row] * acc_scale;
+		if (sensors[row] & GYRO)
+		    gyro[i] = gyro_axes[i][row] * gyro_scale;
+	    }
+	    if (sensors[row] & BARO) {
+		altitude = altitudes[row] / 16.0f;
+		temperature = temperatures[row] / 16.0f;
+	    }
+	    if (sensors[row] & PHT)
+		light = lights[row] * light_scale;
+	    if (fprintf(csv, "%u,%.7g,%.7g,%.7g,%.7g,%.7g,%.7g,%.7g,%.7g,%.7g\n", delta[row],
+			acc[0], acc[1], acc[2], gyro[0], gyro[1], gyro[2], altitude, temperature,
+			light) < 0)
+		return false;
+	}
+    }
+    return true;
+}
+
+// Nearest whole number of 'scale' units in 'value'
+static long counts(double value, float scale)
+{
+    double scaled = value / scale;
+    return (long)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+// Read a file in the layout of the Android application's CSV log into a log
+bool importCsv(FILE * csv, Sample_Log_Writer & log)
+{
+    const Log_Column * columns = sample_log_columns;
+    char line[512];
+    uint32_t time = 0;
+    while (fgets(line, sizeof(line), csv)) {
+	double values[10];
+	char * cursor = line;
+	int count = 0;
+	while (count < 10) {
+	    char * end;
+	    values[count] = strtod(cursor, &end);
+	    if (end == cursor)
+		break;
+	    count += 1;
+	    cursor = end;
+	    while (*cursor == ',' || *cursor == ' ')
+		cursor += 1;
+	}
+	// Skip a header or anything else that is not a row of numbers
+	if (count != 10)
+	    continue;
+
+	Sensor_Reading reading;
+	reading.sensors = ACC | GYRO | BARO | PHT;
+	reading.delta = values[0];
+	time += reading.delta;
+	reading.time = time;
+	for (int i = 0; i < 3; ++i) {
+	    reading.acc[i] = counts(values[1 + i], columns[LOG_ACC_X].scale);
+	    reading.gyro[i] = counts(values[4 + i], columns[LOG_GYRO_X].scale);
+	}
+	long altitude = counts(values[7], 1 / 16.0f);
+	long temperature = counts(values[8], 1 / 16.0f);
+	reading.altitude = altitude >> 4;
+	reading.altitude_frac = altitude & 0xF;
+	reading.temperature = temperature >> 4;
+	reading.temperature_frac = temperature & 0xF;
+	reading.light = counts(values[9], columns[LOG_LIGHT].scale);
+	if (!log.append(reading))
+	    return false;
+    }
+    return true;
+}
@@ -0,0 +1,167 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Binary sample log. Samples are stored by column in chunks of up to 'chunk_rows' rows so a
+// reader can map the file and use each column as an array in place, with nothing parsed or
+// copied. All values are little endian.
+//
+// File layout:
+//   header (64 bytes):
+//     magic "BSNSLOG1" (8) | version (2) | header size (2) | column count (2) | reserved (2) |
+//     rows per chunk (4) | chunk count (4) | row count (8) | index offset (8) |
+//     first time (8) | last time (8) | reserved (8)
+//   column table, 32 bytes per column:
+//     column id (1) | value size in bytes (1) | signed (1) | reserved (1) | scale to the
+//     units below as a float (4) | name (24)
+//   chunks, each starting on an 8 byte boundary:
+//     magic "CHNK" (4) | rows (4) | first time (8) | last time (8) | reserved (8) |
+//     then every column in table order as 'rows' values, each padded to 8 bytes
+//   chunk index at the index offset, 32 bytes per chunk:
+//     chunk offset (8) | rows (4) | reserved (4) | first time (8) | last time (8)
+//
+// Times are microseconds. The header and index are filled in when the writer is closed, a log
+// whose writer never closed has a chunk count of zero.
+
+// Compiler directive to make sure the classes have not already been defined
+#ifndef SAMPLE_LOG
+#define SAMPLE_LOG
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "Sensor_Stream.h"
+
+#define SAMPLE_LOG_VERSION 1
+#define SAMPLE_LOG_CHUNK_ROWS 4096
+
+// Columns of every log, in file order
+enum log_column
+{
+    LOG_TIME,		// uint64, microseconds
+    LOG_DELTA,		// uint16, microseconds since the previous single sample frame
+    LOG_SENSORS,	// uint8, ACC, GYRO, BARO and PHT bits of the readings present
+    LOG_ACC_X,		// int16, counts, scale gives m/s^2
+    LOG_ACC_Y,
+    LOG_ACC_Z,
+    LOG_GYRO_X,		// int16, counts, scale gives deg/s
+    LOG_GYRO_Y,
+    LOG_GYRO_Z,
+    LOG_ALTITUDE,	// int32, sixteenths of a meter
+    LOG_TEMPERATURE,	// int16, sixteenths of a degree Celsius
+    LOG_LIGHT,		// uint16, analog counts, scale gives percent
+    LOG_COLUMNS
+};
+
+// Description of a column as stored in the column table
+struct Log_Column
+{
+    uint8_t id;
+    uint8_t size;
+    uint8_t is_signed;
+    uint8_t reserved;
+    float scale;
+    char name[24];
+};
+
+// The column table every log is written with
+extern const Log_Column sample_log_columns[LOG_COLUMNS];
+
+// Entry of the chunk index
+struct Log_Chunk
+{
+    uint64_t offset;
+    uint32_t rows;
+    uint32_t reserved;
+    uint64_t first_time;
+    uint64_t last_time;
+};
+
+class Sample_Log_Writer {
+// Internal members not used outside the class
+private:
+    FILE * file;
+    uint32_t chunk_rows;
+    uint32_t rows;
+    uint64_t row_count;
+    uint64_t first_time;
+    uint64_t last_time;
+    // Board time extended past the 32 bit wrap
+    uint32_t last_board_time;
+    uint64_t time_base;
+    std::vector<uint8_t> columns[LOG_COLUMNS];
+    std::vector<Log_Chunk> index;
+
+    bool flushChunk();
+    bool writePadded(const void * data, size_t size);
+
+// Member functions accesible outside the class
+public:
+    Sample_Log_Writer();
+    ~Sample_Log_Writer();
+
+    // Create a log, returns false if the file could not be created
+    bool open(const std::string & path, uint32_t chunk_rows = SAMPLE_LOG_CHUNK_ROWS);
+
+    // Add a sample. Readings missing from it are stored as zero with their sensor bit clear.
+    bool append(const Sensor_Reading & reading);
+
+    // Write the last chunk, the index and the header and close the file
+    bool close();
+};
+
+class Sample_Log_Reader {
+// Internal members not used outside the class
+private:
+    int fd;
+    const uint8_t * map;
+    size_t map_size;
+    const Log_Chunk * chunk_index;
+    uint32_t chunk_count;
+    uint64_t row_count;
+    uint16_t column_count;
+    const Log_Column * column_table;
+
+// Member functions accesible outside the class
+public:
+    Sample_Log_Reader();
+    ~Sample_Log_Reader();
+
+    // Map a log and check its header and index, returns false if it is not a complete log
+    bool open(const std::string & path);
+    void close();
+
+    uint64_t rows() const { return row_count; }
+    uint32_t chunks() const { return chunk_count; }
+    const Log_Chunk & chunk(uint32_t index) const { return chunk_index[index]; }
+    const Log_Column & column(uint8_t id) const { return column_table[id]; }
+
+    // Values of a column in a chunk, pointing into the mapped file
+    const void * columnData(uint32_t chunk, uint8_t id) const;
+    template <typename T> const T * values(uint32_t chunk, uint8_t id) const
+    {
+	return (const T *)columnData(chunk, id);
+    }
+
+    // First chunk that may hold samples at or after 'time'
+    uint32_t findChunk(uint64_t time) const;
+};
+
+// Convert between a log and the comma separated layout of the Android application's
+// inertial_sensors.csv: delta time in microseconds, acceleration in m/s^2 and rotation rate in
+// deg/s for each axis, altitude in meters, temperature in degrees Celsius and light in percent,
+// one sample per line with no header. Readings a sample does not have repeat the last values,
+// as the application does. Samples read from a CSV file are marked as having every reading.
+bool exportCsv(const Sample_Log_Reader & log, FILE * csv);
+bool importCsv(FILE * csv, Sample_Log_Writer & log);
+
+#endif
@@ -0,0 +1,302 @@
+// Batch quaternion kernels over arrays of components, see Quaternion_Batch.h
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "Quaternion_Batch.h"
+
+#define DEG_TO_RAD (M_PI / 180)
+
+// Largest squared half angle the series below are used for, the rest go through libm
+#define SERIES_LIMIT 0.25
+
+// Samples gone over in one go between the passes that fix up large turns and normalize the
+// chained orientation
+#define QUATERNION_CHUNK 256
+
+void Quaternion_Batch::resize(size_t count)
+{
+    w.resize(count);
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+}
+
+// Call 'function' with every index below 'count', shared out over 'threads' threads
+template <typename Function>
+static void parallelFor(size_t count, unsigned threads, Function function)
+{
+    if (threads > count)
+	threads = count;
+    if (threads <= 1) {
+	for (size_t i = 0; i < count; ++i)
+	    function(i);
+	return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+	for (size_t i = next++; i < count; i = next++)
+	    function(i);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i)
+	pool.push_back(std::thread(work));
+    work();
+    for (size_t i = 0; i < pool.size(); ++i)
+	pool[i].join();
+}
+
+// cos(a) and sin(a) / a from a^2 by their Taylor series, within a unit in the last place for
+// a^2 up to SERIES_LIMIT, with no calls or branches so the loop over them vectorizes
+static inline double seriesCos(double a2)
+{
+    return 1 + a2 * (-1.0 / 2 + a2 * (1.0 / 24 + a2 * (-1.0 / 720 + a2 * (1.0 / 40320 +
+	a2 * (-1.0 / 3628800 + a2 * (1.0 / 479001600 + a2 * (-1.0 / 87178291200.0)))))));
+}
+
+static inline double seriesSinc(double a2)
+{
+    return 1 + a2 * (-1.0 / 6 + a2 * (1.0 / 120 + a2 * (-1.0 / 5040 + a2 * (1.0 / 362880 +
+	a2 * (-1.0 / 39916800 + a2 * (1.0 / 6227020800.0 + a2 * (-1.0 / 1307674368000.0)))))));
+}
+
+void deltaQuaternions(const double * __restrict rate_x, const double * __restrict rate_y,
+		      const double * __restrict rate_z, const double * __restrict dt,
+		      size_t count, Quaternion_Batch & deltas)
+{
+    deltas.resize(count);
+    double * __restrict w = deltas.w.data();
+    double * __restrict x = deltas.x.data();
+    double * __restrict y = deltas.y.data();
+    double * __restrict z = deltas.z.data();
+
+    for (size_t first = 0; first < count; first += QUATERNION_CHUNK) {
+	size_t last = std::min(first + QUATERNION_CHUNK, count);
+	int large = 0;
+	for (size_t i = first; i < last; ++i) {
+	    double hx = 0.5 * rate_x[i] * dt[i], hy = 0.5 * rate_y[i] * dt[i];
+	    double hz = 0.5 * rate_z[i] * dt[i];
+	    double a2 = hx * hx + hy * hy + hz * hz;
+	    double sinc = seriesSinc(a2);
+	    w[i] = seriesCos(a2);
+	    x[i] = hx * sinc;
+	    y[i] = hy * sinc;
+	    z[i] = hz * sinc;
+	    large |= a2 > SERIES_LIMIT;
+	}
+	if (!large)
+	    continue;
+
+	// Turns too large for the series in one sample are rare, redo them exactly
+	for (size_t i = first; i < last; ++i) {
+	    double hx = 0.5 * rate_x[i] * dt[i], hy = 0.5 * rate_y[i] * dt[i];
+	    double hz = 0.5 * rate_z[i] * dt[i];
+	    double a2 = hx * hx + hy * hy + hz * hz;
+	    if (a2 <= SERIES_LIMIT)
+		continue;
+	    double a = sqrt(a2), sinc = sin(a) / a;
+	    w[i] = cos(a);
+	    x[i] = hx * sinc;
+	    y[i] = hy * sinc;
+	    z[i] = hz * sinc;
+	}
+    }
+}
+
+// Scale 'count' quaternions to unit length
+static void normalize(double * __restrict w, double * __restrict x, double * __restrict y,
+		      double * __restrict z, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+	double scale = 1 / sqrt(w[i] * w[i] + x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+	w[i] *= scale;
+	x[i] *= scale;
+	y[i] *= scale;
+	z[i] *= scale;
+    }
+}
+
+// Multiply deltas 'first' up to 'last' on the left of (w, x, y, z) in turn, writing out the
+// normalized product after each. Normalizing only scales the product, so the products are
+// chained a chunk at a time as they are and normalized afterwards in a loop of its own, which
+// keeps the square root and division out of the dependency from one sample to the next.
+static void chain(const Quaternion_Batch & deltas, size_t first, size_t last, double w, double x,
+		  double y, double z, Quaternion_Batch & orientation)
+{
+    const double * dw = deltas.w.data(), * dx = deltas.x.data();
+    const double * dy = deltas.y.data(), * dz = deltas.z.data();
+    double * ow = orientation.w.data(), * ox = orientation.x.data();
+    double * oy = orientation.y.data(), * oz = orientation.z.data();
+    for (size_t begin = first; begin < last; begin += QUATERNION_CHUNK) {
+	size_t end = std::min(begin + QUATERNION_CHUNK, last);
+	for (size_t i = begin; i < end; ++i) {
+	    // Summed in pairs for a shorter chain of additions
+	    double nw = (dw[i] * w - dx[i] * x) - (dy[i] * y + dz[i] * z);
+	    double nx = (dw[i] * x + dx[i] * w) + (dy[i] * z - dz[i] * y);
+	    double ny = (dw[i] * y - dx[i] * z) + (dy[i] * w + dz[i] * x);
+	    double nz = (dw[i] * z + dx[i] * y) - (dy[i] * x - dz[i] * w);
+	    ow[i] = w = nw;
+	    ox[i] = x = nx;
+	    oy[i] = y = ny;
+	    oz[i] = z = nz;
+	}
+	normalize(ow + begin, ox + begin, oy + begin, oz + begin, end - begin);
+	w = ow[end - 1];
+	x = ox[end - 1];
+	y = oy[end - 1];
+	z = oz[end - 1];
+    }
+}
+
+void integrateQuaternions(const Quaternion_Batch & deltas, const double * initial,
+			  Quaternion_Batch & orientation, unsigned threads)
+{
+    const size_t count = deltas.size();
+    const size_t blocks = (count + QUATERNION_BLOCK - 1) / QUATERNION_BLOCK;
+    orientation.resize(count);
+    double scale = 1 / sqrt(initial[0] * initial[0] + initial[1] * initial[1] +
+			    initial[2] * initial[2] + initial[3] * initial[3]);
+    double w = initial[0] * scale, x = initial[1] * scale;
+    double y = initial[2] * scale, z = initial[3] * scale;
+
+    // Alone there is nothing to gain from splitting the run up
+    if (threads <= 1 || blocks <= 1) {
+	chain(deltas, 0, count, w, x, y, z, orientation);
+	return;
+    }
+
+    // The turn over each block on its own, from no rotation at the block's start
+    parallelFor(blocks, threads, [&](size_t block) {
+	size_t first = block * QUATERNION_BLOCK;
+	chain(deltas, first, std::min(first + QUATERNION_BLOCK, count), 1, 0, 0, 0, orientation);
+    });
+
+    // Orientation at the start of each block, each block's turn applied to the one before
+    double * ow = orientation.w.data(), * ox = orientation.x.data();
+    double * oy = orientation.y.data(), * oz = orientation.z.data();
+    std::vector<double> start(4 * blocks);
+    for (size_t block = 0; block < blocks; ++block) {
+	start[4 * block] = w;
+	start[4 * block + 1] = x;
+	start[4 * block + 2] = y;
+	start[4 * block + 3] = z;
+	size_t end = std::min((block + 1) * QUATERNION_BLOCK, count) - 1;
+	double nw = ow[end] * w - ox[end] * x - oy[end] * y - oz[end] * z;
+	double nx = ow[end] * x + ox[end] * w + oy[end] * z - oz[end] * y;
+	double ny = ow[end] * y - ox[end] * z + oy[end] * w + oz[end] * x;
+	double nz = ow[end] * z + ox[end] * y - oy[end] * x + oz[end] * w;
+	scale = 1 / sqrt(nw * nw + nx * nx + ny * ny + nz * nz);
+	w = nw * scale;
+	x = nx * scale;
+	y = ny * scale;
+	z = nz * scale;
+    }
+
+    // Every sample's turn within its block applied to the block's start
+    parallelFor(blocks, threads, [&](size_t block) {
+	size_t first = block * QUATERNION_BLOCK, last = std::min(first + QUATERNION_BLOCK, count);
+	const double sw = start[4 * block], sx = start[4 * block + 1];
+	const double sy = start[4 * block + 2], sz = start[4 * block + 3];
+	double * __restrict bw = ow + first, * __restrict bx = ox + first;
+	double * __restrict by = oy + first, * __restrict bz = oz + first;
+	for (size_t i = 0; i < last - first; ++i) {
+	    double nw = bw[i] * sw - bx[i] * sx - by[i] * sy - bz[i] * sz;
+	    double nx = bw[i] * sx + bx[i] * sw + by[i] * sz - bz[i] * sy;
+	    double ny = bw[i] * sy - bx[i] * sz + by[i] * sw + bz[i] * sx;
+	    double nz = bw[i] * sz + bx[i] * sy - by[i] * sx + bz[i] * sw;
+	    double scale = 1 / sqrt(nw * nw + nx * nx + ny * ny + nz * nz);
+	    bw[i] = nw * scale;
+	    bx[i] = nx * scale;
+	    by[i] = ny * scale;
+	    bz[i] = nz * scale;
+	}
+    });
+}
+
+void normalizeQuaternions(Quaternion_Batch & quaternions)
+{
+    normalize(quaternions.w.data(), quaternions.x.data(), quaternions.y.data(),
+	      quaternions.z.data(), quaternions.size());
+}
+
+void quaternionsToAngles(const Quaternion_Batch & quaternions, double * __restrict roll,
+			 double * __restrict pitch, double * __restrict yaw)
+{
+    const double * w = quaternions.w.data(), * x = quaternions.x.data();
+    const double * y = quaternions.y.data(), * z = quaternions.z.data();
+    for (size_t i = 0; i < quaternions.size(); ++i) {
+	roll[i] = atan2(2 * (w[i] * x[i] + y[i] * z[i]), 1 - 2 * (x[i] * x[i] + y[i] * y[i]));
+	// Rounding can take the sine just past one straight up or down
+	double sine = 2 * (w[i] * y[i] - z[i] * x[i]);
+	pitch[i] = asin(sine > 1 ? 1 : sine < -1 ? -1 : sine);
+	yaw[i] = atan2(2 * (w[i] * z[i] + x[i] * y[i]), 1 - 2 * (y[i] * y[i] + z[i] * z[i]));
+    }
+}
+
+void anglesToQuaternions(const double * roll, const double * pitch, const double * yaw,
+			 size_t count, Quaternion_Batch & quaternions)
+{
+    quaternions.resize(count);
+    double * __restrict w = quaternions.w.data(), * __restrict x = quaternions.x.data();
+    double * __restrict y = quaternions.y.data(), * __restrict z = quaternions.z.data();
+    for (size_t i = 0; i < count; ++i) {
+	double c1 = cos(roll[i] / 2), s1 = sin(roll[i] / 2);
+	double c2 = cos(pitch[i] / 2), s2 = sin(pitch[i] / 2);
+	double c3 = cos(yaw[i] / 2), s3 = sin(yaw[i] / 2);
+	w[i] = c1 * c2 * c3 + s1 * s2 * s3;
+	x[i] = s1 * c2 * c3 - c1 * s2 * s3;
+	y[i] = c1 * s2 * c3 + s1 * c2 * s3;
+	z[i] = c1 * c2 * s3 - s1 * s2 * c3;
+    }
+}
+
+void quaternionsToRotationMatrices(const Quaternion_Batch & quaternions, double * const * matrices)
+{
+    const double * w = quaternions.w.data(), * x = quaternions.x.data();
+    const double * y = quaternions.y.data(), * z = quaternions.z.data();
+    double * __restrict m0 = matrices[0], * __restrict m1 = matrices[1];
+    double * __restrict m2 = matrices[2], * __restrict m3 = matrices[3];
+    double * __restrict m4 = matrices[4], * __restrict m5 = matrices[5];
+    double * __restrict m6 = matrices[6], * __restrict m7 = matrices[7];
+    double * __restrict m8 = matrices[8];
+    for (size_t i = 0; i < quaternions.size(); ++i) {
+	double xx = x[i] * x[i], yy = y[i] * y[i], zz = z[i] * z[i];
+	double xy = x[i] * y[i], xz = x[i] * z[i], yz = y[i] * z[i];
+	double wx = w[i] * x[i], wy = w[i] * y[i], wz = w[i] * z[i];
+	m0[i] = 1 - 2 * (yy + zz);
+	m1[i] = 2 * (xy - wz);
+	m2[i] = 2 * (xz + wy);
+	m3[i] = 2 * (xy + wz);
+	m4[i] = 1 - 2 * (xx + zz);
+	m5[i] = 2 * (yz - wx);
+	m6[i] = 2 * (xz - wy);
+	m7[i] = 2 * (yz + wx);
+	m8[i] = 1 - 2 * (xx + yy);
+    }
+}
+
+void anglesToRotationMatrices(const double * roll, const double * pitch, const double * yaw,
+			      size_t count, double * const * matrices)
+{
+    double * __restrict m0 = matrices[0], * __restrict m1 = matrices[1];
+    double * __restrict m2 = matrices[2], * __restrict m3 = matrices[3];
+    double * __restrict m4 = matrices[4], * __restrict m5 = matrices[5];
+    double * __restrict m6 = matrices[6], * __restrict m7 = matrices[7];
+    double * __restrict m8 = matrices[8];
+    for (size_t i = 0; i < count; ++i) {
+	double cx = cos(roll[i] * DEG_TO_RAD), sx = sin(roll[i] * DEG_TO_RAD);
+	double cy = cos(pitch[i] * DEG_TO_RAD), sy = sin(pitch[i] * DEG_TO_RAD);
+	double cz = cos(yaw[i] * DEG_TO_RAD), sz = sin(yaw[i] * DEG_TO_RAD);
+	m0[i] = cz * cy;
+	m1[i] = cz * sy * sx - sz * cx;
+	m2[i] = cz * sy * cx + sz * sx;
+	m3[i] = sz * cy;
+	m4[i] = sz * sy * sx + cz * cx;
+	m5[i] = sz * sy * cx - cz * sx;
+	m6[i] = -sy;
+	m7[i] = cy * sx;
+	m8[i] = cy * cx;
+    }
+}
@@ -0,0 +1,65 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Orientation for long runs of gyroscope samples, the batch versions of the quaternion
+// functions in analysis/. Quaternions are stored with one array per component so each kernel
+// is a plain loop over arrays that the compiler can turn into vector instructions. The
+// integration, which depends on the previous sample, chains the bare products and normalizes
+// them a chunk at a time, and is split into blocks whose partial products are combined
+// afterwards.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef QUATERNION_BATCH
+#define QUATERNION_BATCH
+
+#include <stddef.h>
+#include <vector>
+
+// Samples in each block of the integration, every block can go to its own thread
+#define QUATERNION_BLOCK 16384
+
+// Quaternions w + xi + yj + zk, one array per component
+class Quaternion_Batch {
+// Member functions accesible outside the class
+public:
+    std::vector<double> w, x, y, z;
+
+    size_t size() const { return w.size(); }
+    void resize(size_t count);
+};
+
+// The rotation over each sample for rates in rad/s held for 'dt' seconds: with h the rate
+// times dt / 2, (cos |h|, h sin |h| / |h|) as quaternion_integrate.m builds it
+void deltaQuaternions(const double * rate_x, const double * rate_y, const double * rate_z,
+		      const double * dt, size_t count, Quaternion_Batch & deltas);
+
+// Orientation after every sample starting from 'initial' (w, x, y, z), each delta multiplied
+// on the left and the result normalized as quaternion_integrate.m does
+void integrateQuaternions(const Quaternion_Batch & deltas, const double * initial,
+			  Quaternion_Batch & orientation, unsigned threads = 1);
+
+void normalizeQuaternions(Quaternion_Batch & quaternions);
+
+// Roll, pitch and yaw in radians as quaternion_to_angles.m gives them, and back as
+// angles_to_quaternion.m
+void quaternionsToAngles(const Quaternion_Batch & quaternions, double * roll, double * pitch,
+			 double * yaw);
+void anglesToQuaternions(const double * roll, const double * pitch, const double * yaw,
+			 size_t count, Quaternion_Batch & quaternions);
+
+// Rotation matrices with element (row, column) of each in matrices[3 * row + column]. From
+// unit quaternions, or from roll, pitch and yaw in degrees as angles_to_rotation_matrix.m
+// builds them, Z * Y * X.
+void quaternionsToRotationMatrices(const Quaternion_Batch & quaternions, double * const * matrices);
+void anglesToRotationMatrices(const double * roll, const double * pitch, const double * yaw,
+			      size_t count, double * const * matrices);
+
+#endif
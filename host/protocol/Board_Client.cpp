@@ -0,0 +1,298 @@
+// Host side of the configuration requests
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Board_Client.h"
+#include "TWI_Queue.h"
+
+size_t encodeSetBaudRate(uint32_t baud, uint8_t * out)
+{
+    out[0] = SET_BAUD_RATE;
+    out[1] = baud >> 24;
+    out[2] = baud >> 16;
+    out[3] = baud >> 8;
+    out[4] = baud;
+    return 5;
+}
+
+size_t encodeSetSensors(uint8_t sensors, uint8_t * out)
+{
+    out[0] = SET_SENSORS;
+    out[1] = sensors;
+    return 2;
+}
+
+size_t encodeSetDivisor(uint8_t sensor, uint16_t ticks, uint8_t * out)
+{
+    out[0] = SET_DIVISOR;
+    out[1] = sensor;
+    out[2] = ticks >> 8;
+    out[3] = ticks;
+    return 4;
+}
+
+size_t encodeSetRange(uint8_t sensor, uint8_t range, uint8_t * out)
+{
+    out[0] = SET_RANGE;
+    out[1] = sensor;
+    out[2] = range;
+    return 3;
+}
+
+size_t encodeSetHighPass(uint8_t sensor, uint8_t cutoff, uint8_t * out)
+{
+    out[0] = SET_HIGH_PASS;
+    out[1] = sensor;
+    out[2] = cutoff;
+    return 3;
+}
+
+size_t encodeSetMotion(uint8_t ticks, uint8_t threshold, uint8_t * out)
+{
+    out[0] = SET_MOTION;
+    out[1] = ticks;
+    out[2] = threshold;
+    return 3;
+}
+
+const char * ackStatusText(uint8_t status)
+{
+    if (status & ACK_BUS_ERROR)
+	return "I2C error";
+    switch (status) {
+    case ACK_OK: return "ok";
+    case ACK_INVALID: return "invalid or not supported";
+    case ACK_TIMEOUT: return "arguments timed out";
+    case ACK_MODULE_ERROR: return "Bluetooth module did not change rate";
+    default: return "unknown status";
+    }
+}
+
+const char * busErrorText(uint8_t error)
+{
+    switch (error) {
+    case NO_ERROR: return "none";
+    case BUFFER_SIZE_ERROR: return "queue full";
+    case ADDRESS_NO_ACKNOWLEDGE: return "address not acknowledged";
+    case DATA_NO_ACKNOWLEDGE: return "data not acknowledged";
+    case TWI_ERROR: return "bus error";
+    case IDENTIFICATION_FAILURE: return "wrong device";
+    case REGISTER_MISMATCH: return "register mismatch";
+    case TWI_TIMEOUT: return "bus stalled";
+    default: return "unknown error";
+    }
+}
+
+uint8_t sensorBit(const char * name)
+{
+    if (!strcmp(name, "acc"))
+	return ACC;
+    if (!strcmp(name, "gyro"))
+	return GYRO;
+    if (!strcmp(name, "baro"))
+	return BARO;
+    if (!strcmp(name, "light"))
+	return PHT;
+    return 0;
+}
+
+// Rate codes for the serial port, 0 for rates termios does not have
+static speed_t speedCode(uint32_t baud)
+{
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    default: return 0;
+    }
+}
+
+// Put a serial port in raw mode at 'baud'
+bool setPortSpeed(int fd, uint32_t baud)
+{
+    struct termios settings;
+    if (!speedCode(baud) || !isatty(fd) || tcgetattr(fd, &settings) != 0)
+	return false;
+    cfmakeraw(&settings);
+    cfsetspeed(&settings, speedCode(baud));
+    settings.c_cflag |= CLOCAL | CREAD;
+    return tcsetattr(fd, TCSANOW, &settings) == 0;
+}
+
+static long milliseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+Board_Client::Board_Client(int fd, uint8_t framing)
+    : fd(fd), stream(dropReading, 0), answered(false), reported(false),
+      benchmarked(false), timeout(1000)
+{
+    stream.setFraming(framing);
+    stream.setAckHandler(keepAck, this);
+    stream.setHealthHandler(keepHealth, this);
+    stream.setBenchmarkHandler(keepBenchmark, this);
+}
+
+void Board_Client::dropReading(const Sensor_Reading &, void *)
+{
+}
+
+void Board_Client::keepAck(const Config_Ack & ack, void * context)
+{
+    Board_Client & client = *(Board_Client *)context;
+    client.last = ack;
+    client.answered = true;
+}
+
+void Board_Client::keepHealth(const Board_Health & health, void * context)
+{
+    Board_Client & client = *(Board_Client *)context;
+    client.health = health;
+    client.reported = true;
+}
+
+void Board_Client::keepBenchmark(const Bus_Benchmark & benchmark, void * context)
+{
+    Board_Client & client = *(Board_Client *)context;
+    client.benchmark = benchmark;
+    client.benchmarked = true;
+}
+
+bool Board_Client::sendAll(const uint8_t * data, size_t size)
+{
+    while (size) {
+	ssize_t sent = write(fd, data, size);
+	if (sent < 0 && errno == EINTR)
+	    continue;
+	if (sent < 0 && errno == EAGAIN) {
+	    struct pollfd waiting = { fd, POLLOUT, 0 };
+	    poll(&waiting, 1, timeout);
+	    continue;
+	}
+	if (sent <= 0)
+	    return false;
+	data += sent;
+	size -= sent;
+    }
+    return true;
+}
+
+// Send a request and wait up to 'wait' milliseconds for the frame answering it, an
+// acknowledgement or for SEND_HEALTH and RUN_BENCHMARK the health and benchmark frames
+bool Board_Client::exchange(const uint8_t * data, size_t size, int wait)
+{
+    answered = false;
+    reported = false;
+    benchmarked = false;
+    if (!sendAll(data, size))
+	return false;
+
+    // A new rate is set on the port before the board answers at it
+    if (data[0] == SET_BAUD_RATE && isatty(fd) && tcdrain(fd) == 0)
+	setPortSpeed(fd, ((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) |
+		     ((uint32_t)data[3] << 8) | data[4]);
+
+    long end = milliseconds() + wait;
+    uint8_t buffer[256];
+    for (;;) {
+	long left = end - milliseconds();
+	if (left <= 0)
+	    return false;
+	struct pollfd waiting = { fd, POLLIN, 0 };
+	int ready = poll(&waiting, 1, left);
+	if (ready < 0 && errno != EINTR)
+	    return false;
+	if (ready <= 0)
+	    continue;
+	ssize_t got = read(fd, buffer, sizeof(buffer));
+	if (got < 0 && (errno == EINTR || errno == EAGAIN))
+	    continue;
+	if (got <= 0)
+	    return false;
+	// Stop at the answer to this request, anything after it is dropped
+	for (ssize_t i = 0; i < got; ++i) {
+	    stream.feed(buffer + i, 1);
+	    bool done = data[0] == SEND_HEALTH ? reported :
+		data[0] == RUN_BENCHMARK ? benchmarked : answered && last.request == data[0];
+	    if (done)
+		return true;
+	}
+    }
+}
+
+// Send a request and wait for its acknowledgement
+bool Board_Client::request(const uint8_t * data, size_t size, Config_Ack & ack)
+{
+    if (!exchange(data, size, timeout))
+	return false;
+    ack = last;
+    return true;
+}
+
+bool Board_Client::setBaudRate(uint32_t baud, Config_Ack & ack)
+{
+    uint8_t data[CONFIG_REQUEST_MAX];
+    return request(data, encodeSetBaudRate(baud, data), ack);
+}
+
+bool Board_Client::setSensors(uint8_t sensors, Config_Ack & ack)
+{
+    uint8_t data[CONFIG_REQUEST_MAX];
+    return request(data, encodeSetSensors(sensors, data), ack);
+}
+
+bool Board_Client::setDivisor(uint8_t sensor, uint16_t ticks, Config_Ack & ack)
+{
+    uint8_t data[CONFIG_REQUEST_MAX];
+    return request(data, encodeSetDivisor(sensor, ticks, data), ack);
+}
+
+bool Board_Client::setRange(uint8_t sensor, uint8_t range, Config_Ack & ack)
+{
+    uint8_t data[CONFIG_REQUEST_MAX];
+    return request(data, encodeSetRange(sensor, range, data), ack);
+}
+
+bool Board_Client::setHighPass(uint8_t sensor, uint8_t cutoff, Config_Ack & ack)
+{
+    uint8_t data[CONFIG_REQUEST_MAX];
+    return request(data, encodeSetHighPass(sensor, cutoff, data), ack);
+}
+
+bool Board_Client::setMotion(uint8_t ticks, uint8_t threshold, Config_Ack & ack)
+{
+    uint8_t data[CONFIG_REQUEST_MAX];
+    return request(data, encodeSetMotion(ticks, threshold, data), ack);
+}
+
+bool Board_Client::readHealth(Board_Health & health)
+{
+    const uint8_t data[] = { SEND_HEALTH };
+    if (!exchange(data, sizeof(data), timeout))
+	return false;
+    health = this->health;
+    return true;
+}
+
+bool Board_Client::runBenchmark(Bus_Benchmark & benchmark)
+{
+    const uint8_t data[] = { RUN_BENCHMARK };
+    if (!exchange(data, sizeof(data), timeout + BENCHMARK_WAIT))
+	return false;
+    benchmark = this->benchmark;
+    return true;
+}
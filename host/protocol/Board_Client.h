@@ -0,0 +1,102 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Host side of the configuration requests, see Sensor_Protocol.h. The encode functions write
+// the bytes of each request for a program that talks to the board its own way. Board_Client
+// sends them over an open serial port or Bluetooth socket and waits for each acknowledgement,
+// dropping any samples that arrive in between, so it is meant for a board that is not
+// streaming. It also asks for the board's health frame and runs its bus benchmark.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef BOARD_CLIENT
+#define BOARD_CLIENT
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Sensor_Stream.h"
+
+// Bytes of the longest configuration request
+#define CONFIG_REQUEST_MAX 5
+
+// Milliseconds the board may take over the benchmark, most of it per register reads at standard
+// mode
+#define BENCHMARK_WAIT 2000
+
+// Write a request into 'out' and return the number of bytes written
+size_t encodeSetBaudRate(uint32_t baud, uint8_t * out);
+size_t encodeSetSensors(uint8_t sensors, uint8_t * out);
+size_t encodeSetDivisor(uint8_t sensor, uint16_t ticks, uint8_t * out);
+size_t encodeSetRange(uint8_t sensor, uint8_t range, uint8_t * out);
+size_t encodeSetHighPass(uint8_t sensor, uint8_t cutoff, uint8_t * out);
+size_t encodeSetMotion(uint8_t ticks, uint8_t threshold, uint8_t * out);
+
+// Text for an ACK_* status
+const char * ackStatusText(uint8_t status);
+
+// Text for an I2C error code of the firmware, see TWI_Queue.h
+const char * busErrorText(uint8_t error);
+
+// Put a serial port in raw mode at 'baud', returns false if 'fd' is not a serial port or the
+// rate is not one termios has
+bool setPortSpeed(int fd, uint32_t baud);
+
+// ACC, GYRO, BARO or PHT for a sensor name (acc, gyro, baro or light), 0 for anything else
+uint8_t sensorBit(const char * name);
+
+class Board_Client {
+// Internal members not used outside the class
+private:
+    int fd;
+    Sensor_Stream stream;
+    Config_Ack last;
+    bool answered;
+    Board_Health health;
+    bool reported;
+    Bus_Benchmark benchmark;
+    bool benchmarked;
+
+    static void dropReading(const Sensor_Reading & reading, void * context);
+    static void keepAck(const Config_Ack & ack, void * context);
+    static void keepHealth(const Board_Health & health, void * context);
+    static void keepBenchmark(const Bus_Benchmark & benchmark, void * context);
+    bool sendAll(const uint8_t * data, size_t size);
+    bool exchange(const uint8_t * data, size_t size, int wait);
+
+// Member functions accesible outside the class
+public:
+    // Milliseconds to wait for an acknowledgement, allowing for the module's command mode
+    int timeout;
+
+    // Talk to the board on 'fd' in DLE_FRAMING or COBS_FRAMING, the framing it was left in
+    Board_Client(int fd, uint8_t framing = DLE_FRAMING);
+
+    // Send a request and wait for its acknowledgement, returns false if none came in time or
+    // the descriptor failed
+    bool request(const uint8_t * data, size_t size, Config_Ack & ack);
+
+    // Each request in turn. A new baud rate is also set on the descriptor when it is a serial
+    // port at a standard rate, before the acknowledgement comes back at that rate.
+    bool setBaudRate(uint32_t baud, Config_Ack & ack);
+    bool setSensors(uint8_t sensors, Config_Ack & ack);
+    bool setDivisor(uint8_t sensor, uint16_t ticks, Config_Ack & ack);
+    bool setRange(uint8_t sensor, uint8_t range, Config_Ack & ack);
+    bool setHighPass(uint8_t sensor, uint8_t cutoff, Config_Ack & ack);
+    bool setMotion(uint8_t ticks, uint8_t threshold, Config_Ack & ack);
+
+    // Ask for the board's health frame, returns false if none came in time
+    bool readHealth(Board_Health & health);
+
+    // Have the board time full samples at each bus frequency and read mode, returns false if
+    // the results did not come within BENCHMARK_WAIT milliseconds more than the timeout
+    bool runBenchmark(Bus_Benchmark & benchmark);
+};
+
+#endif
@@ -0,0 +1,693 @@
+// Host side encoder and decoder for the frames sent by the sensor board
+
+#include <string.h>
+#include "Sensor_Frames.h"
+
+// Append a byte inside a frame, doubling it if it could be mistaken for a control code
+static uint8_t * stuff(uint8_t * out, uint8_t value)
+{
+    if (value == DLE)
+	*out++ = DLE;
+    *out++ = value;
+    return out;
+}
+
+static uint8_t * stuffBlock(uint8_t * out, const uint8_t * data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+	out = stuff(out, data[i]);
+    return out;
+}
+
+// Write a sample's sequence number and time as they start every frame header
+static uint8_t * sampleStamp(uint8_t * out, uint16_t sequence, uint32_t time)
+{
+    *out++ = sequence >> 8;
+    *out++ = sequence;
+    *out++ = time >> 24;
+    *out++ = time >> 16;
+    *out++ = time >> 8;
+    *out++ = time;
+    return out;
+}
+
+// Write the batched frame header, the sequence number and start time are taken from the first
+// sample
+static uint8_t * batchHeader(uint8_t * out, const Sensor_Sample * samples, uint8_t count,
+			     uint16_t period)
+{
+    *out++ = count;
+    out = sampleStamp(out, count ? samples[0].sequence : 0, count ? samples[0].time : 0);
+    *out++ = period >> 8;
+    *out++ = period;
+    return out;
+}
+
+// Write a single sample frame for 'sample' into 'out' and return the number of bytes written
+size_t encodeSingleFrame(const Sensor_Sample & sample, uint8_t * out)
+{
+    uint8_t * begin = out;
+    uint8_t header[SINGLE_HEADER_SIZE];
+    sampleStamp(header, sample.sequence, sample.time);
+    *out++ = DLE;
+    *out++ = STX;
+    out = stuffBlock(out, header, sizeof(header));
+
+    if (sample.sensors & ACC) {
+	*out++ = DLE;
+	*out++ = ACC;
+	out = stuffBlock(out, sample.acc, ACC_PAYLOAD);
+    }
+    if (sample.sensors & GYRO) {
+	*out++ = DLE;
+	*out++ = GYRO;
+	out = stuffBlock(out, sample.gyro, GYRO_PAYLOAD);
+    }
+    if (sample.sensors & BARO) {
+	*out++ = DLE;
+	*out++ = BARO;
+	out = stuffBlock(out, sample.baro, BARO_PAYLOAD);
+    }
+    if (sample.sensors & PHT) {
+	*out++ = DLE;
+	*out++ = PHT;
+	out = stuffBlock(out, sample.light, PHT_PAYLOAD);
+    }
+    if (sample.sensors & QUAT) {
+	*out++ = DLE;
+	*out++ = QUAT;
+	out = stuffBlock(out, sample.quat, QUAT_PAYLOAD);
+    }
+
+    *out++ = DLE;
+    *out++ = ETX;
+    return out - begin;
+}
+
+// Write a batched frame of 'count' samples into 'out' and return the number of bytes written,
+// the frame sequence number and start time are taken from the first sample
+size_t encodeBatchFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+			uint8_t * out)
+{
+    uint8_t * begin = out;
+    uint8_t header[BATCH_HEADER_SIZE];
+    batchHeader(header, samples, count, period);
+    *out++ = DLE;
+    *out++ = BTX;
+    out = stuffBlock(out, header, sizeof(header));
+
+    for (uint8_t i = 0; i < count; ++i) {
+	const Sensor_Sample & sample = samples[i];
+	out = stuff(out, sample.sensors);
+	if (sample.sensors & ACC)
+	    out = stuffBlock(out, sample.acc, ACC_PAYLOAD);
+	if (sample.sensors & GYRO)
+	    out = stuffBlock(out, sample.gyro, GYRO_PAYLOAD);
+	if (sample.sensors & BARO)
+	    out = stuffBlock(out, sample.baro, BARO_PAYLOAD);
+	if (sample.sensors & PHT)
+	    out = stuffBlock(out, sample.light, PHT_PAYLOAD);
+	if (sample.sensors & QUAT)
+	    out = stuffBlock(out, sample.quat, QUAT_PAYLOAD);
+    }
+
+    *out++ = DLE;
+    *out++ = ETX;
+    return out - begin;
+}
+
+// Copy the payloads carried by 'sample' to 'out', with the sensor tag in front of each block
+// for single sample frames
+static uint8_t * copySensors(uint8_t * out, const Sensor_Sample & sample, bool tagged)
+{
+    if (sample.sensors & ACC) {
+	if (tagged)
+	    *out++ = ACC;
+	memcpy(out, sample.acc, ACC_PAYLOAD);
+	out += ACC_PAYLOAD;
+    }
+    if (sample.sensors & GYRO) {
+	if (tagged)
+	    *out++ = GYRO;
+	memcpy(out, sample.gyro, GYRO_PAYLOAD);
+	out += GYRO_PAYLOAD;
+    }
+    if (sample.sensors & BARO) {
+	if (tagged)
+	    *out++ = BARO;
+	memcpy(out, sample.baro, BARO_PAYLOAD);
+	out += BARO_PAYLOAD;
+    }
+    if (sample.sensors & PHT) {
+	if (tagged)
+	    *out++ = PHT;
+	memcpy(out, sample.light, PHT_PAYLOAD);
+	out += PHT_PAYLOAD;
+    }
+    if (sample.sensors & QUAT) {
+	if (tagged)
+	    *out++ = QUAT;
+	memcpy(out, sample.quat, QUAT_PAYLOAD);
+	out += QUAT_PAYLOAD;
+    }
+    return out;
+}
+
+// Add the CRC to the 'size' bytes of 'frame', COBS encode them into 'out' with the delimiter
+// and return the number of bytes written
+static size_t finishCobsFrame(uint8_t * frame, size_t size, uint8_t * out)
+{
+    uint16_t crc = crc16(frame, size);
+    frame[size++] = crc & 0xFF;
+    frame[size++] = crc >> 8;
+    size_t encoded = cobsEncode(frame, size, out);
+    out[encoded++] = 0;
+    return encoded;
+}
+
+// The same frames in COBS framing, with CRC and the zero delimiter
+size_t encodeCobsSingleFrame(const Sensor_Sample & sample, uint8_t * out)
+{
+    uint8_t frame[1 + SINGLE_HEADER_SIZE + 5 + ACC_PAYLOAD + GYRO_PAYLOAD + BARO_PAYLOAD +
+		  PHT_PAYLOAD + QUAT_PAYLOAD + 2];
+    uint8_t * end = frame;
+    *end++ = STX;
+    end = sampleStamp(end, sample.sequence, sample.time);
+    end = copySensors(end, sample, true);
+    return finishCobsFrame(frame, end - frame, out);
+}
+
+// Write three little endian axes as zig-zag varint differences from the last reading in the
+// frame, or in full for the first reading of the sensor in the frame
+static uint8_t * copyDeltas(uint8_t * out, const uint8_t * payload, int16_t * last,
+			   bool keyed)
+{
+    for (int i = 0; i < 3; ++i) {
+	int16_t value = payload[2 * i] | (payload[2 * i + 1] << 8);
+	if (keyed)
+	    out += varintEncode(zigZag16(value - last[i]), out);
+	last[i] = value;
+    }
+    if (!keyed) {
+	memcpy(out, payload, 6);
+	out += 6;
+    }
+    return out;
+}
+
+// Write the contents of a batched or compressed frame, returning the number of bytes
+static size_t batchContents(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+			    bool compressed, uint8_t * frame)
+{
+    uint8_t * end = frame;
+    *end++ = compressed ? CTX : BTX;
+    end = batchHeader(end, samples, count, period);
+
+    int16_t last_acc[3], last_gyro[3];
+    uint8_t keyed = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+	const Sensor_Sample & sample = samples[i];
+	*end++ = sample.sensors;
+	if (!compressed) {
+	    end = copySensors(end, sample, false);
+	    continue;
+	}
+	if (sample.sensors & ACC) {
+	    end = copyDeltas(end, sample.acc, last_acc, keyed & ACC);
+	    keyed |= ACC;
+	}
+	if (sample.sensors & GYRO) {
+	    end = copyDeltas(end, sample.gyro, last_gyro, keyed & GYRO);
+	    keyed |= GYRO;
+	}
+	if (sample.sensors & BARO) {
+	    memcpy(end, sample.baro, BARO_PAYLOAD);
+	    end += BARO_PAYLOAD;
+	}
+	if (sample.sensors & PHT) {
+	    memcpy(end, sample.light, PHT_PAYLOAD);
+	    end += PHT_PAYLOAD;
+	}
+	if (sample.sensors & QUAT) {
+	    memcpy(end, sample.quat, QUAT_PAYLOAD);
+	    end += QUAT_PAYLOAD;
+	}
+    }
+    return end - frame;
+}
+
+size_t encodeCobsBatchFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+			    uint8_t * out)
+{
+    uint8_t frame[FRAME_CONTENTS_MAX + 2];
+    return finishCobsFrame(frame, batchContents(samples, count, period, false, frame), out);
+}
+
+size_t encodeCobsCompressedFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+				 uint8_t * out)
+{
+    uint8_t frame[FRAME_CONTENTS_MAX + 2];
+    return finishCobsFrame(frame, batchContents(samples, count, period, true, frame), out);
+}
+
+// Write a compressed frame of 'count' samples into 'out' and return the number of bytes
+// written
+size_t encodeCompressedFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+			     uint8_t * out)
+{
+    uint8_t frame[FRAME_CONTENTS_MAX];
+    size_t size = batchContents(samples, count, period, true, frame);
+    uint8_t * begin = out;
+    *out++ = DLE;
+    *out++ = frame[0];
+    out = stuffBlock(out, frame + 1, size - 1);
+    *out++ = DLE;
+    *out++ = ETX;
+    return out - begin;
+}
+
+// Size of each sample payload in the order they are sent
+static uint8_t payloadSize(uint8_t sensors)
+{
+    uint8_t size = 0;
+    if (sensors & ACC)
+	size += ACC_PAYLOAD;
+    if (sensors & GYRO)
+	size += GYRO_PAYLOAD;
+    if (sensors & BARO)
+	size += BARO_PAYLOAD;
+    if (sensors & PHT)
+	size += PHT_PAYLOAD;
+    if (sensors & QUAT)
+	size += QUAT_PAYLOAD;
+    return size;
+}
+
+// Fill the payloads of 'sample' from 'in', returns the bytes used or 0 if there are too few
+static size_t readSensors(const uint8_t * in, size_t size, Sensor_Sample & sample)
+{
+    size_t needed = payloadSize(sample.sensors);
+    if (needed > size)
+	return 0;
+    if (sample.sensors & ACC) {
+	memcpy(sample.acc, in, ACC_PAYLOAD);
+	in += ACC_PAYLOAD;
+    }
+    if (sample.sensors & GYRO) {
+	memcpy(sample.gyro, in, GYRO_PAYLOAD);
+	in += GYRO_PAYLOAD;
+    }
+    if (sample.sensors & BARO) {
+	memcpy(sample.baro, in, BARO_PAYLOAD);
+	in += BARO_PAYLOAD;
+    }
+    if (sample.sensors & PHT) {
+	memcpy(sample.light, in, PHT_PAYLOAD);
+	in += PHT_PAYLOAD;
+    }
+    if (sample.sensors & QUAT)
+	memcpy(sample.quat, in, QUAT_PAYLOAD);
+    return needed;
+}
+
+// Big endian values in the frame headers
+static uint16_t readWord(const uint8_t * in)
+{
+    return (in[0] << 8) | in[1];
+}
+
+// Read the samples from decoded single sample frame contents
+int parseSingleFrame(const uint8_t * frame, size_t size, Sensor_Sample & sample)
+{
+    if (size < 1 + SINGLE_HEADER_SIZE || frame[0] != STX)
+	return -1;
+    sample.sensors = 0;
+    sample.sequence = readWord(frame + 1);
+    sample.time = ((uint32_t)readWord(frame + 3) << 16) | readWord(frame + 5);
+
+    // Each block is a tag then the payload, in the same order as they are sent
+    size_t index = 1 + SINGLE_HEADER_SIZE;
+    uint8_t last = 0;
+    while (index < size) {
+	uint8_t tag = frame[index++];
+	if ((tag != ACC && tag != GYRO && tag != BARO && tag != PHT && tag != QUAT) || tag <= last)
+	    return -1;
+	last = tag;
+	// Read just this block into the sample
+	uint8_t sensors = sample.sensors;
+	sample.sensors = tag;
+	size_t used = readSensors(frame + index, size - index, sample);
+	if (used == 0)
+	    return -1;
+	index += used;
+	sample.sensors = sensors | tag;
+    }
+    return 1;
+}
+
+// Read decoded stats frame contents
+bool parseStatsFrame(const uint8_t * frame, size_t size, Loop_Stats & stats)
+{
+    if (size < 4 || frame[0] != PTX || size != 4 + (size_t)frame[1] * STAGE_RECORD_SIZE)
+	return false;
+    stats.stages = frame[1] < STAGE_COUNT ? frame[1] : STAGE_COUNT;
+    stats.tick = readWord(frame + 2);
+    const uint8_t * in = frame + 4;
+    for (uint8_t i = 0; i < stats.stages; ++i, in += STAGE_RECORD_SIZE) {
+	stats.stage[i].count = readWord(in);
+	stats.stage[i].shortest = readWord(in + 2);
+	stats.stage[i].longest = readWord(in + 4);
+	stats.stage[i].total = ((uint32_t)readWord(in + 6) << 16) | readWord(in + 8);
+	for (int j = 0; j < PROFILE_BINS; ++j)
+	    stats.stage[i].bins[j] = readWord(in + 10 + 2 * j);
+    }
+    return true;
+}
+
+// Read decoded acknowledgement frame contents
+bool parseAckFrame(const uint8_t * frame, size_t size, Config_Ack & ack)
+{
+    if (size != 1 + ACK_PAYLOAD || frame[0] != ATX)
+	return false;
+    ack.request = frame[1];
+    ack.status = frame[2];
+    ack.value = ((uint32_t)readWord(frame + 3) << 16) | readWord(frame + 5);
+    return true;
+}
+
+// Read decoded health frame contents
+bool parseHealthFrame(const uint8_t * frame, size_t size, Board_Health & health)
+{
+    if (size != 1 + HEALTH_PAYLOAD || frame[0] != HTX)
+	return false;
+    health.recoveries = readWord(frame + 1);
+    const uint8_t * in = frame + 3;
+    for (int i = 0; i < HEALTH_SENSORS; ++i, in += HEALTH_RECORD_SIZE) {
+	health.sensor[i].failures = readWord(in);
+	health.sensor[i].setups = readWord(in + 2);
+	health.sensor[i].last_error = in[4];
+    }
+    health.down = *in;
+    return true;
+}
+
+// Read decoded benchmark frame contents
+bool parseBenchmarkFrame(const uint8_t * frame, size_t size, Bus_Benchmark & benchmark)
+{
+    if (size < 2 || frame[0] != RTX || size != 2 + (size_t)frame[1] * BENCHMARK_RECORD_SIZE)
+	return false;
+    benchmark.count = frame[1] < BENCHMARK_RECORDS ? frame[1] : BENCHMARK_RECORDS;
+    const uint8_t * in = frame + 2;
+    for (int i = 0; i < benchmark.count; ++i, in += BENCHMARK_RECORD_SIZE) {
+	benchmark.record[i].khz = readWord(in);
+	benchmark.record[i].mode = in[2];
+	benchmark.record[i].failures = in[3];
+	benchmark.record[i].average = readWord(in + 4);
+	benchmark.record[i].longest = readWord(in + 6);
+    }
+    return true;
+}
+
+// Read three axes written by copyDeltas() back into a little endian payload, returns the bytes
+// used or 0 if the contents end early
+static size_t readDeltas(const uint8_t * in, size_t size, uint8_t * payload, int16_t * last,
+			 bool keyed)
+{
+    if (!keyed) {
+	if (size < 6)
+	    return 0;
+	memcpy(payload, in, 6);
+	for (int i = 0; i < 3; ++i)
+	    last[i] = in[2 * i] | (in[2 * i + 1] << 8);
+	return 6;
+    }
+
+    size_t used = 0;
+    for (int i = 0; i < 3; ++i) {
+	uint16_t delta;
+	uint8_t length = varintDecode(in + used, size - used, delta);
+	if (length == 0)
+	    return 0;
+	used += length;
+	last[i] += unZigZag16(delta);
+	payload[2 * i] = last[i];
+	payload[2 * i + 1] = (uint16_t)last[i] >> 8;
+    }
+    return used;
+}
+
+// Read the samples from decoded batched or compressed frame contents
+int parseBatchFrame(const uint8_t * frame, size_t size, Sensor_Sample * samples,
+		    uint16_t & period)
+{
+    if (size < 1 + BATCH_HEADER_SIZE || (frame[0] != BTX && frame[0] != CTX))
+	return -1;
+    bool compressed = frame[0] == CTX;
+    uint8_t count = frame[1];
+    uint16_t sequence = readWord(frame + 2);
+    uint32_t start = ((uint32_t)readWord(frame + 4) << 16) | readWord(frame + 6);
+    period = readWord(frame + 8);
+
+    int16_t last_acc[3] = { 0, 0, 0 }, last_gyro[3] = { 0, 0, 0 };
+    uint8_t keyed = 0;
+    int found = 0;
+    size_t index = 1 + BATCH_HEADER_SIZE;
+    for (uint8_t i = 0; i < count; ++i) {
+	if (index >= size || (frame[index] & ~(ACC | GYRO | BARO | PHT | QUAT)))
+	    return -1;
+	// Padding filling out the frame at the end of a stream
+	if (frame[index] == 0) {
+	    index += 1;
+	    continue;
+	}
+	Sensor_Sample & sample = samples[found++];
+	sample.sensors = frame[index++];
+	sample.sequence = sequence + i;
+	sample.time = start + (uint32_t)i * period;
+
+	uint8_t sensors = sample.sensors;
+	if (compressed) {
+	    if (sensors & ACC) {
+		size_t used = readDeltas(frame + index, size - index, sample.acc, last_acc,
+					 keyed & ACC);
+		if (used == 0)
+		    return -1;
+		index += used;
+		keyed |= ACC;
+	    }
+	    if (sensors & GYRO) {
+		size_t used = readDeltas(frame + index, size - index, sample.gyro, last_gyro,
+					 keyed & GYRO);
+		if (used == 0)
+		    return -1;
+		index += used;
+		keyed |= GYRO;
+	    }
+	    // The rest are sent as they are
+	    sample.sensors &= BARO | PHT | QUAT;
+	}
+	size_t used = readSensors(frame + index, size - index, sample);
+	if (used == 0 && sample.sensors != 0)
+	    return -1;
+	index += used;
+	sample.sensors = sensors;
+    }
+    if (index != size)
+	return -1;
+    return found;
+}
+
+// Take bytes from a block of the stream up to and including the one that completes a frame
+size_t Cobs_Decoder::feed(const uint8_t * data, size_t size, bool & complete)
+{
+    complete = false;
+    size_t index = 0;
+    while (index < size) {
+	// Copy everything up to the delimiter that fits
+	const uint8_t * zero = (const uint8_t *)memchr(data + index, 0, size - index);
+	size_t run = (zero ? zero - data : size) - index;
+	if (!overflowed && run <= sizeof(buffer) - fill) {
+	    memcpy(buffer + fill, data + index, run);
+	    fill += run;
+	    index += run;
+	    if (!zero)
+		break;
+	}
+	if (push(data[index++])) {
+	    complete = true;
+	    break;
+	}
+    }
+    return index;
+}
+
+Dle_Decoder::Dle_Decoder()
+{
+    errors = 0;
+    overruns = 0;
+    frame_size = 0;
+    reset();
+}
+
+// Forget any partly received frame
+void Dle_Decoder::reset()
+{
+    fill = 0;
+    escaped = false;
+    inside = false;
+    overflowed = false;
+}
+
+void Dle_Decoder::append(uint8_t value)
+{
+    if (fill == sizeof(buffer)) {
+	if (!overflowed)
+	    overruns += 1;
+	overflowed = true;
+    }
+    else
+	buffer[fill++] = value;
+}
+
+// Take the next byte from the stream, returns true when it completes a frame
+bool Dle_Decoder::push(uint8_t value)
+{
+    if (!escaped) {
+	if (value == DLE)
+	    escaped = true;
+	else if (inside)
+	    append(value);
+	return false;
+    }
+    escaped = false;
+
+    switch (value) {
+    // A doubled DLE is a data byte
+    case DLE:
+	if (inside)
+	    append(value);
+	return false;
+
+    // Sensor tags only mean something inside a single sample frame
+    case ACC:
+    case GYRO:
+    case BARO:
+    case PHT:
+    case QUAT:
+	if (inside && buffer[0] == STX) {
+	    append(value);
+	    return false;
+	}
+	break;
+
+    case STX:
+    case BTX:
+    case CTX:
+    case PTX:
+    case ATX:
+    case HTX:
+    case RTX:
+	if (inside)
+	    errors += 1;
+	reset();
+	inside = true;
+	append(value);
+	return false;
+
+    case ETX:
+	if (!inside)
+	    return false;
+	if (overflowed) {
+	    reset();
+	    return false;
+	}
+	frame_size = fill;
+	reset();
+	return true;
+    }
+
+    // Anything else breaks the frame
+    if (inside)
+	errors += 1;
+    reset();
+    return false;
+}
+
+// Take bytes from a block of the stream up to and including the one that completes a frame
+size_t Dle_Decoder::feed(const uint8_t * data, size_t size, bool & complete)
+{
+    complete = false;
+    size_t index = 0;
+    while (index < size) {
+	if (!escaped) {
+	    // Everything before the next DLE is either frame data or noise between frames
+	    const uint8_t * dle = (const uint8_t *)memchr(data + index, DLE, size - index);
+	    size_t run = (dle ? dle - data : size) - index;
+	    if (!inside)
+		index += run;
+	    else if (!overflowed && run <= sizeof(buffer) - fill) {
+		memcpy(buffer + fill, data + index, run);
+		fill += run;
+		index += run;
+	    }
+	    if (index == size)
+		break;
+	}
+	if (push(data[index++])) {
+	    complete = true;
+	    break;
+	}
+    }
+    return index;
+}
+Cobs_Decoder::Cobs_Decoder()
+{
+    crc_errors = 0;
+    encoding_errors = 0;
+    overruns = 0;
+    frame_size = 0;
+    reset();
+}
+
+// Forget any partly received frame
+void Cobs_Decoder::reset()
+{
+    fill = 0;
+    overflowed = false;
+}
+
+// Take the next byte from the stream, returns true when it completes a frame that passes its
+// CRC
+bool Cobs_Decoder::push(uint8_t value)
+{
+    if (value != 0) {
+	if (fill == sizeof(buffer)) {
+	    if (!overflowed)
+		overruns += 1;
+	    overflowed = true;
+	}
+	else
+	    buffer[fill++] = value;
+	return false;
+    }
+
+    // Delimiter, decode whatever came before it
+    size_t encoded = fill;
+    bool skip = overflowed;
+    reset();
+    if (skip || encoded == 0)
+	return false;
+
+    long decoded = cobsDecode(buffer, encoded, buffer);
+    if (decoded < 0) {
+	encoding_errors += 1;
+	return false;
+    }
+    // The CRC of the contents followed by their CRC is zero
+    if (decoded < 3 || crc16(buffer, decoded) != 0) {
+	crc_errors += 1;
+	return false;
+    }
+    frame_size = decoded - 2;
+    return true;
+}
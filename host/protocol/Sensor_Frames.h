@@ -0,0 +1,235 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Host side encoder and decoder for the frames sent by the sensor board, following the layout
+// described in Sensor_Protocol.h. Sensor payloads are kept as the raw bytes the drivers send so
+// a decoded frame can be encoded again byte for byte. Decoding is done in two steps, a framing
+// decoder (Dle_Decoder or Cobs_Decoder) turns the byte stream into frame contents, the type byte
+// followed by the frame with no framing bytes, and the parse functions read samples from those.
+
+// Compiler directive to make sure the classes have not already been defined
+#ifndef SENSOR_FRAMES
+#define SENSOR_FRAMES
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Sensor_Protocol.h"
+#include "Frame_Codec.h"
+
+// One reading of some or all of the sensors
+struct Sensor_Sample
+{
+    // ACC, GYRO, BARO, PHT and QUAT bits of the blocks with data in this sample
+    uint8_t sensors;
+    // Number of the sample among all those the board has sent
+    uint16_t sequence;
+    // Board clock in microseconds when the sample's reads were started
+    uint32_t time;
+    uint8_t acc[ACC_PAYLOAD];
+    uint8_t gyro[GYRO_PAYLOAD];
+    uint8_t baro[BARO_PAYLOAD];
+    uint8_t light[PHT_PAYLOAD];
+    uint8_t quat[QUAT_PAYLOAD];
+};
+
+// Times the board recorded for each stage of its sampling loop, from a stats frame (PTX)
+struct Loop_Stats
+{
+    // Stages in the frame, zero when the board was built without STAGE_PROFILING
+    uint8_t stages;
+    // Nanoseconds of a tick
+    uint16_t tick;
+    struct
+    {
+	uint16_t count;
+	uint16_t shortest;
+	uint16_t longest;
+	uint32_t total;
+	uint16_t bins[PROFILE_BINS];
+    } stage[STAGE_COUNT];
+};
+
+// Answer to a configuration request, from an acknowledgement frame (ATX)
+struct Config_Ack
+{
+    uint8_t request;
+    // ACK_* status
+    uint8_t status;
+    // Setting asked for, or the baud rate the board's UART runs at
+    uint32_t value;
+};
+
+// Bus recoveries and sensor failures the board has counted since reset, from a health frame
+// (HTX)
+struct Board_Health
+{
+    uint16_t recoveries;
+    // Accelerometer, gyroscope and barometer in that order
+    struct
+    {
+	uint16_t failures;
+	uint16_t setups;
+	uint8_t last_error;
+    } sensor[HEALTH_SENSORS];
+    // ACC, GYRO and BARO bits of the sensors left out of the samples
+    uint8_t down;
+};
+
+// Full sample times the board measured at each SCL frequency and read mode, from a benchmark
+// frame (RTX)
+struct Bus_Benchmark
+{
+    uint8_t count;
+    struct Record
+    {
+	uint16_t khz;
+	// BENCHMARK_BURST or BENCHMARK_PER_REGISTER
+	uint8_t mode;
+	uint8_t failures;
+	// Microseconds per full sample
+	uint16_t average;
+	uint16_t longest;
+    } record[BENCHMARK_RECORDS];
+};
+
+// Largest encoded frames, every byte after the leading control code could need stuffing
+#define SINGLE_FRAME_MAX (2 + 2 * (SINGLE_HEADER_SIZE + 2 + ACC_PAYLOAD + 2 + GYRO_PAYLOAD + 2 + BARO_PAYLOAD + 2 + PHT_PAYLOAD + 2 + QUAT_PAYLOAD) + 2)
+#define BATCH_FRAME_MAX(count) (2 + 2 * (BATCH_HEADER_SIZE + (count) * SAMPLE_RECORD_MAX) + 2)
+
+// Write a single sample frame for 'sample' into 'out' and return the number of bytes written
+size_t encodeSingleFrame(const Sensor_Sample & sample, uint8_t * out);
+
+// Write a batched frame of 'count' samples into 'out' and return the number of bytes written,
+// the frame sequence number and start time are taken from the first sample
+size_t encodeBatchFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+			uint8_t * out);
+
+// Write a compressed frame of 'count' samples into 'out' and return the number of bytes
+// written. The accelerometer and gyroscope payloads are read as three little endian 16 bit axes,
+// as the board holds them.
+#define COMPRESSED_FRAME_MAX(count) (2 + 2 * (BATCH_HEADER_SIZE + (count) * COMPRESSED_RECORD_MAX) + 2)
+size_t encodeCompressedFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+			     uint8_t * out);
+
+// Largest frame contents, a compressed frame of 255 samples
+#define FRAME_CONTENTS_MAX (1 + BATCH_HEADER_SIZE + 255 * COMPRESSED_RECORD_MAX)
+
+// Largest COBS framed frames including the zero delimiter
+#define COBS_SINGLE_FRAME_MAX (COBS_MAX_ENCODED(1 + SINGLE_HEADER_SIZE + 5 + ACC_PAYLOAD + GYRO_PAYLOAD + BARO_PAYLOAD + PHT_PAYLOAD + QUAT_PAYLOAD + 2) + 1)
+#define COBS_BATCH_FRAME_MAX(count) (COBS_MAX_ENCODED(1 + BATCH_HEADER_SIZE + (count) * SAMPLE_RECORD_MAX + 2) + 1)
+#define COBS_COMPRESSED_FRAME_MAX(count) (COBS_MAX_ENCODED(1 + BATCH_HEADER_SIZE + (count) * COMPRESSED_RECORD_MAX + 2) + 1)
+
+// The same frames in COBS framing, with CRC and the zero delimiter
+size_t encodeCobsSingleFrame(const Sensor_Sample & sample, uint8_t * out);
+size_t encodeCobsBatchFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+			    uint8_t * out);
+size_t encodeCobsCompressedFrame(const Sensor_Sample * samples, uint8_t count, uint16_t period,
+				 uint8_t * out);
+
+// Read the samples from decoded frame contents. A single sample frame (STX) gives one sample
+// and a batched (BTX) or compressed (CTX) frame gives up to 255 with the period stored in
+// 'period', leaving out the padding records that carry no sensors. Returns the number of
+// samples or -1 if the contents do not follow the layout.
+int parseSingleFrame(const uint8_t * frame, size_t size, Sensor_Sample & sample);
+int parseBatchFrame(const uint8_t * frame, size_t size, Sensor_Sample * samples,
+		    uint16_t & period);
+
+// Read decoded stats frame contents, returns false if they do not follow the layout. Stages
+// past STAGE_COUNT, from newer firmware, are left out.
+bool parseStatsFrame(const uint8_t * frame, size_t size, Loop_Stats & stats);
+
+// Read decoded acknowledgement frame contents, returns false if they do not follow the layout
+bool parseAckFrame(const uint8_t * frame, size_t size, Config_Ack & ack);
+
+// Read decoded health frame contents, returns false if they do not follow the layout
+bool parseHealthFrame(const uint8_t * frame, size_t size, Board_Health & health);
+
+// Read decoded benchmark frame contents, returns false if they do not follow the layout.
+// Records past BENCHMARK_RECORDS, from newer firmware, are left out.
+bool parseBenchmarkFrame(const uint8_t * frame, size_t size, Bus_Benchmark & benchmark);
+
+// Incremental decoder for DLE framed frames. Doubled DLE bytes are undone and the sensor tags of
+// single sample frames are kept as plain bytes, giving the same contents a COBS frame carries.
+// Frames broken off by another frame or an unknown control code are dropped and counted.
+class Dle_Decoder {
+// Internal members not used outside the class
+private:
+    uint8_t buffer[FRAME_CONTENTS_MAX];
+    size_t fill;
+    size_t frame_size;
+    // True when the previous byte was a DLE whose meaning depends on the next byte
+    bool escaped;
+    // True while inside a frame, and while skipping the rest of one that did not fit
+    bool inside;
+    bool overflowed;
+
+    void append(uint8_t value);
+
+// Member functions accesible outside the class
+public:
+    unsigned long errors;
+    unsigned long overruns;
+
+    Dle_Decoder();
+
+    // Forget any partly received frame
+    void reset();
+
+    // Take the next byte from the stream, returns true when it completes a frame
+    bool push(uint8_t value);
+
+    // Take bytes from a block of the stream up to and including the one that completes a
+    // frame, setting 'complete' if one did. Returns the number of bytes used, runs of bytes
+    // with no DLE among them are copied in one go.
+    size_t feed(const uint8_t * data, size_t size, bool & complete);
+
+    // The last completed frame starting with its type byte
+    const uint8_t * frame() const { return buffer; }
+    size_t size() const { return frame_size; }
+};
+
+// Incremental decoder for COBS framed frames. Bytes are collected until the zero delimiter, then
+// the frame is decoded and its CRC checked. Frames that are too long, badly encoded or fail the
+// CRC are dropped and counted.
+class Cobs_Decoder {
+// Internal members not used outside the class
+private:
+    uint8_t buffer[COBS_MAX_ENCODED(FRAME_CONTENTS_MAX + 2)];
+    size_t fill;
+    size_t frame_size;
+    // True while skipping the rest of a frame that did not fit in the buffer
+    bool overflowed;
+
+// Member functions accesible outside the class
+public:
+    unsigned long crc_errors;
+    unsigned long encoding_errors;
+    unsigned long overruns;
+
+    Cobs_Decoder();
+
+    // Forget any partly received frame
+    void reset();
+
+    // Take the next byte from the stream, returns true when it completes a frame that passes
+    // its CRC
+    bool push(uint8_t value);
+
+    // Take bytes from a block of the stream up to and including the one that completes a
+    // frame, setting 'complete' if one did. Returns the number of bytes used.
+    size_t feed(const uint8_t * data, size_t size, bool & complete);
+
+    // The last completed frame starting with its type byte, without the CRC
+    const uint8_t * frame() const { return buffer; }
+    size_t size() const { return frame_size; }
+};
+
+#endif
@@ -0,0 +1,231 @@
+// Streaming decoder for everything a sensor board sends
+
+#include "Sensor_Stream.h"
+#include "Orientation_Filter.h"
+
+// Little endian 16 bit value from two payload bytes
+static int16_t readInt16(const uint8_t * bytes)
+{
+    return (int16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+// Convert a sample with raw payload bytes into readings
+void readSample(const Sensor_Sample & sample, Sensor_Reading & reading)
+{
+    reading.sensors = sample.sensors;
+    for (int i = 0; i < 3; ++i) {
+	reading.acc[i] = sample.sensors & ACC ? readInt16(&sample.acc[2 * i]) : 0;
+	reading.gyro[i] = sample.sensors & GYRO ? readInt16(&sample.gyro[2 * i]) : 0;
+    }
+    if (sample.sensors & BARO) {
+	reading.altitude = readInt16(sample.baro);
+	reading.altitude_frac = sample.baro[2];
+	reading.temperature = sample.baro[3];
+	reading.temperature_frac = sample.baro[4];
+    }
+    else {
+	reading.altitude = 0;
+	reading.altitude_frac = 0;
+	reading.temperature = 0;
+	reading.temperature_frac = 0;
+    }
+    reading.light = sample.sensors & PHT ? readInt16(sample.light) : 0;
+    if (sample.sensors & QUAT)
+	expandQuaternion(sample.quat, reading.quat);
+    else {
+	reading.quat[0] = 0;
+	reading.quat[1] = 0;
+	reading.quat[2] = 0;
+	reading.quat[3] = 0;
+    }
+}
+
+Sensor_Stream::Sensor_Stream(Handler handler, void * context)
+{
+    this->handler = handler;
+    this->context = context;
+    stats_handler = 0;
+    stats_context = 0;
+    ack_handler = 0;
+    ack_context = 0;
+    health_handler = 0;
+    health_context = 0;
+    benchmark_handler = 0;
+    benchmark_context = 0;
+    framing = DLE_FRAMING;
+    frames = 0;
+    readings = 0;
+    malformed = 0;
+    lost = 0;
+    started = false;
+    last_sequence = 0;
+    last_time = 0;
+    reset();
+}
+
+// Decode DLE_FRAMING or COBS_FRAMING, matching the request sent to the board
+void Sensor_Stream::setFraming(uint8_t framing)
+{
+    this->framing = framing;
+    dle.reset();
+    cobs.reset();
+}
+
+// Hand stats frames sent for SEND_STATS to 'handler'
+void Sensor_Stream::setStatsHandler(Stats_Handler handler, void * context)
+{
+    stats_handler = handler;
+    stats_context = context;
+}
+
+// Hand acknowledgements of configuration requests to 'handler'
+void Sensor_Stream::setAckHandler(Ack_Handler handler, void * context)
+{
+    ack_handler = handler;
+    ack_context = context;
+}
+
+// Hand health frames sent for SEND_HEALTH to 'handler'
+void Sensor_Stream::setHealthHandler(Health_Handler handler, void * context)
+{
+    health_handler = handler;
+    health_context = context;
+}
+
+// Hand benchmark frames sent for RUN_BENCHMARK to 'handler'
+void Sensor_Stream::setBenchmarkHandler(Benchmark_Handler handler, void * context)
+{
+    benchmark_handler = handler;
+    benchmark_context = context;
+}
+
+// Forget any partly received frame
+void Sensor_Stream::reset()
+{
+    dle.reset();
+    cobs.reset();
+}
+
+unsigned long Sensor_Stream::framingErrors() const
+{
+    return dle.errors + dle.overruns + cobs.crc_errors + cobs.encoding_errors + cobs.overruns;
+}
+
+// Hand a sample to the handler with the samples missing before it and the time since the last
+void Sensor_Stream::deliver(const Sensor_Sample & sample)
+{
+    Sensor_Reading reading;
+    readSample(sample, reading);
+    reading.sequence = sample.sequence;
+    reading.time = sample.time;
+    reading.lost = 0;
+    reading.delta = 0;
+    if (started) {
+	// A step backwards is the board starting over after a reset rather than a loss
+	uint16_t gap = sample.sequence - last_sequence - 1;
+	if (gap < 0x8000)
+	    reading.lost = gap;
+	uint32_t elapsed = sample.time - last_time;
+	reading.delta = elapsed < 0xFFFF ? elapsed : 0xFFFF;
+    }
+    started = true;
+    last_sequence = sample.sequence;
+    last_time = sample.time;
+    lost += reading.lost;
+    handler(reading, context);
+}
+
+// Hand the samples of a completed frame to the handler
+void Sensor_Stream::frame(const uint8_t * contents, size_t size)
+{
+    if (contents[0] == STX) {
+	if (parseSingleFrame(contents, size, samples[0]) != 1) {
+	    malformed += 1;
+	    return;
+	}
+	frames += 1;
+	deliver(samples[0]);
+	readings += 1;
+	return;
+    }
+
+    if (contents[0] == PTX) {
+	Loop_Stats stats;
+	if (!parseStatsFrame(contents, size, stats)) {
+	    malformed += 1;
+	    return;
+	}
+	frames += 1;
+	if (stats_handler)
+	    stats_handler(stats, stats_context);
+	return;
+    }
+
+    if (contents[0] == ATX) {
+	Config_Ack ack;
+	if (!parseAckFrame(contents, size, ack)) {
+	    malformed += 1;
+	    return;
+	}
+	frames += 1;
+	if (ack_handler)
+	    ack_handler(ack, ack_context);
+	return;
+    }
+
+    if (contents[0] == HTX) {
+	Board_Health health;
+	if (!parseHealthFrame(contents, size, health)) {
+	    malformed += 1;
+	    return;
+	}
+	frames += 1;
+	if (health_handler)
+	    health_handler(health, health_context);
+	return;
+    }
+
+    if (contents[0] == RTX) {
+	Bus_Benchmark benchmark;
+	if (!parseBenchmarkFrame(contents, size, benchmark)) {
+	    malformed += 1;
+	    return;
+	}
+	frames += 1;
+	if (benchmark_handler)
+	    benchmark_handler(benchmark, benchmark_context);
+	return;
+    }
+
+    uint16_t period;
+    int count = parseBatchFrame(contents, size, samples, period);
+    if (count < 0) {
+	malformed += 1;
+	return;
+    }
+    frames += 1;
+    for (int i = 0; i < count; ++i)
+	deliver(samples[i]);
+    readings += count;
+}
+
+// Decode a block of the stream
+void Sensor_Stream::feed(const uint8_t * data, size_t size)
+{
+    while (size != 0) {
+	bool complete;
+	size_t used;
+	if (framing == COBS_FRAMING) {
+	    used = cobs.feed(data, size, complete);
+	    if (complete)
+		frame(cobs.frame(), cobs.size());
+	}
+	else {
+	    used = dle.feed(data, size, complete);
+	    if (complete)
+		frame(dle.frame(), dle.size());
+	}
+	data += used;
+	size -= used;
+    }
+}
@@ -0,0 +1,135 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Streaming decoder for everything a sensor board sends. Blocks of any size are fed in as they
+// are read from the serial port or socket and a handler is called with each sample in the
+// order they were taken. Single sample, batched and compressed frames are all understood, in
+// DLE or COBS framing. Samples lost on the way are found from the gaps in their sequence
+// numbers. Nothing is allocated once the decoder is constructed, so one thread can
+// keep up with many boards.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef SENSOR_STREAM
+#define SENSOR_STREAM
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Sensor_Frames.h"
+
+// A sample with the sensor readings in their raw units, laid out as the drivers hold them
+struct Sensor_Reading
+{
+    // ACC, GYRO, BARO, PHT and QUAT bits of the readings filled in
+    uint8_t sensors;
+    // Number of the sample among all those the board has sent
+    uint16_t sequence;
+    // Samples the board sent between the last reading and this one that never arrived
+    uint16_t lost;
+    // Board clock in microseconds when the sample's reads were started, wrapping at 32 bits
+    uint32_t time;
+    // Microseconds since the last reading, zero for the first and 65535 for any longer gap
+    uint16_t delta;
+    // Accelerometer and gyroscope counts for each axis
+    int16_t acc[3];
+    int16_t gyro[3];
+    // Altitude in meters and temperature in degrees Celsius, with sixteenths in the fractions
+    int16_t altitude;
+    uint8_t altitude_frac;
+    int8_t temperature;
+    uint8_t temperature_frac;
+    // Light sensor analog reading
+    uint16_t light;
+    // Orientation from the board's filter as w, x, y and z with 16384 for 1
+    int16_t quat[4];
+};
+
+// Convert a sample with raw payload bytes into readings
+void readSample(const Sensor_Sample & sample, Sensor_Reading & reading);
+
+class Sensor_Stream {
+public:
+    // Called for each decoded sample with the context given to the constructor
+    typedef void (*Handler)(const Sensor_Reading & reading, void * context);
+    // Called for each stats frame
+    typedef void (*Stats_Handler)(const Loop_Stats & stats, void * context);
+    // Called for each acknowledgement of a configuration request
+    typedef void (*Ack_Handler)(const Config_Ack & ack, void * context);
+    // Called for each health frame
+    typedef void (*Health_Handler)(const Board_Health & health, void * context);
+    // Called for each benchmark frame
+    typedef void (*Benchmark_Handler)(const Bus_Benchmark & benchmark, void * context);
+
+// Internal members not used outside the class
+private:
+    Handler handler;
+    void * context;
+    Stats_Handler stats_handler;
+    void * stats_context;
+    Ack_Handler ack_handler;
+    void * ack_context;
+    Health_Handler health_handler;
+    void * health_context;
+    Benchmark_Handler benchmark_handler;
+    void * benchmark_context;
+    uint8_t framing;
+    // Whether a sample has been handed on since the reset, and its sequence number and time
+    bool started;
+    uint16_t last_sequence;
+    uint32_t last_time;
+    Dle_Decoder dle;
+    Cobs_Decoder cobs;
+    Sensor_Sample samples[255];
+
+    void frame(const uint8_t * contents, size_t size);
+    void deliver(const Sensor_Sample & sample);
+
+// Member functions accesible outside the class
+public:
+    // Frames decoded, samples handed on and frames that did not follow the layout. Stats,
+    // acknowledgement, health and benchmark frames count as frames.
+    unsigned long frames;
+    unsigned long readings;
+    unsigned long malformed;
+    // Samples missing from the sequence, whether lost in a broken frame or never sent
+    unsigned long lost;
+
+    Sensor_Stream(Handler handler, void * context);
+
+    // Decode DLE_FRAMING or COBS_FRAMING, matching the request sent to the board. Any partly
+    // received frame is dropped.
+    void setFraming(uint8_t framing);
+
+    // Hand stats frames sent for SEND_STATS to 'handler', they are dropped without one
+    void setStatsHandler(Stats_Handler handler, void * context);
+
+    // Hand acknowledgements of configuration requests to 'handler', they are dropped without
+    // one
+    void setAckHandler(Ack_Handler handler, void * context);
+
+    // Hand health frames sent for SEND_HEALTH to 'handler', they are dropped without one
+    void setHealthHandler(Health_Handler handler, void * context);
+
+    // Hand benchmark frames sent for RUN_BENCHMARK to 'handler', they are dropped without one
+    void setBenchmarkHandler(Benchmark_Handler handler, void * context);
+
+    // Forget any partly received frame, samples lost with it are still counted from the gap
+    // before the next sequence number
+    void reset();
+
+    // Decode a block of the stream
+    void feed(const uint8_t * data, size_t size);
+
+    // Frames lost in the framing layer, broken or overlong DLE frames and COBS frames that
+    // were badly encoded, too long or failed their CRC
+    unsigned long framingErrors() const;
+};
+
+#endif
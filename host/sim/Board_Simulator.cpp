@@ -0,0 +1,103 @@
+// The sensor board around the simulated ATmega328
+
+#include "Board_Simulator.h"
+#include "Arduino.h"
+#include <math.h>
+
+#define PHOTO_SENSOR_PIN A3
+#define GYRO_INTERRUPT 0
+#define ACCELEROMETER_INTERRUPT 1
+
+// Rocking of the board about x and y, and its height above the start in meters
+#define ROCK_FREQUENCY 0.5
+#define ROCK_AMPLITUDE 0.3
+#define HEIGHT_AMPLITUDE 2.0
+// Gyroscope counts per radian per second at 250 dps full scale
+#define GYRO_COUNTS 3275.0
+
+Board_Simulator::Board_Simulator()
+    : still(false)
+{
+    for (int i = 0; i < BOARD_SENSORS; ++i)
+    {
+	next[i] = CLOCK_IDLE;
+	samples[i] = 0;
+    }
+    twi_simulator.attach(accelerometer);
+    twi_simulator.attach(gyroscope);
+    twi_simulator.attach(barometer);
+    uart_simulator.connect(&bluetooth);
+    addClockSource(*this);
+}
+
+Board_Simulator::~Board_Simulator()
+{
+    uart_simulator.connect(0);
+    removeClockSource(*this);
+}
+
+uint64_t Board_Simulator::samplePeriod(int sensor) const
+{
+    if (sensor == 0)
+	return accelerometer.samplePeriod();
+    if (sensor == 1)
+	return gyroscope.samplePeriod();
+    return barometer.samplePeriod();
+}
+
+// Latch the sample for 'seconds' into time and raise the data ready interrupt
+void Board_Simulator::sample(int sensor, double seconds)
+{
+    double phase = 2 * M_PI * ROCK_FREQUENCY * seconds;
+    double amplitude = still ? 0 : ROCK_AMPLITUDE;
+    double roll = amplitude * sin(phase);
+    double pitch = amplitude * cos(phase);
+    samples[sensor] += 1;
+    if (sensor == 0)
+    {
+	accelerometer.sample(-sin(pitch), sin(roll) * cos(pitch), cos(roll) * cos(pitch));
+	if (accelerometer.dataReadyInterrupt())
+	    raiseInterrupt(ACCELEROMETER_INTERRUPT);
+    }
+    else if (sensor == 1)
+    {
+	double rate = 2 * M_PI * ROCK_FREQUENCY * amplitude * GYRO_COUNTS;
+	gyroscope.sample(rate * cos(phase), -rate * sin(phase), 0);
+	if (gyroscope.dataReadyInterrupt())
+	    raiseInterrupt(GYRO_INTERRUPT);
+    }
+    else
+	barometer.sample(HEIGHT_AMPLITUDE * sin(phase / 4), 21.5);
+    setAnalogValue(PHOTO_SENSOR_PIN, 512 + 256 * sin(phase / 8));
+}
+
+// A sensor the firmware has just started is first due a period from now, and one it has
+// stopped goes idle
+uint64_t Board_Simulator::nextEvent()
+{
+    uint64_t first = CLOCK_IDLE;
+    for (int i = 0; i < BOARD_SENSORS; ++i)
+    {
+	uint64_t period = samplePeriod(i);
+	if (!period)
+	    next[i] = CLOCK_IDLE;
+	else if (next[i] == CLOCK_IDLE)
+	    next[i] = clockNanos() + period;
+	if (next[i] < first)
+	    first = next[i];
+    }
+    return first;
+}
+
+void Board_Simulator::fire()
+{
+    uint64_t now = clockNanos();
+    for (int i = 0; i < BOARD_SENSORS; ++i)
+	if (next[i] <= now)
+	{
+	    // Moved on first, the data ready interrupt the sample raises charges the clock
+	    uint64_t due = next[i];
+	    next[i] += samplePeriod(i);
+	    sample(i, due * 1e-9);
+	}
+}
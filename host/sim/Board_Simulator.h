@@ -0,0 +1,60 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// The sensor board around the simulated ATmega328: the accelerometer, gyroscope and barometer
+// models on the TWI bus, the photo sensor on A3 and the RN-42 Bluetooth module on the UART.
+// Each sensor latches a new sample at the data rate the firmware configured it for, as the
+// virtual clock reaches it, and the data ready outputs raise external interrupt 0 (gyroscope
+// INT2) and 1 (accelerometer INT1) when the firmware enabled them. The board is moved through
+// a slow made up motion so the samples change from one to the next, unless it is held still.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef BOARD_SIMULATOR
+#define BOARD_SIMULATOR
+
+#include "MMA8452Q_Model.h"
+#include "L3G4200D_Model.h"
+#include "MPL3115A2_Model.h"
+#include "RN42_Model.h"
+
+#define BOARD_SENSORS 3
+
+class Board_Simulator : public Clock_Source {
+// Internal members not used outside the class
+private:
+    // Virtual time each sensor latches its next sample, CLOCK_IDLE while it is not sampling
+    uint64_t next[BOARD_SENSORS];
+
+    uint64_t samplePeriod(int sensor) const;
+    void sample(int sensor, double seconds);
+
+// Member functions accesible outside the class
+public:
+    MMA8452Q_Model accelerometer;
+    L3G4200D_Model gyroscope;
+    MPL3115A2_Model barometer;
+    RN42_Model bluetooth;
+    // Samples latched by the accelerometer, gyroscope and barometer
+    unsigned long samples[BOARD_SENSORS];
+    // Hold the board level and not turning instead of rocking it
+    bool still;
+
+    // Attach the sensors to the simulated bus and the module to the UART
+    Board_Simulator();
+    virtual ~Board_Simulator();
+
+    // Sensors start sampling once the firmware configures a data rate, checked here as the
+    // clock looks for its next event
+    virtual uint64_t nextEvent();
+    virtual void fire();
+};
+
+#endif
@@ -0,0 +1,166 @@
+// Register level model of the L3G4200D gyroscope for the simulated I2C bus.
+
+#include "L3G4200D_Model.h"
+
+// Register addresses and values from the ST datasheet
+#define DEVICE_ADDRESS 0x69
+#define WHO_AM_I 0x0F
+#define CTRL_REG1 0x20
+#define CTRL_REG3 0x22
+#define CTRL_REG5 0x24
+#define STATUS_REG 0x27
+#define OUT_X_L 0x28
+#define OUT_Z_H 0x2D
+#define FIFO_CTRL_REG 0x2E
+#define FIFO_SRC_REG 0x2F
+#define WHO_AM_I_VALUE 0xD3
+#define CTRL_REG1_DEFAULT 0x07
+#define REBOOT 0x80
+#define POWER_ON 0x08
+#define DATA_RATE_SHIFT 6
+#define INTERRUPT_DATA_READY 0x08
+#define AUTO_INCREMENT 0x80
+#define NEW_DATA 0x0F
+#define DATA_OVERRUN 0xF0
+#define ENABLE_FIFO 0x40
+#define FIFO_MODE_MASK 0xE0
+#define FIFO_WATERMARK_MASK 0x1F
+#define FIFO_SIZE 32
+#define FIFO_WATERMARK 0x80
+#define FIFO_OVERRUN 0x40
+#define FIFO_EMPTY 0x20
+
+L3G4200D_Model::L3G4200D_Model()
+    : Register_Device(DEVICE_ADDRESS), auto_increment(false)
+{
+    powerOn();
+}
+
+// Load the power on register values
+void L3G4200D_Model::powerOn()
+{
+    for (int i = 0; i < 256; ++i)
+	registers[i] = 0;
+    registers[WHO_AM_I] = WHO_AM_I_VALUE;
+    registers[CTRL_REG1] = CTRL_REG1_DEFAULT;
+    fifo.clear();
+    fifo_overrun = false;
+}
+
+// Any mode other than bypass buffers samples once the FIFO is enabled
+bool L3G4200D_Model::fifoEnabled() const
+{
+    return (registers[CTRL_REG5] & ENABLE_FIFO) && (registers[FIFO_CTRL_REG] & FIFO_MODE_MASK);
+}
+
+// The high bit of the sub-address turns on auto-increment for the rest of the transaction
+void L3G4200D_Model::selectRegister(uint8_t data)
+{
+    auto_increment = data & AUTO_INCREMENT;
+    pointer = data & ~AUTO_INCREMENT;
+}
+
+uint8_t L3G4200D_Model::nextRegister(uint8_t reg)
+{
+    if (!auto_increment)
+	return reg;
+    if (reg == OUT_Z_H && fifoEnabled())
+	return OUT_X_L;
+    return reg + 1;
+}
+
+// Latch a new rate sample into the output registers as the sensor would at its data rate
+void L3G4200D_Model::sample(int16_t x, int16_t y, int16_t z)
+{
+    int16_t axes[3] = {x, y, z};
+
+    if (fifoEnabled())
+    {
+	Sample converted;
+	for (int i = 0; i < 3; ++i)
+	{
+	    converted.bytes[2 * i] = (uint16_t)axes[i] & 0xFF;
+	    converted.bytes[2 * i + 1] = (uint16_t)axes[i] >> 8;
+	}
+	// Stream mode discards the oldest sample when full
+	if (fifo.size() == FIFO_SIZE)
+	{
+	    fifo.pop_front();
+	    fifo_overrun = true;
+	}
+	fifo.push_back(converted);
+	return;
+    }
+
+    // A sample that was never read is reported as overwritten
+    if (registers[STATUS_REG] & NEW_DATA)
+	registers[STATUS_REG] |= DATA_OVERRUN;
+    for (int i = 0; i < 3; ++i)
+    {
+	registers[OUT_X_L + 2 * i] = (uint16_t)axes[i] & 0xFF;
+	registers[OUT_X_L + 2 * i + 1] = (uint16_t)axes[i] >> 8;
+    }
+    registers[STATUS_REG] |= NEW_DATA;
+}
+
+// The data rate doubles from 100 Hz with each step of the data rate bits
+uint64_t L3G4200D_Model::samplePeriod() const
+{
+    if (!(registers[CTRL_REG1] & POWER_ON))
+	return 0;
+    return 10000000ULL >> (registers[CTRL_REG1] >> DATA_RATE_SHIFT);
+}
+
+bool L3G4200D_Model::dataReadyInterrupt() const
+{
+    return registers[CTRL_REG3] & INTERRUPT_DATA_READY;
+}
+
+uint8_t L3G4200D_Model::readRegister(uint8_t reg)
+{
+    if (fifoEnabled() && reg == FIFO_SRC_REG)
+    {
+	uint8_t count = fifo.size() < FIFO_SIZE ? fifo.size() : FIFO_SIZE - 1;
+	uint8_t source = count;
+	if (fifo.empty())
+	    source |= FIFO_EMPTY;
+	if (fifo_overrun)
+	    source |= FIFO_OVERRUN;
+	if (fifo.size() >= (registers[FIFO_CTRL_REG] & FIFO_WATERMARK_MASK))
+	    source |= FIFO_WATERMARK;
+	fifo_overrun = false;
+	return source;
+    }
+    if (fifoEnabled() && reg >= OUT_X_L && reg <= OUT_Z_H)
+    {
+	if (fifo.empty())
+	    return 0;
+	uint8_t value = fifo.front().bytes[reg - OUT_X_L];
+	// Reading the last output register moves the FIFO on to the next sample
+	if (reg == OUT_Z_H)
+	    fifo.pop_front();
+	return value;
+    }
+
+    uint8_t value = registers[reg];
+    // Reading the last output register releases the sample
+    if (reg == OUT_Z_H)
+	registers[STATUS_REG] = 0;
+    return value;
+}
+
+bool L3G4200D_Model::writeRegister(uint8_t reg, uint8_t value)
+{
+    // Reboot restores the power on contents and clears itself
+    if (reg == CTRL_REG5 && (value & REBOOT))
+    {
+	powerOn();
+	registers[CTRL_REG5] = value & ~REBOOT;
+	return true;
+    }
+    // The identity and status registers are read only
+    if (reg == WHO_AM_I || (reg >= STATUS_REG && reg <= OUT_Z_H))
+	return true;
+    registers[reg] = value;
+    return true;
+}
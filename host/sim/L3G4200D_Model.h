@@ -0,0 +1,62 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Register level model of the L3G4200D gyroscope for the simulated I2C bus. Like the real part
+// the register address only advances during a multiple byte transfer when the most significant
+// bit of the sub-address was set, and reading the output registers clears the new data flags.
+// With the FIFO enabled the output registers show the oldest buffered sample and an
+// auto-increment read wraps from OUT_Z_H back to OUT_X_L onto the next sample.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef L3G4200D_MODEL
+#define L3G4200D_MODEL
+
+#include "TWI_Simulator.h"
+#include <deque>
+
+class L3G4200D_Model : public Register_Device {
+// Internal members not used outside the class
+private:
+    bool auto_increment;
+    struct Sample
+    {
+	uint8_t bytes[6];
+    };
+    std::deque<Sample> fifo;
+    bool fifo_overrun;
+
+    bool fifoEnabled() const;
+
+protected:
+    virtual void selectRegister(uint8_t data);
+    virtual uint8_t nextRegister(uint8_t reg);
+
+// Member functions accesible outside the class
+public:
+    L3G4200D_Model();
+
+    // Load the power on register values
+    void powerOn();
+
+    // Latch a new rate sample into the output registers as the sensor would at its data rate
+    void sample(int16_t x, int16_t y, int16_t z);
+
+    // Nanoseconds between samples at the configured data rate, 0 when powered down
+    uint64_t samplePeriod() const;
+
+    // True when the data ready interrupt is enabled on INT2
+    bool dataReadyInterrupt() const;
+
+    virtual uint8_t readRegister(uint8_t reg);
+    virtual bool writeRegister(uint8_t reg, uint8_t value);
+};
+
+#endif
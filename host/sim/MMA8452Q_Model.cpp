@@ -0,0 +1,197 @@
+// Register level model of the MMA8452Q accelerometer for the simulated I2C bus.
+
+#include "MMA8452Q_Model.h"
+#include <math.h>
+
+// Register addresses and values from the Freescale datasheet
+#define DEVICE_ADDRESS 0x1D
+#define STATUS 0x00
+#define OUT_X_MSB 0x01
+#define OUT_Y_MSB 0x03
+#define OUT_Z_MSB 0x05
+#define OUT_Z_LSB 0x06
+#define SYSMOD 0x0B
+#define WHO_AM_I 0x0D
+#define XYZ_DATA_CFG 0x0E
+#define HP_FILTER_CUTOFF 0x0F
+#define TRANSIENT_CFG 0x1D
+#define TRANSIENT_SRC 0x1E
+#define TRANSIENT_THS 0x1F
+#define TRANSIENT_COUNT 0x20
+#define CTRL_REG1 0x2A
+#define CTRL_REG2 0x2B
+#define CTRL_REG4 0x2D
+#define CTRL_REG5 0x2E
+#define WHO_AM_I_VALUE 0x2A
+#define ACTIVE 0x01
+#define FAST_READ 0x02
+#define DATA_RATE_MASK 0x38
+#define DATA_RATE_SHIFT 3
+#define RANGE_MASK 0x03
+#define RESET 0x40
+#define INTERRUPT_DATA_READY 0x01
+#define NEW_DATA 0x08
+#define DATA_OVERWRITE 0x80
+#define CUTOFF_MASK 0x03
+#define HIGH_PASS_BYPASS 0x01
+#define TRANSIENT_LATCH 0x10
+#define TRANSIENT_ACTIVE 0x40
+#define THRESHOLD_MASK 0x7F
+// Acceleration of one step of TRANSIENT_THS in g
+#define THRESHOLD_STEP 0.063f
+
+// Sample periods in nanoseconds for each data rate code, 800 Hz down to 1.56 Hz
+static const uint64_t SAMPLE_PERIODS[8] = {
+    1250000ULL, 2500000ULL, 5000000ULL, 10000000ULL,
+    20000000ULL, 80000000ULL, 160000000ULL, 640000000ULL
+};
+
+MMA8452Q_Model::MMA8452Q_Model()
+    : Register_Device(DEVICE_ADDRESS), reset_requested(false)
+{
+    powerOn();
+}
+
+// Load the power on register values
+void MMA8452Q_Model::powerOn()
+{
+    for (int i = 0; i < 256; ++i)
+	registers[i] = 0;
+    registers[WHO_AM_I] = WHO_AM_I_VALUE;
+    reset_requested = false;
+    filtering = false;
+    debounce = 0;
+}
+
+bool MMA8452Q_Model::active() const
+{
+    return registers[CTRL_REG1] & ACTIVE;
+}
+
+// Bursts wrap from the last output register back to STATUS, only visiting the high bytes in
+// fast read mode
+uint8_t MMA8452Q_Model::nextRegister(uint8_t reg)
+{
+    if (registers[CTRL_REG1] & FAST_READ)
+    {
+	if (reg == STATUS || reg == OUT_X_MSB || reg == OUT_Y_MSB)
+	    return reg + 2 - (reg == STATUS);
+	if (reg == OUT_Z_MSB)
+	    return STATUS;
+    }
+    else if (reg == OUT_Z_LSB)
+	return STATUS;
+    return reg + 1;
+}
+
+// Run the sample through the transient detection's high pass filter and look for an event
+void MMA8452Q_Model::detectTransient(const float * axes)
+{
+    uint8_t config = registers[TRANSIENT_CFG];
+    float period = samplePeriod() * 1e-9;
+    float cutoff = 16 >> (registers[HP_FILTER_CUTOFF] & CUTOFF_MASK);
+    float decay = 1 / (1 + 2 * M_PI * cutoff * period);
+    bool beyond = false;
+    uint8_t event = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+	// The filter starts from the first sample, so switching it on is not an event
+	filtered[i] = filtering ? decay * (filtered[i] + axes[i] - last[i]) : 0;
+	last[i] = axes[i];
+	float value = config & HIGH_PASS_BYPASS ? axes[i] : filtered[i];
+	// XTEFE, YTEFE and ZTEFE are bits 1 to 3, each axis has an event and a polarity bit
+	if ((config & (2 << i)) &&
+	    fabsf(value) > (registers[TRANSIENT_THS] & THRESHOLD_MASK) * THRESHOLD_STEP)
+	{
+	    beyond = true;
+	    event |= (2 | (value < 0)) << (2 * i);
+	}
+    }
+    filtering = true;
+
+    debounce = beyond ? debounce + (debounce < 0xFF) : 0;
+    if (beyond && debounce >= registers[TRANSIENT_COUNT])
+	registers[TRANSIENT_SRC] = TRANSIENT_ACTIVE | event;
+    else if (!(config & TRANSIENT_LATCH))
+	registers[TRANSIENT_SRC] = 0;
+}
+
+// Latch a new acceleration sample in g
+void MMA8452Q_Model::sample(float x, float y, float z)
+{
+    float axes[3] = {x, y, z};
+    // 1024 counts per g in the 2 g range, halving with each range step
+    float scale = 1024 >> (registers[XYZ_DATA_CFG] & RANGE_MASK);
+
+    if (registers[STATUS] & NEW_DATA)
+	registers[STATUS] |= DATA_OVERWRITE;
+    for (int i = 0; i < 3; ++i)
+    {
+	float counts = axes[i] * scale;
+	int16_t value = counts > 2047 ? 2047 : counts < -2048 ? -2048 : (int16_t)counts;
+	registers[OUT_X_MSB + 2 * i] = (uint16_t)value >> 4;
+	registers[OUT_X_MSB + 2 * i + 1] = (value & 0x0F) << 4;
+    }
+    registers[STATUS] |= NEW_DATA;
+    if (registers[TRANSIENT_CFG] & 0x0E)
+	detectTransient(axes);
+    else
+	filtering = false;
+}
+
+// Nanoseconds between samples at the configured data rate
+uint64_t MMA8452Q_Model::samplePeriod() const
+{
+    if (!active())
+	return 0;
+    return SAMPLE_PERIODS[(registers[CTRL_REG1] & DATA_RATE_MASK) >> DATA_RATE_SHIFT];
+}
+
+bool MMA8452Q_Model::dataReadyInterrupt() const
+{
+    return (registers[CTRL_REG4] & INTERRUPT_DATA_READY) &&
+	(registers[CTRL_REG5] & INTERRUPT_DATA_READY);
+}
+
+// A reset requested in the transaction takes effect once it ends
+void MMA8452Q_Model::stop()
+{
+    if (reset_requested)
+	powerOn();
+}
+
+uint8_t MMA8452Q_Model::readRegister(uint8_t reg)
+{
+    if (reg == SYSMOD)
+	return active() ? 1 : 0;
+    uint8_t value = registers[reg];
+    // Reading the last high output byte releases the sample, and reading the transient source
+    // a latched event
+    if (reg == OUT_Z_MSB)
+	registers[STATUS] = 0;
+    if (reg == TRANSIENT_SRC)
+	registers[TRANSIENT_SRC] = 0;
+    return value;
+}
+
+bool MMA8452Q_Model::writeRegister(uint8_t reg, uint8_t value)
+{
+    // Unlike the barometer the reset is acknowledged first
+    if (reg == CTRL_REG2 && (value & RESET))
+    {
+	reset_requested = true;
+	return true;
+    }
+    // Read only registers
+    if (reg <= SYSMOD || reg == WHO_AM_I || reg == TRANSIENT_SRC)
+	return true;
+    // In active mode only CTRL_REG1 can be written, and then only to change the active bit
+    if (active() && reg != CTRL_REG2)
+    {
+	if (reg == CTRL_REG1)
+	    registers[reg] = (registers[reg] & ~ACTIVE) | (value & ACTIVE);
+	return true;
+    }
+    registers[reg] = value;
+    return true;
+}
@@ -0,0 +1,66 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Register level model of the MMA8452Q accelerometer for the simulated I2C bus. As on the real
+// part a multiple byte read runs through the output registers and wraps from the last one
+// back to STATUS, skipping the low bytes in fast read mode, reading OUT_Z_MSB releases the
+// sample, and the configuration registers only take a new value in standby. The software
+// reset is acknowledged before the registers return to their power on values. The transient
+// detection runs each axis through a first order high pass filter at the HP_FILTER_CUTOFF
+// frequency of the high resolution mode, whatever the oversampling mode, and sets
+// TRANSIENT_SRC once an enabled axis has been beyond the threshold for the debounce count.
+// Reading TRANSIENT_SRC clears a latched event.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef MMA8452Q_MODEL
+#define MMA8452Q_MODEL
+
+#include "TWI_Simulator.h"
+
+class MMA8452Q_Model : public Register_Device {
+// Internal members not used outside the class
+private:
+    bool reset_requested;
+    // Last sample in g and the high pass filtered axes of the transient detection, and the
+    // samples in a row the threshold has been passed for
+    float last[3], filtered[3];
+    bool filtering;
+    uint8_t debounce;
+
+    bool active() const;
+    void detectTransient(const float * axes);
+
+protected:
+    virtual uint8_t nextRegister(uint8_t reg);
+
+// Member functions accesible outside the class
+public:
+    MMA8452Q_Model();
+
+    // Load the power on register values
+    void powerOn();
+
+    // Latch a new acceleration sample in g into the output registers as the sensor would at
+    // its data rate, scaled by the full scale range and clipped to 12 bits
+    void sample(float x, float y, float z);
+
+    // Nanoseconds between samples at the configured data rate, 0 in standby
+    uint64_t samplePeriod() const;
+
+    // True when the data ready interrupt is enabled and routed to INT1
+    bool dataReadyInterrupt() const;
+
+    virtual void stop();
+    virtual uint8_t readRegister(uint8_t reg);
+    virtual bool writeRegister(uint8_t reg, uint8_t value);
+};
+
+#endif
@@ -0,0 +1,150 @@
+// Register level model of the MPL3115A2 barometer for the simulated I2C bus, including the
+// 32 sample FIFO.
+
+#include "MPL3115A2_Model.h"
+#include <math.h>
+
+// Register addresses and values from the Freescale datasheet
+#define DEVICE_ADDRESS 0x60
+#define STATUS 0x00
+#define OUT_P_MSB 0x01
+#define OUT_T_LSB 0x05
+#define WHO_AM_I 0x0C
+#define F_STATUS 0x0D
+#define F_SETUP 0x0F
+#define CTRL_REG1 0x26
+#define CTRL_REG2 0x27
+#define WHO_AM_I_VALUE 0xC4
+#define RESET 0x04
+#define ACTIVE 0x01
+#define ONE_SHOT 0x02
+#define ALTIMETER 0x80
+#define OVERSAMPLE_MASK 0x38
+#define OVERSAMPLE_SHIFT 3
+#define TIME_STEP_MASK 0x0F
+#define FIFO_MODE_MASK 0xC0
+#define FIFO_OVERFLOW 0x80
+#define FIFO_SIZE 32
+#define DATA_READY 0x0E
+
+MPL3115A2_Model::MPL3115A2_Model()
+    : Register_Device(DEVICE_ADDRESS), fifo_byte(0)
+{
+    powerOn();
+}
+
+// Load the power on register values
+void MPL3115A2_Model::powerOn()
+{
+    for (int i = 0; i < 256; ++i)
+	registers[i] = 0;
+    registers[WHO_AM_I] = WHO_AM_I_VALUE;
+    fifo.clear();
+    fifo_byte = 0;
+}
+
+bool MPL3115A2_Model::fifoEnabled() const
+{
+    return registers[F_SETUP] & FIFO_MODE_MASK;
+}
+
+// The FIFO data register does not advance so every byte of a burst comes from the FIFO
+uint8_t MPL3115A2_Model::nextRegister(uint8_t reg)
+{
+    if (reg == OUT_P_MSB && fifoEnabled())
+	return reg;
+    return reg + 1;
+}
+
+// Complete a conversion with altitude in meters and temperature in degrees Celsius, both
+// with four fractional bits, as the sensor would at its acquisition rate
+void MPL3115A2_Model::sample(float altitude, float temperature)
+{
+    // Altitude is a signed 16.4 fixed point number and pressure an unsigned 18.2 one, both
+    // left aligned in 24 bits
+    int32_t fixed_altitude = (int32_t)(altitude * 16) << 4;
+    if (!(registers[CTRL_REG1] & ALTIMETER))
+	fixed_altitude = (int32_t)(101325 * pow(1 - altitude / 44330.77, 5.255877) * 4) << 4;
+    int16_t fixed_temperature = (int16_t)(temperature * 16) << 4;
+    registers[CTRL_REG1] &= ~ONE_SHOT;
+    Sample converted;
+    converted.bytes[0] = (fixed_altitude >> 16) & 0xFF;
+    converted.bytes[1] = (fixed_altitude >> 8) & 0xFF;
+    converted.bytes[2] = fixed_altitude & 0xF0;
+    converted.bytes[3] = (fixed_temperature >> 8) & 0xFF;
+    converted.bytes[4] = fixed_temperature & 0xF0;
+
+    if (fifoEnabled())
+    {
+	// The circular mode drops the oldest sample when full
+	if (fifo.size() == FIFO_SIZE)
+	{
+	    fifo.pop_front();
+	    registers[F_STATUS] |= FIFO_OVERFLOW;
+	}
+	fifo.push_back(converted);
+	registers[F_STATUS] = (registers[F_STATUS] & FIFO_OVERFLOW) | fifo.size();
+	return;
+    }
+
+    for (int i = 0; i < 5; ++i)
+	registers[OUT_P_MSB + i] = converted.bytes[i];
+    registers[STATUS] |= DATA_READY;
+}
+
+// Conversion times in nanoseconds for each oversampling ratio, 1 up to 128
+static const uint64_t CONVERSION_TIMES[8] = {
+    6000000ULL, 10000000ULL, 18000000ULL, 34000000ULL,
+    66000000ULL, 130000000ULL, 258000000ULL, 512000000ULL
+};
+
+// Nanoseconds between conversions in active mode
+uint64_t MPL3115A2_Model::samplePeriod() const
+{
+    uint64_t conversion =
+	CONVERSION_TIMES[(registers[CTRL_REG1] & OVERSAMPLE_MASK) >> OVERSAMPLE_SHIFT];
+    if (!(registers[CTRL_REG1] & ACTIVE))
+	return registers[CTRL_REG1] & ONE_SHOT ? conversion : 0;
+    uint64_t step = 1000000000ULL << (registers[CTRL_REG2] & TIME_STEP_MASK);
+    return step > conversion ? step : conversion;
+}
+
+uint8_t MPL3115A2_Model::readRegister(uint8_t reg)
+{
+    if (reg == OUT_P_MSB && fifoEnabled())
+    {
+	if (fifo.empty())
+	    return 0;
+	uint8_t value = fifo.front().bytes[fifo_byte++];
+	if (fifo_byte == 5)
+	{
+	    fifo.pop_front();
+	    fifo_byte = 0;
+	    registers[F_STATUS] = (registers[F_STATUS] & FIFO_OVERFLOW) | fifo.size();
+	}
+	return value;
+    }
+    uint8_t value = registers[reg];
+    // Reading the FIFO status clears the overflow flag
+    if (reg == F_STATUS)
+	registers[F_STATUS] &= ~FIFO_OVERFLOW;
+    // Reading the temperature releases the sample
+    if (reg == OUT_T_LSB)
+	registers[STATUS] = 0;
+    return value;
+}
+
+bool MPL3115A2_Model::writeRegister(uint8_t reg, uint8_t value)
+{
+    // A software reset takes the device off the bus before it can acknowledge
+    if (reg == CTRL_REG1 && (value & RESET))
+    {
+	powerOn();
+	return false;
+    }
+    // The status and output registers start at address 0 and are read only
+    if (reg == WHO_AM_I || reg == F_STATUS || reg <= OUT_T_LSB)
+	return true;
+    registers[reg] = value;
+    return true;
+}
@@ -0,0 +1,63 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Register level model of the MPL3115A2 barometer for the simulated I2C bus, including the
+// 32 sample FIFO. When the FIFO is enabled reads from F_DATA stay on that register and pop
+// samples five bytes at a time, a full FIFO sets the overflow flag in F_STATUS until it is
+// next read, and a software reset drops off the bus before the byte that requested it is
+// acknowledged just as the real part does. In standby a write of the one shot bit starts a
+// single conversion, which clears the bit when it is done.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef MPL3115A2_MODEL
+#define MPL3115A2_MODEL
+
+#include "TWI_Simulator.h"
+#include <deque>
+
+class MPL3115A2_Model : public Register_Device {
+// Internal members not used outside the class
+private:
+    struct Sample
+    {
+	uint8_t bytes[5];
+    };
+    std::deque<Sample> fifo;
+    // Position within the FIFO sample being read
+    uint8_t fifo_byte;
+
+    bool fifoEnabled() const;
+
+protected:
+    virtual uint8_t nextRegister(uint8_t reg);
+
+// Member functions accesible outside the class
+public:
+    MPL3115A2_Model();
+
+    // Load the power on register values
+    void powerOn();
+
+    // Complete a conversion with altitude in meters and temperature in degrees Celsius, both
+    // with four fractional bits, as the sensor would at its acquisition rate. In barometer
+    // mode the output is the pressure at that altitude in the standard atmosphere.
+    void sample(float altitude, float temperature);
+
+    // Nanoseconds between conversions in active mode, the time step or the conversion time
+    // of the oversampling ratio if that is longer, the conversion time of a one shot
+    // conversion under way in standby and 0 otherwise
+    uint64_t samplePeriod() const;
+
+    virtual uint8_t readRegister(uint8_t reg);
+    virtual bool writeRegister(uint8_t reg, uint8_t value);
+};
+
+#endif
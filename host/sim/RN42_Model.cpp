@@ -0,0 +1,97 @@
+// Model of the RN-42 Bluetooth module
+
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "RN42_Model.h"
+
+RN42_Model::RN42_Model()
+    : command_mode(false), escape(0), last_byte(0), line_size(0), baud(115200), escapes(0),
+      rate_changes(0)
+{
+}
+
+void RN42_Model::reply(const char * text)
+{
+    while (*text)
+	replies.push_back(*text++);
+}
+
+// Carry out the command line collected
+void RN42_Model::command()
+{
+    // Rates of the U command, in the module's own notation
+    static const struct { const char * code; long baud; } rates[] = {
+	{ "1200", 1200 }, { "2400", 2400 }, { "4800", 4800 }, { "9600", 9600 },
+	{ "19.2", 19200 }, { "28.8", 28800 }, { "38.4", 38400 }, { "57.6", 57600 },
+	{ "115K", 115200 }, { "230K", 230400 }, { "460K", 460800 }, { "921K", 921600 }
+    };
+
+    line[line_size] = 0;
+    line_size = 0;
+    if (!strcmp(line, "---")) {
+	reply("END\r\n");
+	command_mode = false;
+	return;
+    }
+    if (!strncmp(line, "U,", 2)) {
+	const char * comma = strchr(line + 2, ',');
+	for (size_t i = 0; comma && i < sizeof(rates) / sizeof(rates[0]); ++i) {
+	    if ((size_t)(comma - line - 2) == strlen(rates[i].code) &&
+		!strncmp(line + 2, rates[i].code, comma - line - 2)) {
+		// Takes effect at once and leaves command mode without an answer
+		baud = rates[i].baud;
+		rate_changes += 1;
+		command_mode = false;
+		return;
+	    }
+	}
+    }
+    reply("?\r\n");
+}
+
+// A byte from the board
+void RN42_Model::receive(uint8_t data)
+{
+    uint64_t now = clockNanos();
+    bool quiet = now - last_byte >= RN42_QUIET;
+    last_byte = now;
+
+    if (command_mode) {
+	if (data == '\r')
+	    command();
+	else if (data != '\n' && line_size < RN42_LINE_MAX)
+	    line[line_size++] = data;
+	return;
+    }
+
+    if (data == '$' && (escape || quiet)) {
+	escape += 1;
+	if (escape == 3) {
+	    escape = 0;
+	    command_mode = true;
+	    line_size = 0;
+	    escapes += 1;
+	    reply("CMD\r\n");
+	}
+	return;
+    }
+    // Not the escape after all
+    for (; escape; --escape)
+	Serial.transmitted.push_back('$');
+    Serial.transmitted.push_back(data);
+}
+
+bool RN42_Model::sending() const
+{
+    return !replies.empty() || (!command_mode && !Serial.received.empty());
+}
+
+// Replies go first, the receiver's bytes only in data mode
+uint8_t RN42_Model::send()
+{
+    std::deque<uint8_t> & source = replies.empty() ? Serial.received : replies;
+    uint8_t data = source.front();
+    source.pop_front();
+    return data;
+}
@@ -0,0 +1,69 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Simulated ATmega328 TWI peripheral and the devices attached to it. The firmware drives it
+// Model of the RN-42 Bluetooth module wired to the board's UART. In data mode it passes bytes
+// between the UART and the receiver at the other end of the Bluetooth link, which is Serial in
+// the simulation: bytes from the board are added to Serial.transmitted and bytes queued in
+// Serial.received are sent to the board. Three $ bytes after a quiet spell on the UART enter
+// command mode, answered with CMD. In command mode lines ending in a carriage return are
+// commands, of which U,<rate>,<parity> changes the UART rate until the module is powered off
+// and leaves command mode, and --- leaves it answering END. Other commands answer ?. The
+// receiver's bytes wait while the module is in command mode.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef RN42_MODEL
+#define RN42_MODEL
+
+#include <stdint.h>
+#include <deque>
+#include "UART_Simulator.h"
+
+// Nanoseconds the UART has to be quiet before a command mode escape
+#define RN42_QUIET 10000000ULL
+
+// Longest command line kept
+#define RN42_LINE_MAX 32
+
+class RN42_Model : public UART_Peer {
+// Internal members not used outside the class
+private:
+    bool command_mode;
+    // $ bytes held back while they could be the escape
+    uint8_t escape;
+    // Virtual time of the last byte from the board
+    uint64_t last_byte;
+    char line[RN42_LINE_MAX + 1];
+    uint8_t line_size;
+    std::deque<uint8_t> replies;
+
+    void reply(const char * text);
+    void command();
+
+// Member functions accesible outside the class
+public:
+    // Rate of the module's UART, 115200 as the board is shipped
+    long baud;
+    // Times command mode was entered and rate changes made
+    unsigned long escapes;
+    unsigned long rate_changes;
+
+    RN42_Model();
+
+    bool commandMode() const { return command_mode; }
+
+    virtual long baudRate() const { return baud; }
+    virtual void receive(uint8_t data);
+    virtual bool sending() const;
+    virtual uint8_t send();
+};
+
+#endif
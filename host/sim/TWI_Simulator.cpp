@@ -0,0 +1,256 @@
+// Simulated ATmega328 TWI peripheral and the devices attached to it. The firmware drives it
+// through the functions in TWI_Hardware.h exactly as it drives the real control, status and
+// data registers.
+
+#include "TWI_Simulator.h"
+#include "TWI_Hardware.h"
+#include "Arduino.h"
+#include <string.h>
+
+// SCL periods of each bus action, a START or STOP condition and a byte with its acknowledge
+#define CONDITION_PERIODS 1
+#define BYTE_PERIODS 9
+
+// Entering and leaving the TWI interrupt and the queue's handler
+#define INTERRUPT_CYCLES 100
+// One pass of a loop waiting on a bus that has nothing to do
+#define YIELD_CYCLES 32
+// The recovery bit banged by twiRecover(), nine SCL clocks and a STOP with 5 us half periods
+#define RECOVERY_NANOS ((2 + 9 * 2 + 4) * 5000ULL)
+
+TWI_Simulator twi_simulator;
+
+Register_Device::Register_Device(uint8_t device_address)
+    : TWI_Device(device_address), pointer_set(false), pointer(0)
+{
+    memset(registers, 0, sizeof(registers));
+}
+
+void Register_Device::start(bool read)
+{
+    // A write transaction always begins by selecting the register
+    if (!read)
+	pointer_set = false;
+}
+
+bool Register_Device::write(uint8_t data)
+{
+    if (nack_data)
+	return false;
+    if (!pointer_set)
+    {
+	selectRegister(data);
+	pointer_set = true;
+	return true;
+    }
+    bool acknowledge = writeRegister(pointer, data);
+    pointer = nextRegister(pointer);
+    return acknowledge;
+}
+
+uint8_t Register_Device::read()
+{
+    uint8_t value = readRegister(pointer);
+    pointer = nextRegister(pointer);
+    return value;
+}
+
+TWI_Simulator::TWI_Simulator()
+{
+    reset();
+    addClockSource(*this);
+}
+
+TWI_Simulator::~TWI_Simulator()
+{
+    removeClockSource(*this);
+}
+
+// The SCL frequency is F_CPU / (16 + 2 * bit_rate) with the prescaler at one
+uint64_t TWI_Simulator::sclTime(unsigned periods) const
+{
+    return cycleNanos((uint64_t)periods * (16 + 2 * bit_rate));
+}
+
+// Connect a device to the bus
+void TWI_Simulator::attach(TWI_Device & device)
+{
+    devices.push_back(&device);
+}
+
+// Remove all devices and return the peripheral to its reset state
+void TWI_Simulator::reset()
+{
+    devices.clear();
+    active = 0;
+    control = 0;
+    status = 0xF8;
+    data = 0xFF;
+    pending = false;
+    bus_owned = false;
+    expecting_address = false;
+    reading = false;
+    bit_rate = 0;
+    bus_error = false;
+    bus_hang = false;
+    held = false;
+    starts = 0;
+    stops = 0;
+    bytes = 0;
+    recoveries = 0;
+    busy = 0;
+    due = 0;
+    bus_free = 0;
+}
+
+// A STOP takes effect as soon as it is requested so the firmware never waits on it, though
+// the bus is not free for the next START until it has been sent. Any other action completes
+// once its bus time has passed.
+void TWI_Simulator::writeControl(uint8_t value)
+{
+    control = value;
+    if (!(value & (1 << TWINT)) || held)
+	return;
+    uint64_t now = clockNanos();
+    uint64_t start = bus_free > now ? bus_free : now;
+    if (value & (1 << TWSTO))
+    {
+	if (active)
+	    active->stop();
+	active = 0;
+	bus_owned = false;
+	expecting_address = false;
+	stops += 1;
+	control &= ~(1 << TWSTO);
+	bus_free = start + sclTime(CONDITION_PERIODS);
+	busy += sclTime(CONDITION_PERIODS);
+	pending = (value & (1 << TWSTA)) != 0;
+	due = bus_free + sclTime(CONDITION_PERIODS);
+	if (pending)
+	    busy += sclTime(CONDITION_PERIODS);
+	return;
+    }
+    uint64_t length = sclTime((value & (1 << TWSTA)) ? CONDITION_PERIODS : BYTE_PERIODS);
+    busy += length;
+    due = start + length;
+    pending = true;
+}
+
+// Hand the new status to the firmware if it enabled the interrupt
+void TWI_Simulator::interrupt()
+{
+    if (control & (1 << TWIE))
+    {
+	twiInterrupt();
+	chargeCycles(INTERRUPT_CYCLES);
+    }
+}
+
+// Move the clock on until the pending action is carried out
+bool TWI_Simulator::step()
+{
+    if (!pending)
+	return false;
+    advanceClockTo(due);
+    return true;
+}
+
+// Carry out the action requested through the control register and raise the interrupt
+void TWI_Simulator::perform()
+{
+    pending = false;
+
+    if (bus_error)
+    {
+	bus_error = false;
+	status = TW_BUS_ERROR;
+	interrupt();
+	return;
+    }
+
+    // The action never completes and no interrupt comes
+    if (bus_hang)
+    {
+	bus_hang = false;
+	held = true;
+	return;
+    }
+
+    // START or repeated START, the next byte written is a device address
+    if (control & (1 << TWSTA))
+    {
+	status = bus_owned ? TW_REP_START : TW_START;
+	bus_owned = true;
+	expecting_address = true;
+	starts += 1;
+	interrupt();
+	return;
+    }
+
+    bytes += 1;
+    if (expecting_address)
+    {
+	expecting_address = false;
+	reading = data & TW_READ;
+	active = 0;
+	for (size_t i = 0; i < devices.size(); ++i)
+	    if (devices[i]->address == (data >> 1) && !devices[i]->nack_address)
+		active = devices[i];
+	if (active)
+	{
+	    active->start(reading);
+	    status = reading ? TW_MR_SLA_ACK : TW_MT_SLA_ACK;
+	}
+	else
+	    status = reading ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+    }
+    else if (!active)
+	status = TW_BUS_ERROR;
+    else if (reading)
+    {
+	data = active->read();
+	status = (control & (1 << TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+    }
+    else
+	status = active->write(data) ? TW_MT_DATA_ACK : TW_MT_DATA_NACK;
+
+    interrupt();
+}
+
+// Step until the peripheral is idle
+void TWI_Simulator::run()
+{
+    while (step());
+}
+
+// Clock SCL from the port and send a STOP
+void TWI_Simulator::recover()
+{
+    if (active)
+	active->stop();
+    active = 0;
+    held = false;
+    pending = false;
+    bus_owned = false;
+    expecting_address = false;
+    status = 0xF8;
+    control = (1 << TWEN) | (1 << TWIE);
+    recoveries += 1;
+    advanceNanos(RECOVERY_NANOS);
+    bus_free = clockNanos();
+}
+
+// Register access for the firmware, see TWI_Hardware.h
+uint8_t twiStatus() { return twi_simulator.readStatus(); }
+uint8_t twiReadData() { return twi_simulator.readData(); }
+void twiWriteData(uint8_t data) { twi_simulator.writeData(data); }
+void twiControl(uint8_t control) { twi_simulator.writeControl(control); }
+bool twiStopping() { return false; }
+void twiEnable(uint8_t bit_rate) { twi_simulator.bit_rate = bit_rate; }
+void twiBitRate(uint8_t bit_rate) { twi_simulator.bit_rate = bit_rate; }
+void twiRecover() { twi_simulator.recover(); }
+void twiYield()
+{
+    if (!twi_simulator.step())
+	chargeCycles(YIELD_CYCLES);
+}
@@ -0,0 +1,152 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Simulated ATmega328 TWI peripheral and the devices attached to it. The firmware drives it
+// through the functions in TWI_Hardware.h exactly as it drives the real control, status and
+// data registers. Each bus event is carried out when the virtual clock reaches the time it
+// takes at the SCL rate set by the bit rate register, or at once by step() which moves the
+// clock there, and then calls the firmware's interrupt handler. So the order in which
+// transactions complete, the error codes they report and the time the bus is busy can be
+// checked on a desktop machine.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef TWI_SIMULATOR
+#define TWI_SIMULATOR
+
+#include <stdint.h>
+#include <vector>
+#include "Virtual_Clock.h"
+
+// A slave device on the simulated bus
+class TWI_Device {
+public:
+    uint8_t address;
+    // Fault injection, refuse to acknowledge the address or data bytes written to the device
+    bool nack_address;
+    bool nack_data;
+
+    TWI_Device(uint8_t device_address)
+	: address(device_address), nack_address(false), nack_data(false) {}
+    virtual ~TWI_Device() {}
+
+    // The device has been addressed after a START, for reading when 'read' is true
+    virtual void start(bool /* read */) {}
+
+    // A byte written by the master, return false to not acknowledge it
+    virtual bool write(uint8_t data) = 0;
+
+    // The next byte the device sends to the master
+    virtual uint8_t read() = 0;
+
+    // A STOP condition ended the transaction
+    virtual void stop() {}
+};
+
+// A device with a register file where the first byte written selects the register, further
+// bytes read or write consecutive registers
+class Register_Device : public TWI_Device {
+protected:
+    bool pointer_set;
+
+    // The first byte of a write transaction, selecting the register to start at
+    virtual void selectRegister(uint8_t data) { pointer = data; }
+
+    // Register that follows 'reg' during a multiple byte transfer
+    virtual uint8_t nextRegister(uint8_t reg) { return reg + 1; }
+
+public:
+    uint8_t registers[256];
+    uint8_t pointer;
+
+    Register_Device(uint8_t device_address);
+
+    virtual uint8_t readRegister(uint8_t reg) { return registers[reg]; }
+    // Store a written value, return false for the device to not acknowledge the byte
+    virtual bool writeRegister(uint8_t reg, uint8_t value) { registers[reg] = value; return true; }
+
+    virtual void start(bool read);
+    virtual bool write(uint8_t data);
+    virtual uint8_t read();
+};
+
+class TWI_Simulator : public Clock_Source {
+// Internal members not used outside the class
+private:
+    std::vector<TWI_Device *> devices;
+    TWI_Device * active;
+    uint8_t control;
+    uint8_t status;
+    uint8_t data;
+    bool pending;
+    bool bus_owned;
+    bool expecting_address;
+    bool reading;
+    // A device is holding the bus after a bus_hang, nothing happens until it is recovered
+    bool held;
+    // Virtual time the pending action completes and the bus is free after a STOP
+    uint64_t due;
+    uint64_t bus_free;
+
+    void interrupt();
+    void perform();
+    // Nanoseconds of 'periods' SCL periods
+    uint64_t sclTime(unsigned periods) const;
+
+// Member functions accesible outside the class
+public:
+    // Bit rate register written by the firmware
+    uint8_t bit_rate;
+    // Fault injection, report a bus error on the next event
+    bool bus_error;
+    // Fault injection, a device holds the bus during the next event so it never completes
+    // and no later action does until the bus is recovered
+    bool bus_hang;
+    // Counts of bus activity
+    unsigned long starts;
+    unsigned long stops;
+    unsigned long bytes;
+    unsigned long recoveries;
+    // Nanoseconds the bus was driven
+    uint64_t busy;
+
+    TWI_Simulator();
+    virtual ~TWI_Simulator();
+
+    // Connect a device to the bus
+    void attach(TWI_Device & device);
+
+    // Remove all devices and return the peripheral to its reset state
+    void reset();
+
+    // Move the clock on until the action requested through the control register is carried
+    // out and the interrupt raised, false when the peripheral has nothing to do
+    bool step();
+
+    virtual uint64_t nextEvent() { return pending ? due : CLOCK_IDLE; }
+    virtual void fire() { perform(); }
+
+    // Step until the peripheral is idle
+    void run();
+
+    // Clock SCL from the port and send a STOP, as twiRecover() does on the AVR, freeing a held
+    // bus and leaving the peripheral idle
+    void recover();
+
+    // Register access used by TWI_Hardware.h
+    uint8_t readStatus() const { return status; }
+    uint8_t readData() const { return data; }
+    void writeData(uint8_t value) { data = value; }
+    void writeControl(uint8_t value);
+};
+
+extern TWI_Simulator twi_simulator;
+
+#endif
@@ -0,0 +1,160 @@
+// Simulated ATmega328 USART for Frame_Port
+
+#include "Arduino.h"
+#include "UART_Simulator.h"
+#include "UART_Hardware.h"
+
+// Entering and leaving the interrupt handlers and the handlers themselves
+#define UART_INTERRUPT_CYCLES 40
+// One pass of a loop polling a flag, and a call finding no received byte
+#define UART_POLL_CYCLES 8
+#define UART_READ_CYCLES 40
+
+// Left undefined unless the sketch is linked in
+extern "C" void USART_UDRE_vect() __attribute__((weak));
+extern "C" void USART_RX_vect() __attribute__((weak));
+
+UART_Simulator uart_simulator;
+
+UART_Simulator::UART_Simulator()
+    : data_full(false), data(0), shift_done(0), transmit_interrupt(false), receive_due(0),
+      receive_data(0), peer(0), enabled(false), baud(0), byte_time(0), bytes(0), busy(0),
+      blocked(0), garbled(0)
+{
+    addClockSource(*this);
+}
+
+UART_Simulator::~UART_Simulator()
+{
+    removeClockSource(*this);
+}
+
+// The UART runs at F_CPU / 8 / (divisor + 1) at double speed, ten bits to a byte
+void UART_Simulator::enable(uint16_t divisor)
+{
+    enabled = true;
+    baud = F_CPU / 8 / (divisor + 1);
+    byte_time = 10 * 1000000000ULL * 8 * (divisor + 1) / F_CPU;
+}
+
+// Start a byte through the shift register
+void UART_Simulator::shift(uint8_t value, uint64_t start)
+{
+    shift_done = start + byte_time;
+    busy += byte_time;
+    bytes += 1;
+    if (!peer) {
+	Serial.transmitted.push_back(value);
+	return;
+    }
+    if (!matched()) {
+	value = UART_GARBLED;
+	garbled += 1;
+    }
+    peer->receive(value);
+}
+
+bool UART_Simulator::matched() const
+{
+    if (!peer)
+	return true;
+    double difference = 100.0 * (baud - peer->baudRate()) / peer->baudRate();
+    return difference < UART_RATE_TOLERANCE && difference > -UART_RATE_TOLERANCE;
+}
+
+// True while a byte is waiting to come in
+bool UART_Simulator::incoming() const
+{
+    return peer ? peer->sending() : !Serial.received.empty();
+}
+
+void UART_Simulator::writeData(uint8_t value)
+{
+    if (!enabled)
+	return;
+    if (shift_done <= clockNanos())
+	shift(value, clockNanos());
+    else {
+	// A write to a full data register is lost, as on the hardware
+	if (data_full)
+	    return;
+	data = value;
+	data_full = true;
+    }
+}
+
+uint64_t UART_Simulator::nextEvent()
+{
+    if (!enabled)
+	return CLOCK_IDLE;
+    // The interrupt is raised as soon as the data register can take a byte
+    if (transmit_interrupt && !data_full && USART_UDRE_vect)
+	return clockNanos();
+    if (receive_due == 0 && incoming())
+	receive_due = clockNanos() + byte_time;
+    uint64_t next = CLOCK_IDLE;
+    if (shift_done)
+	next = shift_done;
+    if (receive_due && receive_due < next)
+	next = receive_due;
+    return next;
+}
+
+void UART_Simulator::fire()
+{
+    uint64_t now = clockNanos();
+    if (transmit_interrupt && !data_full && USART_UDRE_vect) {
+	USART_UDRE_vect();
+	chargeCycles(UART_INTERRUPT_CYCLES);
+	return;
+    }
+    if (shift_done && shift_done <= now) {
+	// The waiting byte follows straight on
+	if (data_full) {
+	    data_full = false;
+	    shift(data, shift_done);
+	}
+	else
+	    shift_done = 0;
+	return;
+    }
+    if (receive_due && receive_due <= now) {
+	receive_due = 0;
+	// The peer may have stopped sending since
+	if (!incoming())
+	    return;
+	if (peer)
+	    receive_data = peer->send();
+	else {
+	    receive_data = Serial.received.front();
+	    Serial.received.pop_front();
+	}
+	if (!matched()) {
+	    receive_data = UART_GARBLED;
+	    garbled += 1;
+	}
+	if (USART_RX_vect) {
+	    USART_RX_vect();
+	    chargeCycles(UART_INTERRUPT_CYCLES);
+	}
+    }
+}
+
+// Wait for the transmitter to do something, or poll once if it has nothing to do
+void UART_Simulator::yield()
+{
+    uint64_t start = clockNanos();
+    uint64_t next = shift_done ? shift_done : CLOCK_IDLE;
+    if (next != CLOCK_IDLE && next > start)
+	advanceClockTo(next);
+    else
+	chargeCycles(UART_POLL_CYCLES);
+    blocked += clockNanos() - start;
+}
+
+void uartEnable(uint16_t divisor) { uart_simulator.enable(divisor); }
+void uartWriteData(uint8_t data) { uart_simulator.writeData(data); }
+uint8_t uartReadData() { return uart_simulator.readData(); }
+void uartTransmitInterrupt(bool enable) { uart_simulator.transmitInterrupt(enable); }
+void uartYield() { uart_simulator.yield(); }
+void uartPoll() { chargeCycles(UART_READ_CYCLES); }
@@ -0,0 +1,110 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Simulated ATmega328 TWI peripheral and the devices attached to it. The firmware drives it
+// Simulated ATmega328 USART for Frame_Port, driven through the functions in UART_Hardware.h.
+// A byte written to the data register moves to the shift register as soon as it is free and
+// takes ten bit times on the wire at the rate the divisor gives. The data register empty
+// interrupt is raised whenever it is enabled and the data register can take a byte, and the
+// receive interrupt for each byte coming in, one byte time apart. The UART is wired to a peer,
+// the Bluetooth module on the real board, and every byte either way is garbled while the two
+// run at rates too far apart. Without a peer sent bytes are added to Serial.transmitted and
+// bytes queued in Serial.received come in, so the stream is read back as it is with the core's
+// Serial.
+// The time the line is busy and the time the firmware waits on it are both kept, and what is
+// left of the busy time is what sending overlapped with the firmware's other work.
+
+// Compiler directive to make sure the class has not already been defined
+#ifndef UART_SIMULATOR
+#define UART_SIMULATOR
+
+#include <stdint.h>
+#include "Virtual_Clock.h"
+
+// Largest difference in percent between the rates at both ends that bytes get through
+#define UART_RATE_TOLERANCE 4.5
+
+// Byte read in place of one sent at the wrong rate
+#define UART_GARBLED 0x00
+
+// Whatever is at the other end of the UART's wires
+class UART_Peer {
+public:
+    virtual ~UART_Peer() {}
+
+    // Baud rate of the peer's UART
+    virtual long baudRate() const = 0;
+
+    // A byte from the board
+    virtual void receive(uint8_t data) = 0;
+
+    // True while the peer has a byte for the board, and the byte
+    virtual bool sending() const = 0;
+    virtual uint8_t send() = 0;
+};
+
+class UART_Simulator : public Clock_Source {
+// Internal members not used outside the class
+private:
+    // Byte waiting in the data register for the shift register
+    bool data_full;
+    uint8_t data;
+    // Virtual time the shift register finishes its byte, 0 while it is idle
+    uint64_t shift_done;
+    bool transmit_interrupt;
+    // Virtual time the next received byte is complete, 0 while none is arriving
+    uint64_t receive_due;
+    uint8_t receive_data;
+
+    UART_Peer * peer;
+
+    void shift(uint8_t value, uint64_t start);
+    bool incoming() const;
+
+// Member functions accesible outside the class
+public:
+    // Set once the firmware has turned the UART on, and the rate it runs at
+    bool enabled;
+    long baud;
+    // Nanoseconds each byte takes on the wire
+    uint64_t byte_time;
+    // Bytes sent, nanoseconds the line was sending and nanoseconds the firmware spent waiting
+    // for the transmitter in uartYield()
+    unsigned long bytes;
+    uint64_t busy;
+    uint64_t blocked;
+    // Bytes either way garbled by mismatched rates
+    unsigned long garbled;
+
+    UART_Simulator();
+    virtual ~UART_Simulator();
+
+    // Wire the UART to 'peer', or to Serial for none
+    void connect(UART_Peer * peer) { this->peer = peer; }
+
+    // True if the peer can read what the UART sends at the rates they run at
+    bool matched() const;
+
+    virtual uint64_t nextEvent();
+    virtual void fire();
+
+    // Register access used by UART_Hardware.h
+    void enable(uint16_t divisor);
+    void writeData(uint8_t value);
+    uint8_t readData() const { return receive_data; }
+    void transmitInterrupt(bool enable) { transmit_interrupt = enable; }
+    // Move the clock to the next thing the UART does
+    void yield();
+};
+
+extern UART_Simulator uart_simulator;
+
+#endif
@@ -0,0 +1,131 @@
+// Compares the single sample and batched frame formats. For each batch size the bytes sent per
+// sample and the highest sample rate a 115200 baud link can carry are reported, then a long
+// stream is encoded and decoded to check every sample survives and to time the host side.
+//
+// $ build/tools/batch_benchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "Sensor_Frames.h"
+
+// 8N1 framing puts ten bits on the wire for every byte
+#define BAUD_RATE 115200
+#define BYTES_PER_SECOND (BAUD_RATE / 10)
+
+// Sample period and sensor divisors matching the firmware defaults
+#define SAMPLE_PERIOD 2500
+#define BAROMETER_DIVISOR 100
+#define LIGHT_DIVISOR 100
+
+#define STREAM_SAMPLES 200000
+
+// Simulated sensor stream, raw bytes are random so DLE stuffing happens at its natural rate
+static void makeSamples(std::vector<Sensor_Sample> & samples)
+{
+    srand(1);
+    for (size_t i = 0; i < samples.size(); ++i) {
+	Sensor_Sample & sample = samples[i];
+	memset(&sample, 0, sizeof(sample));
+	sample.sensors = ACC | GYRO;
+	if (i % BAROMETER_DIVISOR == 0)
+	    sample.sensors |= BARO;
+	if (i % LIGHT_DIVISOR == 0)
+	    sample.sensors |= PHT;
+	sample.sequence = i;
+	sample.time = i * SAMPLE_PERIOD;
+	for (int j = 0; j < ACC_PAYLOAD; ++j)
+	    sample.acc[j] = rand();
+	for (int j = 0; j < GYRO_PAYLOAD; ++j)
+	    sample.gyro[j] = rand();
+	for (int j = 0; j < BARO_PAYLOAD; ++j)
+	    sample.baro[j] = rand();
+	for (int j = 0; j < PHT_PAYLOAD; ++j)
+	    sample.light[j] = rand();
+    }
+}
+
+static bool sameSample(const Sensor_Sample & a, const Sensor_Sample & b)
+{
+    if (a.sensors != b.sensors || a.sequence != b.sequence || a.time != b.time)
+	return false;
+    if ((a.sensors & ACC) && memcmp(a.acc, b.acc, ACC_PAYLOAD))
+	return false;
+    if ((a.sensors & GYRO) && memcmp(a.gyro, b.gyro, GYRO_PAYLOAD))
+	return false;
+    if ((a.sensors & BARO) && memcmp(a.baro, b.baro, BARO_PAYLOAD))
+	return false;
+    if ((a.sensors & PHT) && memcmp(a.light, b.light, PHT_PAYLOAD))
+	return false;
+    return true;
+}
+
+static void report(const char * name, size_t bytes, size_t samples)
+{
+    double per_sample = (double)bytes / samples;
+    printf("%-10s %8.2f bytes/sample %8.0f samples/s at %d baud\n", name, per_sample,
+	   BYTES_PER_SECOND / per_sample, BAUD_RATE);
+}
+
+int main()
+{
+    std::vector<Sensor_Sample> samples(STREAM_SAMPLES);
+    makeSamples(samples);
+    std::vector<uint8_t> stream(STREAM_SAMPLES * SINGLE_FRAME_MAX);
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+	bytes += encodeSingleFrame(samples[i], &stream[bytes]);
+    report("single", bytes, samples.size());
+
+    // Samples of the last decoded frame
+    static Sensor_Sample frame[255];
+    const int sizes[] = { 1, 2, 4, 8, 16, 32, 64 };
+    bool failed = false;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+	int batch = sizes[s];
+	size_t frames = samples.size() / batch;
+
+	auto encode_start = std::chrono::steady_clock::now();
+	bytes = 0;
+	for (size_t f = 0; f < frames; ++f)
+	    bytes += encodeBatchFrame(&samples[f * batch], batch, SAMPLE_PERIOD, &stream[bytes]);
+	auto encode_end = std::chrono::steady_clock::now();
+
+	// Decode everything back and compare against what was sent
+	Dle_Decoder decoder;
+	size_t decoded = 0, used = 0;
+	bool malformed = false;
+	while (used < bytes) {
+	    bool complete;
+	    used += decoder.feed(&stream[used], bytes - used, complete);
+	    if (!complete)
+		continue;
+	    uint16_t period;
+	    int count = parseBatchFrame(decoder.frame(), decoder.size(), frame, period);
+	    malformed |= count < 0 || period != SAMPLE_PERIOD;
+	    for (int j = 0; j < count; ++j)
+		if (!sameSample(frame[j], samples[decoded++]))
+		    failed = true;
+	}
+	auto decode_end = std::chrono::steady_clock::now();
+	if (decoded != frames * batch || malformed || decoder.errors)
+	    failed = true;
+
+	char name[16];
+	snprintf(name, sizeof(name), "batch %d", batch);
+	report(name, bytes, frames * batch);
+	double encode_seconds = std::chrono::duration<double>(encode_end - encode_start).count();
+	double decode_seconds = std::chrono::duration<double>(decode_end - encode_end).count();
+	printf("           encode %8.1f MB/s decode %8.1f MB/s\n", bytes / encode_seconds / 1e6,
+	       bytes / decode_seconds / 1e6);
+    }
+
+    if (failed) {
+	printf("decoded samples do not match the encoded samples\n");
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,267 @@
+// Configure a sensor board over its serial port or Bluetooth socket with the configuration
+// requests: the baud rate, the sensors read, each sensor's divisor of the sample clock, the
+// range and high pass filter of the accelerometer and gyroscope and the reduced rate while the
+// board is still. The settings are sent in the order given and the acknowledgement of each is
+// printed. Settings last until the board is reset. With --health the board's I2C bus
+// recoveries and sensor failures are printed after them, and with --benchmark the full sample
+// rates the board reached at each I2C frequency and read mode. Exits with 1 if any setting
+// failed or was not acknowledged, or the health or benchmark frame did not come.
+//
+// $ build/tools/board_config [options] port
+//
+// Range and cutoff codes are the drivers' enumerations: accelerometer range 0, 1 or 2 for 2, 4
+// or 8 g and cutoff 0 to 3, gyroscope range 0, 1 or 2 for 250, 500 or 2000 dps and cutoff 0 to
+// 9, or off for either cutoff.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "Board_Client.h"
+
+static void usage(const char * program)
+{
+    fprintf(stderr,
+	    "usage: %s [options] port\n"
+	    "  -r, --rate RATE             serial port speed the board is at (default 115200)\n"
+	    "  -c, --cobs                  the board was left in COBS framing\n"
+	    "  -t, --timeout MS            time to wait for each answer (default 1000)\n"
+	    "  -b, --baud RATE             change the link to RATE\n"
+	    "  -s, --sensors LIST          read only the sensors in LIST, e.g. acc,gyro (or none)\n"
+	    "  -d, --divisor SENSOR=N      read SENSOR on every N ticks of the sample clock\n"
+	    "  -g, --range SENSOR=CODE     set the range of acc or gyro\n"
+	    "  -p, --high-pass SENSOR=CODE set the high pass cutoff of acc or gyro, or off\n"
+	    "  -m, --motion TICKS,STEPS    sample on every TICKS ticks while the board is still,\n"
+	    "                              moving beyond STEPS of 0.063 g, or off\n"
+	    "  -H, --health                print the bus recoveries and sensor failures\n"
+	    "  -B, --benchmark             time full samples at each bus frequency and read mode\n",
+	    program);
+}
+
+// A setting from the command line
+struct Setting
+{
+    int option;
+    std::string argument;
+};
+
+// Split SENSOR=VALUE, returns false if the sensor is unknown or there is no value
+static bool sensorValue(const std::string & argument, uint8_t & sensor, std::string & value)
+{
+    size_t equals = argument.find('=');
+    if (equals == std::string::npos || equals + 1 == argument.size())
+	return false;
+    sensor = sensorBit(argument.substr(0, equals).c_str());
+    value = argument.substr(equals + 1);
+    return sensor != 0;
+}
+
+// Read a whole decimal number
+static bool number(const std::string & text, unsigned long & value)
+{
+    char * end;
+    value = strtoul(text.c_str(), &end, 10);
+    return !text.empty() && *end == 0;
+}
+
+static bool badSetting(const Setting & setting)
+{
+    fprintf(stderr, "%s: not understood\n", setting.argument.c_str());
+    return false;
+}
+
+// Send one setting, returns false if it was malformed, failed or not acknowledged
+static bool apply(Board_Client & client, const Setting & setting)
+{
+    Config_Ack ack;
+    uint8_t sensor = 0;
+    std::string value;
+    unsigned long n;
+    bool answered;
+
+    switch (setting.option) {
+    case 'b':
+	if (!number(setting.argument, n))
+	    return badSetting(setting);
+	answered = client.setBaudRate(n, ack);
+	break;
+    case 's': {
+	uint8_t sensors = 0;
+	size_t start = 0;
+	while (setting.argument != "none" && start <= setting.argument.size()) {
+	    size_t comma = setting.argument.find(',', start);
+	    if (comma == std::string::npos)
+		comma = setting.argument.size();
+	    uint8_t bit = sensorBit(setting.argument.substr(start, comma - start).c_str());
+	    if (!bit)
+		return badSetting(setting);
+	    sensors |= bit;
+	    start = comma + 1;
+	}
+	answered = client.setSensors(sensors, ack);
+	break;
+    }
+    case 'd':
+	if (!sensorValue(setting.argument, sensor, value) || !number(value, n) || n > 0xFFFF)
+	    return badSetting(setting);
+	answered = client.setDivisor(sensor, n, ack);
+	break;
+    case 'g':
+	if (!sensorValue(setting.argument, sensor, value) || !number(value, n) || n > 0xFF)
+	    return badSetting(setting);
+	answered = client.setRange(sensor, n, ack);
+	break;
+    case 'm': {
+	// TICKS,STEPS or off
+	unsigned long steps = 0;
+	size_t comma = setting.argument.find(',');
+	if (setting.argument == "off")
+	    n = 0;
+	else if (comma == std::string::npos || !number(setting.argument.substr(0, comma), n) ||
+		 !number(setting.argument.substr(comma + 1), steps) || n > 0xFF || steps > 0xFF)
+	    return badSetting(setting);
+	answered = client.setMotion(n, steps, ack);
+	break;
+    }
+    default:
+	if (!sensorValue(setting.argument, sensor, value))
+	    return badSetting(setting);
+	if (value == "off")
+	    n = HIGH_PASS_OFF;
+	else if (!number(value, n) || n >= HIGH_PASS_OFF)
+	    return badSetting(setting);
+	answered = client.setHighPass(sensor, n, ack);
+	break;
+    }
+
+    if (!answered) {
+	printf("%s: no answer\n", setting.argument.c_str());
+	return false;
+    }
+    printf("%s: %s (%lu)\n", setting.argument.c_str(), ackStatusText(ack.status),
+	   (unsigned long)ack.value);
+    return ack.status == ACK_OK;
+}
+
+// Ask for the health frame and print it, returns false if it did not come
+static bool printHealth(Board_Client & client)
+{
+    static const char * const names[HEALTH_SENSORS] = { "accelerometer", "gyroscope",
+							"barometer" };
+    Board_Health health;
+    if (!client.readHealth(health)) {
+	printf("health: no answer\n");
+	return false;
+    }
+    printf("bus recoveries %u\n", health.recoveries);
+    for (int i = 0; i < HEALTH_SENSORS; ++i)
+	printf("%-14s %5u failed reads, set up again %u times, last error %s%s\n", names[i],
+	       health.sensor[i].failures, health.sensor[i].setups,
+	       busErrorText(health.sensor[i].last_error),
+	       health.down & (1 << i) ? ", down" : "");
+    return true;
+}
+
+// Run the bus benchmark and print the sample rate of each record, returns false if it did not
+// come
+static bool printBenchmark(Board_Client & client)
+{
+    Bus_Benchmark benchmark;
+    if (!client.runBenchmark(benchmark)) {
+	printf("benchmark: no answer\n");
+	return false;
+    }
+    for (int i = 0; i < benchmark.count; ++i) {
+	const Bus_Benchmark::Record & record = benchmark.record[i];
+	printf("%3u kHz %-12s %5u us per sample (longest %5u us), %5.0f samples/s",
+	       record.khz, record.mode == BENCHMARK_BURST ? "burst" : "per register",
+	       record.average, record.longest, record.average ? 1e6 / record.average : 0.0);
+	if (record.failures)
+	    printf(", %u failed reads", record.failures);
+	printf("\n");
+    }
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned long rate = 115200;
+    uint8_t framing = DLE_FRAMING;
+    int timeout = 1000;
+    bool health = false;
+    bool benchmark = false;
+    std::vector<Setting> settings;
+
+    static const struct option options[] = {
+	{ "rate", required_argument, 0, 'r' },
+	{ "cobs", no_argument, 0, 'c' },
+	{ "timeout", required_argument, 0, 't' },
+	{ "baud", required_argument, 0, 'b' },
+	{ "sensors", required_argument, 0, 's' },
+	{ "divisor", required_argument, 0, 'd' },
+	{ "range", required_argument, 0, 'g' },
+	{ "high-pass", required_argument, 0, 'p' },
+	{ "motion", required_argument, 0, 'm' },
+	{ "health", no_argument, 0, 'H' },
+	{ "benchmark", no_argument, 0, 'B' },
+	{ 0, 0, 0, 0 }
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "r:ct:b:s:d:g:p:m:HB", options, 0)) != -1) {
+	switch (option) {
+	case 'r': rate = strtoul(optarg, 0, 10); break;
+	case 'c': framing = COBS_FRAMING; break;
+	case 't': timeout = atoi(optarg); break;
+	case 'H': health = true; break;
+	case 'B': benchmark = true; break;
+	case 'b':
+	case 's':
+	case 'd':
+	case 'g':
+	case 'p':
+	case 'm': {
+	    Setting setting = { option, optarg };
+	    settings.push_back(setting);
+	    break;
+	}
+	default:
+	    usage(argv[0]);
+	    return 2;
+	}
+    }
+    if (optind + 1 != argc || (settings.empty() && !health && !benchmark) || timeout <= 0) {
+	usage(argv[0]);
+	return 2;
+    }
+
+    int fd = open(argv[optind], O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+	perror(argv[optind]);
+	return 1;
+    }
+    if (isatty(fd) && !setPortSpeed(fd, rate)) {
+	fprintf(stderr, "%s: can not set the port to %lu baud\n", argv[optind], rate);
+	close(fd);
+	return 1;
+    }
+
+    Board_Client client(fd, framing);
+    client.timeout = timeout;
+    bool failed = false;
+    for (size_t i = 0; i < settings.size(); ++i) {
+	if (!apply(client, settings[i])) {
+	    failed = true;
+	    break;
+	}
+    }
+    if (!failed && health && !printHealth(client))
+	failed = true;
+    if (!failed && benchmark && !printBenchmark(client))
+	failed = true;
+    close(fd);
+    return failed ? 1 : 0;
+}
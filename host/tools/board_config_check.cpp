@@ -0,0 +1,355 @@
+// Runs the sketch on the simulated board and checks the configuration requests. A script of
+// requests is sent to the board through the simulated RN-42 module, as a receiver at the other
+// end of the Bluetooth link would, and each acknowledgement is compared with the one expected:
+// settings that are taken, arguments out of range and a request whose arguments never come.
+// The baud rate request moves both the board and the module to 230400. Afterwards the sensor
+// registers are checked for the ranges and filters set, and the board streams for a second to
+// check the sensor bits and divisors are followed at the new rate. Then the time and I2C
+// transactions the drivers take to change a setting are printed, and their register caches
+// are checked against the sensors, before and after a register is changed behind a driver's
+// back. Prints each step and exits with 1 if any check failed.
+//
+// Built as tools/orientation_config_check with ONBOARD_ORIENTATION set, it runs the sketch with
+// the orientation filter on instead, where the gyroscope divisor, the accelerometer range and
+// the sample rate while still are fixed and the gyroscope ranges the filter can not follow at
+// 400 Hz are refused, with the gyroscope left at 250 dps.
+//
+// $ build/tools/board_config_check
+// $ build/tools/orientation_config_check
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "Arduino.h"
+#include "Virtual_Clock.h"
+#include "Board_Simulator.h"
+#include "Board_Client.h"
+#include "UART_Simulator.h"
+#include "TWI_Simulator.h"
+#include "MMA8452Q_Accelerometer.h"
+#include "L3G4200D_Gyroscope.h"
+#include "MPL3115A2_Barometer.h"
+
+// The sketch's entry points and sensor drivers
+void setup();
+void loop();
+extern MMA8452Q_Accelerometer accelerometer;
+extern L3G4200D_Gyroscope gyrometer;
+extern MPL3115A2_Barometer barometer;
+
+// Virtual nanoseconds between the steps of the script
+#define STEP_TIME 300000000ULL
+// Virtual nanoseconds the board streams for
+#define STREAM_TIME 1000000000ULL
+// Base sample rate the sketch is built with
+#define SKETCH_SAMPLE_RATE 400
+// Set when the sketch is built with the orientation filter on
+#ifndef ONBOARD_ORIENTATION
+#define ONBOARD_ORIENTATION 0
+#endif
+#if ONBOARD_ORIENTATION
+// Gyroscope divisor, accelerometer range code, gyroscope CTRL_REG4 range bits and accelerometer
+// TRANSIENT_CFG the sketch keeps to
+#define GYRO_TICKS 1
+#define ACC_RANGE 0
+#define GYRO_RANGE_BITS 0x00
+#define MOTION_CONFIG 0x00
+#else
+#define GYRO_TICKS 2
+#define ACC_RANGE 2
+#define GYRO_RANGE_BITS 0x10
+#define MOTION_CONFIG 0x1E
+#endif
+
+// A request and the acknowledgement expected for it, none for a request that is not
+// acknowledged
+struct Step
+{
+    const char * name;
+    uint8_t request[CONFIG_REQUEST_MAX];
+    size_t size;
+    bool acknowledged;
+    uint8_t status;
+    uint32_t value;
+    // Virtual nanoseconds until the next step
+    uint64_t wait;
+};
+
+// Sends the script to the board one step at a time, as the virtual clock reaches each, noting
+// how much the board had sent before each step
+class Script : public Clock_Source {
+private:
+    const std::vector<Step> & steps;
+    size_t next;
+    uint64_t time;
+
+public:
+    std::vector<size_t> sent;
+
+    Script(const std::vector<Step> & script, uint64_t start)
+	: steps(script), next(0), time(start) { addClockSource(*this); }
+    virtual ~Script() { removeClockSource(*this); }
+
+    virtual uint64_t nextEvent() { return next < steps.size() ? time : CLOCK_IDLE; }
+    virtual void fire()
+    {
+	const Step & step = steps[next++];
+	sent.push_back(Serial.transmitted.size());
+	for (size_t i = 0; i < step.size; ++i)
+	    Serial.received.push_back(step.request[i]);
+	time += step.wait;
+    }
+};
+
+static Step makeStep(const char * name, const uint8_t * request, size_t size, uint8_t status,
+		     uint32_t value)
+{
+    Step step;
+    step.name = name;
+    memcpy(step.request, request, size);
+    step.size = size;
+    step.acknowledged = true;
+    step.status = status;
+    step.value = value;
+    step.wait = STEP_TIME;
+    return step;
+}
+
+// Readings of each sensor bit in the stream
+struct Counts
+{
+    unsigned long acc, gyro, baro, light;
+    std::vector<Config_Ack> acks;
+};
+
+static void countReading(const Sensor_Reading & reading, void * context)
+{
+    Counts & counts = *(Counts *)context;
+    counts.acc += (reading.sensors & ACC) != 0;
+    counts.gyro += (reading.sensors & GYRO) != 0;
+    counts.baro += (reading.sensors & BARO) != 0;
+    counts.light += (reading.sensors & PHT) != 0;
+}
+
+static void keepAck(const Config_Ack & ack, void * context)
+{
+    ((Counts *)context)->acks.push_back(ack);
+}
+
+static int failures;
+
+static void check(bool passed, const char * what)
+{
+    printf("  %-52s %s\n", what, passed ? "ok" : "FAILED");
+    if (!passed)
+	failures += 1;
+}
+
+// Print the virtual time and the I2C transactions 'change' takes, checking it succeeds
+static void timeChange(const char * what, uint8_t (*change)())
+{
+    uint64_t start = clockNanos();
+    unsigned long stops = twi_simulator.stops;
+    uint8_t error = change();
+    char line[128];
+    snprintf(line, sizeof(line), "%-27s %4.0f us, %lu transactions", what,
+	     (clockNanos() - start) * 1e-3, twi_simulator.stops - stops);
+    check(error == NO_ERROR, line);
+}
+
+// The changes timed, each the same kind as a configuration request makes
+static uint8_t accelerometerRange()
+{
+    return accelerometer.setRange(MMA8452Q_Accelerometer::MAX_4G);
+}
+static uint8_t accelerometerCutoff()
+{
+    return accelerometer.setHighPassCutoff(MMA8452Q_Accelerometer::CUTOFF_4_HZ);
+}
+static uint8_t accelerometerFilterOff() { return accelerometer.disableHighPassFilter(); }
+static uint8_t accelerometerRate()
+{
+    return accelerometer.setDataRate(MMA8452Q_Accelerometer::RATE_400_HZ);
+}
+static uint8_t accelerometerMotion() { return accelerometer.enableMotionDetection(2, 4); }
+static uint8_t gyroscopeRange()
+{
+    return gyrometer.setRange(L3G4200D_Gyroscope::MAX_2000_DPS);
+}
+static uint8_t gyroscopeCutoff()
+{
+    return gyrometer.setHighPassCutoff(L3G4200D_Gyroscope::CUTOFF_1_HZ);
+}
+static uint8_t gyroscopeLowPass() { return gyrometer.enableLowPassFilter(); }
+static uint8_t barometerFifo() { return barometer.enableFIFO(0); }
+static uint8_t barometerFifoOff() { return barometer.disableFIFO(); }
+
+int main()
+{
+    Board_Simulator board;
+    setClockLimit(clockNanos() + 1000000000ULL);
+    try {
+	setup();
+    }
+    catch (Clock_Limit &) {
+	fprintf(stderr, "setup() did not finish\n");
+	return 1;
+    }
+    long initial_rate = uart_simulator.baud;
+
+    std::vector<Step> steps;
+    uint8_t request[CONFIG_REQUEST_MAX];
+    steps.push_back(makeStep("accelerometer and gyroscope only", request,
+			     encodeSetSensors(ACC | GYRO, request), ACK_OK, ACC | GYRO));
+#if ONBOARD_ORIENTATION
+    steps.push_back(makeStep("gyroscope divisor fixed for the filter", request,
+			     encodeSetDivisor(GYRO, 2, request), ACK_INVALID, 2));
+    steps.push_back(makeStep("gyroscope 500 dps too fast for the filter", request,
+			     encodeSetRange(GYRO, 1, request), ACK_INVALID, 1));
+    steps.push_back(makeStep("gyroscope 2000 dps too fast for the filter", request,
+			     encodeSetRange(GYRO, 2, request), ACK_INVALID, 2));
+    steps.push_back(makeStep("accelerometer range fixed for the filter", request,
+			     encodeSetRange(ACC, 2, request), ACK_INVALID, 2));
+#else
+    steps.push_back(makeStep("gyroscope on every other tick", request,
+			     encodeSetDivisor(GYRO, 2, request), ACK_OK, 2));
+    steps.push_back(makeStep("gyroscope 500 dps", request, encodeSetRange(GYRO, 1, request),
+			     ACK_OK, 1));
+    steps.push_back(makeStep("accelerometer 8 g", request, encodeSetRange(ACC, 2, request),
+			     ACK_OK, 2));
+#endif
+    steps.push_back(makeStep("accelerometer high pass 8 Hz", request,
+			     encodeSetHighPass(ACC, 1, request), ACK_OK, 1));
+    steps.push_back(makeStep("gyroscope high pass off", request,
+			     encodeSetHighPass(GYRO, HIGH_PASS_OFF, request), ACK_OK,
+			     HIGH_PASS_OFF));
+    steps.push_back(makeStep("motion threshold of 0", request,
+			     encodeSetMotion(8, 0, request), ACK_INVALID, 8));
+    steps.push_back(makeStep(ONBOARD_ORIENTATION ? "stride while still fixed for the filter" :
+			     "every 8 ticks while still", request, encodeSetMotion(8, 1, request),
+			     ONBOARD_ORIENTATION ? ACK_INVALID : ACK_OK, 8));
+    steps.push_back(makeStep("barometer has no range", request,
+			     encodeSetRange(BARO, 0, request), ACK_INVALID, 0));
+    steps.push_back(makeStep("unknown sensor bit", request,
+			     encodeSetDivisor(0x10, 1, request), ACK_INVALID, 1));
+    steps.push_back(makeStep("baud rate 230400", request, encodeSetBaudRate(230400, request),
+			     ACK_OK, F_CPU / 8 / ((F_CPU / 4 / 230400 - 1) / 2 + 1)));
+    steps.push_back(makeStep("baud rate 460800 is too far off", request,
+			     encodeSetBaudRate(460800, request), ACK_INVALID,
+			     F_CPU / 8 / ((F_CPU / 4 / 230400 - 1) / 2 + 1)));
+    steps.push_back(makeStep("sensors request with no argument", request,
+			     encodeSetSensors(0, request) - 1, ACK_TIMEOUT, 0));
+    const uint8_t stream_start[] = { START_STREAM };
+    const uint8_t stream_end[] = { END_STREAM };
+    steps.push_back(makeStep("stream", stream_start, 1, 0, 0));
+    steps.back().acknowledged = false;
+    steps.back().wait = STREAM_TIME;
+    steps.push_back(makeStep("end", stream_end, 1, 0, 0));
+    steps.back().acknowledged = false;
+
+    // loop() never returns, it is stopped a step after the last
+    uint64_t end = clockNanos() + STEP_TIME;
+    Script script(steps, end);
+    for (size_t i = 0; i < steps.size(); ++i)
+	end += steps[i].wait;
+    setClockLimit(end);
+    try {
+	loop();
+    }
+    catch (Clock_Limit &) {
+    }
+    setClockLimit(CLOCK_IDLE);
+    if (script.sent.size() != steps.size()) {
+	fprintf(stderr, "the script did not finish\n");
+	return 1;
+    }
+    size_t before_stream = script.sent[steps.size() - 2];
+    long config_rate = uart_simulator.baud;
+
+    Counts counts;
+    counts.acc = counts.gyro = counts.baro = counts.light = 0;
+    Sensor_Stream stream(countReading, &counts);
+    stream.setAckHandler(keepAck, &counts);
+    stream.feed(&Serial.transmitted[0], before_stream);
+    unsigned long config_readings = stream.readings;
+
+    printf("acknowledgements\n");
+    size_t received = 0;
+    for (size_t i = 0; i < steps.size(); ++i) {
+	if (!steps[i].acknowledged)
+	    continue;
+	char what[128];
+	if (received == counts.acks.size()) {
+	    snprintf(what, sizeof(what), "%s: no answer", steps[i].name);
+	    check(false, what);
+	    continue;
+	}
+	const Config_Ack & ack = counts.acks[received++];
+	snprintf(what, sizeof(what), "%s: %s (%lu)", steps[i].name, ackStatusText(ack.status),
+		 (unsigned long)ack.value);
+	check(ack.request == steps[i].request[0] && ack.status == steps[i].status &&
+	      ack.value == steps[i].value, what);
+    }
+    check(received == counts.acks.size(), "no other acknowledgements");
+    check(config_readings == 0, "no samples while configuring");
+
+    printf("board\n");
+    // MMA8452Q XYZ_DATA_CFG (0x0E), HP_FILTER_CUTOFF (0x0F) and CTRL_REG1 (0x2A)
+    check((board.accelerometer.registers[0x0E] & 0x03) == ACC_RANGE,
+	  ACC_RANGE == 2 ? "accelerometer range 8 g" : "accelerometer range 2 g");
+    check((board.accelerometer.registers[0x0E] & 0x10) &&
+	  (board.accelerometer.registers[0x0F] & 0x03) == 1, "accelerometer high pass 8 Hz");
+    check(board.accelerometer.registers[0x2A] & 0x01, "accelerometer still active");
+    // MMA8452Q TRANSIENT_CFG (0x1D) and TRANSIENT_THS (0x1F)
+    check(board.accelerometer.registers[0x1D] == MOTION_CONFIG &&
+	  (MOTION_CONFIG == 0 || board.accelerometer.registers[0x1F] == 1),
+	  MOTION_CONFIG != 0 ? "accelerometer motion detection latched, 0.063 g" :
+	  "accelerometer motion detection off");
+    // L3G4200D CTRL_REG4 (0x23) and CTRL_REG5 (0x24)
+    check((board.gyroscope.registers[0x23] & 0x30) == GYRO_RANGE_BITS,
+	  GYRO_RANGE_BITS == 0x10 ? "gyroscope range 500 dps" : "gyroscope range 250 dps");
+    check(!(board.gyroscope.registers[0x24] & 0x10), "gyroscope high pass off");
+    char what[128];
+    snprintf(what, sizeof(what), "UART %ld to %ld baud, module %ld", initial_rate, config_rate,
+	     board.bluetooth.baud);
+    check(board.bluetooth.baud == 230400 && board.bluetooth.rate_changes == 1 &&
+	  uart_simulator.matched(), what);
+    check(uart_simulator.garbled == 0, "no bytes garbled");
+
+    // Rates in the stream at the new baud rate
+    stream.feed(&Serial.transmitted[before_stream], Serial.transmitted.size() - before_stream);
+    double seconds = STREAM_TIME * 1e-9;
+    printf("stream at %ld baud, %lu samples\n", config_rate, stream.readings - config_readings);
+    snprintf(what, sizeof(what), "accelerometer %.0f/s", counts.acc / seconds);
+    check(counts.acc > 0.95 * SKETCH_SAMPLE_RATE * seconds &&
+	  counts.acc < 1.05 * SKETCH_SAMPLE_RATE * seconds, what);
+    snprintf(what, sizeof(what), "gyroscope %.0f/s", counts.gyro / seconds);
+    check(counts.gyro > 0.95 * SKETCH_SAMPLE_RATE / GYRO_TICKS * seconds &&
+	  counts.gyro < 1.05 * SKETCH_SAMPLE_RATE / GYRO_TICKS * seconds, what);
+    check(counts.baro == 0 && counts.light == 0, "no barometer or light readings");
+    check(stream.malformed == 0 && stream.framingErrors() == 0, "every frame decoded");
+
+    printf("reconfiguration\n");
+    timeChange("accelerometer range 4 g", accelerometerRange);
+    timeChange("accelerometer cutoff 4 Hz", accelerometerCutoff);
+    timeChange("accelerometer high pass off", accelerometerFilterOff);
+    timeChange("accelerometer data rate 400 Hz", accelerometerRate);
+    timeChange("accelerometer motion 0.126 g", accelerometerMotion);
+    timeChange("gyroscope range 2000 dps", gyroscopeRange);
+    timeChange("gyroscope cutoff 1 Hz", gyroscopeCutoff);
+    timeChange("gyroscope low pass on", gyroscopeLowPass);
+    timeChange("barometer FIFO on", barometerFifo);
+    timeChange("barometer FIFO off", barometerFifoOff);
+
+    printf("register caches\n");
+    check(accelerometer.verifyRegisters() == NO_ERROR, "accelerometer matches");
+    check(gyrometer.verifyRegisters() == NO_ERROR, "gyroscope matches");
+    check(barometer.verifyRegisters() == NO_ERROR, "barometer matches");
+    // Change the gyroscope's CTRL_REG2 (0x21) behind the driver's back
+    board.gyroscope.registers[0x21] ^= 0x01;
+    check(gyrometer.verifyRegisters() == REGISTER_MISMATCH, "gyroscope change found");
+    check(gyrometer.verifyRegisters() == NO_ERROR, "gyroscope cache reloaded");
+
+    printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
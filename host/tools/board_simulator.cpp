@@ -0,0 +1,413 @@
+// Runs the sketch on the simulated board to measure the sample rates it reaches. setup() and
+// loop() run against the host core, the simulated TWI peripheral and the sensor models, on a
+// virtual clock charged with the time the I2C bus and UART take to move each byte, the sensors'
+// data rates and the cycles of the interrupts and polling loops. Computation is not charged, so
+// the rates are what the buses allow, an upper bound on the real board. The stream the sketch
+// sent is decoded and the rate of each sensor in it, the load on the buses and the sample
+// clock's missed ticks are printed with the spread of the sample times and any samples missing
+// from the sequence numbers, and when the sketch sends through the interrupt driven frame
+// port, how much of the time the UART was sending the sketch carried on with its work. The
+// stream is then ended and the sketch's stage timing asked for with SEND_STATS, and the time
+// each stage of the sampling loop took is printed.
+// Exits with 1 if any frame did not decode, a sample was lost or the stats never came.
+//
+// With --motion the sketch is first asked to lower its sample rate while the accelerometer sees
+// no motion, and with --still the simulated board is held still for a while in the middle of
+// the stream, so the samples/s before, while and after it show the rate drop and come back.
+//
+// With --benchmark the sketch is instead asked for RUN_BENCHMARK and the full sample times it
+// measured at each I2C frequency and read mode are printed, exiting with 1 if they never came
+// or a read failed.
+//
+// $ build/tools/board_simulator [--seconds S] [--mode single|batch|compressed] [--cobs]
+//       [--motion TICKS[,STEPS]] [--still FROM,TO]
+// $ build/tools/board_simulator --benchmark
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "Virtual_Clock.h"
+#include "Board_Simulator.h"
+#include "UART_Simulator.h"
+#include "Sample_Scheduler.h"
+#include "Sensor_Protocol.h"
+#include "Sensor_Stream.h"
+#include "Board_Client.h"
+
+// The sketch's entry points and sample clock
+void setup();
+void loop();
+extern Sample_Scheduler scheduler;
+
+// Readings of each sensor bit in the decoded stream and the shortest and longest times between
+// readings, and the readings before, while and after the board was held still, by board time in
+// microseconds
+struct Counts
+{
+    unsigned long readings, acc, gyro, baro, light, quat;
+    uint16_t shortest, longest;
+    uint32_t still_from, still_to;
+    unsigned long before, during, after;
+};
+
+static void countReading(const Sensor_Reading & reading, void * context)
+{
+    Counts & counts = *(Counts *)context;
+    counts.acc += (reading.sensors & ACC) != 0;
+    counts.gyro += (reading.sensors & GYRO) != 0;
+    counts.baro += (reading.sensors & BARO) != 0;
+    counts.light += (reading.sensors & PHT) != 0;
+    counts.quat += (reading.sensors & QUAT) != 0;
+    counts.before += reading.time < counts.still_from;
+    counts.during += reading.time >= counts.still_from && reading.time < counts.still_to;
+    counts.after += reading.time >= counts.still_to;
+    // The first reading has nothing before it
+    if (counts.readings++ != 0) {
+	if (reading.delta < counts.shortest)
+	    counts.shortest = reading.delta;
+	if (reading.delta > counts.longest)
+	    counts.longest = reading.delta;
+    }
+}
+
+static void keepStats(const Loop_Stats & stats, void * context)
+{
+    *(Loop_Stats *)context = stats;
+}
+
+static void printStats(const Loop_Stats & stats)
+{
+    static const char * names[STAGE_COUNT] = {
+	"wait", "request", "accelerometer", "gyroscope", "barometer", "light", "filter", "send"
+    };
+    if (stats.stages == 0) {
+	printf("the sketch was built without STAGE_PROFILING\n");
+	return;
+    }
+    double tick = stats.tick * 1e-3;
+    printf("  stage            runs   min us  mean us   max us   share   histogram (<%.0f us, "
+	   "doubling)\n", PROFILE_BIN_FIRST * tick);
+    double all = 0;
+    for (int i = 0; i < stats.stages; ++i)
+	all += stats.stage[i].total;
+    for (int i = 0; i < stats.stages; ++i) {
+	if (stats.stage[i].count == 0)
+	    continue;
+	printf("  %-14s %6u %8.1f %8.1f %8.1f %6.1f %% ", names[i], stats.stage[i].count,
+	       stats.stage[i].shortest * tick,
+	       stats.stage[i].total * tick / stats.stage[i].count,
+	       stats.stage[i].longest * tick, 100.0 * stats.stage[i].total / all);
+	for (int j = 0; j < PROFILE_BINS; ++j)
+	    printf(" %u", stats.stage[i].bins[j]);
+	printf("\n");
+    }
+}
+
+// Time after END_STREAM to send SEND_STATS, once a batched stream has closed its last frame.
+// Request bytes that arrive while a stream is open are read and dropped by the sketch.
+#define STATS_DELAY 50000000ULL
+
+// Sends END_STREAM to the sketch when the clock reaches 'time', noting what the board and the
+// buses did up to then, and SEND_STATS a little later
+class Stream_End : public Clock_Source {
+private:
+    const Board_Simulator & board;
+
+public:
+    uint64_t time;
+    bool ended;
+    size_t sent;
+    uint64_t stalled;
+    uint64_t sending;
+    uint64_t blocked;
+    uint32_t ticks;
+    uint16_t missed;
+    unsigned long bytes;
+    uint64_t busy;
+    unsigned long latched[BOARD_SENSORS];
+
+    Stream_End(const Board_Simulator & simulator, uint64_t end)
+	: board(simulator), time(end), ended(false) { addClockSource(*this); }
+    virtual ~Stream_End() { removeClockSource(*this); }
+
+    virtual uint64_t nextEvent() { return time; }
+    virtual void fire()
+    {
+	if (ended) {
+	    Serial.received.push_back(SEND_STATS);
+	    time = CLOCK_IDLE;
+	    return;
+	}
+	sent = Serial.transmitted.size();
+	stalled = Serial.stalled;
+	sending = uart_simulator.busy;
+	blocked = uart_simulator.blocked;
+	ticks = scheduler.ticks;
+	missed = scheduler.missed;
+	bytes = twi_simulator.bytes;
+	busy = twi_simulator.busy;
+	for (int i = 0; i < BOARD_SENSORS; ++i)
+	    latched[i] = board.samples[i];
+	Serial.received.push_back(END_STREAM);
+	ended = true;
+	time += STATS_DELAY;
+    }
+};
+
+// Holds the simulated board still from one time to another
+class Still_Time : public Clock_Source {
+private:
+    Board_Simulator & board;
+    uint64_t from, to;
+
+public:
+    Still_Time(Board_Simulator & simulator, uint64_t start, uint64_t end)
+	: board(simulator), from(start), to(end) { addClockSource(*this); }
+    virtual ~Still_Time() { removeClockSource(*this); }
+
+    virtual uint64_t nextEvent() { return board.still ? to : from; }
+    virtual void fire()
+    {
+	board.still = !board.still;
+	if (!board.still)
+	    from = to = CLOCK_IDLE;
+    }
+};
+
+static void keepBenchmark(const Bus_Benchmark & benchmark, void * context)
+{
+    *(Bus_Benchmark *)context = benchmark;
+}
+
+// Ask the sketch for its bus benchmark and print it, returns false if it did not come or a read
+// failed
+static bool runBenchmark()
+{
+    Serial.received.push_back(RUN_BENCHMARK);
+    size_t sent_before = Serial.transmitted.size();
+    setClockLimit(clockNanos() + BENCHMARK_WAIT * 1000000ULL);
+    try {
+	loop();
+    }
+    catch (Clock_Limit &) {
+    }
+    setClockLimit(CLOCK_IDLE);
+
+    Counts counts;
+    Bus_Benchmark benchmark;
+    benchmark.count = 0;
+    Sensor_Stream decoder(countReading, &counts);
+    decoder.setBenchmarkHandler(keepBenchmark, &benchmark);
+    decoder.feed(&Serial.transmitted[sent_before], Serial.transmitted.size() - sent_before);
+    if (benchmark.count == 0) {
+	printf("no benchmark frame was sent\n");
+	return false;
+    }
+
+    bool failed = false;
+    printf("full samples, %u reads of each:\n", BENCHMARK_READS);
+    printf("  SCL      read mode       mean us  longest us  samples/s\n");
+    for (int i = 0; i < benchmark.count; ++i) {
+	const Bus_Benchmark::Record & record = benchmark.record[i];
+	printf("  %3u kHz  %-12s  %8u  %10u  %9.0f", record.khz,
+	       record.mode == BENCHMARK_BURST ? "burst" : "per register", record.average,
+	       record.longest, record.average ? 1e6 / record.average : 0.0);
+	if (record.failures)
+	    printf("  %u failed reads", record.failures);
+	printf("\n");
+	failed |= record.failures != 0;
+    }
+    return !failed;
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr,
+	    "usage: %s [options]\n"
+	    "  -s, --seconds S       virtual time to stream for (default 5)\n"
+	    "  -m, --mode MODE       single, batch or compressed stream (default single)\n"
+	    "  -c, --cobs            ask for COBS framing\n"
+	    "  -M, --motion TICKS[,STEPS]\n"
+	    "                        sample every TICKS ticks while the accelerometer sees less\n"
+	    "                        than STEPS of 0.063 g of motion (default 1)\n"
+	    "  -q, --still FROM,TO   hold the board still from FROM to TO seconds into the stream\n"
+	    "  -b, --benchmark       time full samples at each I2C frequency and read mode\n",
+	    program);
+}
+
+int main(int argc, char ** argv)
+{
+    double seconds = 5;
+    uint8_t request = START_STREAM;
+    bool cobs = false;
+    bool benchmark = false;
+    unsigned motion_ticks = 0, motion_steps = 1;
+    double still_from = 0, still_to = 0;
+
+    static const struct option options[] = {
+	{ "seconds", required_argument, 0, 's' },
+	{ "mode", required_argument, 0, 'm' },
+	{ "cobs", no_argument, 0, 'c' },
+	{ "benchmark", no_argument, 0, 'b' },
+	{ "motion", required_argument, 0, 'M' },
+	{ "still", required_argument, 0, 'q' },
+	{ 0, 0, 0, 0 }
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "s:m:cbM:q:", options, 0)) != -1) {
+	switch (option) {
+	case 's': seconds = atof(optarg); break;
+	case 'm':
+	    if (!strcmp(optarg, "single"))
+		request = START_STREAM;
+	    else if (!strcmp(optarg, "batch"))
+		request = START_BATCH_STREAM;
+	    else if (!strcmp(optarg, "compressed"))
+		request = START_COMPRESSED_STREAM;
+	    else {
+		usage(argv[0]);
+		return 2;
+	    }
+	    break;
+	case 'c': cobs = true; break;
+	case 'b': benchmark = true; break;
+	case 'M':
+	    if (sscanf(optarg, "%u,%u", &motion_ticks, &motion_steps) < 1 || motion_ticks < 2 ||
+		motion_ticks > 255 || motion_steps < 1 || motion_steps > MOTION_THRESHOLD_MAX) {
+		usage(argv[0]);
+		return 2;
+	    }
+	    break;
+	case 'q':
+	    if (sscanf(optarg, "%lf,%lf", &still_from, &still_to) != 2 || still_from < 0 ||
+		still_to <= still_from) {
+		usage(argv[0]);
+		return 2;
+	    }
+	    break;
+	default:
+	    usage(argv[0]);
+	    return 2;
+	}
+    }
+    if (optind != argc || seconds <= 0) {
+	usage(argv[0]);
+	return 2;
+    }
+
+    Board_Simulator board;
+    // A sensor that fails to set up leaves setup() waiting forever, with the clock limit it
+    // throws instead
+    setClockLimit(clockNanos() + 1000000000ULL);
+    try {
+	setup();
+    }
+    catch (Clock_Limit &) {
+	fprintf(stderr, "setup() did not finish\n");
+	return 1;
+    }
+    uint64_t setup_time = clockNanos();
+    printf("setup() took %.2f ms, %lu I2C bytes\n", setup_time * 1e-6, twi_simulator.bytes);
+    if (benchmark)
+	return runBenchmark() ? 0 : 1;
+
+    // Stream for the time asked for, then leave time to close the stream and send the stats.
+    // loop() never returns.
+    if (cobs)
+	Serial.received.push_back(COBS_FRAMING);
+    if (motion_ticks) {
+	uint8_t motion[CONFIG_REQUEST_MAX];
+	size_t size = encodeSetMotion(motion_ticks, motion_steps, motion);
+	Serial.received.insert(Serial.received.end(), motion, motion + size);
+    }
+    Serial.received.push_back(request);
+    size_t sent_before = Serial.transmitted.size();
+    unsigned long bytes_before = twi_simulator.bytes;
+    uint64_t sending_before = uart_simulator.busy;
+    uint64_t blocked_before = uart_simulator.blocked;
+    uint64_t busy_before = twi_simulator.busy;
+    unsigned long latched_before[BOARD_SENSORS];
+    for (int i = 0; i < BOARD_SENSORS; ++i)
+	latched_before[i] = board.samples[i];
+    uint64_t end = setup_time + (uint64_t)(seconds * 1e9);
+    Stream_End stream_end(board, end);
+    uint64_t still_start = setup_time + (uint64_t)(still_from * 1e9);
+    Still_Time still_time(board, still_to > 0 ? still_start : CLOCK_IDLE,
+			  setup_time + (uint64_t)(still_to * 1e9));
+    setClockLimit(end + 2 * STATS_DELAY);
+    try {
+	loop();
+    }
+    catch (Clock_Limit &) {
+    }
+    setClockLimit(CLOCK_IDLE);
+
+    Counts counts;
+    memset(&counts, 0, sizeof(counts));
+    counts.shortest = 0xFFFF;
+    counts.still_from = counts.still_to = 0xFFFFFFFF;
+    if (still_to > 0) {
+	counts.still_from = (setup_time + (uint64_t)(still_from * 1e9)) / 1000;
+	counts.still_to = (setup_time + (uint64_t)(still_to * 1e9)) / 1000;
+    }
+    Loop_Stats stats;
+    stats.stages = 0xFF;
+    Sensor_Stream * decoder = new Sensor_Stream(countReading, &counts);
+    decoder->setFraming(cobs ? COBS_FRAMING : DLE_FRAMING);
+    decoder->setStatsHandler(keepStats, &stats);
+    decoder->feed(&Serial.transmitted[sent_before], Serial.transmitted.size() - sent_before);
+
+    // Rates over the time asked for, the samples after it that close a batched frame are few
+    double elapsed = (end - setup_time) * 1e-9;
+    size_t sent = stream_end.sent - sent_before;
+    printf("%.1f s virtual, %lu frames, %lu samples, %lu lost\n", elapsed, decoder->frames,
+	   decoder->readings, decoder->lost);
+    printf("  sensor         latched/s  sent/s\n");
+    printf("  accelerometer  %9.1f  %6.1f\n",
+	   (stream_end.latched[0] - latched_before[0]) / elapsed, counts.acc / elapsed);
+    printf("  gyroscope      %9.1f  %6.1f\n",
+	   (stream_end.latched[1] - latched_before[1]) / elapsed, counts.gyro / elapsed);
+    printf("  barometer      %9.1f  %6.1f\n",
+	   (stream_end.latched[2] - latched_before[2]) / elapsed, counts.baro / elapsed);
+    printf("  light                     %6.1f\n", counts.light / elapsed);
+    if (counts.quat)
+	printf("  quaternion                %6.1f\n", counts.quat / elapsed);
+    if (uart_simulator.enabled) {
+	uint64_t sending = stream_end.sending - sending_before;
+	uint64_t blocked = stream_end.blocked - blocked_before;
+	printf("UART   %.0f bytes/s, %.1f %% of the %ld baud link, frame port waited %.1f ms\n",
+	       sent / elapsed, 100.0 * sending * 1e-9 / elapsed, uart_simulator.baud,
+	       blocked * 1e-6);
+	printf("       %.1f %% of the sending overlapped other work\n",
+	       sending ? 100.0 * (sending - (blocked < sending ? blocked : sending)) / sending : 0.0);
+    }
+    else
+	printf("UART   %.0f bytes/s, %.1f %% of the %ld baud link, writes stalled %.1f ms\n",
+	       sent / elapsed, 100.0 * sent * Serial.byte_time * 1e-9 / elapsed, Serial.baud,
+	       stream_end.stalled * 1e-6);
+    printf("I2C    %.0f bytes/s, bus busy %.1f %%\n", (stream_end.bytes - bytes_before) / elapsed,
+	   100.0 * (stream_end.busy - busy_before) * 1e-9 / elapsed);
+    printf("clock  %lu ticks, %u missed\n", (unsigned long)stream_end.ticks, stream_end.missed);
+    if (still_to > 0) {
+	double after = elapsed - still_to;
+	printf("still  %.1f samples/s before, %.1f while still, %.1f after\n",
+	       still_from > 0 ? counts.before / still_from : 0.0, counts.during / (still_to - still_from),
+	       after > 0 ? counts.after / after : 0.0);
+    }
+    if (decoder->readings > 1)
+	printf("times  samples %u to %u us apart\n", counts.shortest, counts.longest);
+    if (stats.stages != 0xFF)
+	printStats(stats);
+    else
+	printf("no stats frame was sent\n");
+
+    bool failed = decoder->malformed || decoder->framingErrors() || !decoder->readings ||
+	decoder->lost || stats.stages == 0xFF;
+    if (decoder->malformed || decoder->framingErrors())
+	printf("%lu malformed frames, %lu framing errors\n", decoder->malformed,
+	       decoder->framingErrors());
+    delete decoder;
+    return failed ? 1 : 0;
+}
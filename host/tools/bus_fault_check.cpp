@@ -0,0 +1,292 @@
+// Checks that the board rides out faults on its I2C bus. The transaction queue is first driven
+// on its own against the simulated bus with each fault the TWI simulator can inject: a device
+// holding the bus, a device that does not acknowledge its address or data and a bus error.
+// Each must fail only the transaction it hit, a held bus within the stall time, and leave the
+// bus working for the next. Then the sketch is run on the simulated board with the barometer
+// missing at reset and a batched stream is sent while the bus hangs, reports a bus error and
+// loses the accelerometer for a while. The stream must carry on without a sample missing, the
+// sensors must come back with the settings made before, and the health frame must count what
+// happened. Prints each step and exits with 1 if any check failed.
+//
+// $ build/tools/bus_fault_check
+
+#include <stdio.h>
+#include <vector>
+#include "Arduino.h"
+#include "Virtual_Clock.h"
+#include "Board_Simulator.h"
+#include "Board_Client.h"
+#include "TWI_Simulator.h"
+#include "TWI_Queue.h"
+#include "I2C_Tools.h"
+#include "MMA8452Q_Accelerometer.h"
+
+// The sketch's entry points
+void setup();
+void loop();
+
+// Device and identity register addresses of the accelerometer and gyroscope
+#define ACCELEROMETER_ADDRESS 0x1D
+#define ACCELEROMETER_WHO_AM_I 0x0D
+#define GYROSCOPE_ADDRESS 0x69
+#define GYROSCOPE_WHO_AM_I 0x0F
+// MMA8452Q XYZ_DATA_CFG, holding the range
+#define ACCELEROMETER_RANGE 0x0E
+
+// Virtual milliseconds into the run of the sketch at which each event happens
+#define STREAM_START 300
+#define BAROMETER_BACK 800
+#define BUS_HANG 1300
+#define BUS_ERROR 1600
+#define ACCELEROMETER_LOST 2000
+#define ACCELEROMETER_BACK 3500
+#define STREAM_END 5000
+#define HEALTH_REQUEST 5100
+#define RUN_END 5300
+
+static int failures;
+
+static void check(bool passed, const char * what)
+{
+    printf("  %-56s %s\n", what, passed ? "ok" : "FAILED");
+    if (!passed)
+	failures += 1;
+}
+
+// Read the accelerometer's identity register and check it is read correctly
+static void checkRead(const char * what)
+{
+    uint8_t value = 0;
+    uint8_t error = readRegister(ACCELEROMETER_ADDRESS, ACCELEROMETER_WHO_AM_I, value);
+    check(error == NO_ERROR && value == 0x2A, what);
+}
+
+// Read the accelerometer's identity register with a fault injected and check the error code
+static void checkFault(const char * what, uint8_t expected)
+{
+    uint8_t value;
+    uint8_t error = readRegister(ACCELEROMETER_ADDRESS, ACCELEROMETER_WHO_AM_I, value);
+    char line[128];
+    snprintf(line, sizeof(line), "%s: %s", what, busErrorText(error));
+    check(error == expected, line);
+}
+
+// The transaction queue on its own
+static void checkQueue(Board_Simulator & board)
+{
+    printf("transaction queue\n");
+    twi_queue.begin();
+    checkRead("clean read");
+
+    twi_simulator.bus_hang = true;
+    uint64_t start = clockNanos();
+    uint8_t value;
+    uint8_t error = readRegister(ACCELEROMETER_ADDRESS, ACCELEROMETER_WHO_AM_I, value);
+    double waited = (clockNanos() - start) * 1e-3;
+    char line[128];
+    snprintf(line, sizeof(line), "held bus: %s after %.0f us", busErrorText(error), waited);
+    check(error == TWI_TIMEOUT && waited >= TWI_STALL_MICROS &&
+	  waited < TWI_STALL_MICROS + 500, line);
+    check(twi_queue.recoveries == 1 && twi_simulator.recoveries == 1, "bus recovered once");
+    checkRead("read after the recovery");
+
+    // A held bus fails the transaction on it but not the one queued behind it
+    TWI_Transaction first, second;
+    uint8_t first_value, second_value = 0;
+    twi_simulator.bus_hang = true;
+    requestRegisters(first, ACCELEROMETER_ADDRESS, ACCELEROMETER_WHO_AM_I, 1, &first_value);
+    requestRegisters(second, GYROSCOPE_ADDRESS, GYROSCOPE_WHO_AM_I, 1, &second_value);
+    error = twi_queue.wait(second);
+    check(first.status == TWI_TIMEOUT && error == NO_ERROR && second_value == 0xD3,
+	  "queued read after a held bus");
+
+    board.accelerometer.nack_address = true;
+    checkFault("address not acknowledged", ADDRESS_NO_ACKNOWLEDGE);
+    board.accelerometer.nack_address = false;
+    board.accelerometer.nack_data = true;
+    checkFault("data not acknowledged", DATA_NO_ACKNOWLEDGE);
+    board.accelerometer.nack_data = false;
+    twi_simulator.bus_error = true;
+    checkFault("bus error", TWI_ERROR);
+    checkRead("read after the faults");
+    check(twi_queue.recoveries == 2 && !twi_queue.busy(), "queue idle");
+}
+
+// A fault or request at a set time in the run of the sketch
+struct Event
+{
+    uint64_t time;
+    void (*happen)(Board_Simulator & board);
+};
+
+static void startStream(Board_Simulator &) { Serial.received.push_back(START_BATCH_STREAM); }
+static void endStream(Board_Simulator &) { Serial.received.push_back(END_STREAM); }
+static void requestHealth(Board_Simulator &) { Serial.received.push_back(SEND_HEALTH); }
+static void barometerBack(Board_Simulator & board) { board.barometer.nack_address = false; }
+static void hangBus(Board_Simulator &) { twi_simulator.bus_hang = true; }
+static void breakBus(Board_Simulator &) { twi_simulator.bus_error = true; }
+static void loseAccelerometer(Board_Simulator & board)
+{
+    board.accelerometer.nack_address = true;
+}
+static void accelerometerBack(Board_Simulator & board)
+{
+    board.accelerometer.nack_address = false;
+}
+
+// Carries out the events as the virtual clock reaches each
+class Fault_Script : public Clock_Source {
+private:
+    Board_Simulator & board;
+    const std::vector<Event> & events;
+    size_t next;
+
+public:
+    Fault_Script(Board_Simulator & simulator, const std::vector<Event> & script)
+	: board(simulator), events(script), next(0) { addClockSource(*this); }
+    virtual ~Fault_Script() { removeClockSource(*this); }
+
+    virtual uint64_t nextEvent()
+    {
+	return next < events.size() ? events[next].time : CLOCK_IDLE;
+    }
+    virtual void fire() { events[next++].happen(board); }
+};
+
+// What the stream carried
+struct Counts
+{
+    // Board times in microseconds of the stream start, the first fault, the time every sensor
+    // should be back and the stream end, and the samples between the first two and the last two
+    uint32_t start, faulted, settled, end;
+    unsigned long before, after;
+    unsigned long readings, acc, baro;
+    // Microseconds covered by the samples without an accelerometer reading
+    uint64_t without_acc;
+    bool reported;
+    Board_Health health;
+};
+
+static void countReading(const Sensor_Reading & reading, void * context)
+{
+    Counts & counts = *(Counts *)context;
+    counts.readings += 1;
+    counts.before += reading.time >= counts.start && reading.time < counts.faulted;
+    counts.after += reading.time >= counts.settled && reading.time < counts.end;
+    counts.acc += (reading.sensors & ACC) != 0;
+    if (!(reading.sensors & ACC))
+	counts.without_acc += reading.delta;
+    counts.baro += (reading.sensors & BARO) != 0;
+}
+
+static void keepHealth(const Board_Health & health, void * context)
+{
+    Counts & counts = *(Counts *)context;
+    counts.health = health;
+    counts.reported = true;
+}
+
+int main()
+{
+    Board_Simulator board;
+    checkQueue(board);
+    unsigned long recoveries = twi_queue.recoveries;
+
+    printf("setup\n");
+    board.barometer.nack_address = true;
+    setClockLimit(clockNanos() + 1000000000ULL);
+    try {
+	setup();
+	check(true, "setup finished without the barometer");
+    }
+    catch (Clock_Limit &) {
+	check(false, "setup finished without the barometer");
+	return 1;
+    }
+
+    // The accelerometer range is set before streaming and must survive it being set up again
+    uint8_t request[CONFIG_REQUEST_MAX];
+    size_t size = encodeSetRange(ACC, MMA8452Q_Accelerometer::MAX_8G, request);
+    Serial.received.insert(Serial.received.end(), request, request + size);
+
+    uint64_t start = clockNanos();
+    std::vector<Event> events;
+    Event script[] = {
+	{ STREAM_START, startStream },
+	{ BAROMETER_BACK, barometerBack },
+	{ BUS_HANG, hangBus },
+	{ BUS_ERROR, breakBus },
+	{ ACCELEROMETER_LOST, loseAccelerometer },
+	{ ACCELEROMETER_BACK, accelerometerBack },
+	{ STREAM_END, endStream },
+	{ HEALTH_REQUEST, requestHealth }
+    };
+    for (size_t i = 0; i < sizeof(script) / sizeof(script[0]); ++i) {
+	script[i].time = start + script[i].time * 1000000ULL;
+	events.push_back(script[i]);
+    }
+    Fault_Script faults(board, events);
+
+    // loop() never returns, it is stopped once the health frame has had time to go out
+    setClockLimit(start + RUN_END * 1000000ULL);
+    try {
+	loop();
+    }
+    catch (Clock_Limit &) {
+    }
+    setClockLimit(CLOCK_IDLE);
+
+    Counts counts = Counts();
+    counts.start = start / 1000 + STREAM_START * 1000;
+    counts.faulted = start / 1000 + BUS_HANG * 1000;
+    counts.settled = start / 1000 + (ACCELEROMETER_BACK + SENSOR_RETRY) * 1000;
+    counts.end = start / 1000 + STREAM_END * 1000;
+    Sensor_Stream stream(countReading, &counts);
+    stream.setHealthHandler(keepHealth, &counts);
+    stream.feed(&Serial.transmitted[0], Serial.transmitted.size());
+
+    printf("stream through the faults, %lu samples\n", counts.readings);
+    // The rate once every sensor is back is the rate before the faults
+    double before = counts.before / ((counts.faulted - counts.start) * 1e-6);
+    double after = counts.after / ((counts.end - counts.settled) * 1e-6);
+    char what[128];
+    snprintf(what, sizeof(what), "%.0f samples/s before the faults, %.0f after", before, after);
+    check(after > 0.95 * before, what);
+    check(stream.malformed == 0 && stream.framingErrors() == 0, "every frame decoded");
+    check(stream.lost == 0, "no samples lost");
+    // The accelerometer is gone for its outage and until the next try to set it up
+    double outage = counts.without_acc * 1e-6;
+    snprintf(what, sizeof(what), "accelerometer missing for %.2f s", outage);
+    check(outage > (ACCELEROMETER_BACK - ACCELEROMETER_LOST) * 0.9e-3 &&
+	  outage < (ACCELEROMETER_BACK - ACCELEROMETER_LOST + SENSOR_RETRY) * 1e-3 + 0.1,
+	  what);
+    snprintf(what, sizeof(what), "barometer back, %lu readings", counts.baro);
+    check(counts.baro != 0, what);
+    check((board.accelerometer.registers[ACCELEROMETER_RANGE] & 0x03) == 2,
+	  "accelerometer still at 8 g");
+
+    printf("health\n");
+    check(counts.reported, "health frame sent");
+    if (!counts.reported) {
+	printf("%d checks failed\n", failures);
+	return 1;
+    }
+    const Board_Health & health = counts.health;
+    snprintf(what, sizeof(what), "%lu bus recoveries", health.recoveries - recoveries);
+    check(health.recoveries == recoveries + 1, what);
+    unsigned total = 0;
+    for (int i = 0; i < HEALTH_SENSORS; ++i)
+	total += health.sensor[i].failures;
+    snprintf(what, sizeof(what), "%u failed reads", total);
+    check(total >= 3, what);
+    snprintf(what, sizeof(what), "accelerometer: %u setups, last error %s",
+	     health.sensor[0].setups, busErrorText(health.sensor[0].last_error));
+    check(health.sensor[0].setups >= 2 &&
+	  health.sensor[0].last_error == ADDRESS_NO_ACKNOWLEDGE, what);
+    snprintf(what, sizeof(what), "barometer: %u setups", health.sensor[2].setups);
+    check(health.sensor[2].setups >= 1, what);
+    check(health.down == 0, "no sensor down");
+
+    printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
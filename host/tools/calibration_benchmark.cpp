@@ -0,0 +1,248 @@
+// Times the calibration on a made up capture of several hours: the board rests in a random
+// position, turns about an axis across gravity at a steady rate, rests again and so on, with
+// known scale, alignment and bias errors applied to what it records. The running variance is
+// compared with the window by window variance of calibration.m, and the fits are run on one
+// thread and on every core and checked against the errors the capture was made with. Given a
+// file name the capture is also written there as an Android application CSV log, with a header
+// line, so analysis/calibration.m and imu_calibrate can be run on the same data.
+//
+// $ build/tools/calibration_benchmark [hours [capture.csv]]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "Imu_Calibration.h"
+
+#define SAMPLE_RATE 200
+#define REST_SAMPLES (20 * SAMPLE_RATE)
+#define TURN_SAMPLES (3 * SAMPLE_RATE)
+#define ACC_NOISE 0.02
+#define TURN_ACC_NOISE 0.5
+#define GYRO_NOISE 0.05
+
+// Largest difference allowed between a fitted and a true parameter
+#define FIT_TOLERANCE 2e-3
+
+// Errors the capture is made with, in the parameter layout of Imu_Calibration.h
+static const double true_accelerometer[CALIBRATION_PARAMETERS] =
+    { 1.02, 0.97, 1.01, 0.012, -0.021, 0.015, 0.11, -0.07, 0.19 };
+static const double true_gyroscope[CALIBRATION_PARAMETERS] =
+    { 0.98, 1.03, 1.01, 0.02, -0.015, 0.01, -0.012, 0.018, 0.025 };
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Uniform in [0, 1) and standard normal
+static double uniform()
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static double normal()
+{
+    return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+static void invert(const double m[3][3], double inverse[3][3])
+{
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+	m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+	m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    for (int i = 0; i < 3; ++i)
+	for (int j = 0; j < 3; ++j) {
+	    int r0 = (j + 1) % 3, r1 = (j + 2) % 3, c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+	    inverse[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+	}
+}
+
+static void multiply(const double m[3][3], const double * v, double * result)
+{
+    for (int i = 0; i < 3; ++i)
+	result[i] = m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2];
+}
+
+// Rotate 'v' by the unit quaternion 'q'
+static void rotate(const double * q, const double * v, double * result)
+{
+    const double * u = q + 1;
+    double t[3] = { 2 * (u[1] * v[2] - u[2] * v[1]), 2 * (u[2] * v[0] - u[0] * v[2]),
+		    2 * (u[0] * v[1] - u[1] * v[0]) };
+    result[0] = v[0] + q[0] * t[0] + u[1] * t[2] - u[2] * t[1];
+    result[1] = v[1] + q[0] * t[1] + u[2] * t[0] - u[0] * t[2];
+    result[2] = v[2] + q[0] * t[2] + u[0] * t[1] - u[1] * t[0];
+}
+
+static void makeCapture(std::vector<Imu_Sample> & samples, double gravity, double hours)
+{
+    double acc_correction[3][3], acc_bias[3], acc_inverse[3][3];
+    double gyro_correction[3][3], gyro_inverse[3][3];
+    accelerometerCorrection(true_accelerometer, acc_correction, acc_bias);
+    gyroscopeCorrection(true_gyroscope, gyro_correction);
+    invert(acc_correction, acc_inverse);
+    invert(gyro_correction, gyro_inverse);
+
+    // Record one sample from the true acceleration and rotation rate
+    auto record = [&](const double * acc, const double * rate) {
+	Imu_Sample sample;
+	sample.delta = 1.0 / SAMPLE_RATE;
+	double unbiased[3];
+	for (int i = 0; i < 3; ++i)
+	    unbiased[i] = acc[i] - acc_bias[i];
+	multiply(acc_inverse, unbiased, sample.acc);
+	multiply(gyro_inverse, rate, sample.gyro);
+	for (int i = 0; i < 3; ++i)
+	    sample.gyro[i] = sample.gyro[i] * 180 / M_PI + GYRO_NOISE * normal();
+	samples.push_back(sample);
+    };
+
+    srand(1);
+    const size_t count = (size_t)(hours * 3600 * SAMPLE_RATE);
+    samples.clear();
+    samples.reserve(count + REST_SAMPLES + TURN_SAMPLES);
+    double down[3] = { 0, 0, gravity };
+    const double still[3] = { 0, 0, 0 };
+    while (samples.size() < count) {
+	for (int k = 0; k < REST_SAMPLES; ++k) {
+	    double acc[3];
+	    for (int i = 0; i < 3; ++i)
+		acc[i] = down[i] + ACC_NOISE * normal();
+	    record(acc, still);
+	}
+
+	// Turn about a random axis across gravity, integrated the way the fit integrates
+	double axis[3] = { normal(), normal(), normal() }, along = 0, length = 0;
+	for (int i = 0; i < 3; ++i)
+	    along += axis[i] * down[i] / gravity;
+	for (int i = 0; i < 3; ++i) {
+	    axis[i] -= along * down[i] / gravity;
+	    length += axis[i] * axis[i];
+	}
+	double speed = (0.5 + 2.5 * uniform()) * SAMPLE_RATE / TURN_SAMPLES;
+	double rate[3], q[4] = { 1, 0, 0, 0 }, start[3];
+	memcpy(start, down, sizeof(start));
+	for (int i = 0; i < 3; ++i)
+	    rate[i] = axis[i] / sqrt(length) * speed;
+	for (int k = 0; k < TURN_SAMPLES; ++k) {
+	    double acc[3];
+	    rotate(q, start, down);
+	    for (int i = 0; i < 3; ++i)
+		acc[i] = down[i] + TURN_ACC_NOISE * normal();
+	    record(acc, rate);
+
+	    double half = 0.5 / SAMPLE_RATE, norm = 0;
+	    double step[4] = { -q[1] * rate[0] - q[2] * rate[1] - q[3] * rate[2],
+			       q[0] * rate[0] + q[2] * rate[2] - q[3] * rate[1],
+			       q[0] * rate[1] - q[1] * rate[2] + q[3] * rate[0],
+			       q[0] * rate[2] + q[1] * rate[1] - q[2] * rate[0] };
+	    for (int i = 0; i < 4; ++i) {
+		q[i] += half * step[i];
+		norm += q[i] * q[i];
+	    }
+	    for (int i = 0; i < 4; ++i)
+		q[i] /= sqrt(norm);
+	}
+	rotate(q, start, down);
+    }
+}
+
+static bool writeCapture(const std::vector<Imu_Sample> & samples, const char * path)
+{
+    FILE * file = fopen(path, "w");
+    if (!file)
+	return false;
+    fprintf(file, "delta,acc_x,acc_y,acc_z,gyro_x,gyro_y,gyro_z,altitude,temperature,light\n");
+    for (size_t i = 0; i < samples.size(); ++i) {
+	const Imu_Sample & sample = samples[i];
+	fprintf(file, "%.0f,%.7g,%.7g,%.7g,%.7g,%.7g,%.7g,1655,20,50\n", sample.delta * 1e6,
+		sample.acc[0], sample.acc[1], sample.acc[2], sample.gyro[0], sample.gyro[1],
+		sample.gyro[2]);
+    }
+    return fclose(file) == 0;
+}
+
+// Largest difference between fitted and true parameters
+static double fitError(const Calibration_Fit & fit, const double * truth)
+{
+    double error = 0;
+    for (int i = 0; i < CALIBRATION_PARAMETERS; ++i)
+	error = fmax(error, fabs(fit.p[i] - truth[i]));
+    return error;
+}
+
+int main(int argc, char ** argv)
+{
+    double hours = argc > 1 ? atof(argv[1]) : 3;
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+	cores = 1;
+    bool failed = false;
+
+    Imu_Calibration calibration;
+    std::vector<Imu_Sample> samples;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    makeCapture(samples, calibration.gravity, hours);
+    printf("%.1f hour capture, %zu samples at %d Hz, %zu positions (%.2f s to make)\n", hours,
+	   samples.size(), SAMPLE_RATE, samples.size() / (REST_SAMPLES + TURN_SAMPLES),
+	   since(start));
+    if (argc > 2 && !writeCapture(samples, argv[2])) {
+	fprintf(stderr, "%s: can not write %s\n", argv[0], argv[2]);
+	return 1;
+    }
+
+    // Static variance, window by window and running
+    std::vector<double> direct, running;
+    start = std::chrono::steady_clock::now();
+    staticVarianceDirect(samples, calibration.width, direct);
+    double direct_seconds = since(start);
+    start = std::chrono::steady_clock::now();
+    staticVariance(samples, calibration.width, running, 1);
+    double running_seconds = since(start);
+    start = std::chrono::steady_clock::now();
+    staticVariance(samples, calibration.width, running, cores);
+    double parallel_seconds = since(start);
+    double difference = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+	difference = fmax(difference, fabs(running[i] - direct[i]) / fmax(direct[i], 1e-3));
+    printf("variance, width %u: window by window %.3f s, running %.3f s (%.0fx), "
+	   "%u threads %.3f s, largest relative difference %.2g\n", calibration.width,
+	   direct_seconds, running_seconds, direct_seconds / running_seconds, cores,
+	   parallel_seconds, difference);
+    if (difference > 1e-6) {
+	printf("FAILED: running variance differs from the window by window variance\n");
+	failed = true;
+    }
+
+    // Both fits on one thread and on every core
+    double seconds[2];
+    unsigned threads[2] = { 1, cores };
+    for (int run = 0; run < 2; ++run) {
+	calibration.threads = threads[run];
+	start = std::chrono::steady_clock::now();
+	if (!calibration.calibrate(samples)) {
+	    printf("FAILED: %zu static periods found\n", calibration.intervals.size());
+	    return 1;
+	}
+	seconds[run] = since(start);
+    }
+    printf("calibration, %zu static periods: %.3f s on 1 thread, %.3f s on %u (%.1fx)\n",
+	   calibration.intervals.size(), seconds[0], seconds[1], cores, seconds[0] / seconds[1]);
+
+    const char * names[2] = { "accelerometer", "gyroscope" };
+    const Calibration_Fit * fits[2] = { &calibration.accelerometer, &calibration.gyroscope };
+    const double * truths[2] = { true_accelerometer, true_gyroscope };
+    for (int i = 0; i < 2; ++i) {
+	double error = fitError(*fits[i], truths[i]);
+	printf("%s: %u iterations, rms residual %.3g, largest parameter error %.2g\n", names[i],
+	       fits[i]->iterations, fits[i]->rms, error);
+	if (error > FIT_TOLERANCE) {
+	    printf("FAILED: %s parameters are off by more than %g\n", names[i], FIT_TOLERANCE);
+	    failed = true;
+	}
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// Fuzzes and times the COBS framed protocol variant. A long stream of batched and single
+// sample frames is encoded, decoded back and compared, then decoded again after random bit
+// flips, dropped bytes and inserted bytes to check corrupted frames are dropped by the CRC or
+// the encoding checks rather than handed on with wrong data. The bytes per sample are printed
+// next to the DLE framing for comparison.
+//
+// $ build/tools/cobs_benchmark [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "Sensor_Frames.h"
+
+#define SAMPLE_PERIOD 2500
+#define BAROMETER_DIVISOR 100
+#define LIGHT_DIVISOR 100
+
+#define STREAM_SAMPLES 200000
+#define FUZZ_ROUNDS 20
+
+// Simulated sensor stream, raw bytes are random so zero and DLE bytes turn up at their natural
+// rate
+static void makeSamples(std::vector<Sensor_Sample> & samples)
+{
+    for (size_t i = 0; i < samples.size(); ++i) {
+	Sensor_Sample & sample = samples[i];
+	memset(&sample, 0, sizeof(sample));
+	sample.sensors = ACC | GYRO;
+	if (i % BAROMETER_DIVISOR == 0)
+	    sample.sensors |= BARO;
+	if (i % LIGHT_DIVISOR == 0)
+	    sample.sensors |= PHT;
+	sample.sequence = i;
+	sample.time = i * SAMPLE_PERIOD;
+	for (int j = 0; j < ACC_PAYLOAD; ++j)
+	    sample.acc[j] = rand();
+	for (int j = 0; j < GYRO_PAYLOAD; ++j)
+	    sample.gyro[j] = rand();
+	for (int j = 0; j < BARO_PAYLOAD; ++j)
+	    sample.baro[j] = rand();
+	for (int j = 0; j < PHT_PAYLOAD; ++j)
+	    sample.light[j] = rand();
+    }
+}
+
+static bool sameSample(const Sensor_Sample & a, const Sensor_Sample & b)
+{
+    if (a.sensors != b.sensors || a.sequence != b.sequence || a.time != b.time)
+	return false;
+    if ((a.sensors & ACC) && memcmp(a.acc, b.acc, ACC_PAYLOAD))
+	return false;
+    if ((a.sensors & GYRO) && memcmp(a.gyro, b.gyro, GYRO_PAYLOAD))
+	return false;
+    if ((a.sensors & BARO) && memcmp(a.baro, b.baro, BARO_PAYLOAD))
+	return false;
+    if ((a.sensors & PHT) && memcmp(a.light, b.light, PHT_PAYLOAD))
+	return false;
+    return true;
+}
+
+// Decode a stream of batched frames, counting samples that match 'expected' at the position
+// their start time gives and frames holding any sample that does not
+static void decodeBatches(const std::vector<uint8_t> & stream,
+			  const std::vector<Sensor_Sample> & expected, Cobs_Decoder & decoder,
+			  size_t & good, size_t & bad)
+{
+    static Sensor_Sample samples[255];
+    for (size_t i = 0; i < stream.size(); ++i) {
+	if (!decoder.push(stream[i]))
+	    continue;
+	uint16_t period;
+	int count = parseBatchFrame(decoder.frame(), decoder.size(), samples, period);
+	if (count < 0) {
+	    bad += 1;
+	    continue;
+	}
+	bool wrong = false;
+	for (int j = 0; j < count; ++j) {
+	    size_t index = samples[j].time / SAMPLE_PERIOD;
+	    if (period == SAMPLE_PERIOD && samples[j].time % SAMPLE_PERIOD == 0 &&
+		index < expected.size() && sameSample(samples[j], expected[index]))
+		good += 1;
+	    else
+		wrong = true;
+	}
+	if (wrong)
+	    bad += 1;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned seed = argc > 1 ? atoi(argv[1]) : 1;
+    srand(seed);
+
+    std::vector<Sensor_Sample> samples(STREAM_SAMPLES);
+    makeSamples(samples);
+    bool failed = false;
+
+    // Single sample frames in both framings
+    std::vector<uint8_t> stream(STREAM_SAMPLES * COBS_SINGLE_FRAME_MAX);
+    size_t dle_bytes = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+	dle_bytes += encodeSingleFrame(samples[i], &stream[0]);
+    size_t bytes = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+	bytes += encodeCobsSingleFrame(samples[i], &stream[bytes]);
+    printf("single     DLE %6.2f COBS %6.2f bytes/sample\n", (double)dle_bytes / samples.size(),
+	   (double)bytes / samples.size());
+
+    Cobs_Decoder single_decoder;
+    size_t decoded = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+	if (!single_decoder.push(stream[i]))
+	    continue;
+	Sensor_Sample sample;
+	if (parseSingleFrame(single_decoder.frame(), single_decoder.size(), sample) != 1 ||
+	    !sameSample(sample, samples[decoded++]))
+	    failed = true;
+    }
+    if (decoded != samples.size())
+	failed = true;
+
+    // Batched frames, timed
+    size_t frames = samples.size() / BATCH_SIZE;
+    stream.resize(frames * COBS_BATCH_FRAME_MAX(BATCH_SIZE));
+    dle_bytes = 0;
+    std::vector<uint8_t> dle_frame(BATCH_FRAME_MAX(BATCH_SIZE));
+    for (size_t f = 0; f < frames; ++f)
+	dle_bytes += encodeBatchFrame(&samples[f * BATCH_SIZE], BATCH_SIZE, SAMPLE_PERIOD,
+				      &dle_frame[0]);
+
+    auto encode_start = std::chrono::steady_clock::now();
+    bytes = 0;
+    for (size_t f = 0; f < frames; ++f)
+	bytes += encodeCobsBatchFrame(&samples[f * BATCH_SIZE], BATCH_SIZE, SAMPLE_PERIOD,
+				      &stream[bytes]);
+    auto encode_end = std::chrono::steady_clock::now();
+    stream.resize(bytes);
+
+    Cobs_Decoder decoder;
+    size_t good = 0, bad = 0;
+    decodeBatches(stream, samples, decoder, good, bad);
+    auto decode_end = std::chrono::steady_clock::now();
+    if (good != frames * BATCH_SIZE || bad || decoder.crc_errors || decoder.encoding_errors)
+	failed = true;
+
+    printf("batch %-4d DLE %6.2f COBS %6.2f bytes/sample\n", BATCH_SIZE,
+	   (double)dle_bytes / (frames * BATCH_SIZE), (double)bytes / (frames * BATCH_SIZE));
+    double encode_seconds = std::chrono::duration<double>(encode_end - encode_start).count();
+    double decode_seconds = std::chrono::duration<double>(decode_end - encode_end).count();
+    printf("           encode %8.1f MB/s decode %8.1f MB/s\n", bytes / encode_seconds / 1e6,
+	   bytes / decode_seconds / 1e6);
+
+    // Corrupt the batched stream and make sure nothing wrong gets through
+    size_t corrupted_good = 0, corrupted_bad = 0;
+    unsigned long crc_errors = 0, encoding_errors = 0;
+    for (int round = 0; round < FUZZ_ROUNDS; ++round) {
+	std::vector<uint8_t> corrupted;
+	corrupted.reserve(stream.size());
+	for (size_t i = 0; i < stream.size(); ++i) {
+	    int event = rand() % 2000;
+	    if (event == 0)
+		continue;
+	    if (event == 1)
+		corrupted.push_back(rand());
+	    if (event == 2)
+		corrupted.push_back(stream[i] ^ (1 << (rand() % 8)));
+	    else
+		corrupted.push_back(stream[i]);
+	}
+	Cobs_Decoder fuzz_decoder;
+	decodeBatches(corrupted, samples, fuzz_decoder, corrupted_good, corrupted_bad);
+	crc_errors += fuzz_decoder.crc_errors;
+	encoding_errors += fuzz_decoder.encoding_errors;
+    }
+    printf("fuzz       %lu CRC errors %lu encoding errors %zu samples kept %zu wrong frames\n",
+	   crc_errors, encoding_errors, corrupted_good, corrupted_bad);
+    // A CRC-16 lets about one in 65536 corrupted frames through, only fail on many more
+    size_t corrupted_frames = crc_errors + encoding_errors + corrupted_bad;
+    if (corrupted_bad > 2 + corrupted_frames / 8192)
+	failed = true;
+
+    if (failed) {
+	printf("decoded samples do not match the encoded samples\n");
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Measures the compressed frames against plain batched frames. Samples are read from a recorded
+// trace, the bytes captured from the board's serial port in any of its DLE framed streams (for
+// example 'cat /dev/rfcomm0 > trace.bin' while streaming), or made up as a board at rest with
+// sensor noise and slow motion when no trace is given. Every compressed frame is decoded back
+// and compared with the samples it was made from.
+//
+// $ build/tools/compression_benchmark [trace.bin]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "Sensor_Frames.h"
+
+#define BAUD_RATE 115200
+#define BYTES_PER_SECOND (BAUD_RATE / 10)
+
+// Made up trace, 800 Hz with the barometer and light sensor at 8 Hz
+#define SYNTHETIC_SAMPLES 200000
+#define SYNTHETIC_PERIOD 1250
+#define SLOW_DIVISOR 100
+
+// Times the decode loop is repeated so short traces still give a steady figure
+#define DECODE_REPEATS 20
+
+static void setAxes(uint8_t * payload, const int16_t * axes)
+{
+    for (int i = 0; i < 3; ++i) {
+	payload[2 * i] = axes[i];
+	payload[2 * i + 1] = (uint16_t)axes[i] >> 8;
+    }
+}
+
+// Board lying still then being turned slowly, in raw sensor counts (1 g is 1024 counts at the
+// 2 g range, 1 deg/s is about 114 counts at 250 deg/s)
+static void makeSamples(std::vector<Sensor_Sample> & samples)
+{
+    samples.resize(SYNTHETIC_SAMPLES);
+    srand(1);
+    for (size_t i = 0; i < samples.size(); ++i) {
+	Sensor_Sample & sample = samples[i];
+	memset(&sample, 0, sizeof(sample));
+	double t = i * SYNTHETIC_PERIOD * 1e-6;
+	double angle = 0.5 * sin(2 * M_PI * 0.2 * t);
+	double rate = 0.5 * 2 * M_PI * 0.2 * cos(2 * M_PI * 0.2 * t) * 180 / M_PI;
+
+	int16_t acc[3] = {
+	    (int16_t)(1024 * sin(angle) + rand() % 7 - 3),
+	    (int16_t)(rand() % 7 - 3),
+	    (int16_t)(1024 * cos(angle) + rand() % 7 - 3)
+	};
+	int16_t gyro[3] = {
+	    (int16_t)(rand() % 31 - 15),
+	    (int16_t)(114 * rate + rand() % 31 - 15),
+	    (int16_t)(rand() % 31 - 15)
+	};
+	sample.sensors = ACC | GYRO;
+	sample.sequence = i;
+	sample.time = i * SYNTHETIC_PERIOD;
+	setAxes(sample.acc, acc);
+	setAxes(sample.gyro, gyro);
+	if (i % SLOW_DIVISOR == 0) {
+	    sample.sensors |= BARO | PHT;
+	    for (int j = 0; j < BARO_PAYLOAD; ++j)
+		sample.baro[j] = rand();
+	    for (int j = 0; j < PHT_PAYLOAD; ++j)
+		sample.light[j] = rand();
+	}
+    }
+}
+
+// Decode every frame of a recorded DLE framed stream into samples
+static bool loadTrace(const char * path, std::vector<Sensor_Sample> & samples)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+	return false;
+    static Dle_Decoder decoder;
+    static Sensor_Sample frame_samples[255];
+    int value;
+    while ((value = fgetc(file)) != EOF) {
+	if (!decoder.push(value))
+	    continue;
+	if (decoder.frame()[0] == STX) {
+	    Sensor_Sample sample;
+	    if (parseSingleFrame(decoder.frame(), decoder.size(), sample) != 1)
+		continue;
+	    samples.push_back(sample);
+	}
+	else {
+	    uint16_t period;
+	    int count = parseBatchFrame(decoder.frame(), decoder.size(), frame_samples, period);
+	    for (int i = 0; i < count; ++i)
+		samples.push_back(frame_samples[i]);
+	}
+    }
+    fclose(file);
+    printf("trace      %zu samples, %lu broken frames\n", samples.size(), decoder.errors);
+    return true;
+}
+
+static bool sameSample(const Sensor_Sample & a, const Sensor_Sample & b)
+{
+    if (a.sensors != b.sensors)
+	return false;
+    if ((a.sensors & ACC) && memcmp(a.acc, b.acc, ACC_PAYLOAD))
+	return false;
+    if ((a.sensors & GYRO) && memcmp(a.gyro, b.gyro, GYRO_PAYLOAD))
+	return false;
+    if ((a.sensors & BARO) && memcmp(a.baro, b.baro, BARO_PAYLOAD))
+	return false;
+    if ((a.sensors & PHT) && memcmp(a.light, b.light, PHT_PAYLOAD))
+	return false;
+    return true;
+}
+
+static void report(const char * name, size_t bytes, size_t samples, size_t base)
+{
+    double per_sample = (double)bytes / samples;
+    printf("%-10s %8.2f bytes/sample %8.0f samples/s at %d baud  ratio %.2f\n", name,
+	   per_sample, BYTES_PER_SECOND / per_sample, BAUD_RATE, (double)base / bytes);
+}
+
+int main(int argc, char ** argv)
+{
+    std::vector<Sensor_Sample> samples;
+    if (argc > 1) {
+	if (!loadTrace(argv[1], samples)) {
+	    printf("could not read %s\n", argv[1]);
+	    return 1;
+	}
+    }
+    else
+	makeSamples(samples);
+    size_t frames = samples.size() / BATCH_SIZE;
+    if (frames == 0) {
+	printf("not enough samples\n");
+	return 1;
+    }
+    size_t total = frames * BATCH_SIZE;
+    uint16_t period = (samples[total - 1].time - samples[0].time) / (total - 1);
+
+    std::vector<uint8_t> stream(frames * COMPRESSED_FRAME_MAX(BATCH_SIZE));
+    size_t single_bytes = 0;
+    for (size_t i = 0; i < total; ++i)
+	single_bytes += encodeSingleFrame(samples[i], &stream[0]);
+    size_t batch_bytes = 0;
+    for (size_t f = 0; f < frames; ++f)
+	batch_bytes += encodeBatchFrame(&samples[f * BATCH_SIZE], BATCH_SIZE, period, &stream[0]);
+    size_t bytes = 0;
+    for (size_t f = 0; f < frames; ++f)
+	bytes += encodeCompressedFrame(&samples[f * BATCH_SIZE], BATCH_SIZE, period,
+				       &stream[bytes]);
+
+    report("single", single_bytes, total, single_bytes);
+    report("batch", batch_bytes, total, single_bytes);
+    report("compressed", bytes, total, single_bytes);
+
+    // Decode the compressed stream, checking it the first time through
+    bool failed = false;
+    static Sensor_Sample decoded[255];
+    size_t checked = 0;
+    auto decode_start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < DECODE_REPEATS; ++repeat) {
+	Dle_Decoder decoder;
+	for (size_t i = 0; i < bytes; ++i) {
+	    if (!decoder.push(stream[i]))
+		continue;
+	    int count = parseBatchFrame(decoder.frame(), decoder.size(), decoded, period);
+	    if (count != BATCH_SIZE)
+		failed = true;
+	    if (repeat != 0)
+		continue;
+	    for (int j = 0; j < count; ++j)
+		if (!sameSample(decoded[j], samples[checked++]))
+		    failed = true;
+	}
+    }
+    auto decode_end = std::chrono::steady_clock::now();
+    if (checked != total)
+	failed = true;
+
+    double seconds = std::chrono::duration<double>(decode_end - decode_start).count();
+    printf("           decode %8.1f MB/s %8.2f M samples/s\n",
+	   bytes * DECODE_REPEATS / seconds / 1e6, total * DECODE_REPEATS / seconds / 1e6);
+
+    if (failed) {
+	printf("decoded samples do not match the encoded samples\n");
+	return 1;
+    }
+    return 0;
+}
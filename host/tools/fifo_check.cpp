@@ -0,0 +1,196 @@
+// Checks that the sketch built with BAROMETER_FIFO and GYRO_FIFO sends every sample the
+// barometer and gyroscope buffer and counts the samples their FIFOs lose. The sketch is run on
+// the simulated board and streams batched frames twice. The first stream starts right after
+// setup, so every sample the barometer converts while it runs must arrive, drained from F_DATA
+// and sent once each, and every sample of the gyroscope's 800 Hz output too, but for the few
+// still in its FIFO at the end. The board then sits idle long enough for both FIFOs to fill
+// and lose samples, which the drivers must count once the second stream drains them, sending
+// the full FIFOs' worth of samples. The padding that closes each stream's last frame must
+// not come out as readings or as samples lost between the streams. Prints each step and exits
+// with 1 if any check failed.
+//
+// $ build/tools/fifo_check
+
+#include <stdio.h>
+#include <vector>
+#include "Arduino.h"
+#include "Virtual_Clock.h"
+#include "Board_Simulator.h"
+#include "Sensor_Protocol.h"
+#include "Sensor_Stream.h"
+#include "L3G4200D_Gyroscope.h"
+#include "MPL3115A2_Barometer.h"
+
+// The sketch's entry points, gyroscope and barometer
+void setup();
+void loop();
+extern L3G4200D_Gyroscope gyrometer;
+extern MPL3115A2_Barometer barometer;
+
+// Board sensor indexes of the gyroscope and barometer, and the depths of their FIFOs
+#define GYROSCOPE 1
+#define BAROMETER 2
+#define GYROSCOPE_FIFO_SIZE 32
+#define BAROMETER_FIFO_SIZE 32
+// Gyroscope samples that can be left drained or in its FIFO when a stream ends, the sketch's
+// GYRO_BACKLOG and the most a drain holds
+#define GYROSCOPE_BACKLOG (8 + L3G4200D_FIFO_DEPTH)
+
+// Virtual milliseconds after setup at which each stream starts and ends, with time between
+// them for the barometer's FIFO to overflow at one sample a second
+#define FIRST_START 100
+#define FIRST_END 10100
+#define SECOND_START 50100
+#define SECOND_END 53100
+#define RUN_END 53300
+
+static int failures;
+
+static void check(bool passed, const char * what)
+{
+    printf("  %-56s %s\n", what, passed ? "ok" : "FAILED");
+    if (!passed)
+	failures += 1;
+}
+
+// Samples the board had latched, bytes the sketch had sent and the samples the drivers had
+// counted their FIFOs losing at a stream start or end
+struct Mark
+{
+    unsigned long samples[BOARD_SENSORS];
+    size_t sent;
+    unsigned gyroscope_overruns, barometer_overflows;
+};
+
+// Starts and ends the streams as the virtual clock reaches each time, marking the board there
+class Stream_Script : public Clock_Source {
+private:
+    const Board_Simulator & board;
+    uint64_t start;
+    int next;
+
+public:
+    static const int EVENTS = 4;
+    Mark marks[EVENTS];
+
+    Stream_Script(const Board_Simulator & simulator, uint64_t begun)
+	: board(simulator), start(begun), next(0) { addClockSource(*this); }
+    virtual ~Stream_Script() { removeClockSource(*this); }
+
+    virtual uint64_t nextEvent()
+    {
+	static const uint64_t times[EVENTS] = {
+	    FIRST_START, FIRST_END, SECOND_START, SECOND_END
+	};
+	return next < EVENTS ? start + times[next] * 1000000ULL : CLOCK_IDLE;
+    }
+    virtual void fire()
+    {
+	for (int i = 0; i < BOARD_SENSORS; ++i)
+	    marks[next].samples[i] = board.samples[i];
+	marks[next].sent = Serial.transmitted.size();
+	marks[next].gyroscope_overruns = gyrometer.fifo_overruns;
+	marks[next].barometer_overflows = barometer.fifo_overflows;
+	Serial.received.push_back(next % 2 == 0 ? START_BATCH_STREAM : END_STREAM);
+	next += 1;
+    }
+};
+
+// Readings of each sensor in a stream
+struct Counts
+{
+    unsigned long readings, gyro, baro, empty;
+};
+
+static void countReading(const Sensor_Reading & reading, void * context)
+{
+    Counts & counts = *(Counts *)context;
+    counts.readings += 1;
+    counts.gyro += (reading.sensors & GYRO) != 0;
+    counts.baro += (reading.sensors & BARO) != 0;
+    counts.empty += reading.sensors == 0;
+}
+
+// Decode what the sketch sent from 'begin' to 'end' and count the readings, false if a frame
+// did not decode or a sample was lost
+static bool countStream(size_t begin, size_t end, Counts & counts)
+{
+    counts = Counts();
+    Sensor_Stream stream(countReading, &counts);
+    stream.feed(&Serial.transmitted[begin], end - begin);
+    return stream.malformed == 0 && stream.framingErrors() == 0 && stream.lost == 0;
+}
+
+int main()
+{
+    Board_Simulator board;
+    setClockLimit(clockNanos() + 1000000000ULL);
+    try {
+	setup();
+    }
+    catch (Clock_Limit &) {
+	fprintf(stderr, "setup() did not finish\n");
+	return 1;
+    }
+
+    uint64_t start = clockNanos();
+    Stream_Script script(board, start);
+    setClockLimit(start + RUN_END * 1000000ULL);
+    try {
+	loop();
+    }
+    catch (Clock_Limit &) {
+    }
+    setClockLimit(CLOCK_IDLE);
+    const Mark * marks = script.marks;
+    char what[128];
+
+    printf("stream from setup, %.0f s\n", (FIRST_END - FIRST_START) * 1e-3);
+    Counts first;
+    check(countStream(marks[0].sent, marks[2].sent, first), "every frame decoded, none lost");
+    unsigned long converted = marks[1].samples[BAROMETER] - marks[0].samples[BAROMETER];
+    snprintf(what, sizeof(what), "barometer: %lu converted, %lu sent", converted, first.baro);
+    // A conversion just before the end can still be in the FIFO
+    check(first.baro <= converted && first.baro + 1 >= converted && converted != 0, what);
+    check(marks[2].barometer_overflows == 0, "no barometer FIFO overflow");
+    converted = marks[1].samples[GYROSCOPE] - marks[0].samples[GYROSCOPE];
+    snprintf(what, sizeof(what), "gyroscope: %lu converted, %lu sent", converted, first.gyro);
+    // The FIFO filled between setup and the stream
+    check(first.gyro <= GYROSCOPE_FIFO_SIZE + converted &&
+	  first.gyro + GYROSCOPE_BACKLOG >= converted && converted != 0, what);
+    // A full FIFO is only learned of at the first drain, it loses one more sample before the
+    // second drain takes some out, and none after
+    check(marks[2].gyroscope_overruns >= 1 && marks[2].gyroscope_overruns <= 2,
+	  "gyroscope FIFO overruns only at the start");
+
+    printf("stream after %.0f s idle\n", (SECOND_START - FIRST_END) * 1e-3);
+    Counts second;
+    check(countStream(marks[2].sent, Serial.transmitted.size(), second),
+	  "every frame decoded, none lost");
+    unsigned overflows = barometer.fifo_overflows - marks[2].barometer_overflows;
+    snprintf(what, sizeof(what), "barometer FIFO overflow counted %u times", overflows);
+    check(overflows == 1, what);
+    converted = marks[3].samples[BAROMETER] - marks[2].samples[BAROMETER];
+    snprintf(what, sizeof(what), "barometer: full FIFO and %lu converted, %lu sent", converted,
+	     second.baro);
+    check(second.baro <= BAROMETER_FIFO_SIZE + converted &&
+	  second.baro + 1 >= BAROMETER_FIFO_SIZE + converted, what);
+    overflows = gyrometer.fifo_overruns - marks[2].gyroscope_overruns;
+    snprintf(what, sizeof(what), "gyroscope FIFO overrun counted %u times", overflows);
+    check(overflows >= 1 && overflows <= 2, what);
+    converted = marks[3].samples[GYROSCOPE] - marks[2].samples[GYROSCOPE];
+    snprintf(what, sizeof(what), "gyroscope: full FIFO and %lu converted, %lu sent", converted,
+	     second.gyro);
+    check(second.gyro <= GYROSCOPE_FIFO_SIZE + converted &&
+	  second.gyro + GYROSCOPE_BACKLOG >= GYROSCOPE_FIFO_SIZE + converted, what);
+
+    printf("stream ends\n");
+    check(first.empty == 0 && second.empty == 0, "no readings of the padding");
+    Counts both;
+    check(countStream(marks[0].sent, Serial.transmitted.size(), both) &&
+	  both.readings == first.readings + second.readings,
+	  "no samples lost between the streams");
+
+    printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+// Checks that the L3G4200D driver's single auto-increment burst read, STATUS_REG and the six
+// output registers in one transaction, returns the same bytes as the six separate register
+// reads it replaced. The driver is run against the register level model of the gyroscope on
+// the simulated bus, and for each of a set of made up rates, from zero to either end of the
+// scale, the model is given the sample once for each read mode. Both must give back the rates
+// the model was given, byte for byte, the burst read in a sixth of the transactions. The
+// status read with the burst must show new data and an overwritten sample as the model reports
+// them. Prints each step and exits with 1 if any check failed.
+//
+// $ build/tools/gyro_read_check
+
+#include <stdio.h>
+#include <string.h>
+#include "Arduino.h"
+#include "Virtual_Clock.h"
+#include "TWI_Simulator.h"
+#include "TWI_Queue.h"
+#include "L3G4200D_Gyroscope.h"
+#include "L3G4200D_Model.h"
+
+static int failures;
+
+static void check(bool passed, const char * what)
+{
+    printf("  %-56s %s\n", what, passed ? "ok" : "FAILED");
+    if (!passed)
+	failures += 1;
+}
+
+// Rates the model is given, in counts
+static const int16_t RATES[][3] = {
+    { 0, 0, 0 },
+    { 1, -1, 255 },
+    { 256, -256, 0x7F80 },
+    { 32767, -32768, -1 },
+    { 0x1234, -0x1234, 0x00FF },
+    { -300, 12000, -17 }
+};
+#define RATE_COUNT (int)(sizeof(RATES) / sizeof(RATES[0]))
+
+// Give the model a sample and read it back in 'mode', returning the error code and filling
+// 'bytes' with the axes as the driver stores them
+static byte readSample(L3G4200D_Gyroscope & gyrometer, L3G4200D_Model & model,
+		       L3G4200D_Gyroscope::mode mode, const int16_t * rates, char * bytes,
+		       unsigned long & starts)
+{
+    model.sample(rates[0], rates[1], rates[2]);
+    gyrometer.setReadMode(mode);
+    unsigned long before = twi_simulator.starts;
+    byte error = gyrometer.readData();
+    starts += twi_simulator.starts - before;
+    memcpy(bytes, gyrometer.data, 6);
+    return error;
+}
+
+int main()
+{
+    L3G4200D_Model model;
+    twi_simulator.attach(model);
+    L3G4200D_Gyroscope gyrometer;
+
+    printf("setup\n");
+    check(gyrometer.setup() == NO_ERROR, "gyroscope set up on the simulated bus");
+
+    printf("burst and per register reads\n");
+    unsigned long burst_starts = 0, register_starts = 0;
+    bool errors = false, same = true, exact = true;
+    for (int i = 0; i < RATE_COUNT; ++i)
+    {
+	char burst[6], separate[6];
+	errors |= readSample(gyrometer, model, L3G4200D_Gyroscope::BURST_READ, RATES[i], burst,
+			     burst_starts) != NO_ERROR;
+	errors |= readSample(gyrometer, model, L3G4200D_Gyroscope::PER_REGISTER_READ, RATES[i],
+			     separate, register_starts) != NO_ERROR;
+	same &= memcmp(burst, separate, 6) == 0;
+	for (int axis = 0; axis < 3; ++axis)
+	    exact &= gyrometer.gyro[axis] == RATES[i][axis];
+    }
+    char what[128];
+    snprintf(what, sizeof(what), "%d samples read both ways without errors", RATE_COUNT);
+    check(!errors, what);
+    check(same, "burst bytes match the per register bytes");
+    check(exact, "rates match what the model was given");
+    snprintf(what, sizeof(what), "%lu STARTs for the bursts, %lu one register at a time",
+	     burst_starts, register_starts);
+    check(burst_starts * 6 == register_starts, what);
+
+    printf("status read with the burst\n");
+    gyrometer.setReadMode(L3G4200D_Gyroscope::BURST_READ);
+    model.sample(1, 2, 3);
+    gyrometer.readData();
+    check(gyrometer.newData() && !gyrometer.overrun(), "fresh sample: new data, no overrun");
+    gyrometer.readData();
+    check(!gyrometer.newData(), "same sample again: no new data");
+    model.sample(4, 5, 6);
+    model.sample(7, 8, 9);
+    gyrometer.readData();
+    check(gyrometer.newData() && gyrometer.overrun() && gyrometer.gyro[0] == 7,
+	  "sample overwritten: overrun, newest sample read");
+
+    printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
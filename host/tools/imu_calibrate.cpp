@@ -0,0 +1,111 @@
+// Calibrates the accelerometer and gyroscope from a capture of the board being turned between
+// static positions, as analysis/calibration.m does, and prints the correction matrices and the
+// accelerometer bias in the form calibration.m leaves them. The capture is an Android
+// application CSV log or a binary sample log.
+//
+// $ build/tools/imu_calibrate [options] sensor4_calibration_c.csv
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "Imu_Calibration.h"
+
+static void usage(const char * program)
+{
+    fprintf(stderr,
+	    "usage: %s [options] capture\n"
+	    "  -w, --width N         samples in each variance window (default 100)\n"
+	    "  -t, --threads N       threads for the fits (default every core)\n"
+	    "  -g, --gravity G       local gravity in m/s^2 (default calibration.m's)\n"
+	    "  -i, --intervals       list the static periods found\n",
+	    program);
+}
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void printMatrix(const char * name, const double matrix[3][3])
+{
+    printf("%s =\n", name);
+    for (int i = 0; i < 3; ++i)
+	printf("  %12.8f %12.8f %12.8f\n", matrix[i][0], matrix[i][1], matrix[i][2]);
+}
+
+static void printFit(const char * name, const Calibration_Fit & fit)
+{
+    printf("%s fit: %u iterations, %s, rms residual %.6g\n", name, fit.iterations,
+	   fit.converged ? "converged" : "not converged", fit.rms);
+}
+
+int main(int argc, char ** argv)
+{
+    Imu_Calibration calibration;
+    calibration.threads = std::thread::hardware_concurrency();
+    if (calibration.threads == 0)
+	calibration.threads = 1;
+    bool list = false;
+
+    static const struct option options[] = {
+	{ "width", required_argument, 0, 'w' },
+	{ "threads", required_argument, 0, 't' },
+	{ "gravity", required_argument, 0, 'g' },
+	{ "intervals", no_argument, 0, 'i' },
+	{ 0, 0, 0, 0 }
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "w:t:g:i", options, 0)) != -1) {
+	switch (option) {
+	case 'w': calibration.width = atoi(optarg); break;
+	case 't': calibration.threads = atoi(optarg); break;
+	case 'g': calibration.gravity = atof(optarg); break;
+	case 'i': list = true; break;
+	default:
+	    usage(argv[0]);
+	    return 2;
+	}
+    }
+    if (optind + 1 != argc || calibration.width == 0) {
+	usage(argv[0]);
+	return 2;
+    }
+
+    std::vector<Imu_Sample> samples;
+    if (!loadImuSamples(argv[optind], samples)) {
+	fprintf(stderr, "%s: can not read %s\n", argv[0], argv[optind]);
+	return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool calibrated = calibration.calibrate(samples);
+    double seconds = since(start);
+
+    printf("%zu samples, %zu static periods, gravity %.6f m/s^2\n", samples.size(),
+	   calibration.intervals.size(), calibration.gravity);
+    if (list)
+	for (size_t i = 0; i < calibration.intervals.size(); ++i) {
+	    const double * mean = &calibration.means[3 * i];
+	    printf("  %zu-%zu: %.5f %.5f %.5f\n", calibration.intervals[i].first + 1,
+		   calibration.intervals[i].last + 1, mean[0], mean[1], mean[2]);
+	}
+    if (!calibrated) {
+	fprintf(stderr, "%s: too few static periods to fit %d parameters\n", argv[0],
+		CALIBRATION_PARAMETERS);
+	return 1;
+    }
+
+    double correction[3][3], bias[3];
+    accelerometerCorrection(calibration.accelerometer.p, correction, bias);
+    printFit("accelerometer", calibration.accelerometer);
+    printMatrix("accelerometer_correction", correction);
+    printf("accelerometer_bias =\n  %12.8f %12.8f %12.8f\n", bias[0], bias[1], bias[2]);
+    gyroscopeCorrection(calibration.gyroscope.p, correction);
+    printFit("gyroscope", calibration.gyroscope);
+    printMatrix("gyroscope_correction", correction);
+    printf("%.3f s on %u threads\n", seconds, calibration.threads);
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Compares the binary sample log with CSV logs in the Android application's layout. A made up
+// recording is written both ways, then loaded back: the binary log by mapping it and summing
+// every column in place, the CSV by parsing every value into memory as dlmread does. The
+// binary log is also converted to CSV and back to check nothing is lost beyond the rounding
+// of the CSV values.
+//
+// $ build/tools/log_benchmark [directory]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Sample_Log.h"
+
+#define LOG_SAMPLES 2000000
+#define SAMPLE_PERIOD 1250
+#define SLOW_DIVISOR 100
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static long fileSize(const std::string & path)
+{
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file)
+	return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static void makeReadings(std::vector<Sensor_Reading> & readings)
+{
+    srand(1);
+    for (size_t i = 0; i < readings.size(); ++i) {
+	Sensor_Reading & reading = readings[i];
+	memset(&reading, 0, sizeof(reading));
+	reading.sensors = ACC | GYRO | BARO | PHT;
+	reading.delta = SAMPLE_PERIOD;
+	reading.time = (i + 1) * SAMPLE_PERIOD;
+	for (int j = 0; j < 3; ++j) {
+	    reading.acc[j] = rand() % 4096 - 2048;
+	    reading.gyro[j] = rand() % 65536 - 32768;
+	}
+	reading.altitude = 1600 + rand() % 10;
+	reading.altitude_frac = rand() % 16;
+	reading.temperature = 20 + rand() % 5;
+	reading.temperature_frac = rand() % 16;
+	reading.light = rand() % 1024;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+    std::string binary_path = directory + "/log_benchmark.bslog";
+    std::string csv_path = directory + "/log_benchmark.csv";
+    std::string round_trip_path = directory + "/log_benchmark_round_trip.bslog";
+
+    std::vector<Sensor_Reading> readings(LOG_SAMPLES);
+    makeReadings(readings);
+    bool failed = false;
+
+    // Write
+    auto start = std::chrono::steady_clock::now();
+    Sample_Log_Writer writer;
+    failed |= !writer.open(binary_path);
+    for (size_t i = 0; i < readings.size(); ++i)
+	writer.append(readings[i]);
+    failed |= !writer.close();
+    double binary_write = since(start);
+
+    Sample_Log_Reader reader;
+    failed |= !reader.open(binary_path);
+    start = std::chrono::steady_clock::now();
+    FILE * csv = fopen(csv_path.c_str(), "w");
+    failed |= !csv || !exportCsv(reader, csv);
+    if (csv)
+	fclose(csv);
+    double csv_write = since(start);
+    reader.close();
+
+    // Load
+    start = std::chrono::steady_clock::now();
+    failed |= !reader.open(binary_path);
+    uint64_t rows = 0;
+    double sums[LOG_COLUMNS] = { 0 };
+    for (uint32_t chunk = 0; chunk < reader.chunks(); ++chunk) {
+	uint32_t count = reader.chunk(chunk).rows;
+	rows += count;
+	const uint64_t * times = reader.values<uint64_t>(chunk, LOG_TIME);
+	for (uint32_t row = 0; row < count; ++row)
+	    sums[LOG_TIME] += times[row];
+	for (int column = LOG_ACC_X; column <= LOG_GYRO_Z; ++column) {
+	    const int16_t * values = reader.values<int16_t>(chunk, column);
+	    for (uint32_t row = 0; row < count; ++row)
+		sums[column] += values[row];
+	}
+	const int32_t * altitudes = reader.values<int32_t>(chunk, LOG_ALTITUDE);
+	for (uint32_t row = 0; row < count; ++row)
+	    sums[LOG_ALTITUDE] += altitudes[row];
+    }
+    double binary_load = since(start);
+    failed |= rows != readings.size();
+
+    start = std::chrono::steady_clock::now();
+    std::vector<double> matrix;
+    matrix.reserve(readings.size() * 10);
+    csv = fopen(csv_path.c_str(), "r");
+    char line[512];
+    while (csv && fgets(line, sizeof(line), csv)) {
+	char * cursor = line;
+	for (int i = 0; i < 10; ++i) {
+	    matrix.push_back(strtod(cursor, &cursor));
+	    if (*cursor == ',')
+		cursor += 1;
+	}
+    }
+    if (csv)
+	fclose(csv);
+    double csv_load = since(start);
+    failed |= matrix.size() != readings.size() * 10;
+
+    // Round trip through CSV, the readings are whole counts so they come back exactly
+    csv = fopen(csv_path.c_str(), "r");
+    Sample_Log_Writer round_trip;
+    failed |= !csv || !round_trip.open(round_trip_path) || !importCsv(csv, round_trip);
+    if (csv)
+	fclose(csv);
+    failed |= !round_trip.close();
+    Sample_Log_Reader check;
+    failed |= !check.open(round_trip_path) || check.rows() != readings.size();
+    for (uint32_t chunk = 0; !failed && chunk < check.chunks(); ++chunk) {
+	uint32_t count = check.chunk(chunk).rows;
+	for (int column = LOG_ACC_X; column <= LOG_LIGHT; ++column) {
+	    size_t size = count * check.column(column).size;
+	    if (memcmp(check.columnData(chunk, column), reader.columnData(chunk, column), size))
+		failed = true;
+	}
+    }
+
+    double megabytes = 1e-6;
+    printf("binary  %8.1f MB  write %6.3f s  load %6.3f s\n", fileSize(binary_path) * megabytes,
+	   binary_write, binary_load);
+    printf("csv     %8.1f MB  write %6.3f s  load %6.3f s\n", fileSize(csv_path) * megabytes,
+	   csv_write, csv_load);
+    double checksum = 0;
+    for (int column = 0; column < LOG_COLUMNS; ++column)
+	checksum += sums[column];
+    printf("%zu samples, binary writes %.0fx and loads %.0fx faster (checksum %g)\n",
+	   readings.size(), csv_write / binary_write, csv_load / binary_load, checksum);
+
+    remove(binary_path.c_str());
+    remove(csv_path.c_str());
+    remove(round_trip_path.c_str());
+    if (failed) {
+	printf("log round trip failed\n");
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,267 @@
+// Checks the batch quaternion kernels against line by line ports of the analysis/ functions
+// (quaternion_integrate.m, angles_to_quaternion.m, quaternion_to_angles.m and
+// angles_to_rotation_matrix.m) on a long made up gyroscope recording, and times both in
+// samples per second.
+//
+// $ build/tools/orientation_benchmark [samples]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include "Quaternion_Batch.h"
+
+#define SAMPLE_PERIOD 1250e-6
+// Every so often a sample turns further than the kernels' series cover
+#define FAST_TURN_DIVISOR 50000
+#define TOLERANCE 1e-9
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Quaternion
+{
+    double w, x, y, z;
+};
+
+static Quaternion multiply(const Quaternion & a, const Quaternion & b)
+{
+    Quaternion result = {
+	a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+	a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+	a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+	a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+    };
+    return result;
+}
+
+static Quaternion normalized(const Quaternion & q)
+{
+    double norm = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    Quaternion result = { q.w / norm, q.x / norm, q.y / norm, q.z / norm };
+    return result;
+}
+
+// quaternion_integrate.m, keeping every step
+static void referenceIntegrate(const std::vector<double> * rates, const std::vector<double> & dt,
+			       std::vector<Quaternion> & orientation)
+{
+    Quaternion rotation = { 1, 0, 0, 0 };
+    orientation.resize(dt.size());
+    for (size_t i = 0; i < dt.size(); ++i) {
+	double theta[3] = { 0.5 * rates[0][i] * dt[i], 0.5 * rates[1][i] * dt[i],
+			    0.5 * rates[2][i] * dt[i] };
+	double magnitude = sqrt(theta[0] * theta[0] + theta[1] * theta[1] + theta[2] * theta[2]);
+	if (magnitude != 0) {
+	    double scale = sin(magnitude) / magnitude;
+	    Quaternion delta = { cos(magnitude), theta[0] * scale, theta[1] * scale,
+				 theta[2] * scale };
+	    rotation = normalized(multiply(delta, rotation));
+	}
+	orientation[i] = rotation;
+    }
+}
+
+// quaternion_to_angles.m
+static void referenceAngles(const Quaternion & q, double * angles)
+{
+    angles[0] = atan2(2 * (q.w * q.x + q.y * q.z), 1 - 2 * (q.x * q.x + q.y * q.y));
+    angles[1] = asin(2 * (q.w * q.y - q.z * q.x));
+    angles[2] = atan2(2 * (q.w * q.z + q.x * q.y), 1 - 2 * (q.y * q.y + q.z * q.z));
+}
+
+// angles_to_quaternion.m
+static Quaternion referenceQuaternion(const double * angles)
+{
+    double c[3], s[3];
+    for (int i = 0; i < 3; ++i) {
+	c[i] = cos(angles[i] / 2);
+	s[i] = sin(angles[i] / 2);
+    }
+    Quaternion q = {
+	c[0] * c[1] * c[2] + s[0] * s[1] * s[2],
+	s[0] * c[1] * c[2] - c[0] * s[1] * s[2],
+	c[0] * s[1] * c[2] + s[0] * c[1] * s[2],
+	c[0] * c[1] * s[2] - s[0] * s[1] * c[2]
+    };
+    return q;
+}
+
+// angles_to_rotation_matrix.m, angles in degrees
+static void referenceMatrix(const double * angle, double m[3][3])
+{
+    double X[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    double Y[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    double Z[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    double r[3];
+    for (int i = 0; i < 3; ++i)
+	r[i] = angle[i] * M_PI / 180;
+    X[1][1] = cos(r[0]); X[1][2] = -sin(r[0]); X[2][1] = sin(r[0]); X[2][2] = cos(r[0]);
+    Y[0][0] = cos(r[1]); Y[0][2] = sin(r[1]); Y[2][0] = -sin(r[1]); Y[2][2] = cos(r[1]);
+    Z[0][0] = cos(r[2]); Z[0][1] = -sin(r[2]); Z[1][0] = sin(r[2]); Z[1][1] = cos(r[2]);
+    double ZY[3][3];
+    for (int i = 0; i < 3; ++i)
+	for (int j = 0; j < 3; ++j) {
+	    ZY[i][j] = 0;
+	    for (int k = 0; k < 3; ++k)
+		ZY[i][j] += Z[i][k] * Y[k][j];
+	}
+    for (int i = 0; i < 3; ++i)
+	for (int j = 0; j < 3; ++j) {
+	    m[i][j] = 0;
+	    for (int k = 0; k < 3; ++k)
+		m[i][j] += ZY[i][k] * X[k][j];
+	}
+}
+
+static void report(const char * name, size_t samples, double reference_seconds,
+		   double batch_seconds, double error, bool & failed)
+{
+    printf("%-24s reference %6.1f M/s, batch %7.1f M/s (%4.1fx), largest difference %.2g\n",
+	   name, samples / reference_seconds / 1e6, samples / batch_seconds / 1e6,
+	   reference_seconds / batch_seconds, error);
+    if (!(error <= TOLERANCE)) {
+	printf("FAILED: %s differs from the reference by more than %g\n", name, TOLERANCE);
+	failed = true;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    size_t count = argc > 1 ? atol(argv[1]) : 4000000;
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+	cores = 1;
+    bool failed = false;
+
+    // Rates wandering up to a few turns a second, with the odd jolt
+    std::vector<double> rates[3], dt(count);
+    srand(1);
+    double rate[3] = { 0, 0, 0 };
+    for (int axis = 0; axis < 3; ++axis)
+	rates[axis].resize(count);
+    for (size_t i = 0; i < count; ++i) {
+	dt[i] = SAMPLE_PERIOD * (0.9 + 0.2 * rand() / RAND_MAX);
+	for (int axis = 0; axis < 3; ++axis) {
+	    rate[axis] = 0.999 * rate[axis] + 0.2 * (rand() / (double)RAND_MAX - 0.5);
+	    rates[axis][i] = rate[axis];
+	    if (i % FAST_TURN_DIVISOR == FAST_TURN_DIVISOR - 1)
+		rates[axis][i] = 1500;
+	}
+    }
+
+    // Integration
+    std::vector<Quaternion> reference(count);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    referenceIntegrate(rates, dt, reference);
+    double reference_seconds = since(start);
+
+    // Once untimed so the arrays are in memory
+    Quaternion_Batch deltas, orientation;
+    const double initial[4] = { 1, 0, 0, 0 };
+    deltaQuaternions(rates[0].data(), rates[1].data(), rates[2].data(), dt.data(), count, deltas);
+    integrateQuaternions(deltas, initial, orientation);
+    // On one thread the samples are chained in order, on more the run is split into blocks
+    // whatever the machine has so that path is checked too
+    double batch_seconds[2], errors[2] = { 0, 0 };
+    unsigned threads[2] = { 1, cores > 1 ? cores : 2 };
+    for (int run = 0; run < 2; ++run) {
+	start = std::chrono::steady_clock::now();
+	deltaQuaternions(rates[0].data(), rates[1].data(), rates[2].data(), dt.data(), count,
+			 deltas);
+	integrateQuaternions(deltas, initial, orientation, threads[run]);
+	batch_seconds[run] = since(start);
+	for (size_t i = 0; i < count; ++i) {
+	    errors[run] = fmax(errors[run], fabs(orientation.w[i] - reference[i].w));
+	    errors[run] = fmax(errors[run], fabs(orientation.x[i] - reference[i].x));
+	    errors[run] = fmax(errors[run], fabs(orientation.y[i] - reference[i].y));
+	    errors[run] = fmax(errors[run], fabs(orientation.z[i] - reference[i].z));
+	}
+    }
+    report("integration", count, reference_seconds, batch_seconds[0], errors[0], failed);
+    report("integration in blocks", count, reference_seconds, batch_seconds[1], errors[1],
+	   failed);
+    printf("%-24s on %u threads\n", "", threads[1]);
+
+    // To angles
+    std::vector<double> angles[3], reference_angles(3 * count);
+    for (int axis = 0; axis < 3; ++axis)
+	angles[axis].resize(count);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+	referenceAngles(reference[i], &reference_angles[3 * i]);
+    reference_seconds = since(start);
+    start = std::chrono::steady_clock::now();
+    quaternionsToAngles(orientation, angles[0].data(), angles[1].data(), angles[2].data());
+    batch_seconds[0] = since(start);
+    double error = 0;
+    for (size_t i = 0; i < count; ++i)
+	for (int axis = 0; axis < 3; ++axis) {
+	    // Yaw and roll jump by a whole turn where the two orientations straddle the cut
+	    double difference = fabs(angles[axis][i] - reference_angles[3 * i + axis]);
+	    error = fmax(error, fmin(difference, fabs(difference - 2 * M_PI)));
+	}
+    report("quaternion to angles", count, reference_seconds, batch_seconds[0], error, failed);
+
+    // Back to quaternions
+    Quaternion_Batch rebuilt;
+    rebuilt.resize(count);
+    std::vector<Quaternion> reference_rebuilt(count);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+	reference_rebuilt[i] = referenceQuaternion(&reference_angles[3 * i]);
+    reference_seconds = since(start);
+    start = std::chrono::steady_clock::now();
+    anglesToQuaternions(angles[0].data(), angles[1].data(), angles[2].data(), count, rebuilt);
+    batch_seconds[0] = since(start);
+    error = 0;
+    for (size_t i = 0; i < count; ++i) {
+	// Either sign is the same rotation
+	double sign = rebuilt.w[i] * reference_rebuilt[i].w >= 0 ? 1 : -1;
+	error = fmax(error, fabs(rebuilt.w[i] - sign * reference_rebuilt[i].w));
+	error = fmax(error, fabs(rebuilt.x[i] - sign * reference_rebuilt[i].x));
+	error = fmax(error, fabs(rebuilt.y[i] - sign * reference_rebuilt[i].y));
+	error = fmax(error, fabs(rebuilt.z[i] - sign * reference_rebuilt[i].z));
+    }
+    report("angles to quaternion", count, reference_seconds, batch_seconds[0], error, failed);
+
+    // Rotation matrices, from the angles in degrees and from the quaternions
+    std::vector<double> elements[9];
+    double * matrices[9];
+    for (int i = 0; i < 9; ++i) {
+	elements[i].resize(count);
+	matrices[i] = elements[i].data();
+    }
+    std::vector<double> degrees(3 * count), reference_matrices(9 * count);
+    for (size_t i = 0; i < 3 * count; ++i)
+	degrees[i] = reference_angles[i] * 180 / M_PI;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+	referenceMatrix(&degrees[3 * i], (double (*)[3])&reference_matrices[9 * i]);
+    reference_seconds = since(start);
+    for (int axis = 0; axis < 3; ++axis)
+	for (size_t i = 0; i < count; ++i)
+	    angles[axis][i] = degrees[3 * i + axis];
+    start = std::chrono::steady_clock::now();
+    anglesToRotationMatrices(angles[0].data(), angles[1].data(), angles[2].data(), count,
+			     matrices);
+    batch_seconds[0] = since(start);
+    error = 0;
+    for (size_t i = 0; i < count; ++i)
+	for (int k = 0; k < 9; ++k)
+	    error = fmax(error, fabs(elements[k][i] - reference_matrices[9 * i + k]));
+    report("angles to matrix", count, reference_seconds, batch_seconds[0], error, failed);
+
+    start = std::chrono::steady_clock::now();
+    quaternionsToRotationMatrices(orientation, matrices);
+    batch_seconds[0] = since(start);
+    error = 0;
+    for (size_t i = 0; i < count; ++i)
+	for (int k = 0; k < 9; ++k)
+	    error = fmax(error, fabs(elements[k][i] - reference_matrices[9 * i + k]));
+    report("quaternion to matrix", count, reference_seconds, batch_seconds[0], error, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,307 @@
+// Runs the board's fixed point orientation filter and the same Mahony filter in floating point
+// on a made up recording: the board starts tilted and turns on every axis at up to about
+// 100 deg/s while the gyroscope reads with a bias and noise and the accelerometer with noise,
+// both rounded to counts as the drivers give them. The tilt of each estimate is compared with
+// the true tilt, the two estimates are compared with each other and the compact quaternion
+// sent in QUAT blocks is checked to come back to the estimate. Both are timed in updates per
+// second, which only says how the two compare on the host, not how long the board takes.
+//
+// $ build/tools/orientation_filter_benchmark [seconds]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "Orientation_Filter.h"
+
+#define RATE 800
+#define FULL_SCALE 250
+// Accelerometer counts in 1 g and gyroscope counts per deg/s
+#define ONE_G (1 << ORIENTATION_ONE_G_SHIFT)
+#define GYRO_COUNTS (32768.0 / FULL_SCALE)
+#define GYRO_NOISE 0.2
+#define ACC_NOISE 0.02
+// Seconds left for the estimates to settle and learn the bias before they are compared
+#define SETTLE_TIME 60
+
+// Largest tilt errors allowed, in degrees: the root mean square tilt error of the fixed point
+// estimate against the truth, and the largest tilt difference between the two estimates
+#define TILT_TOLERANCE 1.0
+#define DIFFERENCE_TOLERANCE 0.5
+// Largest error of a compact quaternion component, in Q14 counts
+#define COMPACT_TOLERANCE 4
+
+static const double gyro_bias[3] = { 2.5, -1.7, 0.9 };
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Uniform in [0, 1) and standard normal
+static double uniform()
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static double normal()
+{
+    return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+static int16_t toCounts(double value, double limit)
+{
+    value = fmax(-limit, fmin(limit, value));
+    return (int16_t)lround(value);
+}
+
+// Gravity direction in the board frame for the orientation w, x, y, z, as the filter finds it
+static void gravity(const double * q, double * v)
+{
+    v[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+    v[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+    v[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+}
+
+// Angle in degrees between the gravity directions of two orientations
+static double tiltDifference(const double * a, const double * b)
+{
+    double u[3], v[3];
+    gravity(a, u);
+    gravity(b, v);
+    double dot = (u[0] * v[0] + u[1] * v[1] + u[2] * v[2]) /
+	sqrt((u[0] * u[0] + u[1] * u[1] + u[2] * u[2]) * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+    return acos(fmin(1, dot)) * 180 / M_PI;
+}
+
+// Angle in degrees of the rotation between two orientations
+static double angleDifference(const double * a, const double * b)
+{
+    double dot = fabs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]) /
+	sqrt((a[0] * a[0] + a[1] * a[1] + a[2] * a[2] + a[3] * a[3]) *
+	     (b[0] * b[0] + b[1] * b[1] + b[2] * b[2] + b[3] * b[3]));
+    return 2 * acos(fmin(1, dot)) * 180 / M_PI;
+}
+
+// The Mahony filter of Orientation_Filter.cpp in single precision floating point, with the
+// accelerometer normalized exactly and the quaternion normalized exactly after each update
+class Float_Mahony {
+public:
+    float q[4];
+    float integral[3];
+    float kp, ki, dt, gyro_scale;
+
+    Float_Mahony(float rate, float full_scale, float kp, float ki)
+    {
+	q[0] = 1;
+	q[1] = q[2] = q[3] = 0;
+	integral[0] = integral[1] = integral[2] = 0;
+	this->kp = kp;
+	this->ki = ki;
+	dt = 1 / rate;
+	gyro_scale = full_scale / 32768.0f * (float)M_PI / 180;
+    }
+
+    void update(const int16_t * acc, const int16_t * gyro)
+    {
+	float w[3];
+	for (int i = 0; i < 3; ++i)
+	    w[i] = gyro[i] * gyro_scale;
+	float norm = (float)acc[0] * acc[0] + (float)acc[1] * acc[1] + (float)acc[2] * acc[2];
+	float one_g = ONE_G * ONE_G;
+	if (norm > 0.64f * one_g && norm < 1.44f * one_g) {
+	    float a[3], v[3], e[3];
+	    float scale = 1 / sqrtf(norm);
+	    for (int i = 0; i < 3; ++i)
+		a[i] = acc[i] * scale;
+	    v[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+	    v[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+	    v[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+	    e[0] = a[1] * v[2] - a[2] * v[1];
+	    e[1] = a[2] * v[0] - a[0] * v[2];
+	    e[2] = a[0] * v[1] - a[1] * v[0];
+	    for (int i = 0; i < 3; ++i) {
+		integral[i] += ki * e[i] * dt;
+		w[i] += kp * e[i];
+	    }
+	}
+	for (int i = 0; i < 3; ++i)
+	    w[i] = (w[i] + integral[i]) * dt / 2;
+
+	float d[4] = { -q[1] * w[0] - q[2] * w[1] - q[3] * w[2],
+		       q[0] * w[0] + q[2] * w[2] - q[3] * w[1],
+		       q[0] * w[1] - q[1] * w[2] + q[3] * w[0],
+		       q[0] * w[2] + q[1] * w[1] - q[2] * w[0] };
+	float length = 0;
+	for (int i = 0; i < 4; ++i) {
+	    q[i] += d[i];
+	    length += q[i] * q[i];
+	}
+	length = 1 / sqrtf(length);
+	for (int i = 0; i < 4; ++i)
+	    q[i] *= length;
+    }
+};
+
+// The made up recording, counts for each update and the true orientation after it
+struct Recording
+{
+    std::vector<int16_t> acc, gyro;
+    std::vector<double> truth;
+};
+
+// Rotation rate in deg/s at time t, a few slow sines on each axis
+static void trueRate(double t, double * rate)
+{
+    rate[0] = 60 * sin(2 * M_PI * 0.11 * t) + 25 * sin(2 * M_PI * 0.73 * t);
+    rate[1] = 45 * sin(2 * M_PI * 0.07 * t + 1) + 30 * sin(2 * M_PI * 0.41 * t);
+    rate[2] = 80 * sin(2 * M_PI * 0.05 * t + 2) + 15 * sin(2 * M_PI * 1.3 * t);
+}
+
+static void makeRecording(Recording & recording, size_t count)
+{
+    srand(1);
+    recording.acc.resize(3 * count);
+    recording.gyro.resize(3 * count);
+    recording.truth.resize(4 * count);
+
+    // Start rolled by 30 degrees
+    double q[4] = { cos(M_PI / 12), sin(M_PI / 12), 0, 0 };
+    for (size_t k = 0; k < count; ++k) {
+	double v[3];
+	gravity(q, v);
+	for (int i = 0; i < 3; ++i)
+	    recording.acc[3 * k + i] = toCounts((v[i] + ACC_NOISE * normal()) * ONE_G,
+						2 * ONE_G - 1);
+
+	// The rate held over the update, taken half way through it
+	double rate[3], h[3];
+	trueRate((k + 0.5) / RATE, rate);
+	for (int i = 0; i < 3; ++i) {
+	    recording.gyro[3 * k + i] =
+		toCounts((rate[i] + gyro_bias[i] + GYRO_NOISE * normal()) * GYRO_COUNTS, 32767);
+	    h[i] = rate[i] * M_PI / 180 / RATE / 2;
+	}
+
+	// q * exp(h) exactly
+	double angle = sqrt(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+	double c = cos(angle), s = angle > 0 ? sin(angle) / angle : 1;
+	double d[4] = { c, h[0] * s, h[1] * s, h[2] * s };
+	double next[4] = { q[0] * d[0] - q[1] * d[1] - q[2] * d[2] - q[3] * d[3],
+			   q[0] * d[1] + q[1] * d[0] + q[2] * d[3] - q[3] * d[2],
+			   q[0] * d[2] - q[1] * d[3] + q[2] * d[0] + q[3] * d[1],
+			   q[0] * d[3] + q[1] * d[2] - q[2] * d[1] + q[3] * d[0] };
+	for (int i = 0; i < 4; ++i) {
+	    q[i] = next[i];
+	    recording.truth[4 * k + i] = q[i];
+	}
+    }
+}
+
+// Root mean square and largest of a set of errors
+struct Error_Summary
+{
+    double sum, largest;
+    size_t count;
+
+    Error_Summary() : sum(0), largest(0), count(0) {}
+    void add(double error) { sum += error * error; largest = fmax(largest, error); count += 1; }
+    double rms() const { return count ? sqrt(sum / count) : 0; }
+};
+
+int main(int argc, char ** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 600;
+    size_t count = (size_t)(seconds * RATE);
+    if (seconds <= SETTLE_TIME) {
+	fprintf(stderr, "%s: the recording must be longer than %d s\n", argv[0], SETTLE_TIME);
+	return 2;
+    }
+    bool failed = false;
+
+    Recording recording;
+    makeRecording(recording, count);
+    printf("%.0f s at %d Hz, %zu updates, gyroscope bias %.1f %.1f %.1f deg/s\n", seconds, RATE,
+	   count, gyro_bias[0], gyro_bias[1], gyro_bias[2]);
+
+    Orientation_Filter filter;
+    if (!filter.setup(RATE, FULL_SCALE)) {
+	printf("FAILED: the filter can not run at %d Hz\n", RATE);
+	return 1;
+    }
+    Float_Mahony reference(RATE, FULL_SCALE, ORIENTATION_KP, ORIENTATION_KI);
+
+    // Both filters on the whole recording, keeping every estimate
+    std::vector<int16_t> fixed(4 * count);
+    std::vector<float> floating(4 * count);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < count; ++k) {
+	filter.update(&recording.acc[3 * k], &recording.gyro[3 * k]);
+	filter.quaternion(&fixed[4 * k]);
+    }
+    double fixed_seconds = since(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < count; ++k) {
+	reference.update(&recording.acc[3 * k], &recording.gyro[3 * k]);
+	for (int i = 0; i < 4; ++i)
+	    floating[4 * k + i] = reference.q[i];
+    }
+    double float_seconds = since(start);
+    printf("fixed point %.1f M updates/s, floating point %.1f M updates/s, %.1f %% of updates "
+	   "corrected by the accelerometer\n", count / fixed_seconds / 1e6,
+	   count / float_seconds / 1e6, 100.0 * filter.corrected / filter.updates);
+
+    Error_Summary fixed_tilt, float_tilt, tilt_difference, angle_difference;
+    for (size_t k = (size_t)SETTLE_TIME * RATE; k < count; ++k) {
+	const double * truth = &recording.truth[4 * k];
+	double a[4], b[4];
+	for (int i = 0; i < 4; ++i) {
+	    a[i] = fixed[4 * k + i] / 16384.0;
+	    b[i] = floating[4 * k + i];
+	}
+	fixed_tilt.add(tiltDifference(a, truth));
+	float_tilt.add(tiltDifference(b, truth));
+	tilt_difference.add(tiltDifference(a, b));
+	angle_difference.add(angleDifference(a, b));
+    }
+    printf("tilt error against the truth after %d s: fixed point rms %.3f max %.3f deg, "
+	   "floating point rms %.3f max %.3f deg\n", SETTLE_TIME, fixed_tilt.rms(),
+	   fixed_tilt.largest, float_tilt.rms(), float_tilt.largest);
+    printf("fixed against floating point: tilt rms %.3f max %.3f deg, whole rotation rms %.3f "
+	   "max %.3f deg\n", tilt_difference.rms(), tilt_difference.largest,
+	   angle_difference.rms(), angle_difference.largest);
+    if (fixed_tilt.rms() > TILT_TOLERANCE) {
+	printf("FAILED: the fixed point tilt error is over %g deg\n", TILT_TOLERANCE);
+	failed = true;
+    }
+    if (tilt_difference.largest > DIFFERENCE_TOLERANCE) {
+	printf("FAILED: the estimates differ in tilt by more than %g deg\n", DIFFERENCE_TOLERANCE);
+	failed = true;
+    }
+
+    // Compact quaternions of the estimates over the start of the recording again
+    int largest = 0;
+    for (int k = 0; k < 10000; ++k) {
+	int16_t q[4], expanded[4];
+	uint8_t compact[ORIENTATION_COMPACT_SIZE];
+	filter.update(&recording.acc[3 * (k % count)], &recording.gyro[3 * (k % count)]);
+	filter.quaternion(q);
+	filter.compact(compact);
+	expandQuaternion(compact, expanded);
+	// Either sign is the same rotation
+	int same = 0, opposite = 0;
+	for (int i = 0; i < 4; ++i) {
+	    same = std::max(same, abs(q[i] - expanded[i]));
+	    opposite = std::max(opposite, abs(q[i] + expanded[i]));
+	}
+	largest = std::max(largest, std::min(same, opposite));
+    }
+    printf("compact quaternions: largest component error %d / 16384\n", largest);
+    if (largest > COMPACT_TOLERANCE) {
+	printf("FAILED: compact quaternions are off by more than %d\n", COMPACT_TOLERANCE);
+	failed = true;
+    }
+    return failed ? 1 : 0;
+}
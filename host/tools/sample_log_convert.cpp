@@ -0,0 +1,57 @@
+// Converts between binary sample logs and the CSV layout of the Android application's
+// inertial_sensors.csv. The direction is chosen by the extension of the input file.
+//
+// $ build/tools/sample_log_convert inertial_sensors.csv board0.bslog
+// $ build/tools/sample_log_convert board0.bslog inertial_sensors.csv
+
+#include <stdio.h>
+#include <string>
+#include "Sample_Log.h"
+
+static bool endsWith(const std::string & text, const std::string & ending)
+{
+    return text.size() >= ending.size() &&
+	text.compare(text.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 3) {
+	fprintf(stderr, "usage: %s in.csv out.bslog | in.bslog out.csv\n", argv[0]);
+	return 2;
+    }
+    std::string input = argv[1], output = argv[2];
+
+    if (endsWith(input, ".csv")) {
+	FILE * csv = fopen(input.c_str(), "r");
+	Sample_Log_Writer log;
+	if (!csv || !log.open(output)) {
+	    fprintf(stderr, "could not open %s or %s\n", input.c_str(), output.c_str());
+	    return 1;
+	}
+	bool converted = importCsv(csv, log);
+	fclose(csv);
+	if (!log.close() || !converted) {
+	    fprintf(stderr, "could not write %s\n", output.c_str());
+	    return 1;
+	}
+	return 0;
+    }
+
+    Sample_Log_Reader log;
+    if (!log.open(input)) {
+	fprintf(stderr, "%s is not a complete sample log\n", input.c_str());
+	return 1;
+    }
+    FILE * csv = fopen(output.c_str(), "w");
+    if (!csv) {
+	fprintf(stderr, "could not create %s\n", output.c_str());
+	return 1;
+    }
+    bool converted = exportCsv(log, csv);
+    if (fclose(csv) != 0 || !converted) {
+	fprintf(stderr, "could not write %s\n", output.c_str());
+	return 1;
+    }
+    return 0;
+}
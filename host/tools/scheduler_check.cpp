@@ -0,0 +1,254 @@
+// Checks the sample scheduler against a plain count of the ticks it is given. Simulated
+// interrupts call tick() one at a time or in bursts before each poll, as a slow pass through
+// the main loop would leave them, and every sensor must come out due exactly when one of the
+// ticks a poll covers is a multiple of its divisor since the last reset. That includes the
+// case where a burst carries a sensor's count past its divisor, phase + waiting > divisor, and
+// the one where it lands exactly on it. The same ticks must always give the same sensors, a
+// stride must hand out only every n-th tick without counting the rest as missed, and a
+// divisor of zero must keep its sensor out. The sample period the scheduler reports for a
+// set of sensors must be the spacing of the ticks it hands out with any of them due, or zero
+// when that spacing is uneven. Prints each step and exits with 1 if any check failed.
+//
+// $ build/tools/scheduler_check
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "Sample_Scheduler.h"
+#include "Sensor_Protocol.h"
+
+static int failures;
+
+static void check(bool passed, const char * what)
+{
+    printf("  %-56s %s\n", what, passed ? "ok" : "FAILED");
+    if (!passed)
+	failures += 1;
+}
+
+// Divisors of the four sensors, the accelerometer every tick and the others out of step
+static const uint16_t DIVISORS[SCHEDULER_SENSORS] = { 1, 3, 4, 7 };
+
+static void setDivisors(Sample_Scheduler & scheduler, const uint16_t * divisors)
+{
+    for (uint8_t i = 0; i < SCHEDULER_SENSORS; ++i)
+	scheduler.setDivisor(i, divisors[i]);
+}
+
+// Sensors due on ticks 'first' to 'first' + 'count' - 1 counted from the last reset
+static uint8_t expectedDue(const uint16_t * divisors, uint32_t first, uint32_t count)
+{
+    uint8_t due = 0;
+    for (uint8_t i = 0; i < SCHEDULER_SENSORS; ++i)
+    {
+	if (divisors[i] == 0)
+	    continue;
+	for (uint32_t k = first; k < first + count; ++k)
+	    if (k % divisors[i] == 0)
+		due |= 1 << i;
+    }
+    return due;
+}
+
+// Give the scheduler 'count' ticks and poll it once
+static bool tickAndPoll(Sample_Scheduler & scheduler, uint16_t count, uint8_t & due)
+{
+    for (uint16_t i = 0; i < count; ++i)
+	scheduler.tick();
+    return scheduler.poll(due);
+}
+
+// Bursts of ticks between polls, from a fixed sequence so every run sees the same ones
+static uint16_t burst(uint32_t & state)
+{
+    state = state * 1103515245 + 12345;
+    return 1 + (state >> 16) % 6;
+}
+
+// One tick per poll: every sensor due on the multiples of its divisor from the reset
+static void checkSteady()
+{
+    printf("one tick per poll\n");
+    Sample_Scheduler scheduler;
+    setDivisors(scheduler, DIVISORS);
+    uint8_t due = 0;
+    check(!scheduler.poll(due) && due == 0, "no tick yet: nothing to poll");
+
+    bool matched = true;
+    for (uint32_t k = 0; k < 420; ++k)
+	matched &= tickAndPoll(scheduler, 1, due) && due == expectedDue(DIVISORS, k, 1);
+    check(matched, "sensors due on the multiples of their divisors");
+    check(scheduler.ticks == 420 && scheduler.missed == 0, "420 ticks handled, none missed");
+
+    // After a reset the same ticks give the same sensors again
+    scheduler.reset();
+    tickAndPoll(scheduler, 1, due);
+    check(due == (ACC | GYRO | BARO | PHT), "all sensors due on the first tick after a reset");
+    matched = true;
+    for (uint32_t k = 1; k < 420; ++k)
+	matched &= tickAndPoll(scheduler, 1, due) && due == expectedDue(DIVISORS, k, 1);
+    check(matched && scheduler.ticks == 420, "the same phases after the reset");
+}
+
+// Bursts of ticks per poll: a sensor is due if any tick of the burst was
+static void checkBursts()
+{
+    printf("missed ticks\n");
+    Sample_Scheduler scheduler;
+    setDivisors(scheduler, DIVISORS);
+    uint32_t state = 1, handled = 0, missed = 0;
+    uint8_t due = 0;
+    bool matched = true;
+    for (int i = 0; i < 1000; ++i)
+    {
+	uint16_t count = burst(state);
+	matched &= tickAndPoll(scheduler, count, due) &&
+	    due == expectedDue(DIVISORS, handled, count);
+	handled += count;
+	missed += count - 1;
+    }
+    check(matched, "1000 bursts of 1 to 6 ticks match the tick count");
+    char what[128];
+    snprintf(what, sizeof(what), "%lu ticks handled, %lu missed",
+	     (unsigned long)scheduler.ticks, (unsigned long)scheduler.missed);
+    check(scheduler.ticks == handled && scheduler.missed == missed, what);
+
+    // A divisor of 4 walked to each phase and given two ticks at once
+    const uint16_t fours[SCHEDULER_SENSORS] = { 4, 4, 4, 4 };
+    setDivisors(scheduler, fours);
+    scheduler.reset();
+    tickAndPoll(scheduler, 1, due);
+    tickAndPoll(scheduler, 1, due);
+    tickAndPoll(scheduler, 2, due);
+    check(due == 0, "phase 2 + 2 ticks lands on the divisor: not due");
+    tickAndPoll(scheduler, 1, due);
+    check(due == (ACC | GYRO | BARO | PHT), "then due on the multiple itself");
+    tickAndPoll(scheduler, 1, due);
+    tickAndPoll(scheduler, 1, due);
+    tickAndPoll(scheduler, 2, due);
+    check(due == (ACC | GYRO | BARO | PHT), "phase 3 + 2 ticks passes the divisor: due");
+    tickAndPoll(scheduler, 3, due);
+    check(due == 0, "phase 1 + 3 ticks stops short of it: not due");
+    tickAndPoll(scheduler, 9, due);
+    check(due == (ACC | GYRO | BARO | PHT), "phase 0 + 9 ticks: due once for three multiples");
+    check(scheduler.missed == 1 + 1 + 2 + 8, "ticks beyond the newest counted as missed");
+}
+
+// A stride hands out every n-th tick, with the sensors due on the ticks in between
+static void checkStride()
+{
+    printf("stride\n");
+    Sample_Scheduler scheduler;
+    setDivisors(scheduler, DIVISORS);
+    scheduler.setStride(3);
+    uint32_t handled = 0;
+    uint8_t due = 0;
+    bool held = true, matched = true;
+    for (int i = 0; i < 100; ++i)
+    {
+	held &= !tickAndPoll(scheduler, 1, due) && !tickAndPoll(scheduler, 1, due);
+	matched &= tickAndPoll(scheduler, 1, due) && due == expectedDue(DIVISORS, handled, 3);
+	handled += 3;
+    }
+    check(held, "ticks short of the stride held back");
+    check(matched, "sensors due on any tick of the stride");
+    check(scheduler.ticks == handled && scheduler.missed == 0, "strided ticks not missed");
+
+    // Back to every tick once the stride is set to 1 right after a poll
+    scheduler.setStride(1);
+    matched = true;
+    for (int i = 0; i < 84; ++i, ++handled)
+	matched &= tickAndPoll(scheduler, 1, due) && due == expectedDue(DIVISORS, handled, 1);
+    check(matched, "every tick again with a stride of 1");
+}
+
+// A divisor of zero keeps the sensor out, the others keep their phases
+static void checkDisabled()
+{
+    printf("divisor of zero\n");
+    Sample_Scheduler scheduler;
+    const uint16_t divisors[SCHEDULER_SENSORS] = { 2, 0, 5, 0 };
+    setDivisors(scheduler, divisors);
+    uint32_t state = 7, handled = 0;
+    uint8_t due = 0, seen = 0;
+    bool matched = true;
+    for (int i = 0; i < 200; ++i)
+    {
+	uint16_t count = burst(state);
+	matched &= tickAndPoll(scheduler, count, due) &&
+	    due == expectedDue(divisors, handled, count);
+	seen |= due;
+	handled += count;
+    }
+    check(matched, "the other sensors still match the tick count");
+    check(seen == (ACC | BARO), "the sensors with no divisor never due");
+}
+
+// Ticks between the ticks handed out with any of 'sensors' due over a few hundred polls, 0 if
+// they were uneven
+static uint32_t measurePeriod(Sample_Scheduler & scheduler, uint8_t sensors)
+{
+    scheduler.reset();
+    uint32_t last = 0, period = 0;
+    bool seen = false, even = true;
+    uint8_t due = 0;
+    for (int i = 0; i < 400; ++i)
+    {
+	scheduler.tick();
+	if (!scheduler.poll(due) || !(due & sensors))
+	    continue;
+	uint32_t tick = scheduler.ticks - 1;
+	if (seen && period == 0)
+	    period = tick - last;
+	else if (seen && tick - last != period)
+	    even = false;
+	last = tick;
+	seen = true;
+    }
+    return even ? period : 0;
+}
+
+// The reported sample period matches the ticks handed out
+static void checkPeriod()
+{
+    printf("sample period\n");
+    static const struct {
+	uint16_t divisors[SCHEDULER_SENSORS];
+	uint8_t stride, sensors;
+	uint16_t period;
+    } cases[] = {
+	{ { 1, 3, 4, 7 }, 1, ACC | GYRO | BARO | PHT, 1 },
+	{ { 1, 3, 4, 7 }, 1, BARO, 4 },
+	{ { 1, 3, 4, 7 }, 1, GYRO | BARO, 0 },
+	{ { 2, 4, 8, 0 }, 1, ACC | GYRO | BARO, 2 },
+	{ { 2, 4, 8, 0 }, 1, GYRO | BARO | PHT, 4 },
+	{ { 2, 4, 8, 0 }, 1, PHT, 0 },
+	{ { 2, 4, 8, 0 }, 3, ACC | GYRO, 3 },
+	{ { 2, 4, 8, 0 }, 4, ACC | GYRO | BARO, 4 },
+	{ { 2, 4, 8, 0 }, 4, BARO, 8 },
+	{ { 2, 4, 8, 0 }, 3, BARO, 0 },
+	{ { 6, 4, 0, 0 }, 2, ACC | GYRO, 0 }
+    };
+    bool matched = true;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+	Sample_Scheduler scheduler;
+	setDivisors(scheduler, cases[i].divisors);
+	scheduler.setStride(cases[i].stride);
+	uint16_t period = scheduler.samplePeriod(cases[i].sensors);
+	matched &= period == cases[i].period &&
+	    measurePeriod(scheduler, cases[i].sensors) == period;
+    }
+    check(matched, "period is the spacing of the handed out ticks");
+}
+
+int main()
+{
+    checkSteady();
+    checkBursts();
+    checkStride();
+    checkDisabled();
+    checkPeriod();
+
+    printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
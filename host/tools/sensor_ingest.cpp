@@ -0,0 +1,194 @@
+// Ingest daemon for a fleet of sensor boards. Every port given on the command line is read at
+// once, the stream requested from each board is decoded by a pool of worker threads and every
+// sample is written to the binary sample log <log dir>/<port name>.bslog (or a CSV file with
+// --csv). Counts of bytes, samples, decode errors and dropped data for each board are printed
+// when it exits (on SIGINT or SIGTERM, or once every port has closed).
+//
+// $ build/tools/sensor_ingest [options] /dev/rfcomm0 /dev/rfcomm1 ...
+//
+// With --simulate N the ports are the slave sides of N pseudo terminals driven by made up
+// boards, the run ends after --seconds and the samples logged are checked against the samples
+// the boards sent, so the whole service can be exercised without hardware.
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Ingest_Service.h"
+#include "Pty_Board.h"
+
+static Ingest_Service * service;
+
+static void handleSignal(int)
+{
+    service->stop();
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr,
+	    "usage: %s [options] port...\n"
+	    "  -d, --logs DIR        directory for the per board logs (default .)\n"
+	    "  -w, --workers N       decoding threads (default 2)\n"
+	    "  -b, --baud RATE       serial port speed (default 115200)\n"
+	    "  -q, --queue N         4 KB chunks a board may have waiting (default 64)\n"
+	    "  -s, --stall MS        drop a board's data after its queue has been full this long\n"
+	    "                        (default 1000)\n"
+	    "  -r, --request CODE    request sent to each board on start, 0 for none\n"
+	    "                        (default 0xB0, the single sample stream)\n"
+	    "  -c, --cobs            ask the boards for COBS framing\n"
+	    "      --csv             write CSV logs instead of binary sample logs\n"
+	    "      --simulate N      read N simulated boards on pseudo terminals\n"
+	    "      --seconds S       length of a simulated run (default 5)\n"
+	    "      --rate R          samples per second of each simulated board (default 400)\n",
+	    program);
+}
+
+// Name of the log for a port, its last path component
+static std::string logName(const std::string & path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+int main(int argc, char ** argv)
+{
+    std::string log_dir = ".";
+    unsigned workers = 2;
+    int baud = 115200;
+    size_t queue_chunks = 64;
+    unsigned stall_ms = 1000;
+    long request = START_STREAM;
+    bool cobs = false;
+    bool csv = false;
+    int simulate = 0;
+    double seconds = 5;
+    unsigned rate = 400;
+
+    static const struct option options[] = {
+	{ "logs", required_argument, 0, 'd' },
+	{ "workers", required_argument, 0, 'w' },
+	{ "baud", required_argument, 0, 'b' },
+	{ "queue", required_argument, 0, 'q' },
+	{ "stall", required_argument, 0, 's' },
+	{ "request", required_argument, 0, 'r' },
+	{ "cobs", no_argument, 0, 'c' },
+	{ "csv", no_argument, 0, 'C' },
+	{ "simulate", required_argument, 0, 'S' },
+	{ "seconds", required_argument, 0, 'T' },
+	{ "rate", required_argument, 0, 'R' },
+	{ 0, 0, 0, 0 }
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "d:w:b:q:s:r:c", options, 0)) != -1) {
+	switch (option) {
+	case 'd': log_dir = optarg; break;
+	case 'w': workers = atoi(optarg); break;
+	case 'b': baud = atoi(optarg); break;
+	case 'q': queue_chunks = atoi(optarg); break;
+	case 's': stall_ms = atoi(optarg); break;
+	case 'r': request = strtol(optarg, 0, 0); break;
+	case 'c': cobs = true; break;
+	case 'C': csv = true; break;
+	case 'S': simulate = atoi(optarg); break;
+	case 'T': seconds = atof(optarg); break;
+	case 'R': rate = atoi(optarg); break;
+	default:
+	    usage(argv[0]);
+	    return 2;
+	}
+    }
+    if (optind == argc && simulate == 0) {
+	usage(argv[0]);
+	return 2;
+    }
+
+    service = new Ingest_Service(workers, log_dir, queue_chunks, stall_ms, !csv);
+    for (int i = optind; i < argc; ++i) {
+	if (!service->addDevice(argv[i], logName(argv[i]), baud)) {
+	    fprintf(stderr, "could not open %s or its log\n", argv[i]);
+	    return 1;
+	}
+    }
+
+    std::vector<Pty_Board *> boards;
+    for (int i = 0; i < simulate; ++i) {
+	Pty_Board * board = new Pty_Board(rate, i + 1);
+	if (!board->start()) {
+	    fprintf(stderr, "could not create a pseudo terminal\n");
+	    return 1;
+	}
+	boards.push_back(board);
+	char name[32];
+	snprintf(name, sizeof(name), "board%d", i);
+	if (!service->addDevice(board->path(), name, baud)) {
+	    fprintf(stderr, "could not open %s or its log\n", board->path().c_str());
+	    return 1;
+	}
+    }
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    if (cobs) {
+	service->request(COBS_FRAMING);
+	for (size_t i = 0; i < service->deviceList().size(); ++i)
+	    service->deviceList()[i]->stream.setFraming(COBS_FRAMING);
+    }
+    if (request)
+	service->request(request);
+
+    // A simulated run stops the boards after the set time, waits for what they sent to be
+    // read and then stops the service
+    std::thread timer;
+    if (simulate) {
+	timer = std::thread([&] {
+	    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	    for (size_t i = 0; i < boards.size(); ++i)
+		boards[i]->quiet();
+	    for (int wait = 0; wait < 500 && service->unreadBytes() != 0; ++wait)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	    service->stop();
+	});
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    service->run();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+	.count();
+    if (timer.joinable())
+	timer.join();
+    if (request)
+	service->request(END_STREAM);
+
+    service->printStats(stderr);
+
+    int status = 0;
+    if (simulate) {
+	unsigned long sent = 0, logged = 0, dropped = 0;
+	for (int i = 0; i < simulate; ++i) {
+	    Ingest_Device & device = *service->deviceList()[argc - optind + i];
+	    sent += boards[i]->samples;
+	    logged += device.stream.readings;
+	    dropped += device.dropped_chunks;
+	    // Every sample sent must be logged unless data was dropped on purpose
+	    if (device.dropped_chunks == 0 && device.stream.readings != boards[i]->samples) {
+		fprintf(stderr, "%s sent %lu samples but %lu were logged\n",
+			device.path.c_str(), boards[i]->samples.load(), device.stream.readings);
+		status = 1;
+	    }
+	}
+	fprintf(stderr, "%d boards, %lu samples sent, %lu logged (%.0f samples/s), %lu chunks "
+		"dropped\n", simulate, sent, logged, logged / elapsed, dropped);
+	for (size_t i = 0; i < boards.size(); ++i)
+	    delete boards[i];
+    }
+    delete service;
+    return status;
+}
@@ -0,0 +1,169 @@
+// Times the streaming decoder on a long made up stream of single sample frames, as sent by
+// bluetooth_send(), fed in blocks of several sizes including single bytes and random sizes as a
+// serial port read would give. Every reading is checked against the samples the stream was
+// made from. The same is done for batched frames and for COBS framing, and for single sample
+// frames with some lost on the way, which the decoder must count from the sequence numbers.
+// Every missing frame's neighbours must show the true time between them.
+//
+// $ build/tools/stream_benchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "Sensor_Stream.h"
+
+#define STREAM_SAMPLES 1000000
+#define SAMPLE_PERIOD 2500
+#define SLOW_DIVISOR 100
+
+// Samples expected next by the handler and whether any did not match
+struct Check
+{
+    const std::vector<Sensor_Sample> * samples;
+    size_t next;
+    bool failed;
+};
+
+static void makeSamples(std::vector<Sensor_Sample> & samples)
+{
+    srand(1);
+    for (size_t i = 0; i < samples.size(); ++i) {
+	Sensor_Sample & sample = samples[i];
+	memset(&sample, 0, sizeof(sample));
+	sample.sensors = ACC | GYRO;
+	if (i % SLOW_DIVISOR == 0)
+	    sample.sensors |= BARO | PHT;
+	sample.sequence = i;
+	sample.time = i * SAMPLE_PERIOD;
+	for (int j = 0; j < ACC_PAYLOAD; ++j)
+	    sample.acc[j] = rand();
+	for (int j = 0; j < GYRO_PAYLOAD; ++j)
+	    sample.gyro[j] = rand();
+	for (int j = 0; j < BARO_PAYLOAD; ++j)
+	    sample.baro[j] = rand();
+	for (int j = 0; j < PHT_PAYLOAD; ++j)
+	    sample.light[j] = rand();
+    }
+}
+
+static void checkReading(const Sensor_Reading & reading, void * context)
+{
+    Check & check = *(Check *)context;
+    if (check.next == check.samples->size()) {
+	check.failed = true;
+	return;
+    }
+    const Sensor_Sample & sample = (*check.samples)[check.next];
+    const Sensor_Sample & last = (*check.samples)[check.next ? check.next - 1 : 0];
+    Sensor_Reading expected;
+    readSample(sample, expected);
+    if (reading.sequence != sample.sequence || reading.time != sample.time ||
+	reading.lost != (check.next ? (uint16_t)(sample.sequence - last.sequence - 1) : 0) ||
+	reading.delta != sample.time - last.time)
+	check.failed = true;
+    check.next += 1;
+    if (reading.sensors != expected.sensors || memcmp(reading.acc, expected.acc, 6) ||
+	memcmp(reading.gyro, expected.gyro, 6) || reading.altitude != expected.altitude ||
+	reading.temperature_frac != expected.temperature_frac || reading.light != expected.light)
+	check.failed = true;
+}
+
+// Feed 'stream' in blocks of 'block' bytes, or random sizes up to 4096 when 'block' is zero,
+// and print the rate
+static bool run(const char * name, const std::vector<uint8_t> & stream,
+		const std::vector<Sensor_Sample> & samples, uint8_t framing, size_t block)
+{
+    Check check = { &samples, 0, false };
+    // Too large for the stack with its frame buffers
+    Sensor_Stream * decoder = new Sensor_Stream(checkReading, &check);
+    decoder->setFraming(framing);
+
+    std::vector<size_t> sizes;
+    srand(2);
+    for (size_t fed = 0; fed < stream.size(); ) {
+	size_t size = block ? block : 1 + rand() % 4096;
+	if (size > stream.size() - fed)
+	    size = stream.size() - fed;
+	sizes.push_back(size);
+	fed += size;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t fed = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+	decoder->feed(&stream[fed], sizes[i]);
+	fed += sizes[i];
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    char label[48];
+    if (block)
+	snprintf(label, sizeof(label), "%zu byte blocks", block);
+    else
+	snprintf(label, sizeof(label), "random blocks");
+    printf("%-8s %-18s %8.1f MB/s %7.2f M samples/s\n", name, label,
+	   stream.size() / seconds / 1e6, decoder->readings / seconds / 1e6);
+    // Sequence numbers wrap at 16 bits
+    unsigned long lost = 0;
+    for (size_t i = 1; i < samples.size(); ++i)
+	lost += (uint16_t)(samples[i].sequence - samples[i - 1].sequence - 1);
+    bool passed = !check.failed && check.next == samples.size() && decoder->malformed == 0 &&
+	decoder->framingErrors() == 0 && decoder->lost == lost;
+    delete decoder;
+    return passed;
+}
+
+int main()
+{
+    std::vector<Sensor_Sample> samples(STREAM_SAMPLES);
+    makeSamples(samples);
+    bool passed = true;
+    const size_t blocks[] = { 1, 64, 4096, 0 };
+
+    std::vector<uint8_t> stream(STREAM_SAMPLES * SINGLE_FRAME_MAX);
+    size_t bytes = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+	bytes += encodeSingleFrame(samples[i], &stream[bytes]);
+    stream.resize(bytes);
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); ++b)
+	passed &= run("single", stream, samples, DLE_FRAMING, blocks[b]);
+
+    // Every seventh frame lost on the way
+    std::vector<Sensor_Sample> kept;
+    stream.resize(STREAM_SAMPLES * SINGLE_FRAME_MAX);
+    bytes = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+	if (i % 7 == 3)
+	    continue;
+	kept.push_back(samples[i]);
+	bytes += encodeSingleFrame(samples[i], &stream[bytes]);
+    }
+    stream.resize(bytes);
+    passed &= run("lossy", stream, kept, DLE_FRAMING, 4096);
+
+    size_t frames = samples.size() / BATCH_SIZE;
+    stream.resize(frames * BATCH_FRAME_MAX(BATCH_SIZE));
+    bytes = 0;
+    for (size_t f = 0; f < frames; ++f)
+	bytes += encodeBatchFrame(&samples[f * BATCH_SIZE], BATCH_SIZE, SAMPLE_PERIOD,
+				  &stream[bytes]);
+    stream.resize(bytes);
+    passed &= run("batch", stream, samples, DLE_FRAMING, 4096);
+
+    stream.resize(frames * COBS_BATCH_FRAME_MAX(BATCH_SIZE));
+    bytes = 0;
+    for (size_t f = 0; f < frames; ++f)
+	bytes += encodeCobsBatchFrame(&samples[f * BATCH_SIZE], BATCH_SIZE, SAMPLE_PERIOD,
+				      &stream[bytes]);
+    stream.resize(bytes);
+    passed &= run("cobs", stream, samples, COBS_FRAMING, 4096);
+
+    if (!passed) {
+	printf("decoded readings do not match the encoded samples\n");
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+// Checks the interrupt driven I2C transaction queue against the simulated TWI peripheral with
+// two plain register devices on the bus. Transactions queued together must complete in the
+// order they were submitted, each marked pending until the bus is done with it and its
+// callback called once, and reads must return what the devices hold and writes change it. A
+// device that does not acknowledge its address or a data byte must fail only the transaction
+// it hit with ADDRESS_NO_ACKNOWLEDGE or DATA_NO_ACKNOWLEDGE, through the queue and through the
+// blocking I2C_Tools calls built on it, and a full queue must refuse a transaction with
+// BUFFER_SIZE_ERROR. Prints each step and exits with 1 if any check failed.
+//
+// $ build/tools/twi_queue_check
+
+#include <stdio.h>
+#include <vector>
+#include "Arduino.h"
+#include "Virtual_Clock.h"
+#include "TWI_Simulator.h"
+#include "TWI_Queue.h"
+#include "I2C_Tools.h"
+
+// Addresses of the two devices on the bus and of one that is not there
+#define FIRST_DEVICE 0x20
+#define SECOND_DEVICE 0x21
+#define MISSING_DEVICE 0x30
+
+static int failures;
+
+static void check(bool passed, const char * what)
+{
+    printf("  %-56s %s\n", what, passed ? "ok" : "FAILED");
+    if (!passed)
+	failures += 1;
+}
+
+// Transactions in the order their callbacks were called
+static std::vector<TWI_Transaction *> finished;
+
+static void noteFinished(TWI_Transaction & transaction)
+{
+    finished.push_back(&transaction);
+}
+
+// Transactions queued together complete in order, with their data
+static void checkOrder(Register_Device & first, Register_Device & second)
+{
+    printf("ordering and completion\n");
+    for (int i = 0; i < 8; ++i)
+    {
+	first.registers[i] = 0x10 + i;
+	second.registers[i] = 0x80 + i;
+    }
+
+    // Reads of both devices and a write between them, all queued before the bus gets going
+    TWI_Transaction transactions[5];
+    uint8_t buffers[5][4] = {};
+    uint8_t written[2] = { 0x5A, 0xA5 };
+    transactions[0].setRead(FIRST_DEVICE, 0, 4, buffers[0]);
+    transactions[1].setRead(SECOND_DEVICE, 2, 2, buffers[1]);
+    transactions[2].setWrite(FIRST_DEVICE, 0x40, 2, written);
+    transactions[3].setRead(FIRST_DEVICE, 0x40, 2, buffers[3]);
+    transactions[4].setRead(SECOND_DEVICE, 7, 1, buffers[4]);
+    finished.clear();
+    bool submitted = true;
+    for (int i = 0; i < 5; ++i)
+    {
+	transactions[i].callback = noteFinished;
+	submitted &= twi_queue.submit(transactions[i]) == NO_ERROR;
+    }
+    check(submitted, "five transactions queued");
+    bool pending = true;
+    for (int i = 0; i < 5; ++i)
+	pending &= !transactions[i].complete();
+    check(pending && twi_queue.busy(), "all pending before the bus moves");
+
+    // Waiting on the last runs the bus through all of them
+    uint8_t error = twi_queue.wait(transactions[4]);
+    bool succeeded = error == NO_ERROR;
+    for (int i = 0; i < 5; ++i)
+	succeeded &= transactions[i].complete() && transactions[i].status == NO_ERROR;
+    check(succeeded && !twi_queue.busy(), "all completed without errors");
+    bool ordered = finished.size() == 5;
+    for (size_t i = 0; ordered && i < finished.size(); ++i)
+	ordered = finished[i] == &transactions[i];
+    check(ordered, "callbacks called once each, in submission order");
+
+    check(buffers[0][0] == 0x10 && buffers[0][3] == 0x13, "burst read of the first device");
+    check(buffers[1][0] == 0x82 && buffers[1][1] == 0x83, "burst read of the second device");
+    check(first.registers[0x40] == 0x5A && first.registers[0x41] == 0xA5,
+	  "write reached the first device");
+    check(buffers[3][0] == 0x5A && buffers[3][1] == 0xA5, "read after the write sees it");
+    check(buffers[4][0] == 0x87, "single register read");
+}
+
+// Faults fail the transaction they hit and nothing queued behind it
+static void checkErrors(Register_Device & first)
+{
+    printf("error propagation\n");
+    TWI_Transaction missing, behind;
+    uint8_t value = 0, behind_value = 0;
+    missing.setRead(MISSING_DEVICE, 0, 1, &value);
+    behind.setRead(SECOND_DEVICE, 7, 1, &behind_value);
+    twi_queue.submit(missing);
+    twi_queue.submit(behind);
+    twi_queue.wait(behind);
+    check(missing.status == ADDRESS_NO_ACKNOWLEDGE, "absent device: ADDRESS_NO_ACKNOWLEDGE");
+    check(behind.status == NO_ERROR && behind_value == 0x87, "read queued behind it succeeds");
+
+    first.nack_address = true;
+    check(readRegister(FIRST_DEVICE, 0, value) == ADDRESS_NO_ACKNOWLEDGE,
+	  "address refused: readRegister returns ADDRESS_NO_ACKNOWLEDGE");
+    check(writeRegister(FIRST_DEVICE, 0x40, 0x11) == ADDRESS_NO_ACKNOWLEDGE,
+	  "address refused: writeRegister returns ADDRESS_NO_ACKNOWLEDGE");
+    first.nack_address = false;
+
+    TWI_Transaction refused;
+    uint8_t data[2] = { 0x22, 0x33 };
+    refused.setWrite(FIRST_DEVICE, 0x40, 2, data);
+    behind.setRead(SECOND_DEVICE, 0, 1, &behind_value);
+    first.nack_data = true;
+    twi_queue.submit(refused);
+    twi_queue.submit(behind);
+    twi_queue.wait(behind);
+    first.nack_data = false;
+    check(refused.status == DATA_NO_ACKNOWLEDGE, "data refused: DATA_NO_ACKNOWLEDGE");
+    check(behind.status == NO_ERROR && behind_value == 0x80, "read queued behind it succeeds");
+    check(first.registers[0x40] == 0x5A, "refused write left the register alone");
+
+    first.nack_data = true;
+    check(writeRegister(FIRST_DEVICE, 0x40, 0x44) == DATA_NO_ACKNOWLEDGE,
+	  "data refused: writeRegister returns DATA_NO_ACKNOWLEDGE");
+    first.nack_data = false;
+    check(readRegister(FIRST_DEVICE, 0x40, value) == NO_ERROR && value == 0x5A,
+	  "readRegister after the faults");
+}
+
+// A full queue refuses a transaction instead of overwriting one
+static void checkFull()
+{
+    printf("full queue\n");
+    static TWI_Transaction transactions[TWI_QUEUE_SIZE + 1];
+    static uint8_t values[TWI_QUEUE_SIZE + 1];
+    bool queued = true;
+    for (int i = 0; i < TWI_QUEUE_SIZE; ++i)
+	queued &= requestRegisters(transactions[i], SECOND_DEVICE, i & 7, 1, &values[i]) ==
+	    NO_ERROR;
+    check(queued, "TWI_QUEUE_SIZE transactions queued");
+    uint8_t error = requestRegisters(transactions[TWI_QUEUE_SIZE], SECOND_DEVICE, 0, 1,
+				     &values[TWI_QUEUE_SIZE]);
+    check(error == BUFFER_SIZE_ERROR &&
+	  transactions[TWI_QUEUE_SIZE].status == BUFFER_SIZE_ERROR, "one more: BUFFER_SIZE_ERROR");
+    twi_queue.wait(transactions[TWI_QUEUE_SIZE - 1]);
+    bool read = true;
+    for (int i = 0; i < TWI_QUEUE_SIZE; ++i)
+	read &= transactions[i].status == NO_ERROR && values[i] == 0x80 + (i & 7);
+    check(read && !twi_queue.busy(), "the queued ones all completed");
+}
+
+int main()
+{
+    Register_Device first(FIRST_DEVICE), second(SECOND_DEVICE);
+    twi_simulator.attach(first);
+    twi_simulator.attach(second);
+    twi_queue.begin();
+
+    checkOrder(first, second);
+    checkErrors(first);
+    checkFull();
+
+    printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}